@@ -21,7 +21,11 @@ enum MenuState {
 
 MenuState menuState = applist;
 
-MainMenu::MainMenu() : CubeApplication(40), joystickmngr(8) {
+MainMenu::MainMenu() : CubeApplication(40), adcBattery(std::make_shared<LinuxI2cDevice>(ADS1000_I2C_ADDRESS)) {
+    if (adcBattery.init(false)) {
+        sensors.addDevice("battery", adcBattery);
+        sensors.start();
+    }
     searchDirectory = "/home/pi/APPS";
     for (const auto &p : std::experimental::filesystem::directory_iterator(searchDirectory)) {
         //if(p.path().extension() == "cube"){
@@ -56,7 +60,7 @@ bool MainMenu::loop() {
 
     switch (menuState) {
         case applist: {
-            selectedExec += (int) joystickmngr.getAxisPress(1);
+            selectedExec += (int) getAxisPress(1);
             if (selectedExec < 0) {
                 selectedExec = appList.size() - 1;
             } else {
@@ -70,18 +74,15 @@ bool MainMenu::loop() {
 
 
 
-            if (joystickmngr.getButtonPress(0)) {
+            if (getButtonPress(0)) {
                 if (appList.at(selectedExec).execPath == "settings") {
                     selectedExec = 0;
                     lastSelectedExec = selectedExec;
                     animationOffset = 0;
                     menuState = settings;
                 } else {
-                    std::string temp = appList.at(selectedExec).execPath;
-                    temp += std::string(" 1>/dev/null 2>/dev/null &");
-                    temp = std::string("nohup ") + temp;
-                    std::cout << "start: " << temp << std::endl;
-                    system(temp.data());
+                    std::cout << "start: " << appList.at(selectedExec).execPath << std::endl;
+                    launchApp(appList.at(selectedExec).execPath);
                 }
 
             }
@@ -107,7 +108,7 @@ bool MainMenu::loop() {
         case settings: {
             drawText(top, Vector2i(CharacterBitmaps::centered, 30), Color::blue(), "Settings");
 
-            selectedExec += (int) joystickmngr.getAxisPress(1);
+            selectedExec += (int) getAxisPress(1);
             if (selectedExec < 0) {
                 selectedExec = settingsList.size() - 1;
             } else {
@@ -119,7 +120,7 @@ bool MainMenu::loop() {
             lastSelectedExec = selectedExec;
             animationOffset *= 0.85;
 
-            if (joystickmngr.getButtonPress(0)) {
+            if (getButtonPress(0)) {
                 if (settingsList.at(selectedExec).execPath == "return") {
                     menuState = applist;
                     selectedExec = appList.size() - 1;
@@ -137,7 +138,7 @@ bool MainMenu::loop() {
             }
 
             if (menuState == settings && settingsList.at(selectedExec).execPath == "brightness") {
-                setBrightness(constrain(getBrightness()+(int)(joystickmngr.getAxisPress(0)*10),0,100));
+                setBrightness(constrain(getBrightness()+(int)(getAxisPress(0)*10),0,100));
                 settingsList.at(selectedExec).name = "brightness: " + std::to_string(getBrightness());
             }
 
@@ -172,8 +173,6 @@ bool MainMenu::loop() {
         drawText((ScreenNumber) screenCounter, Vector2i(CharacterBitmaps::left, 1), colVoltageText, hostname);
     }
 
-    joystickmngr.clearAllButtonPresses();
-
     render();
     loopcount++;
     return true;
@@ -3,8 +3,8 @@
 
 #include "CubeApplication.h"
 
-#include "Joystick.h"
 #include "ADS1000.h"
+#include "SensorHub.h"
 
 #include <experimental/filesystem>
 
@@ -19,11 +19,11 @@ public:
 private:
     class AppListItem;
 
-    JoystickManager joystickmngr;
     std::vector<AppListItem> appList;
     std::vector<AppListItem> settingsList;
     std::string searchDirectory;
     ADS1000 adcBattery;
+    SensorHub sensors; // polls the adc, stopped before it is destroyed
 };
 
 class MainMenu::AppListItem {
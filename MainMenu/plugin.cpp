@@ -0,0 +1,5 @@
+#include "mainmenu.h"
+#include <AppPlugin.h>
+
+// MainMenu.so, run in-process by the server if it is installed (see DEFAULTPLUGIN)
+MATRIXAPPLICATION_PLUGIN_EXPORT(MainMenu)
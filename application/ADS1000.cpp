@@ -2,11 +2,10 @@
 
 #include <stdio.h>
 #include <stdint.h>
-#include <wiringPi.h>
-#include <wiringPiI2C.h>
 #include <iostream>
 #include <unistd.h>
-#include <byteswap.h>
+
+#include <FrameTimer.h>
 
 // values
 // 944 = 10.05V
@@ -15,47 +14,80 @@
 // 632 = 6.71V
 // linear interpoliert: voltage = 0,0106 * value - 0,0055
 
-#define ADS1000_I2C_ADDRESS        0x48   // I2C
+#define ADS1000_CONVERSION         0x00
 
 
-int ADS1000::read_word_2c(int fd, char reg){
-    uint16_t value = wiringPiI2CReadReg16(fd, reg);
-    value = __bswap_16(value);
-    if (value >= 0x8000)
-        return -((65535 - value) + 1);
-    else
-        return value;
+ADS1000::ADS1000() : ADS1000(std::make_shared<LinuxI2cDevice>(ADS1000_I2C_ADDRESS)) {
+    init();
 }
 
-ADS1000::ADS1000(){
-    init();
+ADS1000::ADS1000(std::shared_ptr<I2cDevice> setDevice, unsigned int sampleRateHz) :
+        thread_(nullptr),
+        running(false),
+        device(setDevice),
+        sampleRate(sampleRateHz > 0 ? sampleRateHz : ADS1000DEFAULTRATE) {
+}
+
+ADS1000::~ADS1000() {
+    stop();
 }
 
-void ADS1000::init()
+bool ADS1000::init(bool startThread)
 {
-    fd = wiringPiI2CSetup(ADS1000_I2C_ADDRESS);
-    if (fd == -1)
-        return;
+    if (!device || !device->isOpen())
+        return false;
 
-    int readval = read_word_2c(fd, 0x00); // do one dummy read
+    uint8_t data[2];
+    device->readBlock(ADS1000_CONVERSION, data, 2); // do one dummy read
 
-    startRefreshThread();
+    if (startThread)
+        startRefreshThread();
+    return true;
 }
 
 void ADS1000::startRefreshThread()
 {
+    running = true;
     thread_ = new boost::thread(&ADS1000::internalLoop, this);
 }
 
+void ADS1000::stop()
+{
+    boost::mutex::scoped_lock lock(threadLock_);
+    running = false;
+    if (thread_ != nullptr) {
+        thread_->join();
+        delete thread_;
+        thread_ = nullptr;
+    }
+}
+
 void ADS1000::internalLoop(){
-    int loopcount = 0;
-    while(1){
-        int readval = read_word_2c(fd, 0x00);
-        voltage = (0.0106f * readval) - 0.0055f;
-        usleep(100000); //10fps
+    FrameTimer timer(sampleRate);
+    timer.start();
+    while(running){
+        poll();
+        timer.wait();
     }
 }
 
+bool ADS1000::poll(){
+    uint8_t data[2];
+    if (!device->readBlock(ADS1000_CONVERSION, data, 2))
+        return false;
+    int readval = (int16_t) ((data[0] << 8) | data[1]);
+    voltage.publish((0.0106f * readval) - 0.0055f, FrameTimer::nowNs());
+    return true;
+}
+
+unsigned int ADS1000::getPollRate(){
+    return sampleRate;
+}
+
 float ADS1000::getVoltage(){
+    return voltage.get();
+}
+
+SampleChannel<float> & ADS1000::getChannel(){
     return voltage;
-}
\ No newline at end of file
+}
@@ -3,21 +3,37 @@
 
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <memory>
+
+#include <SampleChannel.h>
+#include "I2cDevice.h"
+
+#define ADS1000_I2C_ADDRESS        0x48   // I2C
+#define ADS1000DEFAULTRATE 10 //Hz
 
 class ADS1000 {
 public:
     ADS1000();
-    void init();
+    ADS1000(std::shared_ptr<I2cDevice> device, unsigned int sampleRateHz = ADS1000DEFAULTRATE);
+    ~ADS1000();
+    // false without the device, startThread = false: poll() is driven from outside, e.g. by a SensorHub
+    bool init(bool startThread = true);
+    void stop();
+    bool poll();
+    unsigned int getPollRate();
     float getVoltage();
+    SampleChannel<float> & getChannel();
 private:
     void startRefreshThread();
     void internalLoop();
-    int read_word_2c(int fd, char reg);
     boost::thread * thread_;
     boost::mutex threadLock_;
-    int fd;
+    std::atomic<bool> running;
+    std::shared_ptr<I2cDevice> device;
+    unsigned int sampleRate;
 
-    float voltage;
+    SampleChannel<float> voltage;
 };
 
 
@@ -3,11 +3,14 @@
 #include <iostream>
 #include <iomanip>
 
-CubeApplication::CubeApplication(int fps, std::string setServerAddress, std::string setServerPort) :
-#ifdef MATRIXAPPLICATION_STANDALONE
+CubeApplication::CubeApplication(int fps, std::string setServerAddress, std::string setServerPort,
+                                 TransportType setTransport) :
+#if defined(MATRIXAPPLICATION_STANDALONE)
         MatrixApplicationStandalone(fps, setServerAddress, setServerPort),
+#elif defined(MATRIXAPPLICATION_PLUGIN)
+        MatrixApplicationPlugin(fps, setServerAddress, setServerPort),
 #else
-        MatrixApplication(fps, setServerAddress, setServerPort),
+        MatrixApplication(fps, setServerAddress, setServerPort, setTransport),
 #endif
         virtualSize_(VIRTUALCUBESIZE),
         virtualSizeAll_(VIRTUALCUBESIZE * VIRTUALCUBESIZE * VIRTUALCUBESIZE) {
@@ -22,8 +22,10 @@ other stuff:
 #define VIRTUALCUBEMAXINDEX 65 //VIRTUALCUBESIZE - 1
 #define VIRTUALCUBECENTER 33 //VIRTUALCUBESIZE / 2
 
-#ifdef MATRIXAPPLICATION_STANDALONE
+#if defined(MATRIXAPPLICATION_STANDALONE)
 #include "MatrixApplicationStandalone.h"
+#elif defined(MATRIXAPPLICATION_PLUGIN)
+#include "MatrixApplicationPlugin.h"
 #else
 #include "MatrixApplication.h"
 #endif
@@ -57,8 +59,10 @@ enum ScreenNumber { front, right, back, left, top, bottom, anyScreen };
 enum EdgeNumber { frontRight, rightBack, backLeft, leftFront, topFront, topRight, topBack, topLeft, bottomFront, bottomRight, bottomBack, bottomLeft, anyEdge };
 enum CornerNumber { frontRightTop, rightBackTop, backLeftTop, leftFrontTop, frontRightBottom, rightBackBottom, backLeftBottom, leftFrontBottom, anyCorner };
 
-#ifdef MATRIXAPPLICATION_STANDALONE
+#if defined(MATRIXAPPLICATION_STANDALONE)
 class CubeApplication : public MatrixApplicationStandalone{
+#elif defined(MATRIXAPPLICATION_PLUGIN)
+class CubeApplication : public MatrixApplicationPlugin{
 #else
 class CubeApplication : public MatrixApplication{
 #endif
@@ -66,7 +70,8 @@ public:
     CubeApplication(
             int fps = DEFAULTFPS,
             std::string setServerAddress = DEFAULTSERVERADRESS,
-            std::string setServerPort = DEFAULTSERVERPORT);
+            std::string setServerPort = DEFAULTSERVERPORT,
+            TransportType setTransport = TransportType::automatic);
     void setPixel3D(Vector3i pos, Color col, float intensity = 1.0f, bool add = false);
     void setPixel3D(int x, int y, int z, Color col, float intensity = 1.0f, bool add = false);
     void setPixelSmooth3D(Vector3f pos, Color color);
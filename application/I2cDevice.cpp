@@ -0,0 +1,150 @@
+#include "I2cDevice.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+LinuxI2cDevice::LinuxI2cDevice(uint8_t setAddress, std::string bus) : address(setAddress) {
+    fd = open(bus.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd >= 0 && ioctl(fd, I2C_SLAVE, address) < 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+LinuxI2cDevice::~LinuxI2cDevice() {
+    if (fd >= 0)
+        close(fd);
+}
+
+bool LinuxI2cDevice::isOpen() {
+    return fd >= 0;
+}
+
+int LinuxI2cDevice::readReg8(uint8_t reg) {
+    uint8_t value;
+    if (!readBlock(reg, &value, 1))
+        return -1;
+    return value;
+}
+
+bool LinuxI2cDevice::writeReg8(uint8_t reg, uint8_t value) {
+    uint8_t data[2] = {reg, value};
+    return fd >= 0 && write(fd, data, 2) == 2;
+}
+
+bool LinuxI2cDevice::readBlock(uint8_t reg, uint8_t *data, size_t length) {
+    if (fd < 0)
+        return false;
+    struct i2c_msg messages[2];
+    messages[0].addr = address;
+    messages[0].flags = 0;
+    messages[0].len = 1;
+    messages[0].buf = &reg;
+    messages[1].addr = address;
+    messages[1].flags = I2C_M_RD;
+    messages[1].len = (uint16_t) length;
+    messages[1].buf = data;
+    struct i2c_rdwr_ioctl_data transfer;
+    transfer.msgs = messages;
+    transfer.nmsgs = 2;
+    return ioctl(fd, I2C_RDWR, &transfer) == 2;
+}
+
+bool RecordedI2cDevice::isOpen() {
+    return true;
+}
+
+int RecordedI2cDevice::readReg8(uint8_t reg) {
+    uint8_t value;
+    if (!readBlock(reg, &value, 1))
+        return -1;
+    return value;
+}
+
+bool RecordedI2cDevice::writeReg8(uint8_t reg, uint8_t value) {
+    std::lock_guard<std::mutex> guard(lock);
+    transfers++;
+    registers[reg] = value;
+    return true;
+}
+
+bool RecordedI2cDevice::readBlock(uint8_t reg, uint8_t *data, size_t length) {
+    std::lock_guard<std::mutex> guard(lock);
+    transfers++;
+    auto count = streamCounts.find(reg);
+    if (count != streamCounts.end() && length == 2) {
+        auto size = streams[count->second].size();
+        data[0] = (uint8_t) (size >> 8);
+        data[1] = (uint8_t) size;
+        return true;
+    }
+    auto stream = streams.find(reg);
+    if (stream != streams.end()) {
+        if (stream->second.size() < length)
+            return false;
+        std::copy(stream->second.begin(), stream->second.begin() + length, data);
+        stream->second.erase(stream->second.begin(), stream->second.begin() + length);
+        return true;
+    }
+    auto recorded = frames.find(reg);
+    if (recorded != frames.end()) {
+        auto &position = framePosition[reg];
+        if (position >= recorded->second.size()) {
+            if (!frameLoop[reg] || recorded->second.empty())
+                return false;
+            position = 0;
+        }
+        auto &frame = recorded->second[position++];
+        memset(data, 0, length);
+        memcpy(data, frame.data(), std::min(length, frame.size()));
+        return true;
+    }
+    // consecutive registers, like the device's auto increment
+    for (size_t i = 0; i < length; i++) {
+        auto value = registers.find((uint8_t) (reg + i));
+        data[i] = value != registers.end() ? value->second : 0;
+    }
+    return true;
+}
+
+void RecordedI2cDevice::setRegister(uint8_t reg, uint8_t value) {
+    std::lock_guard<std::mutex> guard(lock);
+    registers[reg] = value;
+}
+
+int RecordedI2cDevice::getRegister(uint8_t reg) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto value = registers.find(reg);
+    return value != registers.end() ? value->second : -1;
+}
+
+void RecordedI2cDevice::addFrames(uint8_t reg, const std::vector<std::vector<uint8_t>> &newFrames, bool loop) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto &recorded = frames[reg];
+    recorded.insert(recorded.end(), newFrames.begin(), newFrames.end());
+    frameLoop[reg] = loop;
+}
+
+void RecordedI2cDevice::addStream(uint8_t reg, const std::vector<uint8_t> &data, int countReg) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (countReg >= 0)
+        streamCounts[(uint8_t) countReg] = reg;
+    auto &stream = streams[reg];
+    stream.insert(stream.end(), data.begin(), data.end());
+}
+
+size_t RecordedI2cDevice::getStreamSize(uint8_t reg) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto stream = streams.find(reg);
+    return stream != streams.end() ? stream->second.size() : 0;
+}
+
+uint64_t RecordedI2cDevice::getTransferCount() {
+    std::lock_guard<std::mutex> guard(lock);
+    return transfers;
+}
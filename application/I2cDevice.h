@@ -0,0 +1,92 @@
+#ifndef MATRIXSERVER_I2CDEVICE_H
+#define MATRIXSERVER_I2CDEVICE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+
+#define DEFAULTI2CBUS "/dev/i2c-1"
+
+/*
+ * Register access to one I2C slave. readBlock reads consecutive registers in a single transfer
+ * (register address write + repeated start + read), which is what the sensors' burst reads need.
+ */
+class I2cDevice {
+public:
+    virtual ~I2cDevice() = default;
+
+    virtual bool isOpen() = 0;
+
+    virtual int readReg8(uint8_t reg) = 0; // -1 on error
+
+    virtual bool writeReg8(uint8_t reg, uint8_t value) = 0;
+
+    virtual bool readBlock(uint8_t reg, uint8_t *data, size_t length) = 0;
+};
+
+// i2c-dev character device, no dependency on wiringPi
+class LinuxI2cDevice : public I2cDevice {
+public:
+    LinuxI2cDevice(uint8_t address, std::string bus = DEFAULTI2CBUS);
+
+    ~LinuxI2cDevice() override;
+
+    bool isOpen() override;
+
+    int readReg8(uint8_t reg) override;
+
+    bool writeReg8(uint8_t reg, uint8_t value) override;
+
+    bool readBlock(uint8_t reg, uint8_t *data, size_t length) override;
+
+private:
+    int fd;
+    uint8_t address;
+};
+
+/*
+ * Stand-in for a real device in tests and benchmarks. Single registers are kept in a map, block
+ * reads of a register are answered from recorded data: either fixed frames (one frame per read,
+ * e.g. the 14 byte data burst) or a byte stream (e.g. the FIFO, read in any chunk size).
+ */
+class RecordedI2cDevice : public I2cDevice {
+public:
+    bool isOpen() override;
+
+    int readReg8(uint8_t reg) override;
+
+    bool writeReg8(uint8_t reg, uint8_t value) override;
+
+    bool readBlock(uint8_t reg, uint8_t *data, size_t length) override;
+
+    void setRegister(uint8_t reg, uint8_t value);
+
+    int getRegister(uint8_t reg);
+
+    // loop: restart with the first frame after the last one, otherwise reads fail once they ran out
+    void addFrames(uint8_t reg, const std::vector<std::vector<uint8_t>> &frames, bool loop = false);
+
+    // countReg (optional): 16 bit big endian register pair reporting the bytes left in the stream
+    void addStream(uint8_t reg, const std::vector<uint8_t> &data, int countReg = -1);
+
+    size_t getStreamSize(uint8_t reg);
+
+    uint64_t getTransferCount();
+
+private:
+    std::mutex lock;
+    std::map<uint8_t, uint8_t> registers;
+    std::map<uint8_t, std::vector<std::vector<uint8_t>>> frames;
+    std::map<uint8_t, size_t> framePosition;
+    std::map<uint8_t, bool> frameLoop;
+    std::map<uint8_t, std::deque<uint8_t>> streams;
+    std::map<uint8_t, uint8_t> streamCounts;
+    uint64_t transfers = 0;
+};
+
+
+#endif //MATRIXSERVER_I2CDEVICE_H
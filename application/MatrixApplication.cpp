@@ -1,122 +1,317 @@
 #include "MatrixApplication.h"
+#include <Trace.h>
 #include <sys/time.h>
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/expressions.hpp>
+#include <Log.h>
 #include <random>
+#include <cstring>
+#include <fcntl.h>
 
 bool updateBrightness = false;
 
-MatrixApplication::MatrixApplication(int fps, std::string setServerAddress, std::string setServerPort) :
+MatrixApplication::MatrixApplication(int fps, std::string setServerAddress, std::string setServerPort,
+                                     TransportType setTransport) :
         mainThread(),
+        senderThread(),
         io_context(),
         serverAddress(setServerAddress),
         serverPort(setServerPort) {
-    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::debug);
+    Log::setLevel(LogLevel::debug);
     std::random_device rd;
     srand(rd());
     setFps(fps);
     appId = 0;
+    started = false;
     appState = AppState::starting;
-//    ioThread = new boost::thread([this]() { io_context.run(); });
+    frontBrightnessUpdate = false;
+    frameQueued = false;
+    frameInFlight = false;
+    frameCounter = 0;
+    frameId = 0;
+    frontFrameId = 0;
+    presentAtNs = 0;
+    presentationDelayNs = 0;
+    frontPresentAtNs = 0;
+    scheduling = false;
+    remoteClock = false;
+    nextClockSync = 0;
+    Trace::init();
+    requestedTransport = setTransport;
+    auto transportEnv = getenv(TRANSPORTENVVARIABLE);
+    if (transportEnv != nullptr) {
+        requestedTransport = transportFromString(transportEnv);
+    }
+    transport = TransportType::automatic;
+    launcherFd = -1;
+    auto launcherFdEnv = getenv(LAUNCHERFDENVVARIABLE);
+    if (launcherFdEnv != nullptr) {
+        launcherFd = atoi(launcherFdEnv);
+        // apps started by this one must not take it over
+        unsetenv(LAUNCHERFDENVVARIABLE);
+        fcntl(launcherFd, F_SETFD, FD_CLOEXEC);
+    }
+    memset(&receivedInput, 0, sizeof(receivedInput));
+    memset(&previousInput, 0, sizeof(previousInput));
+    input.store(receivedInput);
+    for (auto &joystick : consumedButtonPresses)
+        joystick.fill(0);
+    for (auto &joystick : consumedAxisPresses)
+        joystick.fill(0);
     while (!connect(serverAddress, serverPort)) {
         sleep(1);
     }
-    registerAtServer();
 }
 
-bool MatrixApplication::connect(const std::string &serverAddress, const std::string &serverPort) {
-    BOOST_LOG_TRIVIAL(debug) << "[Application] Trying to connect to Server";
+bool MatrixApplication::isLocalServer(const std::string &serverAddress) {
+    return serverAddress == "localhost" || serverAddress == "::1" || serverAddress.compare(0, 4, "127.") == 0;
+}
 
-    auto ipcCon = std::make_shared<IpcConnection>();
-    ipcCon->connectToServer("matrixserver");
-    connection = ipcCon;
-    connection = TcpClient::connect(io_context, serverAddress, serverPort);
-//    connection = UnixSocketClient::connect(io_context, "/tmp/matrixserver.sock");
+std::vector<TransportType> MatrixApplication::getTransportCandidates() {
+    if (requestedTransport != TransportType::automatic)
+        return {requestedTransport};
+    // ipc can't tell when the server is gone, only when it is forced or there is no unix socket
+    if (isLocalServer(serverAddress))
+        return {TransportType::unixSocket, TransportType::ipc, TransportType::tcp};
+    return {TransportType::tcp};
+}
 
-    if (!connection->isDead()) {
-        BOOST_LOG_TRIVIAL(debug) << "[Application] Connection successfull";
-        ioThread = new boost::thread([this]() { io_context.run(); });
-        connection->setReceiveCallback(
-                bind(&MatrixApplication::handleRequest, this, std::placeholders::_1, std::placeholders::_2));
-        return true;
-    } else {
-        BOOST_LOG_TRIVIAL(debug) << "[Application] Connection failed";
+bool MatrixApplication::connect(const std::string &serverAddress, const std::string &serverPort) {
+    if (launcherFd >= 0) {
+        // already connected by the server, reconnects go through the transports
+        MATRIXLOG(debug) << "[Application] Using the connection of the launcher";
+        auto newConnection = UnixSocketClient::adopt(io_context, launcherFd);
+        launcherFd = -1;
+        if (useConnection(newConnection, TransportType::unixSocket))
+            return true;
+    }
+    for (auto candidate : getTransportCandidates()) {
+        MATRIXLOG(debug) << "[Application] Trying to connect to Server via " << transportToString(candidate);
+        std::shared_ptr<UniversalConnection> newConnection;
+        switch (candidate) {
+            case TransportType::ipc: {
+                auto ipcCon = std::make_shared<IpcConnection>();
+                ipcCon->connectToServer(DEFAULTIPCADDRESS);
+                newConnection = ipcCon;
+            }
+                break;
+            case TransportType::unixSocket:
+                newConnection = UnixSocketClient::connect(io_context, DEFAULTUNIXSOCKETPATH);
+                break;
+            default:
+                newConnection = TcpClient::connect(io_context, serverAddress, serverPort);
+                break;
+        }
+        if (useConnection(newConnection, candidate))
+            return true;
+    }
+    MATRIXLOG(debug) << "[Application] Connection failed";
+    return false;
+}
+
+bool MatrixApplication::useConnection(std::shared_ptr<UniversalConnection> newConnection, TransportType newTransport) {
+    if (newConnection->isDead())
         return false;
+    MATRIXLOG(debug) << "[Application] Connection successfull via " << transportToString(newTransport);
+    connection = newConnection;
+    transport = newTransport;
+    remoteClock = newTransport == TransportType::tcp && !isLocalServer(serverAddress);
+    {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        serverClock.reset();
+    }
+    nextClockSync = 0;
+    if (newTransport != TransportType::ipc) {
+        io_context.reset(); // run() returned if an earlier connection died
+        ioThread = new boost::thread([this]() { io_context.run(); });
     }
+    connection->setReceiveCallback(
+            bind(&MatrixApplication::handleRequest, this, std::placeholders::_1, std::placeholders::_2));
+    return true;
 }
 
 void MatrixApplication::registerAtServer() {
-    BOOST_LOG_TRIVIAL(trace) << "[Application] try to register at server";
+    MATRIXLOG(trace) << "[Application] try to register at server";
     auto message = std::make_shared<matrixserver::MatrixServerMessage>();
     message->set_messagetype(matrixserver::registerApp);
+    message->set_subscribeinput(true);
+    auto layer = std::atomic_load(&layerRequest);
+    if (layer)
+        message->mutable_layerrequest()->CopyFrom(*layer);
+    connection->sendMessage(message);
+}
+
+bool MatrixApplication::setLayer(const matrixserver::LayerRequest &request) {
+    std::atomic_store(&layerRequest, std::make_shared<const matrixserver::LayerRequest>(request));
+    if (!started)
+        return true; // sent with registerApp
+    if (connection->isDead())
+        return false;
+    auto message = std::make_shared<matrixserver::MatrixServerMessage>();
+    message->set_messagetype(matrixserver::requestScreenAccess);
+    message->set_appid(appId);
+    message->mutable_layerrequest()->CopyFrom(request);
     connection->sendMessage(message);
+    return true;
+}
+
+bool MatrixApplication::launchApp(const std::string &path, const std::vector<std::string> &arguments,
+                                  bool restartOnFailure) {
+    if (connection->isDead())
+        return false;
+    auto message = std::make_shared<matrixserver::MatrixServerMessage>();
+    message->set_messagetype(matrixserver::launchApp);
+    message->set_appid(appId);
+    auto request = message->mutable_launchrequest();
+    request->set_path(path);
+    for (const auto &argument : arguments)
+        request->add_arguments(argument);
+    request->set_restartonfailure(restartOnFailure);
+    connection->sendMessage(message);
+    return true;
 }
 
 void MatrixApplication::renderToScreens() {
-    auto startTime = micros();
-    auto setScreenMessage = std::make_shared<matrixserver::MatrixServerMessage>();
-    setScreenMessage->set_messagetype(matrixserver::setScreenFrame);
-    setScreenMessage->set_appid(appId);
-    int i = 0;
-    for (auto screen : screens) {
-        auto screenData = setScreenMessage->add_screendata();
-        screenData->set_screenid(screen->getScreenId());
-        screenData->set_framedata((char *) screen->getScreenData().data(), screen->getScreenDataSize() * sizeof(Color));
-        screenData->set_encoding(matrixserver::ScreenData_Encoding_rgb24bbp);
-    }
-//    std::cout << "data ready: " << micros() - startTime << "us" << std::endl;
+    TraceSpan span("renderToScreens");
+    std::unique_lock<std::mutex> lock(frameMutex);
+    // the previous frame has to be encoded and acked before its front set can be reused
+    if (!frameCondition.wait_for(lock, std::chrono::milliseconds(FRAMEACKTIMEOUT),
+                                 [this]() { return !frameQueued && !frameInFlight; })) {
+        if (frameQueued) {
+            MATRIXLOG(debug) << "[Application] last frame still being sent, dropping frame";
+            return;
+        }
+        // the ack got lost, it would hold back every later frame
+        MATRIXLOG(debug) << "[Application] no ack for last frame, sending the next one";
+        frameInFlight = false;
+    }
+    for (unsigned int i = 0; i < screens.size() && i < frontScreens.size(); i++) {
+        frontScreens[i]->setScreenData(screens[i]->getScreenDataRaw());
+    }
     if (updateBrightness) {
-        auto *tempServerConfig = new matrixserver::ServerConfig();
-        tempServerConfig->CopyFrom(serverConfig);
-        setScreenMessage->set_allocated_serverconfig(tempServerConfig);
+        frontServerConfig.CopyFrom(serverConfig);
+        frontBrightnessUpdate = true;
         updateBrightness = false;
     }
+    frontFrameId = frameId;
+    frontPresentAtNs = presentAtNs;
+    if (frontPresentAtNs == 0 && presentationDelayNs != 0)
+        frontPresentAtNs = FrameTimer::nowNs() + presentationDelayNs;
+    presentAtNs = 0;
+    frameQueued = true;
+    lock.unlock();
+    frameCondition.notify_all();
+}
+
+void MatrixApplication::sendFrame() {
+    TraceFrame traceFrame(frontFrameId);
+    std::shared_ptr<matrixserver::MatrixServerMessage> setScreenMessage;
+    {
+        TraceSpan span("encode");
+        setScreenMessage = frameMessage.encode(frontScreens, appId);
+    }
+    setScreenMessage->set_frameid(frontFrameId);
+    setScreenMessage->set_presentatns(toServerClock(frontPresentAtNs));
+    if (frontBrightnessUpdate) {
+        setScreenMessage->mutable_serverconfig()->CopyFrom(frontServerConfig);
+        frontBrightnessUpdate = false;
+    } else if (setScreenMessage->has_serverconfig()) {
+        setScreenMessage->clear_serverconfig();
+    }
 
+    TraceSpan span("send", 0, TraceFlow::out);
     connection->sendMessage(setScreenMessage);
-//    std::cout << "data sent:  " << micros() - startTime << "us" << std::endl;
+}
+
+int64_t MatrixApplication::toServerClock(int64_t presentAt) {
+    if (presentAt == 0 || !remoteClock)
+        return presentAt;
+    std::lock_guard<std::mutex> lock(clockMutex);
+    if (!serverClock.isSynchronized())
+        return 0;
+    return serverClock.toRemote(presentAt);
+}
+
+void MatrixApplication::syncClock() {
+    if (!remoteClock || !scheduling || connection->isDead())
+        return;
+    auto now = FrameTimer::nowNs();
+    if (now < nextClockSync)
+        return;
+    uint64_t samples;
+    {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        samples = serverClock.getSampleCount();
+    }
+    nextClockSync = now + (samples < CLOCKSYNCSAMPLES ? CLOCKSYNCFASTINTERVAL : CLOCKSYNCINTERVAL) * 1000LL;
+    auto message = std::make_shared<matrixserver::MatrixServerMessage>();
+    message->set_messagetype(matrixserver::clusterSync);
+    message->set_appid(appId);
+    message->mutable_clustersync()->set_originns(now);
+    connection->sendMessage(message);
+}
+
+void MatrixApplication::senderLoop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(frameMutex);
+            frameCondition.wait(lock, [this]() { return frameQueued; });
+            frameInFlight = true; // set before sending, the ack may arrive before sendMessage returns
+        }
+        sendFrame();
+        {
+            std::lock_guard<std::mutex> lock(frameMutex);
+            frameQueued = false;
+        }
+        frameCondition.notify_all();
+    }
 }
 
 void MatrixApplication::internalLoop() {
     bool running = true;
+    frameTimer.start();
     while (running) {
-        auto startTime = micros();
         if (appState == AppState::running) {
-            renderSyncMutex.lock();
-            running = loop();
+            frameId = Trace::makeFrameId(++frameCounter);
+            TraceFrame traceFrame(frameId);
+            {
+                TraceSpan span("loop");
+                running = loop();
+            }
             renderToScreens();
         }
         if (appState == AppState::killed) {
             running = false;
         }
         checkConnection();
-        auto sleepTime = (1000000 / fps) - (micros() - startTime);
-        if (sleepTime > 0) {
-            usleep(sleepTime);
-        } else {
-//            BOOST_LOG_TRIVIAL(warning) << "[Application] FPS drop, load: " << load;
+        syncClock();
+        Trace::poll();
+        if (!frameTimer.wait()) {
+//            MATRIXLOG(warning) << "[Application] FPS drop, load: " << getLoad();
         }
-        load = 1.0f - ((float) sleepTime / (1000000.0f / (float) fps));
-//        BOOST_LOG_TRIVIAL(warning) << "[Application] rendertime: " << micros()-startTime << " us";
     }
 }
 
 void MatrixApplication::checkConnection() {
     if (connection->isDead()) {
         appState = AppState::failure;
-        if (connect(serverAddress, serverPort))
+        if (connect(serverAddress, serverPort)) {
+            {
+                std::lock_guard<std::mutex> lock(frameMutex);
+                frameInFlight = false; // the old connection will never ack
+            }
+            frameCondition.notify_all();
             registerAtServer();
+        }
     }
 }
 
 void
 MatrixApplication::handleRequest(std::shared_ptr<UniversalConnection> connection,
                                  std::shared_ptr<matrixserver::MatrixServerMessage> message) {
-    BOOST_LOG_TRIVIAL(trace) << "[Application] handleRequest called";
+    MATRIXLOG(trace) << "[Application] handleRequest called";
     switch (message->messagetype()) {
         case matrixserver::registerApp:
             if (message->status() == matrixserver::success) {
-                BOOST_LOG_TRIVIAL(debug) << "[Application] Register at Server successfull";
+                MATRIXLOG(debug) << "[Application] Register at Server successfull";
                 appId = message->appid();
                 auto response = std::make_shared<matrixserver::MatrixServerMessage>();
                 response->set_messagetype(matrixserver::getServerInfo);
@@ -125,12 +320,14 @@ MatrixApplication::handleRequest(std::shared_ptr<UniversalConnection> connection
             }
             break;
         case matrixserver::getServerInfo:
-            BOOST_LOG_TRIVIAL(debug) << "[Application] ServerInfo received, setup complete!";
+            MATRIXLOG(debug) << "[Application] ServerInfo received, setup complete!";
             serverConfig.Clear();
             serverConfig.CopyFrom(message->serverconfig());
             for (auto screenInfo : serverConfig.screeninfo()) {
                 screens.push_back(
                         std::make_shared<Screen>(screenInfo.width(), screenInfo.height(), screenInfo.screenid()));
+                frontScreens.push_back(
+                        std::make_shared<Screen>(screenInfo.width(), screenInfo.height(), screenInfo.screenid()));
             }
             appState = AppState::running;
             break;
@@ -140,7 +337,7 @@ MatrixApplication::handleRequest(std::shared_ptr<UniversalConnection> connection
             response->set_appid(appId);
             if (pause()) {
                 response->set_status(matrixserver::success);
-                BOOST_LOG_TRIVIAL(debug) << "app Paused";
+                MATRIXLOG(debug) << "app Paused";
             } else
                 response->set_status(matrixserver::error);
             connection->sendMessage(response);
@@ -174,13 +371,33 @@ MatrixApplication::handleRequest(std::shared_ptr<UniversalConnection> connection
             response->set_appid(appId);
             response->set_status(matrixserver::success);
             connection->sendMessage(response);
-            BOOST_LOG_TRIVIAL(debug) << "app killed";
+            MATRIXLOG(debug) << "app killed";
             stop();
         }
             break;
+        case matrixserver::joystickData:
+        case matrixserver::imuData:
+            inputStateFromMessage(*message, receivedInput);
+            input.store(receivedInput);
+            inputEventsFromStates(previousInput, receivedInput, inputEvents);
+            previousInput = receivedInput;
+            break;
+        case matrixserver::trace:
+            Trace::apply(message->tracerequest());
+            break;
+        case matrixserver::clusterSync: {
+            auto arrived = FrameTimer::nowNs();
+            const auto &sync = message->clustersync();
+            std::lock_guard<std::mutex> lock(clockMutex);
+            serverClock.addSample(sync.originns(), sync.receivens(), sync.transmitns(), arrived);
+        }
+            break;
         case matrixserver::requestScreenAccess:
-        case matrixserver::setScreenFrame:
-            renderSyncMutex.unlock();
+        case matrixserver::setScreenFrame: {
+            std::lock_guard<std::mutex> lock(frameMutex);
+            frameInFlight = false;
+        }
+            frameCondition.notify_all();
         default:
             break;
     }
@@ -196,6 +413,7 @@ void MatrixApplication::setFps(int setFps) {
     } else if (setFps == 0) {
         fps = DEFAULTFPS;
     }
+    frameTimer.setFps(fps);
 }
 
 AppState MatrixApplication::getAppState() {
@@ -203,10 +421,23 @@ AppState MatrixApplication::getAppState() {
 }
 
 float MatrixApplication::getLoad() {
-    return load;
+    return frameTimer.getStats().load;
+}
+
+FrameTimerStats MatrixApplication::getFrameStats() {
+    return frameTimer.getStats();
+}
+
+void MatrixApplication::setFramePolicy(FrameTimerPolicy policy, long spinTimeUs) {
+    frameTimer.setPolicy(policy);
+    frameTimer.setSpinTime(spinTimeUs);
 }
 
 void MatrixApplication::start() {
+    // not in the constructor, so a layer set before start() is part of the registration
+    registerAtServer();
+    started = true;
+    senderThread = new boost::thread(&MatrixApplication::senderLoop, this);
     mainThread = new boost::thread(&MatrixApplication::internalLoop, this);
 }
 
@@ -234,10 +465,80 @@ void MatrixApplication::stop() {
 //        mainThread->join();
 //        mainThread = NULL;
 //    }
-//    BOOST_LOG_TRIVIAL(debug)  << "app stop successfull";
+//    MATRIXLOG(debug)  << "app stop successfull";
 //    exit(0);
 }
 
+TransportType MatrixApplication::getTransport() {
+    return transport;
+}
+
+InputState MatrixApplication::getInput() {
+    return input.load();
+}
+
+bool MatrixApplication::getButton(unsigned int num) {
+    if (num >= MAXBUTTONAXISCOUNT)
+        return false;
+    auto state = input.load();
+    for (auto &joystick : state.joysticks) {
+        if (joystick.connected && joystick.button[num])
+            return true;
+    }
+    return false;
+}
+
+// returns true once for every press, coalesced presses are returned on the following calls
+bool MatrixApplication::getButtonPress(unsigned int num) {
+    if (num >= MAXBUTTONAXISCOUNT)
+        return false;
+    auto state = input.load();
+    for (int i = 0; i < MAXJOYSTICKS; i++) {
+        auto count = state.joysticks[i].buttonPressCount[num];
+        auto &consumed = consumedButtonPresses[i][num];
+        if (count < consumed) // counts restart when the app is registered again
+            consumed = count;
+        if (count > consumed) {
+            consumed++;
+            return true;
+        }
+    }
+    return false;
+}
+
+float MatrixApplication::getAxis(unsigned int num) {
+    if (num >= MAXBUTTONAXISCOUNT)
+        return 0.0f;
+    auto state = input.load();
+    float returnValue = 0.0f;
+    for (auto &joystick : state.joysticks) {
+        if (joystick.connected)
+            returnValue += joystick.axis[num];
+    }
+    return returnValue;
+}
+
+float MatrixApplication::getAxisPress(unsigned int num) {
+    if (num >= MAXBUTTONAXISCOUNT)
+        return 0.0f;
+    auto state = input.load();
+    for (int i = 0; i < MAXJOYSTICKS; i++) {
+        auto count = state.joysticks[i].axisPressCount[num];
+        auto &consumed = consumedAxisPresses[i][num];
+        if (count < consumed)
+            consumed = count;
+        if (count > consumed) {
+            consumed++;
+            return state.joysticks[i].axisPress[num];
+        }
+    }
+    return 0.0f;
+}
+
+bool MatrixApplication::popInputEvent(InputEvent &event) {
+    return inputEvents.pop(event);
+}
+
 int MatrixApplication::getBrightness() {
     return serverConfig.globalscreenbrightness();
 }
@@ -247,6 +548,18 @@ void MatrixApplication::setBrightness(int setBrightness) {
     updateBrightness = true;
 }
 
+void MatrixApplication::setPresentationTime(int64_t setPresentAtNs) {
+    std::lock_guard<std::mutex> lock(frameMutex);
+    presentAtNs = setPresentAtNs;
+    scheduling = true;
+}
+
+void MatrixApplication::setPresentationDelay(int64_t delayNs) {
+    std::lock_guard<std::mutex> lock(frameMutex);
+    presentationDelayNs = delayNs > 0 ? delayNs : 0;
+    scheduling = presentationDelayNs != 0 || scheduling;
+}
+
 long MatrixApplication::micros() {
     struct timeval tp;
     gettimeofday(&tp, nullptr);
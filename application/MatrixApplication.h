@@ -7,7 +7,15 @@
 #include <TcpClient.h>
 #include <UnixSocketClient.h>
 #include <IpcConnection.h>
+#include <FrameTimer.h>
+#include <FrameMessage.h>
+#include <InputState.h>
+#include <SeqLock.h>
+#include <ClockSync.h>
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
 
 #define DEFAULTFPS 40
 #define MAXFPS 200
@@ -16,6 +24,12 @@
 #define DEFAULTSERVERADRESS "127.0.0.1"
 #define DEFAULTSERVERPORT "2017"
 
+#define TRANSPORTENVVARIABLE "MATRIXSERVER_TRANSPORT" // ipc, unix, tcp or auto, overrides the constructor
+
+#define FRAMEACKTIMEOUT 1000 //ms to wait for the server to ack the frame in flight
+#define CLOCKSYNCINTERVAL 500000 //us between two clock exchanges with a server on another host while frames are scheduled
+#define CLOCKSYNCFASTINTERVAL 10000 //us, the first CLOCKSYNCSAMPLES exchanges, at most one per frame
+
 enum class AppState {
     starting, running, paused, ended, killed, failure
 };
@@ -25,7 +39,8 @@ public:
     MatrixApplication(
             int fps = DEFAULTFPS,
             std::string setServerAddress = DEFAULTSERVERADRESS,
-            std::string setServerPort = DEFAULTSERVERPORT);
+            std::string setServerPort = DEFAULTSERVERPORT,
+            TransportType setTransport = TransportType::automatic);
 
     ~MatrixApplication() = default;
 
@@ -39,6 +54,10 @@ public:
 
     float getLoad();
 
+    FrameTimerStats getFrameStats();
+
+    void setFramePolicy(FrameTimerPolicy policy, long spinTimeUs = 0);
+
     void start();
 
     bool pause();
@@ -47,10 +66,41 @@ public:
 
     void stop();
 
+    TransportType getTransport();
+
+    // asks the server to start another app, executables are spawned, plugins forked from its zygote
+    bool launchApp(const std::string &path, const std::vector<std::string> &arguments = {},
+                   bool restartOnFailure = false);
+
+    // draw as an overlay over the foreground app instead of replacing it, before or after start()
+    bool setLayer(const matrixserver::LayerRequest &request);
+
+    // input pushed by the server, lock free, presses are consumed per app
+    InputState getInput();
+
+    bool getButton(unsigned int num);
+
+    bool getButtonPress(unsigned int num);
+
+    float getAxis(unsigned int num);
+
+    float getAxisPress(unsigned int num);
+
+    // every edge once, in order, timestamps are CLOCK_MONOTONIC ns (input age = FrameTimer::nowNs() - timestamp)
+    bool popInputEvent(InputEvent &event);
+
     int getBrightness();
 
     void setBrightness(int setBrightness);
 
+    // the next frame renderToScreens() sends is shown at presentAtNs (CLOCK_MONOTONIC of the app) instead of
+    // on arrival. The server buffers a few frames per app, an app may render ahead, its acks pace it then
+    void setPresentationTime(int64_t presentAtNs);
+
+    // every frame is shown delayNs after renderToScreens() was called for it, hiccups of the loop or the
+    // network shorter than that don't show. 0: frames are shown on arrival
+    void setPresentationDelay(int64_t delayNs);
+
     virtual bool loop() = 0;
 
 protected:
@@ -61,8 +111,23 @@ protected:
 private:
     void internalLoop();
 
+    void senderLoop();
+
+    void sendFrame();
+
+    // the server's clock for a presentation time, 0 while the offset of a remote server isn't known yet
+    int64_t toServerClock(int64_t presentAtNs);
+
+    void syncClock();
+
     bool connect(const std::string &serverAddress, const std::string &serverPort);
 
+    bool useConnection(std::shared_ptr<UniversalConnection> newConnection, TransportType newTransport);
+
+    std::vector<TransportType> getTransportCandidates();
+
+    static bool isLocalServer(const std::string &serverAddress);
+
     void checkConnection();
 
     void registerAtServer();
@@ -71,19 +136,51 @@ private:
 
     int appId;
     int fps;
-    float load;
+    FrameTimer frameTimer;
 
     int brightness;
     std::string serverAddress;
     std::string serverPort;
     std::shared_ptr<UniversalConnection> connection;
+    TransportType requestedTransport;
+    TransportType transport;
+    int launcherFd; // connection inherited from the server's launcher, -1 once used
+    std::atomic<bool> started;
+    std::shared_ptr<const matrixserver::LayerRequest> layerRequest; // std::atomic_load/atomic_store
     boost::thread *mainThread;
     boost::thread *ioThread;
+    boost::thread *senderThread;
     AppState appState;
     boost::asio::io_service io_context;
     matrixserver::ServerConfig serverConfig;
 
-    std::mutex renderSyncMutex;
+    // front set: owned by the sender thread while a frame is queued, loop() keeps drawing into screens
+    std::vector<std::shared_ptr<Screen>> frontScreens;
+    FrameMessage frameMessage;
+
+    SeqLock<InputState> input;
+    InputState receivedInput;
+    InputState previousInput;
+    InputEventQueue inputEvents;
+    std::array<std::array<uint32_t, MAXBUTTONAXISCOUNT>, MAXJOYSTICKS> consumedButtonPresses;
+    std::array<std::array<uint32_t, MAXBUTTONAXISCOUNT>, MAXJOYSTICKS> consumedAxisPresses;
+    matrixserver::ServerConfig frontServerConfig;
+    bool frontBrightnessUpdate;
+    bool frameQueued;
+    bool frameInFlight;
+    uint32_t frameCounter;
+    uint64_t frameId; // of the frame loop() draws, Trace::makeFrameId
+    uint64_t frontFrameId; // of the frame in the front set
+    int64_t presentAtNs; // frameMutex, of the next frame, 0: none
+    int64_t presentationDelayNs; // frameMutex
+    int64_t frontPresentAtNs; // of the frame in the front set
+    std::atomic<bool> scheduling; // a presentation time was set once, remote servers need the clock offset
+    std::atomic<bool> remoteClock; // the server runs on another host, its CLOCK_MONOTONIC differs
+    int64_t nextClockSync; // main thread
+    ClockOffsetEstimator serverClock; // clockMutex
+    std::mutex clockMutex;
+    std::mutex frameMutex;
+    std::condition_variable frameCondition;
 };
 
 
@@ -0,0 +1,167 @@
+#include "MatrixApplicationPlugin.h"
+#include <sys/time.h>
+#include <cstring>
+#include <random>
+
+MatrixApplicationPlugin::MatrixApplicationPlugin(int fps, std::string, std::string) :
+        fps(DEFAULTFPS) {
+    std::random_device rd;
+    srand(rd());
+    setFps(fps);
+    appState = AppState::starting;
+    InputState empty;
+    memset(&empty, 0, sizeof(empty));
+    memset(&previousInput, 0, sizeof(previousInput));
+    input.store(empty);
+    for (auto &joystick : consumedButtonPresses)
+        joystick.fill(0);
+    for (auto &joystick : consumedAxisPresses)
+        joystick.fill(0);
+}
+
+// the screens are drawn by the server after every loop(), the app must not keep them past its destruction
+void MatrixApplicationPlugin::attach(std::vector<std::shared_ptr<Screen>> setScreens,
+                                     const matrixserver::ServerConfig &setServerConfig) {
+    screens = setScreens;
+    serverConfig.CopyFrom(setServerConfig);
+    appState = AppState::running;
+}
+
+void MatrixApplicationPlugin::setInput(const InputState &newInput) {
+    input.store(newInput);
+    inputEventsFromStates(previousInput, newInput, inputEvents);
+    previousInput = newInput;
+}
+
+void MatrixApplicationPlugin::setLauncher(AppLaunchFunction launch) {
+    launcher = launch;
+}
+
+bool MatrixApplicationPlugin::launchApp(const std::string &path) {
+    return launcher && launcher(path);
+}
+
+void MatrixApplicationPlugin::renderToScreens() {
+
+}
+
+int MatrixApplicationPlugin::getFps() {
+    return fps;
+}
+
+void MatrixApplicationPlugin::setFps(int setFps) {
+    if (setFps <= MAXFPS && setFps >= MINFPS) {
+        fps = setFps;
+    } else if (setFps == 0) {
+        fps = DEFAULTFPS;
+    }
+}
+
+AppState MatrixApplicationPlugin::getAppState() {
+    return appState;
+}
+
+void MatrixApplicationPlugin::start() {
+
+}
+
+bool MatrixApplicationPlugin::pause() {
+    if (appState == AppState::running) {
+        appState = AppState::paused;
+        return true;
+    }
+    return false;
+}
+
+bool MatrixApplicationPlugin::resume() {
+    if (appState == AppState::paused) {
+        appState = AppState::running;
+        return true;
+    }
+    return false;
+}
+
+void MatrixApplicationPlugin::stop() {
+    appState = AppState::killed;
+}
+
+InputState MatrixApplicationPlugin::getInput() {
+    return input.load();
+}
+
+bool MatrixApplicationPlugin::getButton(unsigned int num) {
+    if (num >= MAXBUTTONAXISCOUNT)
+        return false;
+    auto state = input.load();
+    for (auto &joystick : state.joysticks) {
+        if (joystick.connected && joystick.button[num])
+            return true;
+    }
+    return false;
+}
+
+// returns true once for every press, coalesced presses are returned on the following calls
+bool MatrixApplicationPlugin::getButtonPress(unsigned int num) {
+    if (num >= MAXBUTTONAXISCOUNT)
+        return false;
+    auto state = input.load();
+    for (int i = 0; i < MAXJOYSTICKS; i++) {
+        auto count = state.joysticks[i].buttonPressCount[num];
+        auto &consumed = consumedButtonPresses[i][num];
+        if (count < consumed)
+            consumed = count;
+        if (count > consumed) {
+            consumed++;
+            return true;
+        }
+    }
+    return false;
+}
+
+float MatrixApplicationPlugin::getAxis(unsigned int num) {
+    if (num >= MAXBUTTONAXISCOUNT)
+        return 0.0f;
+    auto state = input.load();
+    float returnValue = 0.0f;
+    for (auto &joystick : state.joysticks) {
+        if (joystick.connected)
+            returnValue += joystick.axis[num];
+    }
+    return returnValue;
+}
+
+float MatrixApplicationPlugin::getAxisPress(unsigned int num) {
+    if (num >= MAXBUTTONAXISCOUNT)
+        return 0.0f;
+    auto state = input.load();
+    for (int i = 0; i < MAXJOYSTICKS; i++) {
+        auto count = state.joysticks[i].axisPressCount[num];
+        auto &consumed = consumedAxisPresses[i][num];
+        if (count < consumed)
+            consumed = count;
+        if (count > consumed) {
+            consumed++;
+            return state.joysticks[i].axisPress[num];
+        }
+    }
+    return 0.0f;
+}
+
+bool MatrixApplicationPlugin::popInputEvent(InputEvent &event) {
+    return inputEvents.pop(event);
+}
+
+int MatrixApplicationPlugin::getBrightness() {
+    return serverConfig.globalscreenbrightness();
+}
+
+void MatrixApplicationPlugin::setBrightness(int setBrightness) {
+    serverConfig.set_globalscreenbrightness(setBrightness);
+}
+
+long MatrixApplicationPlugin::micros() {
+    struct timeval tp;
+    gettimeofday(&tp, nullptr);
+    long us = tp.tv_sec * 1000000 + tp.tv_usec;
+    return us;
+}
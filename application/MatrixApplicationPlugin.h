@@ -0,0 +1,103 @@
+#ifndef MATRIXSERVER_MATRIXAPPLICATIONPLUGIN_H
+#define MATRIXSERVER_MATRIXAPPLICATIONPLUGIN_H
+
+#include <Screen.h>
+#include <UniversalConnection.h>
+#include <AppPlugin.h>
+#include <InputState.h>
+#include <SeqLock.h>
+#include <array>
+#include <atomic>
+
+#include <matrixserver.pb.h>
+
+#define DEFAULTFPS 40
+#define MAXFPS 200
+#define MINFPS 1
+
+#define DEFAULTSERVERADRESS "127.0.0.1"
+#define DEFAULTSERVERPORT "2017"
+
+enum class AppState {
+    starting, running, paused, ended, killed, failure
+};
+
+/*
+ * Base of apps built as server plugins (MATRIXAPPLICATION_PLUGIN). Same interface as
+ * MatrixApplication, but there is no connection and no thread of its own: the server loads the
+ * app, draws it on a thread it owns and renders the screens directly.
+ */
+class MatrixApplicationPlugin : public IAppPlugin {
+public:
+    MatrixApplicationPlugin(
+            int fps = DEFAULTFPS,
+            std::string setServerAddress = DEFAULTSERVERADRESS,
+            std::string setServerPort = DEFAULTSERVERPORT);
+
+    ~MatrixApplicationPlugin() = default;
+
+    void attach(std::vector<std::shared_ptr<Screen>> screens, const matrixserver::ServerConfig &serverConfig);
+
+    void setInput(const InputState &input);
+
+    void setLauncher(AppLaunchFunction launch);
+
+    // started by the server's launcher, e.g. in a process forked from the zygote for plugins
+    bool launchApp(const std::string &path);
+
+    // the server renders after every loop()
+    void renderToScreens();
+
+    int getFps();
+
+    void setFps(int fps);
+
+    AppState getAppState();
+
+    // the server drives the app, these only track the state
+    void start();
+
+    bool pause();
+
+    bool resume();
+
+    void stop();
+
+    InputState getInput();
+
+    bool getButton(unsigned int num);
+
+    bool getButtonPress(unsigned int num);
+
+    float getAxis(unsigned int num);
+
+    float getAxisPress(unsigned int num);
+
+    bool popInputEvent(InputEvent &event);
+
+    int getBrightness();
+
+    void setBrightness(int setBrightness);
+
+    virtual bool loop() = 0;
+
+protected:
+    std::vector<std::shared_ptr<Screen>> screens;
+
+    long micros();
+
+private:
+    std::atomic<int> fps;
+    AppState appState;
+    AppLaunchFunction launcher;
+    matrixserver::ServerConfig serverConfig;
+
+    SeqLock<InputState> input;
+    InputState previousInput;
+    InputEventQueue inputEvents;
+    std::array<std::array<uint32_t, MAXBUTTONAXISCOUNT>, MAXJOYSTICKS> consumedButtonPresses;
+    std::array<std::array<uint32_t, MAXBUTTONAXISCOUNT>, MAXJOYSTICKS> consumedAxisPresses;
+};
+
+
+#endif //MATRIXSERVER_MATRIXAPPLICATIONPLUGIN_H
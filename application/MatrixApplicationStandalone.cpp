@@ -1,160 +1,78 @@
 #include "MatrixApplicationStandalone.h"
 #include <sys/time.h>
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/expressions.hpp>
-#include <thread>
+#include <Log.h>
 #include <unistd.h>
-
-
-void createDefaultCubeConfig(matrixserver::ServerConfig &serverConfig) {
-    serverConfig.Clear();
-    serverConfig.set_globalscreenbrightness(100);
-    serverConfig.set_servername("matrixserver");
-    matrixserver::Connection *serverConnection = new matrixserver::Connection();
-    serverConnection->set_serveraddress("127.0.0.1");
-    serverConnection->set_serverport("2017");
-    serverConnection->set_connectiontype(matrixserver::Connection_ConnectionType_tcp);
-    serverConfig.set_allocated_serverconnection(serverConnection);
-    serverConfig.set_assemblytype(matrixserver::ServerConfig_AssemblyType_cube);
-    for (int i = 0; i < 6; i++) {
-        auto screenInfo = serverConfig.add_screeninfo();
-        screenInfo->set_screenid(i);
-        screenInfo->set_available(true);
-        screenInfo->set_height(64);
-        screenInfo->set_width(64);
-        screenInfo->set_screenorientation((matrixserver::ScreenInfo_ScreenOrientation) (i + 1));
-    }
-}
-
-
-MatrixApplicationStandalone::MatrixApplicationStandalone(int fps, std::string setServerAddress, std::string setServerPort) :
-        mainThread(), renderThread() {
-    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::debug);
-    newFrame = false;
+#include <cstdlib>
+
+#include <NullRenderer.h>
+#include <CountingRenderer.h>
+#include <SimulatorRenderer.h>
+#if defined(__linux__)
+#include <FPGARendererRPISPI.h>
+#endif
+
+
+// placement of the sides in the FPGA frame buffer of the standalone cube
+static const CubeLayout cubeLayout = {{
+        {1, 1, Rotation::rot180}, // front
+        {0, 1, Rotation::rot180}, // right
+        {1, 0, Rotation::rot90}, // back
+        {2, 1, Rotation::rot180}, // left
+        {0, 0, Rotation::rot270}, // top
+        {2, 0, Rotation::rot270}  // bottom
+}};
+
+MatrixApplicationStandalone::MatrixApplicationStandalone(int fps, std::string, std::string) :
+        mainThread(), renderThread(), stopRequested(false) {
+    Log::setLevel(LogLevel::debug);
+    this->fps = DEFAULTFPS;
+    setFps(fps);
 
     createDefaultCubeConfig(serverConfig);
 
-    BOOST_LOG_TRIVIAL(info) << "ServerConfig: " << std::endl << serverConfig.DebugString() << std::endl;
-
-    for (auto screenInfo : serverConfig.screeninfo()){
-        auto screen = std::make_shared<Screen>(screenInfo.width(), screenInfo.height(), screenInfo.screenid());
-        switch(screenInfo.screenorientation()){
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_front :
-                screen->setOffsetX(1);
-                screen->setOffsetY(1);
-                screen->setRotation(Rotation::rot180);
-                break;
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_right :
-                screen->setOffsetX(0);
-                screen->setOffsetY(1);
-                screen->setRotation(Rotation::rot180);
-                break;
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_back :
-                screen->setOffsetX(1);
-                screen->setOffsetY(0);
-                screen->setRotation(Rotation::rot90);
-                break;
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_left :
-                screen->setOffsetX(2);
-                screen->setOffsetY(1);
-                screen->setRotation(Rotation::rot180);
-                break;
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_top :
-                screen->setOffsetX(0);
-                screen->setOffsetY(0);
-                screen->setRotation(Rotation::rot270);
-                break;
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_bottom :
-                screen->setOffsetX(2);
-                screen->setOffsetY(0);
-                screen->setRotation(Rotation::rot270);
-                break;
-            default:
-                break;
-        }
-        renderscreens.push_back(screen);
-    }
+    MATRIXLOG(info) << "ServerConfig: " << std::endl << serverConfig.DebugString() << std::endl;
 
-    for (auto screenInfo : serverConfig.screeninfo()){
-        auto screen = std::make_shared<Screen>(screenInfo.width(), screenInfo.height(), screenInfo.screenid());
-        switch(screenInfo.screenorientation()){
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_front :
-                screen->setOffsetX(1);
-                screen->setOffsetY(1);
-                screen->setRotation(Rotation::rot180);
-                break;
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_right :
-                screen->setOffsetX(0);
-                screen->setOffsetY(1);
-                screen->setRotation(Rotation::rot180);
-                break;
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_back :
-                screen->setOffsetX(1);
-                screen->setOffsetY(0);
-                screen->setRotation(Rotation::rot90);
-                break;
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_left :
-                screen->setOffsetX(2);
-                screen->setOffsetY(1);
-                screen->setRotation(Rotation::rot180);
-                break;
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_top :
-                screen->setOffsetX(0);
-                screen->setOffsetY(0);
-                screen->setRotation(Rotation::rot270);
-                break;
-            case matrixserver::ScreenInfo_ScreenOrientation::ScreenInfo_ScreenOrientation_bottom :
-                screen->setOffsetX(2);
-                screen->setOffsetY(0);
-                screen->setRotation(Rotation::rot270);
-                break;
-            default:
-                break;
-        }
-        screens.push_back(screen);
-    }
+    renderscreens = createScreens(serverConfig, &cubeLayout);
+    screens = createScreens(serverConfig, &cubeLayout);
+    for (int i = 0; i < 3; i++)
+        frameBuffer.getBuffer(i) = createScreens(serverConfig, &cubeLayout);
 
-    renderer = std::make_shared<FPGARendererRPISPI>(renderscreens);
+    auto rendererName = getenv(RENDERERENV);
+    rendererFactory = getRendererFactory(rendererName != nullptr ? rendererName : "");
 
     appState = AppState::starting;
 }
 
 void MatrixApplicationStandalone::renderToScreens() {
-    renderSyncMutex.lock();
-    renderSyncMutex.unlock();
     renderer->render();
-//    std::thread([this](){renderer->render();}).detach();
 }
 
+// renders the newest completed frame, sleeps while there is none
 void MatrixApplicationStandalone::renderLoop() {
-    bool running = true;
-    while (running) {
-        renderSyncMutex.lock();
-        while(newFrame == false)
-            usleep(100);
-        for (auto screen : screens) {
+    while (!stopRequested) {
+        if (!frameBuffer.waitForUpdate(RENDERWAITTIMEOUT))
+            continue;
+        for (auto &screen : frameBuffer.getReadBuffer()) {
             renderer->setScreenData(screen->getScreenId(), screen->getScreenDataRaw());
         }
-        newFrame = false;
-        renderSyncMutex.unlock();
-        auto startTime = micros();
         renderToScreens();
-//      BOOST_LOG_TRIVIAL(warning) << "[Application] rendertime: " << micros()-startTime << " us";
     }
 }
 
 void MatrixApplicationStandalone::internalLoop() {
     bool running = true;
-    while (running) {
-        auto startTime = micros();
+    frameTimer.start();
+    while (running && !stopRequested) {
         if (appState == AppState::running) {
-            while(newFrame == true)
-                usleep(100);
             running = loop();
-            newFrame = true;
+            // apps draw incrementally into screens, so the frame is copied instead of swapped
+            auto &frame = frameBuffer.getWriteBuffer();
+            for (unsigned int i = 0; i < screens.size() && i < frame.size(); i++) {
+                frame[i]->setScreenData(screens[i]->getScreenDataRaw());
+            }
+            frameBuffer.publish();
         }
-        BOOST_LOG_TRIVIAL(warning) << "[Application] rendertime: " << micros()-startTime << " us";
+        frameTimer.wait();
     }
 }
 
@@ -169,6 +87,7 @@ void MatrixApplicationStandalone::setFps(int setFps) {
     } else if (setFps == 0) {
         fps = DEFAULTFPS;
     }
+    frameTimer.setFps(fps);
 }
 
 AppState MatrixApplicationStandalone::getAppState() {
@@ -176,10 +95,48 @@ AppState MatrixApplicationStandalone::getAppState() {
 }
 
 float MatrixApplicationStandalone::getLoad() {
-    return load;
+    return frameTimer.getStats().load;
+}
+
+FrameTimerStats MatrixApplicationStandalone::getFrameStats() {
+    return frameTimer.getStats();
+}
+
+TripleBufferStats MatrixApplicationStandalone::getFrameBufferStats() {
+    return frameBuffer.getStats();
+}
+
+void MatrixApplicationStandalone::setRendererFactory(RendererFactory factory) {
+    rendererFactory = factory;
+}
+
+std::shared_ptr<IRenderer> MatrixApplicationStandalone::getRenderer() {
+    return renderer;
+}
+
+RendererFactory MatrixApplicationStandalone::getRendererFactory(const std::string &name) {
+    if (name == "null") {
+        return [](std::vector<std::shared_ptr<Screen>> screens) { return std::make_shared<NullRenderer>(screens); };
+    } else if (name == "counting") {
+        return [](std::vector<std::shared_ptr<Screen>> screens) { return std::make_shared<CountingRenderer>(screens); };
+    } else if (name == "simulator") {
+        return [](std::vector<std::shared_ptr<Screen>> screens) { return std::make_shared<SimulatorRenderer>(screens); };
+    }
+#if defined(__linux__)
+    if (name != "" && name != "fpga")
+        MATRIXLOG(warning) << "[Standalone] unknown renderer " << name << ", using fpga";
+    return [](std::vector<std::shared_ptr<Screen>> screens) { return std::make_shared<FPGARendererRPISPI>(screens); };
+#else
+    if (name != "" && name != "simulator")
+        MATRIXLOG(warning) << "[Standalone] unknown renderer " << name << ", using simulator";
+    return [](std::vector<std::shared_ptr<Screen>> screens) { return std::make_shared<SimulatorRenderer>(screens); };
+#endif
 }
 
 void MatrixApplicationStandalone::start() {
+    if (renderer == nullptr)
+        renderer = rendererFactory(renderscreens);
+    stopRequested = false;
     mainThread = new boost::thread(&MatrixApplicationStandalone::internalLoop, this);
     renderThread = new boost::thread(&MatrixApplicationStandalone::renderLoop, this);
     appState = AppState::running;
@@ -202,11 +159,17 @@ bool MatrixApplicationStandalone::resume() {
 }
 
 void MatrixApplicationStandalone::stop() {
+    stopRequested = true; // the loops check it every frame and every RENDERWAITTIMEOUT
     if (mainThread != NULL) {
-        mainThread->interrupt();
         mainThread->join();
+        delete mainThread;
         mainThread = NULL;
     }
+    if (renderThread != NULL) {
+        renderThread->join();
+        delete renderThread;
+        renderThread = NULL;
+    }
     appState = AppState::killed;
 }
 
@@ -9,11 +9,15 @@
 #include <IpcConnection.h>
 #include <mutex>
 #include <atomic>
+#include <functional>
+#include <TripleBuffer.h>
+#include <FrameTimer.h>
+#include <CubeConfig.h>
 
 #include <matrixserver.pb.h>
 #include <google/protobuf/util/json_util.h>
 
-#include <FPGARenderer/FPGARendererRPISPI.h>
+#include <IRenderer.h>
 
 #define DEFAULTFPS 40
 #define MAXFPS 200
@@ -21,6 +25,11 @@
 
 #define DEFAULTSERVERADRESS "127.0.0.1"
 #define DEFAULTSERVERPORT "2017"
+#define RENDERWAITTIMEOUT 100000000 //ns
+#define RENDERERENV "MATRIXRENDERER" // fpga (default), simulator, null or counting
+
+// creates the renderer for the screens of the standalone app, they are placed for the FPGA cube
+typedef std::function<std::shared_ptr<IRenderer>(std::vector<std::shared_ptr<Screen>>)> RendererFactory;
 
 enum class AppState {
     starting, running, paused, ended, killed, failure
@@ -35,8 +44,6 @@ public:
 
     ~MatrixApplicationStandalone() = default;
 
-    void renderToScreens();
-
     int getFps();
 
     void setFps(int fps);
@@ -45,12 +52,24 @@ public:
 
     float getLoad();
 
+    FrameTimerStats getFrameStats();
+
+    TripleBufferStats getFrameBufferStats();
+
+    // replaces the renderer chosen by RENDERERENV, call it before start()
+    void setRendererFactory(RendererFactory factory);
+
+    std::shared_ptr<IRenderer> getRenderer();
+
+    static RendererFactory getRendererFactory(const std::string &name);
+
     void start();
 
     bool pause();
 
     bool resume();
 
+    // ends and joins the app and render threads
     void stop();
 
     virtual bool loop() = 0;
@@ -63,20 +82,23 @@ protected:
 private:
     void internalLoop();
     void renderLoop();
+    // only called by the render thread, which owns the renderer
+    void renderToScreens();
 
     int appId;
     int fps;
-    float load;
+    FrameTimer frameTimer;
     boost::thread *mainThread;
     boost::thread *renderThread;
     AppState appState;
+    std::atomic<bool> stopRequested;
 
-    std::mutex renderSyncMutex;
-
-    std::atomic<bool> newFrame;
+    // completed frames on their way from the app thread to the render thread
+    TripleBuffer<std::vector<std::shared_ptr<Screen>>> frameBuffer;
 
     matrixserver::ServerConfig serverConfig;
 
+    RendererFactory rendererFactory;
     std::shared_ptr<IRenderer> renderer;
 };
 
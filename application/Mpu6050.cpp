@@ -2,11 +2,11 @@
 
 #include <stdio.h>
 #include <stdint.h>
-#include <wiringPi.h>
-#include <wiringPiI2C.h>
 #include <iostream>
 #include <unistd.h>
-#include <byteswap.h>
+#include <cstring>
+
+#include <FrameTimer.h>
 
 #include <cmath>
 #define PI 3.14159265
@@ -14,42 +14,67 @@
 using namespace Eigen;
 
 
-#define MPU6050_GYRO_XOUT_H        0x43   // R
-#define MPU6050_GYRO_YOUT_H        0x45   // R
-#define MPU6050_GYRO_ZOUT_H        0x47   // R
+#define MPU6050_SMPLRT_DIV         0x19   // R/W
+#define MPU6050_CONFIG             0x1A   // R/W
+#define MPU6050_GYRO_CONFIG        0x1B   // R/W
+#define MPU6050_ACCEL_CONFIG       0x1C   // R/W
+#define MPU6050_FIFO_EN            0x23   // R/W
+#define MPU6050_ACCEL_XOUT_H       0x3B   // R, start of the 14 data registers: accel, temp, gyro
+#define MPU6050_USER_CTRL          0x6A   // R/W
+#define MPU6050_PWR_MGMT_1         0x6B   // R/W
+#define MPU6050_FIFO_COUNTH        0x72   // R
+#define MPU6050_FIFO_R_W           0x74   // R/W
 
-#define MPU6050_ACCEL_XOUT_H       0x3B   // R
-#define MPU6050_ACCEL_YOUT_H       0x3D   // R
-#define MPU6050_ACCEL_ZOUT_H       0x3F   // R
+#define MPU6050_DATA_LENGTH        14
+#define MPU6050_FIFO_RECORD        12     // accel + gyro, no temperature
+#define MPU6050_FIFO_SIZE          1024
+#define MPU6050_FIFO_EN_ACCELGYRO  0x78
+#define MPU6050_USER_CTRL_FIFO_EN  0x40
+#define MPU6050_USER_CTRL_FIFO_RST 0x04
+#define MPU6050_DLPF_44HZ          0x03   // gyro output rate is 1kHz with the dlpf enabled
 
-#define MPU6050_PWR_MGMT_1         0x6B   // R/W
-#define MPU6050_I2C_ADDRESS        0x68   // I2C
+#define MPU6050_GYRO_SCALE         131.0f   // LSB per deg/s at +-250 deg/s
+#define MPU6050_ACCEL_SCALE        16384.0f // LSB per g at +-2g
 
-Vector2f RotateVector2d(Vector2f input, double degrees)
-{
-    Vector2f result;
-    double radians = degrees * PI/180;
-    result[0] = input[0] * cos(radians) - input[1] * sin(radians);
-    result[1] = input[0] * sin(radians) + input[1] * cos(radians);
-    return result;
+static inline int16_t readWord(const uint8_t *data) {
+    return (int16_t) ((data[0] << 8) | data[1]);
 }
 
-int read_word_2c(int fd, char reg){
-    uint16_t value = wiringPiI2CReadReg16(fd, reg);
-    value = __bswap_16(value);
-    if (value >= 0x8000)
-        return -((65535 - value) + 1);
-    else
-        return value;
+Mpu6050::Mpu6050() : Mpu6050(std::make_shared<LinuxI2cDevice>(MPU6050_I2C_ADDRESS)) {
+    init();
 }
 
-Mpu6050::Mpu6050(){
-    init();
+Mpu6050::Mpu6050(std::shared_ptr<I2cDevice> setDevice, unsigned int sampleRateHz, Mpu6050Mode setMode) :
+        thread_(nullptr),
+        running(false),
+        device(setDevice),
+        sampleRate(sampleRateHz > 0 ? sampleRateHz : MPU6050DEFAULTRATE),
+        mode(setMode),
+        lowPassAlpha(0.5f),
+        complementaryAlpha(0.98f),
+        calibrationSamples(0),
+        calibrationCount(0) {
+    // the sensor is mounted rotated in the x/z plane, computed once instead of per sample
+    float radians = MPU6050MOUNTINGANGLE * PI / 180;
+    rotation << std::cos(radians), 0, -std::sin(radians),
+                std::sin(radians), 0, std::cos(radians),
+                0, 1, 0;
+    accelerationOffset.setZero();
+    gyroOffset.setZero();
+    gyroSum.setZero();
+    memset(&current, 0, sizeof(current));
+}
+
+Mpu6050::~Mpu6050() {
+    stop();
 }
 
 Vector3i Mpu6050::getCubeAccIntersect(){
+    auto acceleration = getAcceleration();
     int maxC;
     auto scaler = acceleration.cwiseAbs().maxCoeff(&maxC);
+    if (scaler == 0)
+        return Vector3i(33,33,33);
     auto scaledAcc = acceleration * (1.0f/scaler);
 
     Vector3i accCubePos = (scaledAcc * 33).template cast<int>() + Vector3i(33,33,33);
@@ -57,49 +82,185 @@ Vector3i Mpu6050::getCubeAccIntersect(){
     return accCubePos;
 }
 
-void Mpu6050::init()
+void Mpu6050::init(bool startThread)
 {
-    fd = wiringPiI2CSetup(MPU6050_I2C_ADDRESS);
-    if (fd == -1)
+    if (!device || !device->isOpen())
         return;
 
-    wiringPiI2CReadReg8 (fd, MPU6050_PWR_MGMT_1);
-    wiringPiI2CWriteReg16(fd, MPU6050_PWR_MGMT_1, 0);
+    configure();
+
+    if (startThread)
+        startRefreshThread();
+}
+
+void Mpu6050::configure()
+{
+    device->writeReg8(MPU6050_PWR_MGMT_1, 0); // wake up
+    device->writeReg8(MPU6050_CONFIG, MPU6050_DLPF_44HZ);
+    device->writeReg8(MPU6050_GYRO_CONFIG, 0);
+    device->writeReg8(MPU6050_ACCEL_CONFIG, 0);
+    unsigned int divider = 1000 / sampleRate;
+    divider = divider > 0 ? divider - 1 : 0;
+    device->writeReg8(MPU6050_SMPLRT_DIV, (uint8_t) std::min(divider, 255u));
+    if (mode == Mpu6050Mode::fifo) {
+        device->writeReg8(MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_RST);
+        device->writeReg8(MPU6050_FIFO_EN, MPU6050_FIFO_EN_ACCELGYRO);
+        device->writeReg8(MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_EN);
+    } else {
+        device->writeReg8(MPU6050_FIFO_EN, 0);
+        device->writeReg8(MPU6050_USER_CTRL, 0);
+    }
+}
+
+void Mpu6050::setFilter(float setLowPassAlpha, float setComplementaryAlpha)
+{
+    lowPassAlpha = setLowPassAlpha;
+    complementaryAlpha = setComplementaryAlpha;
+}
 
-    startRefreshThread();
+void Mpu6050::setAccelerationOffset(Vector3f offset)
+{
+    accelerationOffset = offset;
+}
+
+void Mpu6050::calibrate(unsigned int samples)
+{
+    calibrationSamples = samples;
 }
 
 void Mpu6050::startRefreshThread()
 {
+    running = true;
     thread_ = new boost::thread(&Mpu6050::internalLoop, this);
 }
 
+void Mpu6050::stop()
+{
+    boost::mutex::scoped_lock lock(threadLock_);
+    running = false;
+    if (thread_ != nullptr) {
+        thread_->join();
+        delete thread_;
+        thread_ = nullptr;
+    }
+}
+
 void Mpu6050::internalLoop(){
-    int loopcount = 0;
-    while(1){
-        float gx,gy,gz,ax,ay,az;
+    FrameTimer timer(getPollRate());
+    timer.start();
+    while(running){
+        poll();
+        timer.wait();
+    }
+}
+
+// one sampling step: a burst read or draining the fifo, returns false if no sample was read
+bool Mpu6050::poll()
+{
+    return mode == Mpu6050Mode::fifo ? drainFifo() : readBurst();
+}
+
+// how often poll has to be called
+unsigned int Mpu6050::getPollRate()
+{
+    return mode == Mpu6050Mode::fifo ? std::min(sampleRate, (unsigned int) MPU6050FIFOPOLLRATE) : sampleRate;
+}
 
-        gx = read_word_2c(fd, MPU6050_GYRO_XOUT_H) / 131.0f;
-        gy = read_word_2c(fd, MPU6050_GYRO_YOUT_H) / 131.0f;
-        gz = read_word_2c(fd, MPU6050_GYRO_ZOUT_H) / 131.0f;
+bool Mpu6050::readBurst()
+{
+    uint8_t data[MPU6050_DATA_LENGTH];
+    if (!device->readBlock(MPU6050_ACCEL_XOUT_H, data, MPU6050_DATA_LENGTH))
+        return false;
+    process(data, data + 8, FrameTimer::nowNs());
+    return true;
+}
+
+bool Mpu6050::drainFifo()
+{
+    uint8_t countData[2];
+    if (!device->readBlock(MPU6050_FIFO_COUNTH, countData, 2))
+        return false;
+    unsigned int count = (countData[0] << 8) | countData[1];
+    if (count >= MPU6050_FIFO_SIZE) {
+        // overflowed, the record boundaries are lost
+        device->writeReg8(MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_EN | MPU6050_USER_CTRL_FIFO_RST);
+        return false;
+    }
+    unsigned int records = count / MPU6050_FIFO_RECORD;
+    if (records == 0)
+        return false;
+    uint8_t data[MPU6050_FIFO_SIZE];
+    if (!device->readBlock(MPU6050_FIFO_R_W, data, records * MPU6050_FIFO_RECORD))
+        return false;
+    // the newest record was sampled just now, the others one sample period apart before it
+    int64_t now = FrameTimer::nowNs();
+    int64_t period = 1000000000LL / sampleRate;
+    for (unsigned int i = 0; i < records; i++) {
+        auto record = data + i * MPU6050_FIFO_RECORD;
+        process(record, record + 6, now - (int64_t) (records - 1 - i) * period);
+    }
+    return true;
+}
 
-        ax = read_word_2c(fd, MPU6050_ACCEL_XOUT_H) / 16384.0f;
-        ay = read_word_2c(fd, MPU6050_ACCEL_YOUT_H) / 16384.0f;
-        az = read_word_2c(fd, MPU6050_ACCEL_ZOUT_H) / 16384.0f;
+void Mpu6050::process(const uint8_t *accel, const uint8_t *gyro, uint64_t timestamp)
+{
+    Vector3f rawAcceleration(readWord(accel) / MPU6050_ACCEL_SCALE, readWord(accel + 2) / MPU6050_ACCEL_SCALE,
+                             readWord(accel + 4) / MPU6050_ACCEL_SCALE);
+    Vector3f rawGyro(readWord(gyro) / MPU6050_GYRO_SCALE, readWord(gyro + 2) / MPU6050_GYRO_SCALE,
+                     readWord(gyro + 4) / MPU6050_GYRO_SCALE);
 
-        Vector2f temp;
-        temp[0] = ax;
-        temp[1] = az;
-        auto rotated = RotateVector2d(temp, 45.0f);
+    if (calibrationSamples > 0) {
+        gyroSum += rawGyro;
+        calibrationCount++;
+        if (calibrationCount >= calibrationSamples) {
+            gyroOffset = gyroSum / (float) calibrationCount;
+            gyroSum.setZero();
+            calibrationCount = 0;
+            calibrationSamples = 0;
+        }
+    }
 
-        acceleration[0] = rotated[0];
-        acceleration[1] = rotated[1];
-        acceleration[2] = ay;
+    Vector3f acceleration = rotation * (rawAcceleration - accelerationOffset);
+    Vector3f gyroRate = rotation * (rawGyro - gyroOffset);
 
-        usleep(10000);
+    float dt = current.timestamp > 0 && timestamp > current.timestamp ? (timestamp - current.timestamp) / 1e9f : 0;
+    bool first = sample.getCount() == 0;
+    for (int i = 0; i < 3; i++) {
+        current.acceleration[i] = first ? acceleration[i] :
+                                  current.acceleration[i] + lowPassAlpha * (acceleration[i] - current.acceleration[i]);
+        current.gyro[i] = gyroRate[i];
+    }
+    float accelPitch = std::atan2(-acceleration[0], std::sqrt(acceleration[1] * acceleration[1] + acceleration[2] * acceleration[2])) * 180 / PI;
+    float accelRoll = std::atan2(acceleration[1], acceleration[2]) * 180 / PI;
+    if (first) {
+        current.pitch = accelPitch;
+        current.roll = accelRoll;
+    } else {
+        current.pitch = complementaryAlpha * (current.pitch + gyroRate[1] * dt) + (1 - complementaryAlpha) * accelPitch;
+        current.roll = complementaryAlpha * (current.roll + gyroRate[0] * dt) + (1 - complementaryAlpha) * accelRoll;
     }
+    current.timestamp = timestamp;
+    sample.publish(current, timestamp);
 }
 
 Vector3f Mpu6050::getAcceleration(){
-    return acceleration;
-}
\ No newline at end of file
+    auto snapshot = sample.get();
+    return Vector3f(snapshot.acceleration[0], snapshot.acceleration[1], snapshot.acceleration[2]);
+}
+
+Vector3f Mpu6050::getGyro(){
+    auto snapshot = sample.get();
+    return Vector3f(snapshot.gyro[0], snapshot.gyro[1], snapshot.gyro[2]);
+}
+
+Mpu6050Sample Mpu6050::getSample(){
+    return sample.get();
+}
+
+SampleChannel<Mpu6050Sample> & Mpu6050::getChannel(){
+    return sample;
+}
+
+uint64_t Mpu6050::getSampleCount(){
+    return sample.getCount();
+}
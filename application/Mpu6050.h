@@ -5,21 +5,77 @@
 #include <Eigen/StdVector>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <memory>
+
+#include <SampleChannel.h>
+#include "I2cDevice.h"
+
+#define MPU6050_I2C_ADDRESS        0x68   // I2C
+#define MPU6050DEFAULTRATE 100 //Hz
+#define MPU6050FIFOPOLLRATE 25 //Hz, how often the fifo is drained
+#define MPU6050MOUNTINGANGLE 45.0f // rotation of the sensor around the cube's y axis
+
+enum class Mpu6050Mode {
+    burst, // one 14 register burst per sample, paced by the sampling thread
+    fifo   // the sensor samples on its own clock, the thread drains its fifo in batches
+};
+
+// cube coordinates, calibrated and rotated
+struct Mpu6050Sample {
+    uint64_t timestamp; // CLOCK_MONOTONIC ns
+    float acceleration[3]; // g, low-pass filtered
+    float gyro[3]; // deg/s
+    float pitch; // deg, complementary filter of gyro and acceleration
+    float roll;
+};
 
 class Mpu6050 {
 public:
     Mpu6050();
-    void init();
+    Mpu6050(std::shared_ptr<I2cDevice> device, unsigned int sampleRateHz = MPU6050DEFAULTRATE, Mpu6050Mode mode = Mpu6050Mode::burst);
+    ~Mpu6050();
+    void init(bool startThread = true);
+    void stop();
+    // 1 disables the low-pass filter, complementaryAlpha is the weight of the integrated gyro
+    void setFilter(float lowPassAlpha, float complementaryAlpha);
+    void setAccelerationOffset(Eigen::Vector3f offset);
+    // the sampling thread averages the next samples (sensor at rest) into the gyro offset
+    void calibrate(unsigned int samples = MPU6050DEFAULTRATE);
+    bool poll();
+    unsigned int getPollRate();
     Eigen::Vector3i getCubeAccIntersect();
     Eigen::Vector3f getAcceleration();
+    Eigen::Vector3f getGyro();
+    Mpu6050Sample getSample();
+    SampleChannel<Mpu6050Sample> & getChannel();
+    uint64_t getSampleCount();
 private:
+    void configure();
     void startRefreshThread();
     void internalLoop();
+    bool readBurst();
+    bool drainFifo();
+    void process(const uint8_t *accel, const uint8_t *gyro, uint64_t timestamp);
     boost::thread * thread_;
     boost::mutex threadLock_;
-    int fd;
+    std::atomic<bool> running;
+    std::shared_ptr<I2cDevice> device;
+    unsigned int sampleRate;
+    Mpu6050Mode mode;
+
+    // sampling thread only
+    Eigen::Matrix3f rotation;
+    Eigen::Vector3f accelerationOffset;
+    Eigen::Vector3f gyroOffset;
+    Eigen::Vector3f gyroSum;
+    Mpu6050Sample current;
+    float lowPassAlpha;
+    float complementaryAlpha;
+    std::atomic<unsigned int> calibrationSamples;
+    unsigned int calibrationCount;
 
-    Eigen::Vector3f acceleration;
+    SampleChannel<Mpu6050Sample> sample;
 };
 
 
@@ -0,0 +1,195 @@
+#include "SensorHub.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <climits>
+#include <cstring>
+#include <Log.h>
+
+#include <FrameTimer.h>
+
+#define NSPERSEC 1000000000LL
+#define TIMERID UINT32_MAX
+#define STOPID (UINT32_MAX - 1)
+
+SensorHub::SensorHub() : thread_(nullptr), wakeups(0) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = TIMERID;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event);
+    event.data.u32 = STOPID;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &event);
+}
+
+SensorHub::~SensorHub() {
+    stop();
+    close(epollFd);
+    close(timerFd);
+    close(stopFd);
+}
+
+int SensorHub::addPoll(std::string name, unsigned int rateHz, std::function<bool()> poll) {
+    if (rateHz == 0)
+        return -1;
+    std::unique_ptr<Source> source(new Source());
+    source->name = name;
+    source->fd = -1;
+    source->periodNs = NSPERSEC / rateHz;
+    source->deadline = 0;
+    source->callback = poll;
+    memset(&source->stats, 0, sizeof(source->stats));
+    source->published.store(source->stats);
+    sources.push_back(std::move(source));
+    return (int) sources.size() - 1;
+}
+
+int SensorHub::addFd(std::string name, int fd, std::function<bool()> handler) {
+    std::unique_ptr<Source> source(new Source());
+    source->name = name;
+    source->fd = fd;
+    source->periodNs = 0;
+    source->deadline = 0;
+    source->callback = handler;
+    memset(&source->stats, 0, sizeof(source->stats));
+    source->published.store(source->stats);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = (uint32_t) sources.size();
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        MATRIXLOG(warning) << "[SensorHub] can't wait for " << name << ": " << strerror(errno);
+        return -1;
+    }
+    sources.push_back(std::move(source));
+    return (int) sources.size() - 1;
+}
+
+void SensorHub::start() {
+    if (thread_ == nullptr)
+        thread_ = new boost::thread(&SensorHub::internalLoop, this);
+}
+
+void SensorHub::stop() {
+    if (thread_ == nullptr)
+        return;
+    uint64_t one = 1;
+    if (write(stopFd, &one, sizeof(one)) == sizeof(one))
+        thread_->join();
+    delete thread_;
+    thread_ = nullptr;
+}
+
+void SensorHub::internalLoop() {
+    // common time base, a 100Hz and a 10Hz poll share every 10th wakeup
+    auto base = FrameTimer::nowNs();
+    for (auto &source : sources) {
+        if (source->periodNs > 0)
+            source->deadline = base;
+        else
+            run(*source, FrameTimer::nowNs()); // initial state, e.g. devices present at startup
+    }
+    armTimer();
+
+    struct epoll_event events[16];
+    while (true) {
+        auto count = epoll_wait(epollFd, events, 16, -1);
+        if (count < 0 && errno != EINTR)
+            return;
+        wakeups++;
+        for (int i = 0; i < count; i++) {
+            auto id = events[i].data.u32;
+            if (id == STOPID) {
+                // drained, or the next start() would see this stop and end at once
+                uint64_t stops;
+                if (read(stopFd, &stops, sizeof(stops)) < 0)
+                    MATRIXLOG(warning) << "[SensorHub] can't reset the stop event: " << strerror(errno);
+                return;
+            }
+            if (id == TIMERID) {
+                uint64_t expirations;
+                if (read(timerFd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+                    return;
+                runPolls();
+            } else if (id < sources.size()) {
+                run(*sources[id], FrameTimer::nowNs());
+            }
+        }
+    }
+}
+
+// runs every poll which is due, or will be due within the slack
+void SensorHub::runPolls() {
+    auto now = FrameTimer::nowNs();
+    for (auto &source : sources) {
+        if (source->periodNs == 0 || source->deadline > now + SENSORHUBSLACK)
+            continue;
+        run(*source, source->deadline);
+        // skip deadlines the hub could not keep instead of running the poll several times in a row
+        source->deadline += source->periodNs;
+        auto finished = FrameTimer::nowNs();
+        if (source->deadline <= finished) {
+            auto missed = (finished - source->deadline) / source->periodNs + 1;
+            source->deadline += missed * source->periodNs;
+            source->stats.missedPolls += missed;
+            source->published.store(source->stats);
+        }
+    }
+    armTimer();
+}
+
+void SensorHub::run(Source &source, int64_t deadline) {
+    auto begin = FrameTimer::nowNs();
+    bool success = source.callback();
+    auto end = FrameTimer::nowNs();
+    auto &stats = source.stats;
+    stats.polls++;
+    if (!success)
+        stats.failures++;
+    stats.lastTimestamp = begin;
+    stats.lastLatencyNs = begin - deadline;
+    if (stats.lastLatencyNs > stats.maxLatencyNs)
+        stats.maxLatencyNs = stats.lastLatencyNs;
+    stats.lastDurationNs = end - begin;
+    source.published.store(stats);
+}
+
+void SensorHub::armTimer() {
+    int64_t next = INT64_MAX;
+    for (auto &source : sources) {
+        if (source->periodNs > 0 && source->deadline < next)
+            next = source->deadline;
+    }
+    if (next == INT64_MAX)
+        return;
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = next / NSPERSEC;
+    spec.it_value.tv_nsec = next % NSPERSEC;
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+SensorStats SensorHub::getStats(int id) {
+    if (id < 0 || id >= (int) sources.size()) {
+        SensorStats empty;
+        memset(&empty, 0, sizeof(empty));
+        return empty;
+    }
+    return sources[id]->published.load();
+}
+
+std::string SensorHub::getName(int id) {
+    if (id < 0 || id >= (int) sources.size())
+        return "";
+    return sources[id]->name;
+}
+
+uint64_t SensorHub::getWakeups() {
+    return wakeups;
+}
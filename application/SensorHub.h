@@ -0,0 +1,94 @@
+#ifndef MATRIXSERVER_SENSORHUB_H
+#define MATRIXSERVER_SENSORHUB_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <stdint.h>
+#include <boost/thread/thread.hpp>
+
+#include <SeqLock.h>
+
+#define SENSORHUBSLACK 2000000 //ns, polls due within this window run in the same wakeup
+
+struct SensorStats {
+    uint64_t polls;
+    uint64_t failures;      // poll or handler returned false
+    uint64_t missedPolls;   // deadlines dropped because the hub fell behind
+    uint64_t lastTimestamp; // CLOCK_MONOTONIC ns of the last poll
+    int64_t lastLatencyNs;  // poll start - deadline
+    int64_t maxLatencyNs;
+    int64_t lastDurationNs;
+};
+
+/*
+ * Runs the polling of all sensors of a process on a single thread. Periodic polls are scheduled on
+ * one absolute CLOCK_MONOTONIC timerfd against a common time base, so polls with related rates fall
+ * into the same wakeup and their I2C transfers run back to back. Event driven sources (serial
+ * ports, the joystick reactor) are waited for with epoll on the same thread.
+ * Devices publish their samples themselves (SampleChannel, seqlocks), the hub only drives them:
+ *
+ *   SensorHub hub;
+ *   hub.addDevice("mpu6050", mpu);           // anything with poll() and getPollRate()
+ *   hub.addFd("imu", imu.getFd(), [&]() { return imu.handleInput(); });
+ *   hub.start();
+ *
+ * Register everything before start().
+ */
+class SensorHub {
+public:
+    SensorHub();
+
+    ~SensorHub();
+
+    int addPoll(std::string name, unsigned int rateHz, std::function<bool()> poll);
+
+    // the handler runs once at start and whenever fd is readable
+    int addFd(std::string name, int fd, std::function<bool()> handler);
+
+    template<typename T>
+    int addDevice(std::string name, T &device) {
+        return addPoll(name, device.getPollRate(), [&device]() { return device.poll(); });
+    }
+
+    void start();
+
+    void stop();
+
+    SensorStats getStats(int id);
+
+    std::string getName(int id);
+
+    uint64_t getWakeups();
+
+private:
+    struct Source {
+        std::string name;
+        int fd;
+        int64_t periodNs;
+        int64_t deadline;
+        std::function<bool()> callback;
+        SensorStats stats; // hub thread only
+        SeqLock<SensorStats> published;
+    };
+
+    void internalLoop();
+
+    void runPolls();
+
+    void run(Source &source, int64_t deadline);
+
+    void armTimer();
+
+    std::vector<std::unique_ptr<Source>> sources;
+    int epollFd;
+    int timerFd;
+    int stopFd;
+    boost::thread *thread_;
+    std::atomic<uint64_t> wakeups;
+};
+
+
+#endif //MATRIXSERVER_SENSORHUB_H
@@ -0,0 +1,61 @@
+#ifndef MATRIXSERVER_APPPLUGIN_H
+#define MATRIXSERVER_APPPLUGIN_H
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <functional>
+#include <Screen.h>
+#include <InputState.h>
+#include <matrixserver.pb.h>
+
+/*
+ * ABI of apps which the server loads as shared objects and runs in-process. The server owns the
+ * thread and the screens, the app draws into them in loop() and the server renders them directly,
+ * without any transport. Only meant for trusted apps: a plugin shares the address space with the
+ * server, the watchdog can stop a hung or crashed plugin but not undo what it wrote.
+ * Server and plugin have to be built against the same headers, the version guards this.
+ *
+ *   class Clock : public CubeApplication { ... };   // built with MATRIXAPPLICATION_PLUGIN
+ *   MATRIXAPPLICATION_PLUGIN_EXPORT(Clock)
+ */
+
+#define APPPLUGINABIVERSION 2
+
+#define APPPLUGINABISYMBOL "matrixPluginAbiVersion"
+#define APPPLUGINCREATESYMBOL "matrixPluginCreate"
+#define APPPLUGINDESTROYSYMBOL "matrixPluginDestroy"
+
+// starts another app through the server's launcher (what MainMenu does), false if it wasn't started
+typedef std::function<bool(const std::string &path)> AppLaunchFunction;
+
+class IAppPlugin {
+public:
+    virtual ~IAppPlugin() = default;
+
+    // once before the first loop(), on the plugin thread, the screens belong to the server
+    virtual void attach(std::vector<std::shared_ptr<Screen>> screens, const matrixserver::ServerConfig &serverConfig) = 0;
+
+    // one frame, false ends the app
+    virtual bool loop() = 0;
+
+    virtual int getFps() = 0;
+
+    // called by the server's input thread while the plugin is in the foreground
+    virtual void setInput(const InputState &input) = 0;
+
+    // before attach(), may be called from the plugin thread
+    virtual void setLauncher(AppLaunchFunction launch) = 0;
+};
+
+typedef int (*AppPluginAbiFunction)();
+typedef IAppPlugin *(*AppPluginCreateFunction)();
+typedef void (*AppPluginDestroyFunction)(IAppPlugin *);
+
+#define MATRIXAPPLICATION_PLUGIN_EXPORT(AppClass) \
+    extern "C" int matrixPluginAbiVersion() { return APPPLUGINABIVERSION; } \
+    extern "C" IAppPlugin *matrixPluginCreate() { return new AppClass(); } \
+    extern "C" void matrixPluginDestroy(IAppPlugin *app) { delete app; }
+
+
+#endif //MATRIXSERVER_APPPLUGIN_H
@@ -0,0 +1,55 @@
+#include "ClockSync.h"
+
+ClockOffsetEstimator::ClockOffsetEstimator() : next(0), count(0), best{0, 0} {
+    samples.reserve(CLOCKSYNCSAMPLES);
+}
+
+void ClockOffsetEstimator::addSample(int64_t t0, int64_t t1, int64_t t2, int64_t t3) {
+    ClockSyncSample sample;
+    sample.offsetNs = ((t1 - t0) + (t2 - t3)) / 2;
+    sample.delayNs = (t3 - t0) - (t2 - t1);
+    if (sample.delayNs < 0)
+        sample.delayNs = 0; // the remote side answered faster than the local clock ticked
+    if (samples.size() < CLOCKSYNCSAMPLES)
+        samples.push_back(sample);
+    else
+        samples[next] = sample;
+    next = (next + 1) % CLOCKSYNCSAMPLES;
+    count++;
+    best = samples[0];
+    for (auto &candidate : samples) {
+        if (candidate.delayNs < best.delayNs)
+            best = candidate;
+    }
+}
+
+bool ClockOffsetEstimator::isSynchronized() {
+    return count > 0;
+}
+
+int64_t ClockOffsetEstimator::getOffsetNs() {
+    return best.offsetNs;
+}
+
+int64_t ClockOffsetEstimator::getDelayNs() {
+    return best.delayNs;
+}
+
+uint64_t ClockOffsetEstimator::getSampleCount() {
+    return count;
+}
+
+int64_t ClockOffsetEstimator::toLocal(int64_t remoteNs) {
+    return remoteNs - best.offsetNs;
+}
+
+int64_t ClockOffsetEstimator::toRemote(int64_t localNs) {
+    return localNs + best.offsetNs;
+}
+
+void ClockOffsetEstimator::reset() {
+    samples.clear();
+    next = 0;
+    count = 0;
+    best = {0, 0};
+}
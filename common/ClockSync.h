@@ -0,0 +1,53 @@
+#ifndef MATRIXSERVER_CLOCKSYNC_H
+#define MATRIXSERVER_CLOCKSYNC_H
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#define CLOCKSYNCSAMPLES 16 // exchanges the estimate is taken from, the oldest one is replaced
+
+struct ClockSyncSample {
+    int64_t offsetNs; // remote clock - local clock
+    int64_t delayNs;  // round trip without the time the remote side took to answer
+};
+
+/*
+ * Estimates the offset of a remote CLOCK_MONOTONIC from exchanges like NTP: the local side sends
+ * at t0, the remote side receives at t1 and answers at t2, the answer arrives at t3. The offset of
+ * one exchange is ((t1 - t0) + (t2 - t3)) / 2, off by at most half its round trip, so the exchange
+ * with the shortest round trip of the last CLOCKSYNCSAMPLES is taken, delays from a busy network or
+ * scheduler only make an exchange lose.
+ */
+class ClockOffsetEstimator {
+public:
+    ClockOffsetEstimator();
+
+    // all four in ns, t0 and t3 on the local clock, t1 and t2 on the remote one
+    void addSample(int64_t t0, int64_t t1, int64_t t2, int64_t t3);
+
+    bool isSynchronized();
+
+    // remote clock - local clock
+    int64_t getOffsetNs();
+
+    // round trip of the exchange the offset is taken from, the offset is known within half of it
+    int64_t getDelayNs();
+
+    uint64_t getSampleCount();
+
+    int64_t toLocal(int64_t remoteNs);
+
+    int64_t toRemote(int64_t localNs);
+
+    void reset();
+
+private:
+    std::vector<ClockSyncSample> samples;
+    size_t next;
+    uint64_t count;
+    ClockSyncSample best;
+};
+
+
+#endif //MATRIXSERVER_CLOCKSYNC_H
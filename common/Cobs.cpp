@@ -1,6 +1,8 @@
 #include "Cobs.h"
 
-#include <boost/log/trivial.hpp>
+#include <Log.h>
+#include <cstring>
+#include <algorithm>
 
 ///* Stuffs "length" bytes of data at the location pointed to by
 // * "input", writing the output to the location pointed to by
@@ -69,36 +71,56 @@
 
 Cobs::Cobs(int bufferSize) {
     internalStreamBuffer.reserve(bufferSize);
+    decodedPacket.reserve(bufferSize);
 }
 
 std::vector<std::string> Cobs::insertBytesAndReturnDecodedPackets(const uint8_t *inputData, size_t length) {
-//    BOOST_LOG_TRIVIAL(trace) << "[Cobs] Insert data with length " << length;
-    std::lock_guard<std::mutex> lock(internalStreamBufferLock);
     std::vector<std::string> result;
-    internalStreamBuffer.reserve(internalStreamBuffer.size()+length);
-    int zeroCounter = 0;
-    for (int i = 0; i < length; i++) {
-        if (inputData[i] != 0) {
-            internalStreamBuffer.push_back(inputData[i]);
-        } else {
-//            BOOST_LOG_TRIVIAL(trace) << "[Cobs] Received 0 packet delimiter";
-            zeroCounter++;
-            internalStreamBuffer.push_back(0);
-            if(internalStreamBuffer.size() > 2){
-                result.push_back(decode(internalStreamBuffer));
-                BOOST_LOG_TRIVIAL(trace) << "[Cobs] Received 0 packet delimiter & bufferlen > 2 : " << internalStreamBuffer.size();
-            }
+    insertBytes(inputData, length, [&result](const std::string &packet) { result.push_back(packet); });
+    return result;
+}
 
-            internalStreamBuffer.clear();
+// the packet passed to packetCallback is only valid during the callback, its buffer is reused for the next packet
+void Cobs::insertBytes(const uint8_t *inputData, size_t length, std::function<void(const std::string &)> packetCallback) {
+//    MATRIXLOG(trace) << "[Cobs] Insert data with length " << length;
+    std::lock_guard<std::mutex> lock(internalStreamBufferLock);
+    int zeroCounter = 0;
+    size_t pos = 0;
+    while (pos < length) {
+        auto zero = (const uint8_t *) memchr(inputData + pos, 0, length - pos);
+        size_t end = zero != nullptr ? zero - inputData : length;
+        internalStreamBuffer.append((const char *) inputData + pos, end - pos);
+        if (zero == nullptr)
+            break;
+//        MATRIXLOG(trace) << "[Cobs] Received 0 packet delimiter";
+        zeroCounter++;
+        internalStreamBuffer.push_back(0);
+        if (internalStreamBuffer.size() > 2) {
+            decode(internalStreamBuffer, decodedPacket);
+            MATRIXLOG(trace) << "[Cobs] Received 0 packet delimiter & bufferlen > 2 : " << internalStreamBuffer.size();
+            packetCallback(decodedPacket);
         }
+        internalStreamBuffer.clear();
+        pos = end + 1;
     }
-    BOOST_LOG_TRIVIAL(trace) << "[Cobs] Received a total of " << zeroCounter << " zero-packet delimiters";
-    return result;
+    MATRIXLOG(trace) << "[Cobs] Received a total of " << zeroCounter << " zero-packet delimiters";
 }
 
 const std::string Cobs::encode(std::string input) {
     std::string result;
-    result.resize(COBS_ENCODE_DST_BUF_LEN_MAX(input.size())+100, 0x0);
+    encode(input, result);
+    return result;
+}
+
+const std::string Cobs::decode(std::string input) {
+    std::string result;
+    decode(input, result);
+    return result;
+}
+
+// output keeps its capacity between calls, so encoding into the same string doesn't allocate
+void Cobs::encode(const std::string &input, std::string &output) {
+    output.resize(COBS_ENCODE_DST_BUF_LEN_MAX(input.size()) + 2);
 
     size_t write_index = 1;
     size_t code_index = 0;
@@ -107,40 +129,39 @@ const std::string Cobs::encode(std::string input) {
     auto readIndex = input.begin();
     while(readIndex < input.end()) {
         if (*readIndex == 0) {
-            result.at(code_index) = code;
+            output[code_index] = code;
             code = 1;
             code_index = write_index++;
             readIndex++;
         } else {
-            result.at(write_index++) = *readIndex++;
+            output[write_index++] = *readIndex++;
             code++;
             if (code == 0xFF) {
-                result.at(code_index) = code;
+                output[code_index] = code;
                 code = 1;
                 code_index = write_index++;
             }
         }
     }
 
-    result.at(code_index) = code;
-    result.resize(write_index+1);
-//    result.push_back(0x00); //zero delimiter
-    return result;
+    output[code_index] = code;
+    output[write_index] = 0x00; //zero delimiter
+    output.resize(write_index+1);
 }
 
-const std::string Cobs::decode(std::string input) {
-    std::string result;
-    result.reserve(COBS_DECODE_DST_BUF_LEN_MAX(input.size()));
+void Cobs::decode(const std::string &input, std::string &output) {
+    output.clear();
+    output.reserve(COBS_DECODE_DST_BUF_LEN_MAX(input.size()));
     auto readIndex = input.begin();
     while(readIndex < input.end()) {
         uint8_t code = *readIndex++;
-        for (auto i = 1; i < code; i++) {
-            result.push_back(*readIndex++);
-        }
+        size_t blockLength = std::min<size_t>(code > 0 ? code - 1 : 0, input.end() - readIndex);
+        output.append(readIndex, readIndex + blockLength);
+        readIndex += blockLength;
         if (code != 0xFF && readIndex != input.end()) {
-            result.push_back((char) 0);
+            output.push_back((char) 0);
         }
     }
-    result.pop_back(); //remove last 0
-    return result;
+    if (!output.empty())
+        output.pop_back(); //remove last 0
 }
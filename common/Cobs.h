@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <mutex>
+#include <functional>
 
 #define COBS_ENCODE_DST_BUF_LEN_MAX(SRC_LEN)            ((SRC_LEN) + (((SRC_LEN) + 253u)/254u))
 #define COBS_DECODE_DST_BUF_LEN_MAX(SRC_LEN)            (((SRC_LEN) == 0) ? 0u : ((SRC_LEN) - 1u))
@@ -14,10 +15,14 @@ class Cobs {
 public:
     Cobs(int bufferSize);
     std::vector<std::string> insertBytesAndReturnDecodedPackets(const uint8_t *inputData, size_t length);
+    void insertBytes(const uint8_t *inputData, size_t length, std::function<void(const std::string &)> packetCallback);
     static const std::string decode(std::string input);
     static const std::string encode(const std::string input);
+    static void decode(const std::string &input, std::string &output);
+    static void encode(const std::string &input, std::string &output);
 private:
     std::string internalStreamBuffer;
+    std::string decodedPacket;
     std::mutex internalStreamBufferLock;
 };
 
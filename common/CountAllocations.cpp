@@ -0,0 +1,112 @@
+#include "Metrics.h"
+
+#include <cstdlib>
+#include <new>
+
+/*
+ * Replaces every global operator new and delete with malloc and free, and counts the allocations for
+ * Metrics::getAllocations. Only linked in with MATRIXSERVER_COUNTALLOCATIONS and into the tests, all variants
+ * are replaced so no allocation is freed by a different allocator.
+ */
+
+static void *countedAlloc(size_t size) {
+    Metrics::countAllocation();
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new(size_t size) {
+    void *p = countedAlloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return countedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return countedAlloc(size);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+#ifdef __cpp_aligned_new
+static void *countedAlignedAlloc(size_t size, std::align_val_t alignment) {
+    Metrics::countAllocation();
+    size_t align = (size_t) alignment < sizeof(void *) ? sizeof(void *) : (size_t) alignment;
+    void *p = nullptr;
+    if (posix_memalign(&p, align, size == 0 ? 1 : size) != 0)
+        return nullptr;
+    return p;
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    void *p = countedAlignedAlloc(size, alignment);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return countedAlignedAlloc(size, alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return countedAlignedAlloc(size, alignment);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+#endif
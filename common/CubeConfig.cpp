@@ -0,0 +1,71 @@
+#include "CubeConfig.h"
+
+#include <fstream>
+#include <sstream>
+#include <Log.h>
+#include <google/protobuf/util/json_util.h>
+
+void createDefaultCubeConfig(matrixserver::ServerConfig &serverConfig) {
+    serverConfig.Clear();
+    serverConfig.set_globalscreenbrightness(100);
+    serverConfig.set_servername("matrixserver");
+    matrixserver::Connection *serverConnection = new matrixserver::Connection();
+    serverConnection->set_serveraddress("127.0.0.1");
+    serverConnection->set_serverport("2017");
+    serverConnection->set_connectiontype(matrixserver::Connection_ConnectionType_tcp);
+    serverConfig.set_allocated_serverconnection(serverConnection);
+    serverConfig.set_assemblytype(matrixserver::ServerConfig_AssemblyType_cube);
+    for (int i = 0; i < 6; i++) {
+        auto screenInfo = serverConfig.add_screeninfo();
+        screenInfo->set_screenid(i);
+        screenInfo->set_available(true);
+        screenInfo->set_height(64);
+        screenInfo->set_width(64);
+        screenInfo->set_screenorientation((matrixserver::ScreenInfo_ScreenOrientation) (i + 1));
+    }
+}
+
+bool loadServerConfig(int argc, char **argv, matrixserver::ServerConfig &serverConfig) {
+    if (argc == 2) {
+        MATRIXLOG(debug) << "[Server] Trying to read config from: " << argv[1];
+        std::ifstream configFileReadStream(argv[1]);
+        std::stringstream buffer;
+        buffer << configFileReadStream.rdbuf();
+        if (google::protobuf::util::JsonStringToMessage(buffer.str(), &serverConfig).ok()) {
+            MATRIXLOG(debug) << "[Server] ServerConfig successfully read from: " << argv[1];
+            return true;
+        }
+        MATRIXLOG(debug) << "[Server] ServerConfig read failed from: " << argv[1];
+        return false;
+    }
+    MATRIXLOG(debug) << "[Server] creating default config";
+    createDefaultCubeConfig(serverConfig);
+    std::string configString;
+    google::protobuf::util::JsonOptions jsonOptions;
+    jsonOptions.add_whitespace = true;
+    jsonOptions.always_print_primitive_fields = true;
+    if (google::protobuf::util::MessageToJsonString(serverConfig, &configString, jsonOptions).ok()) {
+        std::ofstream configFileWriteStream(DEFAULTCONFIGFILE, std::ios_base::trunc);
+        configFileWriteStream << configString;
+        configFileWriteStream.close();
+        MATRIXLOG(debug) << "[Server] written default config to " << DEFAULTCONFIGFILE;
+    }
+    return true;
+}
+
+std::vector<std::shared_ptr<Screen>> createScreens(const matrixserver::ServerConfig &serverConfig,
+                                                   const CubeLayout *layout) {
+    std::vector<std::shared_ptr<Screen>> screens;
+    for (const auto &screenInfo : serverConfig.screeninfo()) {
+        auto screen = std::make_shared<Screen>(screenInfo.width(), screenInfo.height(), screenInfo.screenid());
+        int side = (int) screenInfo.screenorientation() - 1;
+        if (layout != nullptr && side >= 0 && side < (int) layout->size()) {
+            const auto &placement = (*layout)[side];
+            screen->setOffsetX(placement.offsetX);
+            screen->setOffsetY(placement.offsetY);
+            screen->setRotation(placement.rotation);
+        }
+        screens.push_back(screen);
+    }
+    return screens;
+}
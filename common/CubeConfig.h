@@ -0,0 +1,34 @@
+#ifndef MATRIXSERVER_CUBECONFIG_H
+#define MATRIXSERVER_CUBECONFIG_H
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <Screen.h>
+#include <matrixserver.pb.h>
+
+#define DEFAULTCONFIGFILE "matrixServerConfig.json"
+
+// where the frame of one cube side ends up in the renderer's buffer
+struct ScreenPlacement {
+    int offsetX;
+    int offsetY;
+    Rotation rotation;
+};
+
+// placements indexed by ScreenOrientation - 1: front, right, back, left, top, bottom
+typedef std::array<ScreenPlacement, 6> CubeLayout;
+
+// six 64x64 screens, tcp on 127.0.0.1:2017
+void createDefaultCubeConfig(matrixserver::ServerConfig &serverConfig);
+
+// reads the json config given as the only argument, otherwise writes the default config to DEFAULTCONFIGFILE
+bool loadServerConfig(int argc, char **argv, matrixserver::ServerConfig &serverConfig);
+
+// one screen per screenInfo, placed by layout (no offsets or rotation without one)
+std::vector<std::shared_ptr<Screen>> createScreens(const matrixserver::ServerConfig &serverConfig,
+                                                   const CubeLayout *layout = nullptr);
+
+
+#endif //MATRIXSERVER_CUBECONFIG_H
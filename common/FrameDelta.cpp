@@ -0,0 +1,50 @@
+#include "FrameDelta.h"
+
+#include <cstring>
+
+static inline bool sameWord(const uint8_t *a, const uint8_t *b) {
+    uint64_t x, y;
+    memcpy(&x, a, 8);
+    memcpy(&y, b, 8);
+    return x == y;
+}
+
+size_t encodeFrameDelta(const uint8_t *previous, const uint8_t *current, size_t length, uint8_t *out) {
+    size_t written = 0;
+    size_t i = 0;
+    while (i < length) {
+        while (i + 8 <= length && sameWord(previous + i, current + i))
+            i += 8;
+        while (i < length && previous[i] == current[i])
+            i++;
+        if (i >= length)
+            break;
+        // the span ends with FRAMEDELTAGAP unchanged bytes, shorter gaps are cheaper to copy than a new span
+        size_t start = i, stop = i;
+        while (i < length && i - stop < FRAMEDELTAGAP) {
+            if (previous[i] != current[i])
+                stop = i + 1;
+            i++;
+        }
+        uint32_t span[2] = {(uint32_t) start, (uint32_t) (stop - start)};
+        memcpy(out + written, span, sizeof(span));
+        memcpy(out + written + sizeof(span), current + start, stop - start);
+        written += sizeof(span) + stop - start;
+        i = stop;
+    }
+    return written;
+}
+
+bool applyFrameDelta(uint8_t *screen, size_t length, const uint8_t *delta, size_t deltaLength) {
+    size_t position = 0;
+    while (position + 8 <= deltaLength) {
+        uint32_t span[2];
+        memcpy(span, delta + position, sizeof(span));
+        position += sizeof(span);
+        if ((size_t) span[0] + span[1] > length || position + span[1] > deltaLength)
+            return false;
+        memcpy(screen + span[0], delta + position, span[1]);
+        position += span[1];
+    }
+    return position == deltaLength;
+}
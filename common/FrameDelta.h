@@ -0,0 +1,23 @@
+#ifndef MATRIXSERVER_FRAMEDELTA_H
+#define MATRIXSERVER_FRAMEDELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAMEDELTAGAP 16 // unchanged bytes shorter than this don't end a span, a new span costs 8 bytes
+#define FRAMEDELTAMAXSIZE(LENGTH) ((LENGTH) + 8 * ((LENGTH) / FRAMEDELTAGAP + 1)) // the longest delta of a screen
+
+/*
+ * Delta of a screen against the previous frame of the same screen: spans of changed bytes, each as
+ * [offset, uint32][length, uint32][length bytes] in host byte order. An unchanged screen is an empty
+ * delta. Captures store it (CaptureRecord::delta), cluster leaders send it to their followers.
+ */
+
+// writes the delta to out (FRAMEDELTAMAXSIZE(length) bytes), returns its length
+size_t encodeFrameDelta(const uint8_t *previous, const uint8_t *current, size_t length, uint8_t *out);
+
+// applies the delta to the previous frame in screen, false if it doesn't fit the screen
+bool applyFrameDelta(uint8_t *screen, size_t length, const uint8_t *delta, size_t deltaLength);
+
+
+#endif //MATRIXSERVER_FRAMEDELTA_H
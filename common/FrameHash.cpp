@@ -0,0 +1,73 @@
+#include "FrameHash.h"
+
+#include <cstring>
+
+static const uint64_t PRIME1 = 11400714785074694791ULL;
+static const uint64_t PRIME2 = 14029467366897019727ULL;
+static const uint64_t PRIME3 = 1609587929392839161ULL;
+static const uint64_t PRIME4 = 9650029242287828579ULL;
+static const uint64_t PRIME5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const uint8_t *data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value)); // unaligned, little endian on all our targets
+    return value;
+}
+
+static inline uint32_t read32(const uint8_t *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint64_t accumulate(uint64_t accumulator, uint64_t input) {
+    accumulator += input * PRIME2;
+    return rotl(accumulator, 31) * PRIME1;
+}
+
+static inline uint64_t merge(uint64_t accumulator, uint64_t lane) {
+    accumulator ^= accumulate(0, lane);
+    return accumulator * PRIME1 + PRIME4;
+}
+
+uint64_t frameHash(const void *data, size_t length, uint64_t seed) {
+    auto *position = static_cast<const uint8_t *>(data);
+    auto *end = position + length;
+    uint64_t hash;
+
+    if (length >= 32) {
+        uint64_t lanes[4] = {seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1};
+        auto *limit = end - 32;
+        do {
+            for (int lane = 0; lane < 4; lane++)
+                lanes[lane] = accumulate(lanes[lane], read64(position + lane * 8));
+            position += 32;
+        } while (position <= limit);
+        hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+        for (int lane = 0; lane < 4; lane++)
+            hash = merge(hash, lanes[lane]);
+    } else {
+        hash = seed + PRIME5;
+    }
+    hash += length;
+
+    for (; position + 8 <= end; position += 8)
+        hash = rotl(hash ^ accumulate(0, read64(position)), 27) * PRIME1 + PRIME4;
+    if (position + 4 <= end) {
+        hash = rotl(hash ^ (read32(position) * PRIME1), 23) * PRIME2 + PRIME3;
+        position += 4;
+    }
+    for (; position < end; position++)
+        hash = rotl(hash ^ (*position * PRIME5), 11) * PRIME1;
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,15 @@
+#ifndef MATRIXSERVER_FRAMEHASH_H
+#define MATRIXSERVER_FRAMEHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * 64 bit xxHash (XXH64) of a buffer. Four independent lanes eat 32 bytes per round, so the
+ * loop runs at memory speed, a 64x64 screen takes a few microseconds. Used to recognize
+ * frames which are byte-identical to the last one, not for anything security related.
+ */
+uint64_t frameHash(const void *data, size_t length, uint64_t seed = 0);
+
+
+#endif //MATRIXSERVER_FRAMEHASH_H
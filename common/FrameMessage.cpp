@@ -0,0 +1,28 @@
+#include "FrameMessage.h"
+
+FrameMessage::FrameMessage() {
+    message = std::make_shared<matrixserver::MatrixServerMessage>();
+    message->set_messagetype(matrixserver::setScreenFrame);
+}
+
+std::shared_ptr<matrixserver::MatrixServerMessage>
+FrameMessage::encode(std::vector<std::shared_ptr<Screen>> &screens, int appId) {
+    message->set_appid(appId);
+    if (message->screendata_size() != (int) screens.size()) {
+        message->clear_screendata();
+        for (unsigned int i = 0; i < screens.size(); i++)
+            message->add_screendata()->set_encoding(matrixserver::ScreenData_Encoding_rgb24bbp);
+    }
+    for (unsigned int i = 0; i < screens.size(); i++) {
+        auto screenData = message->mutable_screendata(i);
+        screenData->set_screenid(screens[i]->getScreenId());
+        // assign() reuses the capacity of the last frame, set_framedata() would build a temporary string
+        screenData->mutable_framedata()->assign((char *) screens[i]->getScreenDataRaw(),
+                                                screens[i]->getScreenDataSize() * sizeof(Color));
+    }
+    return message;
+}
+
+std::shared_ptr<matrixserver::MatrixServerMessage> FrameMessage::getMessage() {
+    return message;
+}
@@ -0,0 +1,28 @@
+#ifndef MATRIXSERVER_FRAMEMESSAGE_H
+#define MATRIXSERVER_FRAMEMESSAGE_H
+
+#include <vector>
+#include <memory>
+#include <matrixserver.pb.h>
+#include "Screen.h"
+
+/*
+ * A setScreenFrame message which is built once and then refilled every frame.
+ * The ScreenData children and their frameData strings are kept, so in the steady state
+ * encoding a frame is a memcpy per screen without any heap allocation.
+ * The message must not be refilled before the previous sendMessage() returned.
+ */
+class FrameMessage {
+public:
+    FrameMessage();
+
+    std::shared_ptr<matrixserver::MatrixServerMessage> encode(std::vector<std::shared_ptr<Screen>> &screens, int appId = 0);
+
+    std::shared_ptr<matrixserver::MatrixServerMessage> getMessage();
+
+private:
+    std::shared_ptr<matrixserver::MatrixServerMessage> message;
+};
+
+
+#endif //MATRIXSERVER_FRAMEMESSAGE_H
@@ -0,0 +1,202 @@
+#include "FrameMirror.h"
+
+#include <new>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <Log.h>
+
+#define FRAMEMIRRORALIGNMENT 64
+
+FrameMirrorWriter::FrameMirrorWriter() : header(nullptr), size(0) {
+
+}
+
+FrameMirrorWriter::~FrameMirrorWriter() {
+    close();
+}
+
+bool FrameMirrorWriter::open(const std::string &setName, const std::vector<std::shared_ptr<Screen>> &screens) {
+    close();
+    if (screens.size() > FRAMEMIRRORMAXSCREENS) {
+        MATRIXLOG(warning) << "[FrameMirror] " << screens.size() << " screens, at most " << FRAMEMIRRORMAXSCREENS
+                           << " can be mirrored";
+        return false;
+    }
+    size_t layoutSize = (sizeof(FrameMirrorHeader) + FRAMEMIRRORALIGNMENT - 1) / FRAMEMIRRORALIGNMENT * FRAMEMIRRORALIGNMENT;
+    std::vector<uint32_t> offsets;
+    for (auto &screen : screens) {
+        offsets.push_back(layoutSize);
+        layoutSize += (screen->getScreenDataSize() * sizeof(Color) + FRAMEMIRRORALIGNMENT - 1) / FRAMEMIRRORALIGNMENT *
+                      FRAMEMIRRORALIGNMENT;
+    }
+    shm_unlink(setName.c_str()); // a segment left by a server which didn't exit cleanly
+    // read-only for everybody else, the viewers can't disturb the server
+    int fd = shm_open(setName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        MATRIXLOG(warning) << "[FrameMirror] can't create " << setName << ": " << strerror(errno);
+        return false;
+    }
+    if (ftruncate(fd, layoutSize) != 0) {
+        MATRIXLOG(warning) << "[FrameMirror] can't size " << setName << ": " << strerror(errno);
+        ::close(fd);
+        shm_unlink(setName.c_str());
+        return false;
+    }
+    void *mapping = mmap(nullptr, layoutSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        MATRIXLOG(warning) << "[FrameMirror] can't map " << setName << ": " << strerror(errno);
+        shm_unlink(setName.c_str());
+        return false;
+    }
+    name = setName;
+    size = layoutSize;
+    header = new(mapping) FrameMirrorHeader(); // the pixels are zero, black
+    header->version = FRAMEMIRRORVERSION;
+    header->screenCount = screens.size();
+    header->size = layoutSize;
+    header->brightness = 100;
+    for (size_t i = 0; i < screens.size(); i++) {
+        header->screens[i].screenId = screens[i]->getScreenId();
+        header->screens[i].width = screens[i]->getWidth();
+        header->screens[i].height = screens[i]->getHeight();
+        header->screens[i].offset = offsets[i];
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = FRAMEMIRRORMAGIC; // readers only trust the layout once it is set
+    MATRIXLOG(info) << "[FrameMirror] mirroring the frames to " << name;
+    return true;
+}
+
+void FrameMirrorWriter::close() {
+    if (header == nullptr)
+        return;
+    munmap(header, size);
+    shm_unlink(name.c_str());
+    header = nullptr;
+    size = 0;
+}
+
+bool FrameMirrorWriter::isOpen() {
+    return header != nullptr;
+}
+
+void FrameMirrorWriter::setScreen(int index, const Color *data) {
+    if (header == nullptr || index < 0 || index >= (int) header->screenCount)
+        return;
+    const auto &screen = header->screens[index];
+    memcpy((uint8_t *) header + screen.offset, data, screen.width * screen.height * sizeof(Color));
+}
+
+void FrameMirrorWriter::begin() {
+    if (header == nullptr)
+        return;
+    auto sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void FrameMirrorWriter::end(int64_t timestampNs, int brightness) {
+    if (header == nullptr)
+        return;
+    header->frames++;
+    header->timestampNs = timestampNs;
+    header->brightness = brightness;
+    header->sequence.store(header->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+FrameMirrorReader::FrameMirrorReader() : header(nullptr), size(0) {
+
+}
+
+FrameMirrorReader::~FrameMirrorReader() {
+    close();
+}
+
+bool FrameMirrorReader::open(const std::string &name) {
+    close();
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t) status.st_size < sizeof(FrameMirrorHeader)) {
+        ::close(fd);
+        return false;
+    }
+    void *mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    auto *mapped = (const FrameMirrorHeader *) mapping;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (mapped->magic != FRAMEMIRRORMAGIC || mapped->version != FRAMEMIRRORVERSION ||
+        mapped->size != (size_t) status.st_size || mapped->screenCount > FRAMEMIRRORMAXSCREENS) {
+        MATRIXLOG(warning) << "[FrameMirror] " << name << " isn't a frame mirror of this version";
+        munmap(mapping, status.st_size);
+        return false;
+    }
+    header = mapped;
+    size = status.st_size;
+    return true;
+}
+
+void FrameMirrorReader::close() {
+    if (header == nullptr)
+        return;
+    munmap((void *) header, size);
+    header = nullptr;
+    size = 0;
+}
+
+bool FrameMirrorReader::isOpen() {
+    return header != nullptr;
+}
+
+std::vector<std::shared_ptr<Screen>> FrameMirrorReader::createScreens() {
+    std::vector<std::shared_ptr<Screen>> screens;
+    if (header == nullptr)
+        return screens;
+    for (uint32_t i = 0; i < header->screenCount; i++) {
+        const auto &screen = header->screens[i];
+        screens.push_back(std::make_shared<Screen>(screen.width, screen.height, screen.screenId));
+    }
+    return screens;
+}
+
+uint64_t FrameMirrorReader::getFrames() {
+    if (header == nullptr)
+        return 0;
+    return header->sequence.load(std::memory_order_acquire) / 2;
+}
+
+bool FrameMirrorReader::read(std::vector<std::shared_ptr<Screen>> &screens, FrameMirrorInfo &info) {
+    if (header == nullptr || screens.size() != header->screenCount)
+        return false;
+    for (uint32_t i = 0; i < header->screenCount; i++) {
+        if (screens[i]->getScreenDataSize() != header->screens[i].width * header->screens[i].height)
+            return false;
+    }
+    for (int tries = 0; tries < FRAMEMIRRORREADRETRIES; tries++) {
+        auto before = header->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            usleep(10);
+            continue;
+        }
+        info.frames = header->frames;
+        info.timestampNs = header->timestampNs;
+        info.brightness = header->brightness;
+        for (uint32_t i = 0; i < header->screenCount; i++) {
+            memcpy(screens[i]->getScreenDataRaw(), (const uint8_t *) header + header->screens[i].offset,
+                   screens[i]->getScreenDataSize() * sizeof(Color));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,106 @@
+#ifndef MATRIXSERVER_FRAMEMIRROR_H
+#define MATRIXSERVER_FRAMEMIRROR_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "Screen.h"
+
+#define FRAMEMIRRORMAGIC 0x4d53464d // "MFSM"
+#define FRAMEMIRRORVERSION 1
+#define FRAMEMIRRORMAXSCREENS 16
+#define FRAMEMIRRORDEFAULTNAME "/matrixserver-frame"
+#define FRAMEMIRRORREADRETRIES 1000 // a reader gives up after this many torn copies in a row
+
+struct FrameMirrorScreen {
+    int32_t screenId;
+    int32_t width;
+    int32_t height;
+    uint32_t offset; // of the pixels (Color, column major like Screen) from the start of the segment
+};
+
+// the start of the shared memory segment, the pixels of the screens follow
+struct FrameMirrorHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t screenCount;
+    uint32_t size; // of the whole segment
+    std::atomic<uint64_t> sequence; // odd while the server writes a frame
+    uint64_t frames; // published frames, only counts up
+    int64_t timestampNs; // CLOCK_MONOTONIC of the last frame
+    int32_t brightness; // the global brightness the renderers apply to the frame
+    int32_t reserved;
+    FrameMirrorScreen screens[FRAMEMIRRORMAXSCREENS];
+};
+
+struct FrameMirrorInfo {
+    uint64_t frames = 0;
+    int64_t timestampNs = 0;
+    int brightness = 100;
+};
+
+/*
+ * Publishes the rendered frame in a POSIX shared memory segment for local viewers (screenshots,
+ * monitors, health checks). The segment is guarded by a sequence counter like SeqLock: the server
+ * never waits for a reader and copies a frame once no matter how many readers there are, readers map
+ * it read-only and copy again if a frame was written meanwhile. Only one writer per segment.
+ */
+class FrameMirrorWriter {
+public:
+    FrameMirrorWriter();
+
+    ~FrameMirrorWriter();
+
+    // creates (or replaces) the segment /name with the layout of the screens
+    bool open(const std::string &name, const std::vector<std::shared_ptr<Screen>> &screens);
+
+    // removes the segment, readers which still map it keep the last frame
+    void close();
+
+    bool isOpen();
+
+    // between begin() and end(), index in the order of the screens given to open()
+    void setScreen(int index, const Color *data);
+
+    void begin();
+
+    void end(int64_t timestampNs, int brightness);
+
+private:
+    std::string name;
+    FrameMirrorHeader *header;
+    size_t size;
+};
+
+class FrameMirrorReader {
+public:
+    FrameMirrorReader();
+
+    ~FrameMirrorReader();
+
+    bool open(const std::string &name = FRAMEMIRRORDEFAULTNAME);
+
+    void close();
+
+    bool isOpen();
+
+    // screens with the layout of the segment, for read()
+    std::vector<std::shared_ptr<Screen>> createScreens();
+
+    // cheap poll for a new frame
+    uint64_t getFrames();
+
+    // a consistent copy of the last frame into screens from createScreens(), false if the server kept
+    // writing for FRAMEMIRRORREADRETRIES tries
+    bool read(std::vector<std::shared_ptr<Screen>> &screens, FrameMirrorInfo &info);
+
+private:
+    const FrameMirrorHeader *header;
+    size_t size;
+};
+
+
+#endif //MATRIXSERVER_FRAMEMIRROR_H
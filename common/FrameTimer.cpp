@@ -0,0 +1,112 @@
+#include "FrameTimer.h"
+
+#include <time.h>
+#include <errno.h>
+#include <cstdlib>
+
+#define NSPERSEC 1000000000LL
+
+FrameTimer::FrameTimer(int fps, FrameTimerPolicy setPolicy, long spinTimeUs) {
+    setFps(fps);
+    setSpinTime(spinTimeUs);
+    policy = setPolicy;
+    deadline = 0;
+    frameStart = 0;
+    started = false;
+}
+
+void FrameTimer::setFps(int fps) {
+    if (fps > 0)
+        periodNs = NSPERSEC / fps;
+}
+
+int FrameTimer::getFps() {
+    return (int) (NSPERSEC / periodNs);
+}
+
+void FrameTimer::setPolicy(FrameTimerPolicy setPolicy) {
+    policy = setPolicy;
+}
+
+FrameTimerPolicy FrameTimer::getPolicy() {
+    return policy;
+}
+
+void FrameTimer::setSpinTime(long spinTimeUs) {
+    spinNs = spinTimeUs > 0 ? spinTimeUs * 1000LL : 0;
+}
+
+void FrameTimer::start() {
+    frameStart = nowNs();
+    deadline = frameStart + periodNs;
+    started = true;
+}
+
+// sleeps until the end of the current frame, returns false if the frame overran its deadline
+bool FrameTimer::wait() {
+    if (!started)
+        start();
+    auto now = nowNs();
+    float load = (float) (now - frameStart) / (float) periodNs;
+    bool onTime = now <= deadline;
+    uint64_t skipped = 0;
+
+    if (!onTime) {
+        auto behind = (now - deadline) / periodNs;
+        if (policy == FrameTimerPolicy::skip || behind >= FRAMETIMER_MAXCATCHUPFRAMES) {
+            // drop the missed deadlines and continue on the next period boundary
+            skipped = behind + 1;
+            deadline += skipped * periodNs;
+        }
+    }
+
+    // catchUp keeps the missed deadline, so the next frame starts immediately
+    if (deadline > now)
+        sleepUntil(deadline);
+
+    auto wakeup = nowNs();
+    auto jitter = wakeup - deadline; // positive while catching up
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.frames++;
+        stats.load = load;
+        stats.skippedFrames += skipped;
+        if (!onTime)
+            stats.overruns++;
+        stats.lastJitterNs = jitter;
+        if (std::llabs(jitter) > stats.maxJitterNs)
+            stats.maxJitterNs = std::llabs(jitter);
+        stats.meanJitterNs += ((double) std::llabs(jitter) - stats.meanJitterNs) / (double) stats.frames;
+    }
+
+    frameStart = wakeup;
+    deadline += periodNs;
+    return onTime;
+}
+
+void FrameTimer::sleepUntil(int64_t deadlineNs) {
+    auto sleepTarget = deadlineNs - spinNs;
+    struct timespec ts;
+    ts.tv_sec = sleepTarget / NSPERSEC;
+    ts.tv_nsec = sleepTarget % NSPERSEC;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+    if (spinNs > 0) {
+        while (nowNs() < deadlineNs);
+    }
+}
+
+FrameTimerStats FrameTimer::getStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
+
+void FrameTimer::resetStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats = FrameTimerStats();
+}
+
+int64_t FrameTimer::nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * NSPERSEC + ts.tv_nsec;
+}
@@ -0,0 +1,72 @@
+#ifndef MATRIXSERVER_FRAMETIMER_H
+#define MATRIXSERVER_FRAMETIMER_H
+
+#include <stdint.h>
+#include <mutex>
+
+/*
+ * Paces a loop against absolute CLOCK_MONOTONIC deadlines (deadline += period), so the
+ * frame rate doesn't drift with the loop body and is immune to wall clock jumps (NTP).
+ * Overrun handling:
+ * - catchUp: the lost time is made up by running the following frames without sleeping
+ *   (bounded by FRAMETIMER_MAXCATCHUPFRAMES, then the timer resyncs)
+ * - skip: missed deadlines are dropped and the loop continues on the next period boundary
+ */
+
+#define FRAMETIMER_MAXCATCHUPFRAMES 5
+
+enum class FrameTimerPolicy {
+    catchUp, skip
+};
+
+struct FrameTimerStats {
+    uint64_t frames = 0;
+    uint64_t overruns = 0;        // frames which finished after their deadline
+    uint64_t skippedFrames = 0;   // deadlines dropped by the skip policy or a resync
+    int64_t lastJitterNs = 0;     // wakeup time - deadline of the last frame
+    int64_t maxJitterNs = 0;
+    double meanJitterNs = 0;      // mean of the absolute jitter
+    float load = 0;               // busy time / frame period of the last frame
+};
+
+class FrameTimer {
+public:
+    FrameTimer(int fps = 40, FrameTimerPolicy policy = FrameTimerPolicy::skip, long spinTimeUs = 0);
+
+    void setFps(int fps);
+
+    int getFps();
+
+    void setPolicy(FrameTimerPolicy policy);
+
+    FrameTimerPolicy getPolicy();
+
+    // the last spinTimeUs before a deadline are busy waited instead of slept, trading cpu for accuracy
+    void setSpinTime(long spinTimeUs);
+
+    void start();
+
+    bool wait();
+
+    FrameTimerStats getStats();
+
+    void resetStats();
+
+    static int64_t nowNs();
+
+private:
+    void sleepUntil(int64_t deadlineNs);
+
+    int64_t periodNs;
+    int64_t spinNs;
+    FrameTimerPolicy policy;
+    int64_t deadline;
+    int64_t frameStart;
+    bool started;
+
+    std::mutex statsMutex;
+    FrameTimerStats stats;
+};
+
+
+#endif //MATRIXSERVER_FRAMETIMER_H
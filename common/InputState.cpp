@@ -0,0 +1,112 @@
+#include "InputState.h"
+
+#include <cstring>
+
+void inputStateToMessage(const InputState &state, matrixserver::MatrixServerMessage &message) {
+    message.clear_joystickdata();
+    for (int i = 0; i < MAXJOYSTICKS; i++) {
+        auto &joystick = state.joysticks[i];
+        if (!joystick.connected)
+            continue;
+        auto joystickData = message.add_joystickdata();
+        joystickData->set_joystickid(i);
+        joystickData->set_timestamp(joystick.timestamp);
+        for (int n = 0; n < MAXBUTTONAXISCOUNT; n++) {
+            joystickData->add_buttons(joystick.button[n]);
+            joystickData->add_axes(joystick.axis[n]);
+            joystickData->add_buttonpresscount(joystick.buttonPressCount[n]);
+            joystickData->add_axispresscount(joystick.axisPressCount[n]);
+            joystickData->add_axispressvalue(joystick.axisPress[n]);
+        }
+        joystickData->set_axisx(joystick.axis[0]);
+        joystickData->set_axisy(joystick.axis[1]);
+    }
+    if (state.imu.valid) {
+        auto imuData = message.mutable_imudata();
+        imuData->set_timestamp(state.imu.timestamp);
+        imuData->set_accelx(state.imu.acceleration[0]);
+        imuData->set_accely(state.imu.acceleration[1]);
+        imuData->set_accelz(state.imu.acceleration[2]);
+        imuData->set_gyrox(state.imu.gyro[0]);
+        imuData->set_gyroy(state.imu.gyro[1]);
+        imuData->set_gyroz(state.imu.gyro[2]);
+    } else {
+        message.clear_imudata();
+    }
+}
+
+// joysticks missing from the message are marked as disconnected, the imu state is only updated if present
+void inputStateFromMessage(const matrixserver::MatrixServerMessage &message, InputState &state) {
+    if (message.joystickdata_size() > 0 || message.messagetype() == matrixserver::joystickData) {
+        for (auto &joystick : state.joysticks)
+            joystick.connected = false;
+    }
+    for (const auto &joystickData : message.joystickdata()) {
+        if (joystickData.joystickid() < 0 || joystickData.joystickid() >= MAXJOYSTICKS)
+            continue;
+        auto &joystick = state.joysticks[joystickData.joystickid()];
+        memset(&joystick, 0, sizeof(joystick));
+        joystick.connected = true;
+        joystick.timestamp = joystickData.timestamp();
+        for (int n = 0; n < MAXBUTTONAXISCOUNT; n++) {
+            if (n < joystickData.buttons_size())
+                joystick.button[n] = joystickData.buttons(n);
+            if (n < joystickData.axes_size())
+                joystick.axis[n] = joystickData.axes(n);
+            if (n < joystickData.buttonpresscount_size())
+                joystick.buttonPressCount[n] = joystickData.buttonpresscount(n);
+            if (n < joystickData.axispresscount_size())
+                joystick.axisPressCount[n] = joystickData.axispresscount(n);
+            if (n < joystickData.axispressvalue_size())
+                joystick.axisPress[n] = joystickData.axispressvalue(n);
+        }
+        if (joystickData.timestamp() > state.timestamp)
+            state.timestamp = joystickData.timestamp();
+    }
+    if (message.has_imudata()) {
+        auto &imuData = message.imudata();
+        state.imu.valid = true;
+        state.imu.timestamp = imuData.timestamp();
+        state.imu.acceleration[0] = imuData.accelx();
+        state.imu.acceleration[1] = imuData.accely();
+        state.imu.acceleration[2] = imuData.accelz();
+        state.imu.gyro[0] = imuData.gyrox();
+        state.imu.gyro[1] = imuData.gyroy();
+        state.imu.gyro[2] = imuData.gyroz();
+        if (imuData.timestamp() > state.timestamp)
+            state.timestamp = imuData.timestamp();
+    }
+}
+
+static void pushEdges(InputEventQueue &queue, uint64_t timestamp, uint8_t joystick, uint8_t number, uint32_t presses,
+                      bool wasActive, bool isActive, InputEventType pressType, InputEventType releaseType, float value) {
+    // presses merged into one update share the timestamp, each of them got released except the last one
+    for (uint32_t i = 0; i < presses; i++) {
+        if (i > 0 || wasActive)
+            queue.push({timestamp, releaseType, joystick, number, 0.0f});
+        queue.push({timestamp, pressType, joystick, number, value});
+    }
+    if ((presses > 0 || wasActive) && !isActive)
+        queue.push({timestamp, releaseType, joystick, number, 0.0f});
+}
+
+// derives the edges between two consecutive states from the press counters and levels
+void inputEventsFromStates(const InputState &previous, const InputState &current, InputEventQueue &queue) {
+    for (int j = 0; j < MAXJOYSTICKS; j++) {
+        auto &before = previous.joysticks[j];
+        auto &after = current.joysticks[j];
+        if (!before.connected && !after.connected)
+            continue;
+        for (int n = 0; n < MAXBUTTONAXISCOUNT; n++) {
+            // counters going backwards were reset by the server, there are no edges to report
+            uint32_t buttonPresses = after.buttonPressCount[n] >= before.buttonPressCount[n] ?
+                                     after.buttonPressCount[n] - before.buttonPressCount[n] : 0;
+            uint32_t axisPresses = after.axisPressCount[n] >= before.axisPressCount[n] ?
+                                   after.axisPressCount[n] - before.axisPressCount[n] : 0;
+            pushEdges(queue, after.timestamp, j, n, buttonPresses, before.button[n], after.button[n],
+                      InputEventType::buttonPress, InputEventType::buttonRelease, 1.0f);
+            pushEdges(queue, after.timestamp, j, n, axisPresses, before.axis[n] != 0, after.axis[n] != 0,
+                      InputEventType::axisPress, InputEventType::axisRelease, after.axisPress[n]);
+        }
+    }
+}
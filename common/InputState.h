@@ -0,0 +1,61 @@
+#ifndef MATRIXSERVER_INPUTSTATE_H
+#define MATRIXSERVER_INPUTSTATE_H
+
+#include <stdint.h>
+#include <matrixserver.pb.h>
+#include "SpscQueue.h"
+
+#define MAXJOYSTICKS 8
+#define MAXBUTTONAXISCOUNT 16
+
+/*
+ * Input as pushed by the server to the foreground app. Press counts are cumulative since the app
+ * came to the foreground, so a consumer can detect every press exactly once by remembering the
+ * count it has seen. Timestamps are CLOCK_MONOTONIC ns of the server host.
+ */
+struct JoystickState {
+    bool connected;
+    uint64_t timestamp;
+    bool button[MAXBUTTONAXISCOUNT];
+    float axis[MAXBUTTONAXISCOUNT];
+    uint32_t buttonPressCount[MAXBUTTONAXISCOUNT];
+    uint32_t axisPressCount[MAXBUTTONAXISCOUNT];
+    float axisPress[MAXBUTTONAXISCOUNT]; // axis value of the last press
+};
+
+struct ImuState {
+    bool valid;
+    uint64_t timestamp;
+    float acceleration[3];
+    float gyro[3];
+};
+
+struct InputState {
+    uint64_t timestamp;
+    JoystickState joysticks[MAXJOYSTICKS];
+    ImuState imu;
+};
+
+enum class InputEventType : uint8_t {
+    buttonPress, buttonRelease, axisPress, axisRelease
+};
+
+// edge of a button or axis, axis edges are an axis leaving or returning to 0
+struct InputEvent {
+    uint64_t timestamp;
+    InputEventType type;
+    uint8_t joystick;
+    uint8_t number;
+    float value;
+};
+
+typedef SpscQueue<InputEvent> InputEventQueue;
+
+void inputStateToMessage(const InputState &state, matrixserver::MatrixServerMessage &message);
+
+void inputStateFromMessage(const matrixserver::MatrixServerMessage &message, InputState &state);
+
+void inputEventsFromStates(const InputState &previous, const InputState &current, InputEventQueue &queue);
+
+
+#endif //MATRIXSERVER_INPUTSTATE_H
@@ -1,6 +1,10 @@
 #include "IpcConnection.h"
 
-#include <boost/log/trivial.hpp>
+#include <Log.h>
+
+#include <FrameTimer.h>
+#include <Metrics.h>
+#include <Trace.h>
 
 IpcConnection::IpcConnection(){
     receiveCallback = NULL;
@@ -26,18 +30,28 @@ void IpcConnection::setReceiveCallback(
 }
 
 void IpcConnection::readLoop() {
+    static auto &decodeLatency = Metrics::histogram("decode", "protobuf parsing of a received message");
+    static auto &bytesReceived = Metrics::counter("bytes_received", "bytes received on all connections");
+    static auto &messagesReceived = Metrics::counter("messages_received", "messages received on all connections");
     boost::interprocess::message_queue::size_type recvd_size;
     unsigned int priority;
-    BOOST_LOG_TRIVIAL(trace) << "[IpcConnection] start read loop";
+    MATRIXLOG(trace) << "[IpcConnection] start read loop";
     while(!dead){
         this->receiveMQ->receive(&receiveData, MAXIPCMESSAGESIZE, recvd_size, priority); //blocking
-        auto receiveMessage = std::make_shared<matrixserver::MatrixServerMessage>();
-        if (receiveMessage->ParseFromString(std::string(receiveData, recvd_size))) {
-            BOOST_LOG_TRIVIAL(trace) << "[IpcConnection] Recieved full Protobuf MatrixServerMessage";
+        bytesReceived.fetch_add(recvd_size, std::memory_order_relaxed);
+        messagesReceived.fetch_add(1, std::memory_order_relaxed);
+        auto decodeStart = FrameTimer::nowNs();
+        auto receiveMessage = getReceiveMessage();
+        bool parsed = receiveMessage->ParseFromArray(receiveData, recvd_size);
+        auto decodeEnd = FrameTimer::nowNs();
+        decodeLatency.record(decodeEnd - decodeStart);
+        Trace::record("decode", decodeStart, decodeEnd, receiveMessage->frameid());
+        if (parsed) {
+            MATRIXLOG(trace) << "[IpcConnection] Recieved full Protobuf MatrixServerMessage";
             if (this->receiveCallback != NULL) {
                 this->receiveCallback(shared_from_this(), receiveMessage);
             }else{
-                BOOST_LOG_TRIVIAL(trace) << "[IpcConnection] NO CALLBACK!";
+                MATRIXLOG(trace) << "[IpcConnection] NO CALLBACK!";
             }
         }
     }
@@ -49,10 +63,10 @@ void IpcConnection::doRead() {
 //        boost::interprocess::message_queue::size_type recvd_size;
 //        unsigned int priority;
 //        this->receiveMQ->receive(&tempData, MAXIPCMESSAGESIZE, recvd_size, priority); //blocking
-//        BOOST_LOG_TRIVIAL(debug) << "[IpcConnection] Recieved something";
+//        MATRIXLOG(debug) << "[IpcConnection] Recieved something";
 //        auto receiveMessage = std::make_shared<matrixserver::MatrixServerMessage>();
 //        if (receiveMessage->ParseFromString(std::string(tempData, recvd_size))) {
-//            BOOST_LOG_TRIVIAL(trace) << "[IpcConnection] Recieved full Protobuf MatrixServerMessage";
+//            MATRIXLOG(trace) << "[IpcConnection] Recieved full Protobuf MatrixServerMessage";
 //            if (this->receiveCallback != NULL) {
 //                this->receiveCallback(shared_from_this(), receiveMessage);
 //            }
@@ -63,7 +77,9 @@ void IpcConnection::doRead() {
 
 
 void IpcConnection::sendMessage(std::shared_ptr<matrixserver::MatrixServerMessage> message) {
-    auto sendBuffer = message->SerializeAsString();
+    TraceSpan span("serialize");
+    std::lock_guard<std::mutex> lock(sendMutex);
+    message->SerializeToString(&sendBuffer);
     sendMQ->send(sendBuffer.data(), sendBuffer.size(), 0);
 }
 
@@ -79,27 +95,37 @@ void IpcConnection::setDead(bool sDead) {
     dead = sDead;
 }
 
+TransportType IpcConnection::getTransport() {
+    return TransportType::ipc;
+}
+
 bool IpcConnection::connectToServer(std::string serverAddress) {
+    std::stringstream receiveMQname;
+    for(int i = 0; i < 20; i++)
+        receiveMQname << (char)(rand()%26+'a'); // add random character [a...z]
     try {
-        std::stringstream receiveMQname;
-        for(int i = 0; i < 20; i++)
-            receiveMQname << (char)(rand()%26+'a'); // add random character [a...z]
-
         auto tempServer = std::make_shared<boost::interprocess::message_queue>(boost::interprocess::open_only, serverAddress.data());
         this->receiveMQ = std::make_shared<boost::interprocess::message_queue>(boost::interprocess::open_or_create, receiveMQname.str().data(), 10, MAXIPCMESSAGESIZE, boost::interprocess::permissions(0666));
         tempServer->send(receiveMQname.str().data(), receiveMQname.str().size(), 0);
         char tempData[MAXIPCMESSAGESIZE];
-        boost::interprocess::message_queue::size_type recvd_size;
+        boost::interprocess::message_queue::size_type recvd_size = 0;
         unsigned int priority;
-        this->receiveMQ->receive(&tempData, MAXIPCMESSAGESIZE, recvd_size, priority); //blocking
-        if(recvd_size == 20){
+        // a stale server queue is never answered, don't block forever
+        auto timeout = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(IPCCONNECTTIMEOUT);
+        if(this->receiveMQ->timed_receive(&tempData, MAXIPCMESSAGESIZE, recvd_size, priority, timeout) && recvd_size == 20){
             this->sendMQ = std::make_shared<boost::interprocess::message_queue>(boost::interprocess::open_only, std::string(tempData, recvd_size).data());
             setDead(false);
         }else{
+            MATRIXLOG(debug) << "[IpcConnection] no answer from " << serverAddress;
+            this->receiveMQ.reset();
+            boost::interprocess::message_queue::remove(receiveMQname.str().data());
             setDead(true);
+            return false;
         }
     } catch (boost::interprocess::interprocess_exception e) {
-        BOOST_LOG_TRIVIAL(debug) << "[IpcConnection] " << e.what();
+        MATRIXLOG(debug) << "[IpcConnection] " << e.what();
+        this->receiveMQ.reset();
+        boost::interprocess::message_queue::remove(receiveMQname.str().data());
         setDead(true);
         return false;
     }
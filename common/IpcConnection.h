@@ -11,6 +11,7 @@
 
 #define SERVERMESSAGESIZE 1000000
 #define MAXIPCMESSAGESIZE 1000000
+#define IPCCONNECTTIMEOUT 1000 //ms
 
 class IpcConnection :  public std::enable_shared_from_this<IpcConnection>, public UniversalConnection {
 public:
@@ -33,6 +34,8 @@ public:
     bool isDead();
 
     void setDead(bool sDead);
+
+    TransportType getTransport();
 private:
     void doRead();
 
@@ -45,6 +48,7 @@ private:
 
     std::mutex sendMutex;
     std::string message_buffer;
+    std::string sendBuffer;
     std::function<void(std::shared_ptr<UniversalConnection>,
                        std::shared_ptr<matrixserver::MatrixServerMessage>)> receiveCallback;
     bool dead = false;
@@ -1,5 +1,5 @@
 #include "IpcServer.h"
-#include <boost/log/trivial.hpp>
+#include <Log.h>
 
 
 
@@ -9,7 +9,7 @@ IpcServer::IpcServer(std::string serverAddress)
     serverMQ = std::make_shared<boost::interprocess::message_queue>(boost::interprocess::open_or_create, serverAddress.data(), 10, SERVERMESSAGESIZE, boost::interprocess::permissions(0666));
     acceptCallback = NULL;
     startAccepting();
-    BOOST_LOG_TRIVIAL(debug) << "[Server] Start accepting on IPC Channel: " << serverAddress;
+    MATRIXLOG(debug) << "[Server] Start accepting on IPC Channel: " << serverAddress;
 }
 
 void IpcServer::startAccepting() {
@@ -30,7 +30,7 @@ void IpcServer::acceptLoop() {
         auto sendMQ = std::make_shared<boost::interprocess::message_queue>(boost::interprocess::open_only, std::string(receiveBuffer, recvd_size).data());
         sendMQ->send(sendMQname.str().data(), sendMQname.str().size(), 0);
 
-        BOOST_LOG_TRIVIAL(debug) << "[Server] Accepted Connection, sendMQ " << receiveBuffer << " receiveMQ " << sendMQname.str();
+        MATRIXLOG(debug) << "[Server] Accepted Connection, sendMQ " << receiveBuffer << " receiveMQ " << sendMQname.str();
 
         auto connection = std::make_shared<IpcConnection>(sendMQ, receiveMQ);
         if (acceptCallback != NULL) {
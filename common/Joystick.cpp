@@ -1,149 +1,177 @@
 #include "Joystick.h"
+#include "FrameTimer.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <climits>
+#include <cstring>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <algorithm>
 #include "unistd.h"
 
-Joystick::Joystick()
-{
-    init("/dev/input/js0", false);
-}
+#include <Log.h>
 
-Joystick::Joystick(int joystickNumber)
+Joystick::Joystick(uint8_t index)
 {
-    std::stringstream sstm;
-    sstm << "/dev/input/js" << joystickNumber;
-    init(sstm.str(), false);
+    _fd = -1;
+    index_ = index;
+    timeOffsetNs_ = 0;
+    hasTimeOffset_ = false;
+    edges_.reserve(2 * JOYSTICKMAXEVENTS);
+    memset(&state_, 0, sizeof(state_));
+    published_.store(state_);
+    consumedButtonPress_.fill(0);
+    consumedAxisPress_.fill(0);
 }
 
-Joystick::Joystick(std::string devicePath)
+bool Joystick::open(const std::string &devicePath)
 {
-    init(devicePath, false);
+    close();
+    devicePath_ = devicePath;
+    _fd = ::open(devicePath_.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if(_fd < 0)
+        return false;
+    hasTimeOffset_ = false;
+    // press counters survive reconnects, so consumers never see them going backwards
+    state_.connected = true;
+    state_.timestamp = FrameTimer::nowNs();
+    publish();
+    return true;
 }
 
-Joystick::Joystick(std::string devicePath, bool blocking)
+void Joystick::close()
 {
-    init(devicePath, blocking);
-}
-
-void Joystick::resetVariables(){
-    for(int i = 0; i < MAXBUTTONAXISCOUNT; i++){
-        buttonPress_[i] = 0;
-        button_[i] = 0;
-        axis_[i] = 0;
+    if(_fd >= 0)
+        ::close(_fd);
+    _fd = -1;
+    if(state_.connected){
+        auto now = FrameTimer::nowNs();
+        for(uint8_t i = 0; i < MAXBUTTONAXISCOUNT; i++){
+            if(state_.button[i])
+                edges_.push_back({(uint64_t) now, InputEventType::buttonRelease, index_, i, 0.0f});
+            if(state_.axis[i] != 0)
+                edges_.push_back({(uint64_t) now, InputEventType::axisRelease, index_, i, 0.0f});
+        }
+        state_.connected = false;
+        memset(state_.button, 0, sizeof(state_.button));
+        memset(state_.axis, 0, sizeof(state_.axis));
+        state_.timestamp = now;
+        publish();
     }
 }
 
-void Joystick::init(std::string devicePath, bool blocking){
-    resetVariables();
-    devicePath_ = devicePath;
-    blocking_ = blocking;
-    openPath();
-    startRefreshThread();
-}
-
-void Joystick::openPath()
+int Joystick::getFd()
 {
-    struct stat buffer;
-    if (stat (devicePath_.c_str(), &buffer) == 0){
-        sleep(1);
-        _fd = open(devicePath_.c_str(), blocking_ ? O_RDONLY : O_RDONLY | O_NONBLOCK);
-    }
+    return _fd;
 }
 
-void Joystick::recheckFilePath()
+const std::string &Joystick::getDevicePath()
 {
-    struct stat buffer;
-    if (stat (devicePath_.c_str(), &buffer) != 0){
-        _fd = 0;
-    }
-    if(_fd == 0){
-        resetVariables();
-        openPath();
-    }
+    return devicePath_;
 }
 
-bool Joystick::sample(Joystick::Event * event)
+// reads all pending events, returns false if the device is gone
+bool Joystick::handleEvents()
 {
-    if(_fd > 0){
-        int bytes = read(_fd, event, sizeof(*event));
-        if (bytes == -1)
+    Joystick::Event events[JOYSTICKMAXEVENTS];
+    while(_fd >= 0){
+        auto bytes = read(_fd, events, sizeof(events));
+        if(bytes < 0)
+            return errno == EAGAIN || errno == EINTR;
+        if(bytes == 0)
             return false;
-        return bytes == sizeof(*event);
+        auto count = bytes / sizeof(Joystick::Event);
+        if(count == 0)
+            return true;
+        auto now = FrameTimer::nowNs();
+        if(!hasTimeOffset_)
+            setTimeOffset(events[count - 1].time, now);
+        for(unsigned int i = 0; i < count; i++)
+            handleEvent(events[i], eventTimestamp(events[i].time, now));
+        publish();
+        if(count < JOYSTICKMAXEVENTS)
+            return true;
     }
     return false;
 }
 
-bool Joystick::isFound()
+void Joystick::setTimeOffset(uint32_t time, int64_t nowNs)
 {
-    struct stat buffer;
-    return (stat (devicePath_.c_str(), &buffer) == 0);
+    timeOffsetNs_ = nowNs - (int64_t) time * 1000000;
+    hasTimeOffset_ = true;
 }
 
-void Joystick::refresh()
+// the event times are ms of the kernel clock, one offset to CLOCK_MONOTONIC keeps their spacing across reads
+int64_t Joystick::eventTimestamp(uint32_t time, int64_t nowNs)
 {
-    Joystick::Event event;
-    while (sample(&event))
-    {
-        if(event.number < MAXBUTTONAXISCOUNT){
-            if (event.isButton()){
-                if(!button_[event.number] && (bool)event.value)
-                    buttonPress_[event.number] = true;
-                button_[event.number] = (bool)event.value;
-            }else if (event.isAxis()){
-                auto tempVal = (float)event.value / INT16_MAX;
-                if(axis_[event.number] == 0 && tempVal != 0)
-                    axisPress_[event.number] = tempVal;
-                axis_[event.number] = tempVal;
-            }
-        }
+    auto timestamp = timeOffsetNs_ + (int64_t) time * 1000000;
+    // not in the future (the offset was taken late) and not ages ago (the 32 bit ms wrapped)
+    if(timestamp > nowNs || timestamp < nowNs - JOYSTICKMAXEVENTAGE){
+        setTimeOffset(time, nowNs);
+        timestamp = nowNs;
     }
+    return timestamp;
 }
 
-void Joystick::startRefreshThread()
+void Joystick::handleEvent(const Joystick::Event &event, uint64_t timestamp)
 {
-    thread_ = new boost::thread(&Joystick::internalLoop, this);
+    if(event.number >= MAXBUTTONAXISCOUNT)
+        return;
+    if (event.isButton()){
+        bool value = event.value != 0;
+        if(state_.button[event.number] != value && !event.isInitialState()){
+            if(value)
+                state_.buttonPressCount[event.number]++;
+            edges_.push_back({timestamp, value ? InputEventType::buttonPress : InputEventType::buttonRelease,
+                              index_, event.number, value ? 1.0f : 0.0f});
+        }
+        state_.button[event.number] = value;
+    }else if (event.isAxis()){
+        auto tempVal = (float)event.value / INT16_MAX;
+        if((state_.axis[event.number] == 0) != (tempVal == 0) && !event.isInitialState()){
+            if(tempVal != 0){
+                state_.axisPress[event.number] = tempVal;
+                state_.axisPressCount[event.number]++;
+            }
+            edges_.push_back({timestamp, tempVal != 0 ? InputEventType::axisPress : InputEventType::axisRelease,
+                              index_, event.number, tempVal});
+        }
+        state_.axis[event.number] = tempVal;
+    }
+    state_.timestamp = timestamp;
 }
 
-void Joystick::stopThread()
+std::vector<InputEvent> &Joystick::getEdges()
 {
-    if(thread_ != NULL)
-    {
-        thread_->interrupt();
-        thread_->join();
-        thread_ = NULL;
-    }
+    return edges_;
 }
 
-void Joystick::internalLoop()
+void Joystick::publish()
 {
-    int loopcount = 0;
-    while(1){
-        if(loopcount % 10 == 0)
-            recheckFilePath();
-        refresh();
-        loopcount++;
-        usleep(10000);
-    }
+    published_.store(state_);
 }
 
-
 bool Joystick::getButton(unsigned int num)
 {
     if(num < MAXBUTTONAXISCOUNT)
-        return button_[num];
+        return published_.load().button[num];
     return false;
 }
 
 bool Joystick::getButtonPress(unsigned int num)
 {
     if(num < MAXBUTTONAXISCOUNT){
-        if(buttonPress_[num]){
-            buttonPress_[num] = false;
+        // one call per press, so presses arriving between two calls are not merged
+        if(published_.load().buttonPressCount[num] != consumedButtonPress_[num]){
+            consumedButtonPress_[num]++;
             return true;
         }
     }
@@ -153,35 +181,42 @@ bool Joystick::getButtonPress(unsigned int num)
 float Joystick::getAxis(unsigned int num)
 {
     if(num < MAXBUTTONAXISCOUNT)
-        return axis_[num];
+        return published_.load().axis[num];
     return 0;
 }
 
 float Joystick::getAxisPress(unsigned int num) {
     if(num < MAXBUTTONAXISCOUNT){
-        if(axisPress_[num] != 0){
-            auto returnValue = axisPress_[num];
-            axisPress_[num] = 0.0f;
-            return returnValue;
+        auto state = published_.load();
+        if(state.axisPressCount[num] != consumedAxisPress_[num]){
+            consumedAxisPress_[num]++;
+            return state.axisPress[num];
         }
     }
     return 0.0f;
 }
 
-
 void Joystick::clearAllButtonPresses(){
+    auto state = published_.load();
     for(int i = 0; i < MAXBUTTONAXISCOUNT; i++){
-        buttonPress_[i] = false;
-    }
-    for(int i = 0; i < MAXBUTTONAXISCOUNT; i++){
-        axisPress_[i] = 0.0f;
+        consumedButtonPress_[i] = state.buttonPressCount[i];
+        consumedAxisPress_[i] = state.axisPressCount[i];
     }
 }
 
+bool Joystick::isConnected()
+{
+    return published_.load().connected;
+}
+
+void Joystick::getState(JoystickState &state)
+{
+    state = published_.load();
+}
+
 Joystick::~Joystick()
 {
-    stopThread();
-    close(_fd);
+    close();
 }
 
 
@@ -193,21 +228,175 @@ std::ostream& operator<<(std::ostream& os, const Joystick::Event& e)
     return os;
 }
 
-JoystickManager::JoystickManager(unsigned int maxNum) {
-    for(int i = 0; i<maxNum; i++)
+JoystickManager::JoystickManager(unsigned int maxNum, std::string inputDir, bool startThread) :
+        inputDir_(inputDir), thread_(nullptr), scanned(false) {
+    for(unsigned int i = 0; i < maxNum; i++)
         joysticks.push_back(new Joystick(i));
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = UINT32_MAX;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &event);
+    // IN_ATTRIB: udev fixes the permissions of a new device after it is created
+    if(inotify_add_watch(inotifyFd, inputDir_.c_str(), IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_TO) < 0)
+        MATRIXLOG(warning) << "[Joystick] can't watch " << inputDir_ << ", hotplug disabled";
+    event.data.u32 = UINT32_MAX - 1;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, inotifyFd, &event);
+    if(startThread)
+        thread_ = new boost::thread(&JoystickManager::internalLoop, this);
+}
+
+JoystickManager::~JoystickManager() {
+    uint64_t one = 1;
+    if(write(stopFd, &one, sizeof(one)) == sizeof(one) && thread_ != nullptr)
+        thread_->join();
+    delete thread_;
+    for(auto joystick : joysticks)
+        delete joystick;
+    ::close(epollFd);
+    ::close(inotifyFd);
+    ::close(stopFd);
+}
+
+void JoystickManager::internalLoop() {
+    while(dispatch(-1));
+}
+
+// handles the pending events, returns false once the manager is shut down
+bool JoystickManager::dispatch(int timeoutMs) {
+    if(!scanned){
+        scanDevices();
+        scanned = true;
+    }
+    struct epoll_event events[MAXJOYSTICKS + 2];
+    auto count = epoll_wait(epollFd, events, MAXJOYSTICKS + 2, timeoutMs);
+    if(count < 0)
+        return errno == EINTR;
+    bool changed = false;
+    for(int i = 0; i < count; i++){
+        auto index = events[i].data.u32;
+        if(index == UINT32_MAX)
+            return false;
+        if(index == UINT32_MAX - 1){
+            handleInotify();
+            changed = true;
+        }else if(index < joysticks.size()){
+            if(!joysticks[index]->handleEvents())
+                closeDevice(index);
+            dispatchEdges(joysticks[index]);
+            changed = true;
+        }
+    }
+    if(changed){
+        boost::mutex::scoped_lock lock(callbackLock_);
+        if(changeCallback)
+            changeCallback();
+    }
+    return true;
+}
+
+int JoystickManager::getFd() {
+    return epollFd;
+}
+
+void JoystickManager::handleEvents() {
+    dispatch(0);
+}
+
+void JoystickManager::scanDevices() {
+    for(unsigned int i = 0; i < joysticks.size(); i++){
+        openDevice(i);
+        dispatchEdges(joysticks[i]);
+    }
+}
+
+void JoystickManager::dispatchEdges(Joystick *joystick) {
+    auto &edges = joystick->getEdges();
+    if(edges.empty())
+        return;
+    {
+        boost::mutex::scoped_lock lock(subscriberLock_);
+        for(auto &queue : subscribers){
+            for(auto &edge : edges)
+                queue->push(edge);
+        }
+    }
+    edges.clear();
+}
+
+void JoystickManager::openDevice(unsigned int index) {
+    auto joystick = joysticks[index];
+    if(joystick->getFd() >= 0)
+        return;
+    std::stringstream sstm;
+    sstm << inputDir_ << "/js" << index;
+    if(!joystick->open(sstm.str()))
+        return;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = index;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, joystick->getFd(), &event);
+    MATRIXLOG(debug) << "[Joystick] opened " << joystick->getDevicePath();
+    if(!joystick->handleEvents()) // initial state
+        closeDevice(index);
+}
+
+void JoystickManager::closeDevice(unsigned int index) {
+    auto joystick = joysticks[index];
+    if(joystick->getFd() < 0)
+        return;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, joystick->getFd(), nullptr);
+    joystick->close();
+    MATRIXLOG(debug) << "[Joystick] closed " << joystick->getDevicePath();
+}
+
+void JoystickManager::handleInotify() {
+    alignas(struct inotify_event) char buffer[4096];
+    while(true){
+        auto bytes = read(inotifyFd, buffer, sizeof(buffer));
+        if(bytes <= 0)
+            return;
+        for(char *ptr = buffer; ptr < buffer + bytes;){
+            auto event = (struct inotify_event *) ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+            auto index = event->len > 0 ? deviceIndex(event->name) : -1;
+            if(index < 0)
+                continue;
+            if(event->mask & IN_DELETE)
+                closeDevice(index);
+            else
+                openDevice(index);
+            dispatchEdges(joysticks[index]);
+        }
+    }
+}
+
+// "js<n>" -> n, -1 for other devices and joysticks above maxNum
+int JoystickManager::deviceIndex(const char *name) {
+    if(strncmp(name, "js", 2) != 0 || name[2] == '\0')
+        return -1;
+    char *end;
+    auto index = strtol(name + 2, &end, 10);
+    if(*end != '\0' || index < 0 || index >= (long) joysticks.size())
+        return -1;
+    return (int) index;
 }
 
 std::vector<Joystick *> &JoystickManager::getJoysticks() {
     return joysticks;
 }
 
+// consumes a single press of any joystick, the others are returned by the following calls
 bool JoystickManager::getButtonPress(unsigned int num) {
-    bool returnValue = false;
     for(auto joystick : joysticks){
-        returnValue = (returnValue || joystick->getButtonPress(num));
+        if(joystick->getButtonPress(num))
+            return true;
     }
-    return returnValue;
+    return false;
 }
 
 float JoystickManager::getAxis(unsigned int num) {
@@ -219,11 +408,12 @@ float JoystickManager::getAxis(unsigned int num) {
 }
 
 float JoystickManager::getAxisPress(unsigned int num) {
-    float returnValue = 0;
     for(auto joystick : joysticks){
-        returnValue += joystick->getAxisPress(num);
+        auto value = joystick->getAxisPress(num);
+        if(value != 0.0f)
+            return value;
     }
-    return returnValue;
+    return 0.0f;
 }
 
 void JoystickManager::clearAllButtonPresses() {
@@ -231,3 +421,29 @@ void JoystickManager::clearAllButtonPresses() {
         joystick->clearAllButtonPresses();
     }
 }
+
+void JoystickManager::getStates(JoystickState *states, unsigned int count) {
+    for(unsigned int i = 0; i < count; i++){
+        if(i < joysticks.size())
+            joysticks[i]->getState(states[i]);
+        else
+            memset(&states[i], 0, sizeof(JoystickState));
+    }
+}
+
+void JoystickManager::setChangeCallback(std::function<void()> callback) {
+    boost::mutex::scoped_lock lock(callbackLock_);
+    changeCallback = callback;
+}
+
+std::shared_ptr<InputEventQueue> JoystickManager::subscribe(size_t capacity) {
+    auto queue = std::make_shared<InputEventQueue>(capacity);
+    boost::mutex::scoped_lock lock(subscriberLock_);
+    subscribers.push_back(queue);
+    return queue;
+}
+
+void JoystickManager::unsubscribe(const std::shared_ptr<InputEventQueue> &queue) {
+    boost::mutex::scoped_lock lock(subscriberLock_);
+    subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), queue), subscribers.end());
+}
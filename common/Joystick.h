@@ -4,41 +4,50 @@
 #include <string>
 #include <iostream>
 #include <stdint.h>
-#include <map>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 
-#define MAXBUTTONAXISCOUNT 16
+#include "InputState.h"
+#include "SeqLock.h"
 
+#define JOYSTICKINPUTDIR "/dev/input"
+#define JOYSTICKMAXEVENTS 64
+#define JOYSTICKMAXEVENTAGE 60000000000LL //ns, an event time this old means the kernel's ms counter wrapped
+
+/*
+ * State of one joystick device. The fd is owned and read by the JoystickManager reactor thread,
+ * which publishes the state after every batch of events through a seqlock, so the getters never
+ * block the reactor. Press edges are latched as cumulative counters, getButtonPress/getAxisPress
+ * consume them one at a time (one consuming thread per Joystick). Consumers which need every edge
+ * with its timestamp subscribe to the JoystickManager instead.
+ */
 class Joystick {
 public:
     class Event;
 
-    ~Joystick();
-
-    Joystick();
-
-    Joystick(int joystickNumber);
+    Joystick(uint8_t index = 0);
 
-    Joystick(std::string devicePath);
+    ~Joystick();
 
     Joystick(Joystick const &) = delete;
 
-    Joystick(Joystick &&) = default;
-
-    Joystick(std::string devicePath, bool blocking);
+    bool open(const std::string &devicePath);
 
-    void init(std::string devicePath, bool blocking);
+    void close();
 
-    bool isFound();
+    int getFd();
 
-    bool sample(Joystick::Event *event);
+    const std::string &getDevicePath();
 
-    void startRefreshThread();
+    bool handleEvents();
 
-    void stopThread();
-
-    void refresh();
+    // edges of the last handleEvents calls, reactor thread only
+    std::vector<InputEvent> &getEdges();
 
     bool getButton(unsigned int num);
 
@@ -50,42 +59,47 @@ public:
 
     void clearAllButtonPresses();
 
+    bool isConnected();
+
+    void getState(JoystickState &state);
+
 private:
-    void internalLoop();
+    void handleEvent(const Joystick::Event &event, uint64_t timestamp);
 
-    void openPath();
+    void setTimeOffset(uint32_t time, int64_t nowNs);
 
-    void recheckFilePath();
+    int64_t eventTimestamp(uint32_t time, int64_t nowNs);
 
-    void resetVariables();
+    void publish();
 
     int _fd;
-    boost::thread *thread_;
-    boost::mutex threadLock_;
+    uint8_t index_;
     std::string devicePath_;
-    bool blocking_;
-    std::array<bool, MAXBUTTONAXISCOUNT> button_;
-    std::array<bool, MAXBUTTONAXISCOUNT> buttonPress_;
-    std::array<float, MAXBUTTONAXISCOUNT> axis_;
-    std::array<float, MAXBUTTONAXISCOUNT> axisPress_;
+    std::vector<InputEvent> edges_;
+    JoystickState state_; // reactor thread only
+    int64_t timeOffsetNs_; // CLOCK_MONOTONIC ns - kernel event time, reactor thread only
+    bool hasTimeOffset_;
+    SeqLock<JoystickState> published_;
+    std::array<uint32_t, MAXBUTTONAXISCOUNT> consumedButtonPress_;
+    std::array<uint32_t, MAXBUTTONAXISCOUNT> consumedAxisPress_;
 };
 
 class Joystick::Event {
 public:
-    unsigned int time;
+    unsigned int time; // ms, kernel clock
     short value;
     unsigned char type;
     unsigned char number;
 
-    bool isButton() {
+    bool isButton() const {
         return (type & 0x01) != 0;
     }
 
-    bool isAxis() {
+    bool isAxis() const {
         return (type & 0x02) != 0;
     }
 
-    bool isInitialState() {
+    bool isInitialState() const {
         return (type & 0x80) != 0;
     }
 
@@ -94,9 +108,17 @@ public:
 
 std::ostream &operator<<(std::ostream &os, const Joystick::Event &e);
 
+/*
+ * Input reactor for /dev/input/js0..js<maxNum-1>: a single thread watches the input directory with
+ * inotify for hotplug and reads every open joystick through epoll, so events are handled as soon
+ * as they arrive. Device discovery happens on the reactor thread, the constructor never blocks.
+ */
 class JoystickManager {
 public:
-    JoystickManager(unsigned int maxNum = 8);
+    // startThread = false: the owner polls getFd() and calls handleEvents(), e.g. a SensorHub
+    JoystickManager(unsigned int maxNum = 8, std::string inputDir = JOYSTICKINPUTDIR, bool startThread = true);
+
+    ~JoystickManager();
 
     std::vector<Joystick *> &getJoysticks();
 
@@ -108,9 +130,49 @@ public:
 
     void clearAllButtonPresses();
 
+    void getStates(JoystickState *states, unsigned int count);
+
+    // called on the reactor thread after new input or a hotplug event
+    void setChangeCallback(std::function<void()> callback);
+
+    // readable whenever input or hotplug events are pending
+    int getFd();
+
+    void handleEvents();
+
+    // every subscriber gets its own queue of edge events, pop it from a single thread
+    std::shared_ptr<InputEventQueue> subscribe(size_t capacity = 256);
+
+    void unsubscribe(const std::shared_ptr<InputEventQueue> &queue);
+
 private:
-    std::vector<Joystick *> joysticks;
+    void internalLoop();
+
+    bool dispatch(int timeoutMs);
+
+    void scanDevices();
 
+    void openDevice(unsigned int index);
+
+    void closeDevice(unsigned int index);
+
+    void dispatchEdges(Joystick *joystick);
+
+    void handleInotify();
+
+    int deviceIndex(const char *name);
+
+    std::vector<Joystick *> joysticks;
+    std::string inputDir_;
+    int epollFd;
+    int inotifyFd;
+    int stopFd;
+    boost::thread *thread_;
+    bool scanned;
+    boost::mutex callbackLock_;
+    std::function<void()> changeCallback;
+    boost::mutex subscriberLock_;
+    std::vector<std::shared_ptr<InputEventQueue>> subscribers;
 };
 
 
@@ -0,0 +1,154 @@
+#include "Log.h"
+
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <pthread.h>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/expressions.hpp>
+
+#include "MpscQueue.h"
+
+std::atomic<int> Log::runtimeLevel((int) LogLevel::trace);
+
+namespace {
+    struct LogWriter {
+        MpscQueue<LogEntry> queue{LOGQUEUESIZE};
+        std::atomic<bool> started{false};
+        std::atomic<uint64_t> queued{0};
+        std::atomic<uint64_t> written{0};
+        std::mutex sinkMutex;
+        std::function<void(const LogEntry &)> sink;
+    };
+}
+
+static LogWriter &writer() {
+    static auto *instance = new LogWriter(); // never destroyed, threads may still log at exit
+    return *instance;
+}
+
+static void writeLoop() {
+    auto &logs = writer();
+    LogEntry entry;
+    uint64_t reportedDropped = 0;
+    while (true) {
+        if (!logs.queue.waitForData(100000000LL))
+            continue;
+        while (logs.queue.pop(entry)) {
+            {
+                std::lock_guard<std::mutex> lock(logs.sinkMutex);
+                if (logs.sink)
+                    logs.sink(entry);
+                else
+                    Log::write(entry);
+            }
+            logs.written.fetch_add(1, std::memory_order_release);
+        }
+        auto dropped = logs.queue.getDropped();
+        if (dropped != reportedDropped) {
+            std::clog << "[Log] " << dropped - reportedDropped << " messages dropped, the queue was full" << std::endl;
+            reportedDropped = dropped;
+        }
+    }
+}
+
+// the child of a fork has no writer thread, it starts its own on its first message
+static void forgetWriterAfterFork() {
+    auto &logs = writer();
+    LogEntry entry;
+    while (logs.queue.pop(entry))
+        logs.written.fetch_add(1, std::memory_order_relaxed); // the parent prints them
+    logs.started.store(false);
+}
+
+static void startWriter() {
+    auto &logs = writer();
+    static std::mutex startMutex;
+    std::lock_guard<std::mutex> lock(startMutex);
+    if (logs.started.load())
+        return;
+    static bool atForkRegistered = false;
+    if (!atForkRegistered) {
+        pthread_atfork(nullptr, nullptr, &forgetWriterAfterFork);
+        std::atexit(&Log::flush);
+        atForkRegistered = true;
+    }
+    std::thread(&writeLoop).detach();
+    logs.started.store(true);
+}
+
+void Log::setLevel(LogLevel level) {
+    runtimeLevel.store((int) level, std::memory_order_relaxed);
+    boost::log::core::get()->set_filter(
+            boost::log::trivial::severity >= (boost::log::trivial::severity_level) level);
+}
+
+LogLevel Log::getLevel() {
+    return (LogLevel) runtimeLevel.load(std::memory_order_relaxed);
+}
+
+void Log::setSink(std::function<void(const LogEntry &)> sink) {
+    auto &logs = writer();
+    std::lock_guard<std::mutex> lock(logs.sinkMutex);
+    logs.sink = sink;
+}
+
+void Log::write(const LogEntry &entry) {
+    std::string line;
+    format(entry, line);
+    line += '\n';
+    std::clog.write(line.data(), line.size());
+    std::clog.flush();
+}
+
+void Log::flush() {
+    auto &logs = writer();
+    if (!logs.started.load())
+        return;
+    auto target = logs.queued.load(std::memory_order_acquire);
+    // bounded, the writer thread may be gone at exit
+    for (int i = 0; i < 10000 && logs.written.load(std::memory_order_acquire) < target; i++)
+        usleep(100);
+}
+
+uint64_t Log::getDropped() {
+    return writer().queue.getDropped();
+}
+
+void Log::format(const LogEntry &entry, std::string &out) {
+    static const char *names[] = {"trace", "debug", "info", "warning", "error", "fatal"};
+    struct tm local;
+    time_t seconds = entry.timestampNs / 1000000000LL;
+    localtime_r(&seconds, &local);
+    char prefix[96];
+    auto length = strftime(prefix, sizeof(prefix), "[%Y-%m-%d %H:%M:%S", &local);
+    auto name = names[(int) entry.level];
+    snprintf(prefix + length, sizeof(prefix) - length, ".%06lld] [0x%016llx] [%s]%*s",
+             (long long) (entry.timestampNs % 1000000000LL / 1000), (unsigned long long) entry.threadId, name,
+             (int) (8 - strlen(name)), "");
+    out += prefix;
+    out.append(entry.text, entry.length);
+}
+
+LogRecord::LogRecord(LogLevel level) : buffer(entry.text, LOGMESSAGESIZE), out(&buffer) {
+    entry.level = level;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    entry.timestampNs = now.tv_sec * 1000000000LL + now.tv_nsec;
+    entry.threadId = (uint64_t) pthread_self();
+}
+
+LogRecord::~LogRecord() {
+    entry.length = buffer.length();
+    auto &logs = writer();
+    if (!logs.started.load(std::memory_order_relaxed))
+        startWriter();
+    if (logs.queue.push(entry))
+        logs.queued.fetch_add(1, std::memory_order_release);
+    if (entry.level >= LogLevel::error)
+        Log::flush();
+}
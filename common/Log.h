@@ -0,0 +1,112 @@
+#ifndef MATRIXSERVER_LOG_H
+#define MATRIXSERVER_LOG_H
+
+#include <atomic>
+#include <string>
+#include <ostream>
+#include <streambuf>
+#include <functional>
+#include <stdint.h>
+
+#define LOGMESSAGESIZE 232 // longer messages are cut
+#define LOGQUEUESIZE 1024 // messages waiting for the writer thread, more are dropped and counted
+
+// the levels of boost::log::trivial
+enum class LogLevel : int {
+    trace, debug, info, warning, error, fatal
+};
+
+// the lowest level compiled in, set by the MATRIXSERVER_LOG_LEVEL CMake option
+#ifndef MATRIXSERVER_LOG_MINLEVEL
+#define MATRIXSERVER_LOG_MINLEVEL 0
+#endif
+
+/*
+ * Drop-in for BOOST_LOG_TRIVIAL in the hot paths:
+ *
+ *   MATRIXLOG(debug) << "[Server] App " << id << " deleted";
+ *
+ * Levels below MATRIXSERVER_LOG_MINLEVEL are a constant false condition, the arguments are never evaluated
+ * and the compiler drops the whole statement. Levels below the runtime level (Log::setLevel) cost a relaxed
+ * load. The message is formatted into a fixed buffer on the stack and queued, a writer thread prints it,
+ * so the logging thread never takes a lock nor allocates. Error and fatal messages are flushed right away.
+ * It is a single statement, the body of an if without braces included.
+ */
+#define MATRIXLOG(level) \
+    for (bool matrixlogOnce_ = MATRIXLOG_ENABLED(level); matrixlogOnce_; matrixlogOnce_ = false) \
+        LogRecord(LogLevel::level).stream()
+
+// for work which only feeds log messages, false for levels which aren't compiled in
+#define MATRIXLOG_ENABLED(level) \
+    ((int) LogLevel::level >= MATRIXSERVER_LOG_MINLEVEL && Log::isEnabled(LogLevel::level))
+
+struct LogEntry {
+    LogLevel level;
+    uint16_t length;
+    int64_t timestampNs; // CLOCK_REALTIME
+    uint64_t threadId; // pthread_self()
+    char text[LOGMESSAGESIZE];
+};
+
+class Log {
+public:
+    static inline bool isEnabled(LogLevel level) {
+        return (int) level >= runtimeLevel.load(std::memory_order_relaxed);
+    }
+
+    // the lowest level printed, also the filter of the code still logging with Boost.Log
+    static void setLevel(LogLevel level);
+
+    static LogLevel getLevel();
+
+    // replaces printing to std::clog, called on the writer thread, nullptr restores it
+    static void setSink(std::function<void(const LogEntry &)> sink);
+
+    static void write(const LogEntry &entry);
+
+    // waits until the writer thread printed all messages queued before
+    static void flush();
+
+    static uint64_t getDropped();
+
+    // the format of Boost.Log's default console sink
+    static void format(const LogEntry &entry, std::string &out);
+
+private:
+    static std::atomic<int> runtimeLevel;
+};
+
+// one message, queued when it is destroyed at the end of the MATRIXLOG statement
+class LogRecord {
+public:
+    explicit LogRecord(LogLevel level);
+
+    ~LogRecord();
+
+    std::ostream &stream() {
+        return out;
+    }
+
+    LogRecord(const LogRecord &) = delete;
+
+    LogRecord &operator=(const LogRecord &) = delete;
+
+private:
+    class Buffer : public std::streambuf {
+    public:
+        Buffer(char *begin, size_t size) {
+            setp(begin, begin + size);
+        }
+
+        size_t length() {
+            return pptr() - pbase();
+        }
+    };
+
+    LogEntry entry;
+    Buffer buffer;
+    std::ostream out;
+};
+
+
+#endif //MATRIXSERVER_LOG_H
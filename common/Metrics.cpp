@@ -0,0 +1,221 @@
+#include "Metrics.h"
+
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocations(0);
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+int LatencyHistogram::bucketIndex(uint64_t ns) {
+    if (ns < (1u << METRICSSUBBUCKETBITS))
+        return (int) ns;
+    int exponent = 63 - __builtin_clzll(ns);
+    if (exponent > METRICSMAXEXPONENT)
+        return METRICSBUCKETS - 1;
+    int sub = (int) (ns >> (exponent - METRICSSUBBUCKETBITS)) & ((1 << METRICSSUBBUCKETBITS) - 1);
+    return ((exponent - METRICSSUBBUCKETBITS + 1) << METRICSSUBBUCKETBITS) + sub;
+}
+
+uint64_t LatencyHistogram::bucketStart(int index) {
+    if (index < (1 << METRICSSUBBUCKETBITS))
+        return index;
+    int exponent = (index >> METRICSSUBBUCKETBITS) + METRICSSUBBUCKETBITS - 1;
+    uint64_t sub = index & ((1 << METRICSSUBBUCKETBITS) - 1);
+    return ((1ULL << METRICSSUBBUCKETBITS) + sub) << (exponent - METRICSSUBBUCKETBITS);
+}
+
+void LatencyHistogram::record(int64_t ns) {
+    if (ns < 0)
+        ns = 0; // clock_gettime of two cores
+    buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumNs.fetch_add(ns, std::memory_order_relaxed);
+    auto max = maxNs.load(std::memory_order_relaxed);
+    while (ns > max && !maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+}
+
+uint64_t LatencyHistogram::getCount() {
+    return count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getSumNs() {
+    return sumNs.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::getMaxNs() {
+    return maxNs.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::percentile(double q) {
+    uint64_t snapshot[METRICSBUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < METRICSBUCKETS; i++) {
+        snapshot[i] = buckets[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+    }
+    if (total == 0)
+        return 0;
+    auto target = (uint64_t) std::ceil(q * total);
+    if (target < 1)
+        target = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < METRICSBUCKETS; i++) {
+        seen += snapshot[i];
+        if (seen >= target) {
+            auto start = bucketStart(i);
+            auto width = i + 1 < METRICSBUCKETS ? bucketStart(i + 1) - start : 0;
+            return start + width / 2;
+        }
+    }
+    return getMaxNs();
+}
+
+void LatencyHistogram::reset() {
+    for (auto &bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    sumNs.store(0, std::memory_order_relaxed);
+    maxNs.store(0, std::memory_order_relaxed);
+}
+
+namespace {
+    struct HistogramEntry {
+        std::string name;
+        std::string help;
+        LatencyHistogram histogram;
+    };
+
+    struct CounterEntry {
+        std::string name;
+        std::string help;
+        std::atomic<uint64_t> value{0};
+    };
+}
+
+// deques, the entries never move
+struct Metrics::Registry {
+    std::mutex mutex;
+    std::deque<HistogramEntry> histograms;
+    std::deque<CounterEntry> counters;
+};
+
+Metrics::Registry &Metrics::registry() {
+    static Registry *instance = new Registry(); // never destroyed, threads may still record at exit
+    return *instance;
+}
+
+LatencyHistogram &Metrics::histogram(const std::string &name, const std::string &help) {
+    auto &metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    for (auto &entry : metrics.histograms) {
+        if (entry.name == name)
+            return entry.histogram;
+    }
+    metrics.histograms.emplace_back();
+    metrics.histograms.back().name = name;
+    metrics.histograms.back().help = help;
+    return metrics.histograms.back().histogram;
+}
+
+std::atomic<uint64_t> &Metrics::counter(const std::string &name, const std::string &help) {
+    auto &metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    for (auto &entry : metrics.counters) {
+        if (entry.name == name)
+            return entry.value;
+    }
+    metrics.counters.emplace_back();
+    metrics.counters.back().name = name;
+    metrics.counters.back().help = help;
+    return metrics.counters.back().value;
+}
+
+void Metrics::countAllocation() {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Metrics::getAllocations() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void Metrics::fillStats(matrixserver::ServerStats &stats) {
+    auto &metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    for (auto &entry : metrics.histograms) {
+        auto *latency = stats.add_latencies();
+        latency->set_name(entry.name);
+        latency->set_help(entry.help);
+        latency->set_count(entry.histogram.getCount());
+        latency->set_sumns(entry.histogram.getSumNs());
+        latency->set_p50ns(entry.histogram.percentile(0.5));
+        latency->set_p90ns(entry.histogram.percentile(0.9));
+        latency->set_p99ns(entry.histogram.percentile(0.99));
+        latency->set_maxns(entry.histogram.getMaxNs());
+    }
+    for (auto &entry : metrics.counters) {
+        auto *counter = stats.add_counters();
+        counter->set_name(entry.name);
+        counter->set_help(entry.help);
+        counter->set_value(entry.value.load(std::memory_order_relaxed));
+    }
+    auto *counter = stats.add_counters();
+    counter->set_name("allocations");
+    counter->set_help("heap allocations, 0 unless built with MATRIXSERVER_COUNTALLOCATIONS");
+    counter->set_value(getAllocations());
+}
+
+static void appendSeconds(std::string &out, int64_t ns) {
+    char number[32];
+    snprintf(number, sizeof(number), "%.9f", ns / 1e9);
+    out += number;
+}
+
+static void appendHeader(std::string &out, const std::string &name, const std::string &help, const char *type) {
+    out += "# HELP " + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+}
+
+void Metrics::exposition(const matrixserver::ServerStats &stats, std::string &out) {
+    for (const auto &latency : stats.latencies()) {
+        auto name = "matrixserver_" + latency.name() + "_seconds";
+        appendHeader(out, name, latency.help(), "summary");
+        const std::pair<const char *, int64_t> quantiles[] = {{"0.5",  latency.p50ns()},
+                                                              {"0.9",  latency.p90ns()},
+                                                              {"0.99", latency.p99ns()}};
+        for (const auto &quantile : quantiles) {
+            out += name + "{quantile=\"" + quantile.first + "\"} ";
+            appendSeconds(out, quantile.second);
+            out += "\n";
+        }
+        out += name + "_sum ";
+        appendSeconds(out, latency.sumns());
+        out += "\n" + name + "_count " + std::to_string(latency.count()) + "\n";
+        appendHeader(out, name + "_max", "longest " + latency.name(), "gauge");
+        out += name + "_max ";
+        appendSeconds(out, latency.maxns());
+        out += "\n";
+    }
+    for (const auto &counter : stats.counters()) {
+        auto name = "matrixserver_" + counter.name() + "_total";
+        appendHeader(out, name, counter.help(), "counter");
+        out += name + " " + std::to_string(counter.value()) + "\n";
+    }
+    if (stats.apps_size() == 0)
+        return;
+    appendHeader(out, "matrixserver_app_frames_total", "frames received from the app", "counter");
+    for (const auto &app : stats.apps())
+        out += "matrixserver_app_frames_total{app=\"" + std::to_string(app.appid()) + "\"} " + std::to_string(app.frames()) + "\n";
+    appendHeader(out, "matrixserver_app_fps", "frame rate of the app", "gauge");
+    for (const auto &app : stats.apps()) {
+        char fps[32];
+        snprintf(fps, sizeof(fps), "%.2f", app.fps());
+        out += "matrixserver_app_fps{app=\"" + std::to_string(app.appid()) + "\"} " + fps + "\n";
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef MATRIXSERVER_METRICS_H
+#define MATRIXSERVER_METRICS_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <matrixserver.pb.h>
+
+#define METRICSSUBBUCKETBITS 3 // 8 buckets per power of two, a value is known within 12.5%
+#define METRICSMAXEXPONENT 40 // ~18 minutes in ns, longer values end up in the last bucket
+#define METRICSBUCKETS ((METRICSMAXEXPONENT - METRICSSUBBUCKETBITS + 2) << METRICSSUBBUCKETBITS)
+
+/*
+ * Latency histogram with log-linear buckets like HdrHistogram: values below 8 ns are exact,
+ * above that every power of two has 8 buckets. record() is a few relaxed atomic adds, so it can
+ * stay in the frame path of every thread, the readers only get a consistent view per counter.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(int64_t ns);
+
+    uint64_t getCount();
+
+    uint64_t getSumNs();
+
+    int64_t getMaxNs();
+
+    // the middle of the bucket holding the value at quantile q (0..1), 0 without values
+    int64_t percentile(double q);
+
+    void reset();
+
+    static int bucketIndex(uint64_t ns);
+
+    static uint64_t bucketStart(int index);
+
+private:
+    std::atomic<uint64_t> buckets[METRICSBUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sumNs;
+    std::atomic<int64_t> maxNs;
+};
+
+/*
+ * The process wide registry of the latency histograms and counters. Registration takes a lock,
+ * the hot path keeps the reference it got, best in a function local static:
+ *
+ *   static auto &decodeLatency = Metrics::histogram("decode", "protobuf parsing of a received message");
+ *   decodeLatency.record(FrameTimer::nowNs() - start);
+ *
+ * The same name always returns the same histogram or counter, they live until the process ends.
+ */
+class Metrics {
+public:
+    static LatencyHistogram &histogram(const std::string &name, const std::string &help);
+
+    static std::atomic<uint64_t> &counter(const std::string &name, const std::string &help);
+
+    // heap allocations since the start, 0 unless built with MATRIXSERVER_COUNTALLOCATIONS
+    static uint64_t getAllocations();
+
+    // called by the operator new of CountAllocations.cpp
+    static void countAllocation();
+
+    // all histograms and counters of the registry
+    static void fillStats(matrixserver::ServerStats &stats);
+
+    // Prometheus text exposition format: histograms as summaries in seconds (matrixserver_<name>_seconds),
+    // counters as matrixserver_<name>_total, the apps with an app label
+    static void exposition(const matrixserver::ServerStats &stats, std::string &out);
+
+private:
+    struct Registry;
+
+    // not file local: renderer libraries loaded into the server share the server's registry
+    static Registry &registry();
+};
+
+
+#endif //MATRIXSERVER_METRICS_H
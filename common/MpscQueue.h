@@ -0,0 +1,120 @@
+#ifndef MATRIXSERVER_MPSCQUEUE_H
+#define MATRIXSERVER_MPSCQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/*
+ * Bounded lock-free queue for any number of producer threads and one consumer thread. Every slot
+ * carries a sequence number, a producer claims a slot with one CAS on the tail and publishes it by
+ * advancing the slot's sequence, so producers never wait for each other to finish writing. The
+ * capacity is rounded up to a power of two, push fails (and is counted) when the queue is full.
+ * The consumer can sleep on a futex until something is pushed.
+ */
+template<typename T>
+class MpscQueue {
+public:
+    MpscQueue(size_t capacity = 256) : head(0), tail(0), signal(0), waiters(0), dropped(0) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        mask = size - 1;
+    }
+
+    MpscQueue(MpscQueue const &) = delete;
+
+    // any thread
+    bool push(const T &value) {
+        auto position = tail.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true) {
+            slot = &slots[position & mask];
+            auto sequence = slot->sequence.load(std::memory_order_acquire);
+            auto difference = (intptr_t) sequence - (intptr_t) position;
+            if (difference == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            } else if (difference < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = value;
+        slot->sequence.store(position + 1, std::memory_order_release);
+        // seq_cst pairs with the consumer's waiters increment, like TripleBuffer::publish
+        signal.fetch_add(1);
+        if (waiters.load() > 0)
+            syscall(SYS_futex, reinterpret_cast<int *>(&signal), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+        return true;
+    }
+
+    // consumer thread only
+    bool pop(T &value) {
+        auto &slot = slots[head & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+            return false;
+        value = std::move(slot.value);
+        slot.value = T(); // don't keep what the value references alive in the queue
+        slot.sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    // consumer thread only, sleeps until something was pushed, false on timeout or while the next value is
+    // still being written by a producer which was overtaken by another one
+    bool waitForData(int64_t timeoutNs) {
+        struct timespec timeout;
+        timeout.tv_sec = timeoutNs / 1000000000LL;
+        timeout.tv_nsec = timeoutNs % 1000000000LL;
+        auto sequence = signal.load(std::memory_order_acquire);
+        if (hasData())
+            return true;
+        waiters.fetch_add(1);
+        // returns immediately if something was pushed since sequence was read
+        syscall(SYS_futex, reinterpret_cast<int *>(&signal), FUTEX_WAIT_PRIVATE, sequence, &timeout, nullptr, 0);
+        waiters.fetch_sub(1);
+        return hasData();
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    uint64_t getDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    bool hasData() {
+        return slots[head & mask].sequence.load(std::memory_order_acquire) == head + 1;
+    }
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    size_t head; // consumer only
+    // padding instead of alignas(64), which a plain operator new doesn't honour before C++17
+    char headPadding[64];
+    std::atomic<size_t> tail;
+    char tailPadding[64];
+    std::atomic<uint32_t> signal; // futex word, incremented per push
+    std::atomic<uint32_t> waiters;
+    std::atomic<uint64_t> dropped;
+};
+
+
+#endif //MATRIXSERVER_MPSCQUEUE_H
@@ -0,0 +1,56 @@
+#ifndef MATRIXSERVER_SAMPLECHANNEL_H
+#define MATRIXSERVER_SAMPLECHANNEL_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "SeqLock.h"
+
+/*
+ * Latest sample of a sensor with its CLOCK_MONOTONIC timestamp. One thread publishes, any thread
+ * reads without locks. The count tells readers whether a new sample arrived since they last looked.
+ */
+template<typename T>
+class SampleChannel {
+public:
+    SampleChannel() : count(0) {}
+
+    void publish(const T &value, uint64_t timestamp) {
+        latest.store({timestamp, value});
+        count.fetch_add(1, std::memory_order_release);
+    }
+
+    // false until the first sample was published
+    bool get(T &value, uint64_t *timestamp = nullptr) const {
+        if (count.load(std::memory_order_acquire) == 0)
+            return false;
+        auto entry = latest.load();
+        value = entry.value;
+        if (timestamp != nullptr)
+            *timestamp = entry.timestamp;
+        return true;
+    }
+
+    T get() const {
+        return latest.load().value;
+    }
+
+    uint64_t getTimestamp() const {
+        return latest.load().timestamp;
+    }
+
+    uint64_t getCount() const {
+        return count.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Entry {
+        uint64_t timestamp;
+        T value;
+    };
+    SeqLock<Entry> latest;
+    std::atomic<uint64_t> count;
+};
+
+
+#endif //MATRIXSERVER_SAMPLECHANNEL_H
@@ -6,6 +6,9 @@ Screen::Screen(int setWidth, int setHeight, int setScreenId) {
     width = setWidth;
     height = setHeight;
     screenDataSize = width*height;
+    offsetX = 0;
+    offsetY = 0;
+    rotation = Rotation::rot0;
     screenData.resize(width*height, 0x00);
     clear();
 }
@@ -0,0 +1,49 @@
+#ifndef MATRIXSERVER_SEQLOCK_H
+#define MATRIXSERVER_SEQLOCK_H
+
+#include <atomic>
+#include <stdint.h>
+#include <type_traits>
+
+/*
+ * Single writer, many readers. The writer never waits, readers retry while a store is in progress,
+ * so readers always get a consistent copy without taking a lock. T has to be trivially copyable.
+ */
+template<typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+public:
+    SeqLock() : sequence(0), data() {}
+
+    void store(const T &value) {
+        auto seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        data = value;
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    T load() const {
+        T result;
+        uint64_t before, after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            result = data;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while (before != after || (before & 1));
+        return result;
+    }
+
+    // number of completed stores, cheap check for new data
+    uint64_t getVersion() const {
+        return sequence.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    std::atomic<uint64_t> sequence;
+    T data;
+};
+
+
+#endif //MATRIXSERVER_SEQLOCK_H
@@ -1,6 +1,10 @@
 #include "SocketConnection.h"
 
-#include <boost/log/trivial.hpp>
+#include <Log.h>
+
+#include <FrameTimer.h>
+#include <Metrics.h>
+#include <Trace.h>
 
 SocketConnection::SocketConnection(boost::asio::io_service &io_context) :
         io(io_context), socket(io), cobsDecoder(RECEIVE_BUFFER_SIZE) {
@@ -23,50 +27,108 @@ void SocketConnection::setReceiveCallback(
 }
 
 void SocketConnection::doRead() {
-    BOOST_LOG_TRIVIAL(trace) << "[SOCK CON] Starting Read";
+    MATRIXLOG(trace) << "[SOCK CON] Starting Read";
+    auto self = shared_from_this(); // the owner may let go while the read is pending
     socket.async_read_some(
             boost::asio::buffer(this->recv_buffer, RECEIVE_BUFFER_SIZE),
-            [this](boost::system::error_code error, size_t bytes_transferred) {
-                this->handleRead(error, bytes_transferred);
+            [self](boost::system::error_code error, size_t bytes_transferred) {
+                self->handleRead(error, bytes_transferred);
             });
 }
 
 void SocketConnection::handleRead(const boost::system::error_code &error, size_t bytes_transferred) {
-    BOOST_LOG_TRIVIAL(trace) << "[SOCK CON] Handling Read";
+    static auto &receiveLatency = Metrics::histogram("receive", "from the first to the last byte of a received message");
+    static auto &decodeLatency = Metrics::histogram("decode", "protobuf parsing of a received message");
+    static auto &bytesReceived = Metrics::counter("bytes_received", "bytes received on all connections");
+    static auto &messagesReceived = Metrics::counter("messages_received", "messages received on all connections");
+    MATRIXLOG(trace) << "[SOCK CON] Handling Read";
     if (!error) {
-        BOOST_LOG_TRIVIAL(trace) << "[SOCK CON] Received: " << bytes_transferred << " bytes";
-        auto packets = cobsDecoder.insertBytesAndReturnDecodedPackets((uint8_t *) this->recv_buffer, bytes_transferred);
-        for (auto packet : packets) {
-            auto receiveMessage = std::make_shared<matrixserver::MatrixServerMessage>();
-            if (receiveMessage->ParseFromString(packet)) {
-                BOOST_LOG_TRIVIAL(trace) << "[SOCK CON] Recieved full Protobuf MatrixServerMessage";
+        MATRIXLOG(trace) << "[SOCK CON] Received: " << bytes_transferred << " bytes";
+        auto readNs = FrameTimer::nowNs();
+        if (packetStartNs == 0)
+            packetStartNs = readNs;
+        bytesReceived.fetch_add(bytes_transferred, std::memory_order_relaxed);
+        cobsDecoder.insertBytes((uint8_t *) this->recv_buffer, bytes_transferred, [this, readNs](const std::string &packet) {
+            auto decodeStart = FrameTimer::nowNs();
+            receiveLatency.record(decodeStart - packetStartNs);
+            packetStartNs = readNs; // the next one started with this read
+            messagesReceived.fetch_add(1, std::memory_order_relaxed);
+            auto receiveMessage = getReceiveMessage();
+            bool parsed = receiveMessage->ParseFromArray(packet.data(), packet.size());
+            auto decodeEnd = FrameTimer::nowNs();
+            decodeLatency.record(decodeEnd - decodeStart);
+            Trace::record("decode", decodeStart, decodeEnd, receiveMessage->frameid());
+            if (parsed) {
+                MATRIXLOG(trace) << "[SOCK CON] Recieved full Protobuf MatrixServerMessage";
                 if (receiveCallback != NULL) {
                     receiveCallback(shared_from_this(), receiveMessage);
                 }
             } else {
                 if (message_buffer.size() > RECEIVE_BUFFER_SIZE) {
-                    BOOST_LOG_TRIVIAL(debug) << "[SOCK CON] Message Buffer to big, resetting";
+                    MATRIXLOG(debug) << "[SOCK CON] Message Buffer to big, resetting";
                 }
             }
-        }
+        });
+        if (bytes_transferred > 0 && recv_buffer[bytes_transferred - 1] == 0)
+            packetStartNs = 0; // no message started
         this->doRead();
     } else {
-        BOOST_LOG_TRIVIAL(debug) << "[SOCK CON] Read Error: " << error.message();
+        MATRIXLOG(debug) << "[SOCK CON] Read Error: " << error.message();
         dead = true;
     }
 }
 
 
+// never waits for a write in flight, it may be called on the io thread which has to complete it
 void SocketConnection::sendMessage(std::shared_ptr<matrixserver::MatrixServerMessage> message) {
-    auto sendBuffer = Cobs::encode(message->SerializeAsString());
-    BOOST_LOG_TRIVIAL(trace) << "[SOCK CON] Starting Write of " << sendBuffer.size() << " bytes - last byte: " << std::hex << (int)sendBuffer.back();
+    static auto &connectionsStalled = Metrics::counter("connections_stalled", "connections dropped because the peer stopped reading");
+    TraceSpan span("serialize");
+    std::lock_guard<std::mutex> lock(sendMutex);
+    if (dead)
+        return;
+    message->SerializeToString(&serializeBuffer);
+    Cobs::encode(serializeBuffer, encodeBuffer);
+    if (writing) {
+        if (pendingBuffer.size() + encodeBuffer.size() > SEND_BUFFER_LIMIT) {
+            // the peer sees the connection close, an app or a cluster follower reconnects and starts over
+            MATRIXLOG(warning) << "[SOCK CON] peer stopped reading, " << pendingBuffer.size() << " bytes pending, closing";
+            connectionsStalled.fetch_add(1, std::memory_order_relaxed);
+            dead = true;
+            std::string().swap(pendingBuffer);
+            auto self = shared_from_this();
+            io.post([self]() {
+                boost::system::error_code ignored;
+                self->socket.close(ignored);
+            });
+            return;
+        }
+        pendingBuffer.append(encodeBuffer); // goes out with the next write
+        return;
+    }
+    sendBuffer.swap(encodeBuffer);
+    writing = true;
+    doWrite();
+}
 
-    sendMutex.lock();
+// sendMutex held
+void SocketConnection::doWrite() {
+    MATRIXLOG(trace) << "[SOCK CON] Starting Write of " << sendBuffer.size() << " bytes - last byte: " << std::hex << (int)sendBuffer.back();
+    auto writeStart = Trace::isEnabled() ? FrameTimer::nowNs() : 0;
+    auto self = shared_from_this(); // sendBuffer has to outlive the write
     boost::asio::async_write(socket,
                              boost::asio::buffer(sendBuffer.data(), sendBuffer.size()),
-                             [this, sendBuffer](boost::system::error_code error, size_t bytes_transferred) {
-                                 sendMutex.unlock();
-                                 this->handleWrite(error, bytes_transferred, sendBuffer);
+                             [self, writeStart](boost::system::error_code error, size_t bytes_transferred) {
+                                 if (writeStart != 0)
+                                     Trace::record("write", writeStart, FrameTimer::nowNs());
+                                 self->handleWrite(error, bytes_transferred, self->sendBuffer);
+                                 std::lock_guard<std::mutex> lock(self->sendMutex);
+                                 if (!error && !self->pendingBuffer.empty()) {
+                                     self->sendBuffer.swap(self->pendingBuffer);
+                                     self->pendingBuffer.clear();
+                                     self->doWrite();
+                                 } else {
+                                     self->writing = false;
+                                 }
                              });
 }
 
@@ -86,19 +148,24 @@ std::string getHexArrayString(std::string input) {
 
 void SocketConnection::handleWrite(const boost::system::error_code &error, size_t bytes_transferred,
                                 const std::string &message_encoded) {
-    BOOST_LOG_TRIVIAL(trace) << "[SOCK CON] Handling Write";
+    static auto &bytesSent = Metrics::counter("bytes_sent", "bytes sent on the socket connections");
+    bytesSent.fetch_add(bytes_transferred, std::memory_order_relaxed);
+    MATRIXLOG(trace) << "[SOCK CON] Handling Write";
     if (!error) {
-        BOOST_LOG_TRIVIAL(trace) << "[SOCK CON] Written: " << bytes_transferred << " bytes from "
-                                 << message_encoded.size();
+        MATRIXLOG(trace) << "[SOCK CON] Written: " << bytes_transferred << " bytes from "
+                         << message_encoded.size();
     } else {
-        BOOST_LOG_TRIVIAL(debug) << "[SOCK CON] Write Error: " << error.message();
+        MATRIXLOG(debug) << "[SOCK CON] Write Error: " << error.message();
         dead = true;
     }
-    BOOST_LOG_TRIVIAL(trace) << "[SOCK CON] written packet end "
-                             << getHexArrayString((const uint8_t *) (message_encoded.data()+message_encoded.size()-10), 10);
-    for (int i = 0; i < message_encoded.size(); i++) {
-        if (message_encoded.at(i) == 0x00) {
-            BOOST_LOG_TRIVIAL(trace) << "[SOCK CON] Found 0 in packet at " << i;
+    if (!MATRIXLOG_ENABLED(trace))
+        return;
+    auto tail = std::min<size_t>(message_encoded.size(), 10);
+    MATRIXLOG(trace) << "[SOCK CON] written packet end "
+                     << getHexArrayString((const uint8_t *) (message_encoded.data() + message_encoded.size() - tail), tail);
+    for (size_t i = 0; i < message_encoded.size(); i++) {
+        if (message_encoded[i] == 0x00) {
+            MATRIXLOG(trace) << "[SOCK CON] Found 0 in packet at " << i;
         }
     }
 }
@@ -108,10 +175,18 @@ bool SocketConnection::isDead() {
 }
 
 SocketConnection::~SocketConnection() {
-//    BOOST_LOG_TRIVIAL(trace) << "[SOCK CON] Shutdown socket";
+//    MATRIXLOG(trace) << "[SOCK CON] Shutdown socket";
 //    this->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both);
 }
 
 void SocketConnection::setDead(bool sDead) {
     dead = sDead;
 }
+
+TransportType SocketConnection::getTransport() {
+    boost::system::error_code error;
+    auto endpoint = socket.local_endpoint(error);
+    if (!error && endpoint.protocol().family() == AF_UNIX)
+        return TransportType::unixSocket;
+    return TransportType::tcp;
+}
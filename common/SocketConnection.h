@@ -10,6 +10,7 @@
 #include "UniversalConnection.h"
 
 #define RECEIVE_BUFFER_SIZE 200000
+#define SEND_BUFFER_LIMIT 4000000 // bytes queued behind the write in flight, a peer which reads slower is dropped
 
 class SocketConnection :  public std::enable_shared_from_this<SocketConnection>, public UniversalConnection {
 public:
@@ -31,9 +32,13 @@ public:
 
     void setDead(bool sDead);
 
+    TransportType getTransport();
+
 private:
     void doRead();
 
+    void doWrite();
+
     void handleWrite(const boost::system::error_code &error, size_t bytes_transferred,
                      const std::string & message_encoded);
 
@@ -44,7 +49,13 @@ private:
     std::mutex sendMutex;
     char recv_buffer[RECEIVE_BUFFER_SIZE];
     std::string message_buffer;
+    std::string serializeBuffer;
+    std::string encodeBuffer;
+    std::string sendBuffer; // in use by the write in flight
+    std::string pendingBuffer; // messages sent while a write is in flight
+    bool writing = false; // sendMutex
     Cobs cobsDecoder;
+    int64_t packetStartNs = 0; // when the first bytes of the message being received arrived, 0: none yet
     std::function<void(std::shared_ptr<UniversalConnection>,
                        std::shared_ptr<matrixserver::MatrixServerMessage>)> receiveCallback;
     bool dead = false;
@@ -0,0 +1,72 @@
+#ifndef MATRIXSERVER_SPSCQUEUE_H
+#define MATRIXSERVER_SPSCQUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Bounded lock-free queue for exactly one producer and one consumer thread. The capacity is rounded
+ * up to a power of two. push fails instead of overwriting when the consumer falls behind, the
+ * failures are counted so they can be reported.
+ */
+template<typename T>
+class SpscQueue {
+public:
+    SpscQueue(size_t capacity = 256) : head(0), tail(0), dropped(0) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        buffer.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(SpscQueue const &) = delete;
+
+    // producer thread only
+    bool push(const T &value) {
+        auto currentTail = tail.load(std::memory_order_relaxed);
+        if (currentTail - head.load(std::memory_order_acquire) > mask) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        buffer[currentTail & mask] = value;
+        tail.store(currentTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer thread only
+    bool pop(T &value) {
+        auto currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead == tail.load(std::memory_order_acquire))
+            return false;
+        value = buffer[currentHead & mask];
+        head.store(currentHead + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    uint64_t getDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<T> buffer;
+    size_t mask;
+    // padding instead of alignas(64), which a plain operator new doesn't honour before C++17
+    char bufferPadding[64];
+    std::atomic<size_t> head;
+    char headPadding[64];
+    std::atomic<size_t> tail;
+    std::atomic<uint64_t> dropped;
+};
+
+
+#endif //MATRIXSERVER_SPSCQUEUE_H
@@ -1,5 +1,5 @@
 #include "TcpClient.h"
-#include <boost/log/trivial.hpp>
+#include <Log.h>
 //
 //TcpClient::TcpClient(boost::asio::io_service &setIo, std::string serverAddress, std::string serverPort) :
 //        io(setIo),
@@ -10,7 +10,7 @@
 //
 //
 //void TcpClient::doAsyncConnect() {
-//    BOOST_LOG_TRIVIAL(debug) << "[TcpClient] connecting to address: " << this->endpoint.address().to_string()
+//    MATRIXLOG(debug) << "[TcpClient] connecting to address: " << this->endpoint.address().to_string()
 //                             << " and port: " << this->endpoint.port();
 //    this->current_connection = std::make_shared<SocketConnection>(io);
 //    this->current_connection->getSocket().async_connect(this->endpoint,
@@ -26,18 +26,18 @@
 //
 //void TcpClient::handleConnect(const boost::system::error_code &error) {
 //    if (!error) {
-//        BOOST_LOG_TRIVIAL(debug) << "[TcpClient] Connect Successfull to address: "
+//        MATRIXLOG(debug) << "[TcpClient] Connect Successfull to address: "
 //                                 << this->endpoint.address().to_string()
 //                                 << " and port: " << this->endpoint.port();
 //        if (connectCallback != nullptr) {
-//            BOOST_LOG_TRIVIAL(trace) << "[TcpClient] calling connect callback now";
+//            MATRIXLOG(trace) << "[TcpClient] calling connect callback now";
 //            connectCallback(current_connection);
 //            this->current_connection->startReceiving();
 //        } else {
-//            BOOST_LOG_TRIVIAL(trace) << "[TcpClient] no connect callback defined";
+//            MATRIXLOG(trace) << "[TcpClient] no connect callback defined";
 //        }
 //    } else {
-//        BOOST_LOG_TRIVIAL(debug) << "[TcpClient] Connect Error: " << error.message() << " Address: "
+//        MATRIXLOG(debug) << "[TcpClient] Connect Error: " << error.message() << " Address: "
 //                                 << this->endpoint.address().to_string()
 //                                 << " and port: " << this->endpoint.port();
 //    }
@@ -57,13 +57,13 @@ TcpClient::connect(boost::asio::io_service &io, std::string serverAddress, std::
         boost::asio::ip::tcp::endpoint endpoint = *endpoints;
         sockConnection->getSocket().connect(endpoint);
         if (sockConnection->getSocket().is_open()) {
-            BOOST_LOG_TRIVIAL(debug) << "[TcpClient] Connect Successful to address: "
-                                     << endpoint.address().to_string()
-                                     << " and port: " << endpoint.port();
+            MATRIXLOG(debug) << "[TcpClient] Connect Successful to address: "
+                             << endpoint.address().to_string()
+                             << " and port: " << endpoint.port();
             sockConnection->startReceiving();
         }
     } catch (boost::system::system_error e) {
-        BOOST_LOG_TRIVIAL(debug) << "[TcpClient] " << e.what();
+        MATRIXLOG(debug) << "[TcpClient] " << e.what();
         sockConnection->setDead(true);
     }
     return sockConnection;
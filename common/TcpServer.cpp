@@ -1,5 +1,5 @@
 #include "TcpServer.h"
-#include <boost/log/trivial.hpp>
+#include <Log.h>
 
 TcpServer::TcpServer(boost::asio::io_service &setIo, boost::asio::ip::tcp::endpoint setEndpoint) :
         io(setIo),
@@ -10,8 +10,8 @@ TcpServer::TcpServer(boost::asio::io_service &setIo, boost::asio::ip::tcp::endpo
 }
 
 void TcpServer::doAccept() {
-    BOOST_LOG_TRIVIAL(debug) << "[Server] Start accepting on address: " << this->endpoint.address().to_string()
-                             << " and port: " << this->endpoint.port();
+    MATRIXLOG(debug) << "[Server] Start accepting on address: " << this->endpoint.address().to_string()
+                     << " and port: " << this->endpoint.port();
     acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
     auto tempCon = std::make_shared<SocketConnection>(io);
     this->acceptor.async_accept(tempCon->getSocket(),
@@ -22,14 +22,14 @@ void TcpServer::doAccept() {
 
 void TcpServer::handleAccept(const boost::system::error_code &error, std::shared_ptr<SocketConnection> connection) {
     if (!error) {
-        BOOST_LOG_TRIVIAL(debug) << "[Server] Accepted Connection";
+        MATRIXLOG(debug) << "[Server] Accepted Connection";
         connection->startReceiving();
         if (acceptCallback != NULL) {
             acceptCallback(connection);
         }
         doAccept();
     } else {
-        BOOST_LOG_TRIVIAL(debug) << "[Server] Server Accept Error: " << error.message();
+        MATRIXLOG(debug) << "[Server] Server Accept Error: " << error.message();
     }
 }
 
@@ -0,0 +1,301 @@
+#include "Trace.h"
+
+#include <mutex>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+std::atomic<bool> Trace::enabled(false);
+
+namespace {
+    // single writer (the owning thread), the dump reads it without stopping the writer
+    struct TraceRing {
+        std::atomic<uint64_t> head{0};
+        uint64_t dumped = 0; // registry mutex
+        std::atomic<bool> owned{true};
+        int32_t tid = 0;
+        char threadName[16] = {0};
+        TraceEvent events[TRACERINGSIZE];
+    };
+
+    // gives the ring to the next new thread when this one ends, its spans stay until they are dumped
+    struct RingOwner {
+        TraceRing *ring = nullptr;
+
+        ~RingOwner() {
+            if (ring != nullptr)
+                ring->owned.store(false, std::memory_order_release);
+        }
+    };
+
+    struct TraceRegistry {
+        std::mutex mutex;
+        std::vector<TraceRing *> rings;
+        std::string path = TRACEDEFAULTPATH;
+    };
+}
+
+static std::atomic<bool> dumpRequested(false);
+static thread_local RingOwner ringOwner;
+static thread_local uint64_t currentFrame = 0;
+
+static TraceRegistry &registry() {
+    static auto *instance = new TraceRegistry(); // never destroyed, threads may still record at exit
+    return *instance;
+}
+
+static void lockBeforeFork() {
+    registry().mutex.lock();
+}
+
+static void unlockAfterFork() {
+    registry().mutex.unlock();
+}
+
+// the child of a fork only has the forking thread, the parent's spans are the parent's to dump
+static void forgetRingsAfterFork() {
+    auto &traces = registry();
+    traces.rings.clear();
+    traces.mutex.unlock();
+    ringOwner.ring = nullptr;
+}
+
+static TraceRing *threadRing() {
+    if (ringOwner.ring != nullptr)
+        return ringOwner.ring;
+    auto &traces = registry();
+    std::lock_guard<std::mutex> lock(traces.mutex);
+    static bool atForkRegistered = false;
+    if (!atForkRegistered) {
+        pthread_atfork(&lockBeforeFork, &unlockAfterFork, &forgetRingsAfterFork);
+        atForkRegistered = true;
+    }
+    TraceRing *ring = nullptr;
+    for (auto *candidate : traces.rings) {
+        bool expected = false;
+        if (candidate->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            ring = candidate;
+            break;
+        }
+    }
+    if (ring == nullptr) {
+        ring = new TraceRing();
+        traces.rings.push_back(ring);
+    }
+    ring->tid = (int32_t) syscall(SYS_gettid);
+    if (pthread_getname_np(pthread_self(), ring->threadName, sizeof(ring->threadName)) != 0)
+        ring->threadName[0] = 0;
+    ringOwner.ring = ring;
+    return ring;
+}
+
+static void handleDumpSignal(int) {
+    dumpRequested.store(true, std::memory_order_relaxed);
+}
+
+void Trace::init() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        signal(TRACEDUMPSIGNAL, &handleDumpSignal);
+        const char *path = getenv(TRACEENVVARIABLE);
+        if (path == nullptr)
+            return;
+        if (*path != 0)
+            setPath(path);
+        setEnabled(true);
+    });
+}
+
+void Trace::setEnabled(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+void Trace::setPath(const std::string &path) {
+    auto &traces = registry();
+    std::lock_guard<std::mutex> lock(traces.mutex);
+    traces.path = path;
+}
+
+std::string Trace::getPath() {
+    auto &traces = registry();
+    std::lock_guard<std::mutex> lock(traces.mutex);
+    return traces.path;
+}
+
+void Trace::record(const char *name, int64_t startNs, int64_t endNs, uint64_t frameId, TraceFlow flow) {
+    if (!isEnabled())
+        return;
+    auto *ring = threadRing();
+    auto head = ring->head.load(std::memory_order_relaxed);
+    auto &event = ring->events[head % TRACERINGSIZE];
+    event.name = name;
+    event.startNs = startNs;
+    event.durationNs = endNs - startNs;
+    event.frameId = frameId != 0 ? frameId : currentFrame;
+    event.tid = ring->tid;
+    event.flow = flow;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+uint64_t Trace::getFrame() {
+    return currentFrame;
+}
+
+void Trace::setFrame(uint64_t frameId) {
+    currentFrame = frameId;
+}
+
+uint64_t Trace::makeFrameId(uint32_t counter) {
+    return ((uint64_t) getpid() << 32) | counter;
+}
+
+void Trace::poll() {
+    if (dumpRequested.load(std::memory_order_relaxed) && dumpRequested.exchange(false))
+        dumpToFile();
+}
+
+static void appendMicros(std::string &out, int64_t ns) {
+    char number[32];
+    snprintf(number, sizeof(number), "%lld.%03lld", (long long) (ns / 1000), (long long) (ns % 1000));
+    out += number;
+}
+
+static void appendEvent(std::string &out, const TraceEvent &event, int pid) {
+    char ids[96];
+    snprintf(ids, sizeof(ids), ",\"pid\":%d,\"tid\":%d", pid, event.tid);
+    out += "{\"name\":\"";
+    out += event.name;
+    out += "\",\"ph\":\"X\",\"ts\":";
+    appendMicros(out, event.startNs);
+    out += ",\"dur\":";
+    appendMicros(out, event.durationNs);
+    out += ids;
+    if (event.frameId != 0) {
+        char frame[64];
+        snprintf(frame, sizeof(frame), ",\"args\":{\"frame\":\"%u:%u\"}",
+                 (unsigned) (event.frameId >> 32), (unsigned) (event.frameId & 0xffffffff));
+        out += frame;
+    }
+    out += "},\n";
+    if (event.flow == TraceFlow::none || event.frameId == 0)
+        return;
+    // an arrow from the span which sent the frame to the one which received it
+    char flow[64];
+    snprintf(flow, sizeof(flow), "\"id\":\"0x%llx\"", (unsigned long long) event.frameId);
+    out += "{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"";
+    out += event.flow == TraceFlow::out ? "s\"," : "f\",\"bp\":\"e\",";
+    out += flow;
+    out += ",\"ts\":";
+    appendMicros(out, event.startNs);
+    out += ids;
+    out += "},\n";
+}
+
+static void appendMetadata(std::string &out, const char *type, int pid, int tid, const char *name) {
+    char ids[64];
+    snprintf(ids, sizeof(ids), "\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d", pid, tid);
+    out += "{\"name\":\"";
+    out += type;
+    out += ids;
+    out += ",\"args\":{\"name\":\"";
+    for (const char *c = name; *c != 0; c++) {
+        if (*c != '"' && *c != '\\' && *c >= ' ')
+            out += *c;
+    }
+    out += "\"}},\n";
+}
+
+void Trace::dump(std::string &out) {
+    auto &traces = registry();
+    std::lock_guard<std::mutex> lock(traces.mutex);
+    int pid = getpid();
+    char processName[32] = {0};
+    FILE *comm = fopen("/proc/self/comm", "r");
+    if (comm != nullptr) {
+        if (fgets(processName, sizeof(processName), comm) != nullptr)
+            processName[strcspn(processName, "\n")] = 0;
+        fclose(comm);
+    }
+    auto start = out.size();
+    std::vector<TraceEvent> events;
+    for (auto *ring : traces.rings) {
+        auto head = ring->head.load(std::memory_order_acquire);
+        auto from = head > TRACERINGSIZE ? head - TRACERINGSIZE : 0;
+        if (ring->dumped > from)
+            from = ring->dumped;
+        events.clear();
+        for (auto i = from; i < head; i++)
+            events.push_back(ring->events[i % TRACERINGSIZE]);
+        // the writer may have lapped the copy, the events it overwrote meanwhile and the slot it may be
+        // writing right now are dropped
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto after = ring->head.load(std::memory_order_relaxed);
+        auto valid = after >= TRACERINGSIZE ? after - TRACERINGSIZE + 1 : 0;
+        for (auto i = from; i < head; i++) {
+            if (i >= valid)
+                appendEvent(out, events[i - from], pid);
+        }
+        ring->dumped = head;
+        if (head > from && ring->threadName[0] != 0)
+            appendMetadata(out, "thread_name", pid, ring->tid, ring->threadName);
+    }
+    if (out.size() > start && processName[0] != 0)
+        appendMetadata(out, "process_name", pid, 0, processName);
+}
+
+bool Trace::dumpToFile(const std::string &path) {
+    std::string out;
+    dump(out);
+    if (out.empty())
+        return true;
+    if (access(path.c_str(), F_OK) != 0) {
+        // linked into place with the '[' already in it, no other process can append before it
+        auto temporary = path + "." + std::to_string(getpid());
+        int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0644);
+        if (fd >= 0) {
+            bool written = write(fd, "[\n", 2) == 2;
+            close(fd);
+            if (written)
+                link(temporary.c_str(), path.c_str());
+            unlink(temporary.c_str());
+        }
+    }
+    // the default path is in /tmp, a symlink planted there must not redirect the dump to another file
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_NOFOLLOW);
+    if (fd < 0)
+        return false;
+    // one write, the dumps of several processes don't interleave
+    bool written = write(fd, out.data(), out.size()) == (ssize_t) out.size();
+    close(fd);
+    return written;
+}
+
+bool Trace::dumpToFile() {
+    return dumpToFile(getPath());
+}
+
+bool Trace::apply(const matrixserver::TraceRequest &request) {
+    // the request may come from any client, it only picks between the paths the host configured
+    const char *configuredPath = getenv(TRACEENVVARIABLE);
+    bool configured = configuredPath != nullptr && *configuredPath != 0 && request.path() == configuredPath;
+    if (request.path() == TRACEDEFAULTPATH || configured)
+        setPath(request.path());
+    else if (!request.path().empty())
+        return false;
+    switch (request.action()) {
+        case matrixserver::TraceRequest::start:
+            setEnabled(true);
+            return true;
+        case matrixserver::TraceRequest::stop:
+            setEnabled(false);
+            return dumpToFile();
+        default:
+            return dumpToFile();
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef MATRIXSERVER_TRACE_H
+#define MATRIXSERVER_TRACE_H
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+#include <matrixserver.pb.h>
+#include "FrameTimer.h"
+
+#define TRACEENVVARIABLE "MATRIXSERVER_TRACE" // enables tracing, the file the traces are appended to
+#define TRACEDEFAULTPATH "/tmp/matrixserver-trace.json"
+#define TRACERINGSIZE 8192 // spans per thread, older ones are overwritten, a dump gets at most TRACERINGSIZE - 1
+#define TRACEDUMPSIGNAL SIGUSR2
+
+enum class TraceFlow {
+    none, out, in // a span which sends the frame to another thread or process, the span which receives it
+};
+
+struct TraceEvent {
+    const char *name;
+    int64_t startNs;
+    int64_t durationNs;
+    uint64_t frameId;
+    int32_t tid;
+    TraceFlow flow;
+};
+
+/*
+ * Span recorder for following a frame from the app's loop() to the display. Every thread appends to its
+ * own ring, so recording is two clock reads and a store without locks; when tracing is off a span is a
+ * single relaxed load. The names have to be string literals, only the pointer is kept.
+ *
+ * Spans carry the id of the frame they work on: set explicitly, or the one of the enclosing TraceFrame of
+ * the thread. Frame ids are unique across processes (pid << 32 | counter) and the timestamps are
+ * CLOCK_MONOTONIC, so the dumps of the apps and the server are one timeline. A dump appends the spans
+ * recorded since the previous one to a shared file in the Chrome JSON array format, which is open for
+ * appending (the closing bracket is optional), load it in chrome://tracing or ui.perfetto.dev.
+ *
+ * Dumps are taken on TRACEDUMPSIGNAL (handled at the next poll()), on a trace message or by calling dumpToFile().
+ */
+class Trace {
+public:
+    // installs the dump signal handler, enables tracing if TRACEENVVARIABLE is set
+    static void init();
+
+    static void setEnabled(bool enabled);
+
+    static inline bool isEnabled() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    static void setPath(const std::string &path);
+
+    static std::string getPath();
+
+    static void record(const char *name, int64_t startNs, int64_t endNs, uint64_t frameId = 0,
+                       TraceFlow flow = TraceFlow::none);
+
+    // the frame the spans of this thread belong to, 0 for none
+    static uint64_t getFrame();
+
+    static void setFrame(uint64_t frameId);
+
+    static uint64_t makeFrameId(uint32_t counter);
+
+    // dumps if the signal arrived since the last call
+    static void poll();
+
+    // the spans since the last dump as JSON array elements, each followed by a comma
+    static void dump(std::string &out);
+
+    // appends the spans since the last dump to the trace file, starts it with '[' if it is new
+    static bool dumpToFile(const std::string &path);
+
+    static bool dumpToFile();
+
+    // start, stop or dump as asked by a trace message, fails for a path other than TRACEDEFAULTPATH or
+    // the one in TRACEENVVARIABLE
+    static bool apply(const matrixserver::TraceRequest &request);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name, uint64_t frameId = 0, TraceFlow flow = TraceFlow::none)
+            : name(nullptr), frameId(frameId), flow(flow), startNs(0) {
+        if (Trace::isEnabled()) {
+            this->name = name;
+            startNs = FrameTimer::nowNs();
+        }
+    }
+
+    ~TraceSpan() {
+        if (name != nullptr)
+            Trace::record(name, startNs, FrameTimer::nowNs(), frameId, flow);
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    uint64_t frameId;
+    TraceFlow flow;
+    int64_t startNs;
+};
+
+// sets the frame of the thread's spans for a scope
+class TraceFrame {
+public:
+    explicit TraceFrame(uint64_t frameId) : previous(Trace::getFrame()) {
+        Trace::setFrame(frameId);
+    }
+
+    ~TraceFrame() {
+        Trace::setFrame(previous);
+    }
+
+    TraceFrame(const TraceFrame &) = delete;
+
+    TraceFrame &operator=(const TraceFrame &) = delete;
+
+private:
+    uint64_t previous;
+};
+
+
+#endif //MATRIXSERVER_TRACE_H
@@ -0,0 +1,111 @@
+#ifndef MATRIXSERVER_TRIPLEBUFFER_H
+#define MATRIXSERVER_TRIPLEBUFFER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+struct TripleBufferStats {
+    uint64_t published = 0; // frames completed by the writer
+    uint64_t presented = 0; // frames picked up by the reader
+    uint64_t dropped = 0;   // frames replaced by a newer one before the reader got them
+    uint64_t repeated = 0;  // reader updates without a new frame, the last one is shown again
+};
+
+/*
+ * Hands frames from one writer thread to one reader thread. The writer always has a free buffer to
+ * draw into and never waits, the reader always gets the newest completed frame. The buffers rotate
+ * through a single atomic "middle" slot, the reader sleeps on a futex until a frame is published.
+ */
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : middle(1), sequence(0), waiters(0), writeIndex(0), readIndex(2) {}
+
+    TripleBuffer(TripleBuffer const &) = delete;
+
+    // direct access for the setup of the buffers, before the threads run
+    T &getBuffer(int index) {
+        return buffers[index];
+    }
+
+    // writer thread only
+    T &getWriteBuffer() {
+        return buffers[writeIndex];
+    }
+
+    void publish() {
+        auto previous = middle.exchange(writeIndex | DIRTY, std::memory_order_acq_rel);
+        if (previous & DIRTY)
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        writeIndex = previous & INDEXMASK;
+        published.fetch_add(1, std::memory_order_relaxed);
+        // seq_cst pairs with the reader's waiters increment, so either the wake or the futex value check sees it
+        sequence.fetch_add(1);
+        if (waiters.load() > 0)
+            syscall(SYS_futex, reinterpret_cast<int *>(&sequence), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    // reader thread only, swaps in the newest frame, false (and a repeat) if there is none
+    bool update() {
+        if (!(middle.load(std::memory_order_acquire) & DIRTY)) {
+            repeated.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEXMASK;
+        presented.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // sleeps until a new frame is published, false on timeout (not counted as a repeat)
+    bool waitForUpdate(int64_t timeoutNs) {
+        struct timespec timeout;
+        timeout.tv_sec = timeoutNs / 1000000000LL;
+        timeout.tv_nsec = timeoutNs % 1000000000LL;
+        auto seq = sequence.load(std::memory_order_acquire);
+        if (!(middle.load(std::memory_order_acquire) & DIRTY)) {
+            waiters.fetch_add(1);
+            // returns immediately if a frame was published since seq was read
+            syscall(SYS_futex, reinterpret_cast<int *>(&sequence), FUTEX_WAIT_PRIVATE, seq, &timeout, nullptr, 0);
+            waiters.fetch_sub(1);
+            if (!(middle.load(std::memory_order_acquire) & DIRTY))
+                return false;
+        }
+        return update();
+    }
+
+    T &getReadBuffer() {
+        return buffers[readIndex];
+    }
+
+    TripleBufferStats getStats() {
+        TripleBufferStats stats;
+        stats.published = published.load(std::memory_order_relaxed);
+        stats.presented = presented.load(std::memory_order_relaxed);
+        stats.dropped = dropped.load(std::memory_order_relaxed);
+        stats.repeated = repeated.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    static const uint32_t DIRTY = 4;
+    static const uint32_t INDEXMASK = 3;
+
+    T buffers[3];
+    std::atomic<uint32_t> middle; // index of the middle buffer | DIRTY if it holds an unread frame
+    std::atomic<uint32_t> sequence; // futex word, incremented per published frame
+    std::atomic<uint32_t> waiters;
+    uint32_t writeIndex;
+    uint32_t readIndex;
+
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> presented{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> repeated{0};
+};
+
+
+#endif //MATRIXSERVER_TRIPLEBUFFER_H
@@ -1 +1,31 @@
 #include "UniversalConnection.h"
+
+// hands out the last received message again once all receivers released it, parsing into it keeps its allocations
+std::shared_ptr<matrixserver::MatrixServerMessage> UniversalConnection::getReceiveMessage() {
+    if (receiveMessage.use_count() != 1)
+        receiveMessage = std::make_shared<matrixserver::MatrixServerMessage>();
+    return receiveMessage;
+}
+
+TransportType transportFromString(const std::string &name) {
+    if (name == "ipc")
+        return TransportType::ipc;
+    if (name == "unix" || name == "unixSocket")
+        return TransportType::unixSocket;
+    if (name == "tcp")
+        return TransportType::tcp;
+    return TransportType::automatic;
+}
+
+std::string transportToString(TransportType transport) {
+    switch (transport) {
+        case TransportType::ipc:
+            return "ipc";
+        case TransportType::unixSocket:
+            return "unix";
+        case TransportType::tcp:
+            return "tcp";
+        default:
+            return "auto";
+    }
+}
@@ -7,6 +7,18 @@
 #include <mutex>
 #include <matrixserver.pb.h>
 
+#define DEFAULTIPCADDRESS "matrixserver"
+#define DEFAULTUNIXSOCKETPATH "/tmp/matrixserver.sock"
+
+// ordered from fastest to slowest, ipc and unixSocket are only usable on the same host
+enum class TransportType {
+    automatic, ipc, unixSocket, tcp
+};
+
+TransportType transportFromString(const std::string &name);
+
+std::string transportToString(TransportType transport);
+
 class UniversalConnection{
 public:
     virtual void startReceiving() = 0;
@@ -19,6 +31,15 @@ public:
     virtual bool isDead() = 0;
 
     virtual void setDead(bool sDead) = 0;
+
+    // ipc and unixSocket (also a socketpair) peers are on the same host
+    virtual TransportType getTransport() = 0;
+
+protected:
+    std::shared_ptr<matrixserver::MatrixServerMessage> getReceiveMessage();
+
+private:
+    std::shared_ptr<matrixserver::MatrixServerMessage> receiveMessage;
 };
 
 #endif //MATRIXSERVER_UNIVERSALCONNECTION_H
@@ -1,5 +1,5 @@
 #include "UnixSocketClient.h"
-#include <boost/log/trivial.hpp>
+#include <Log.h>
 
 std::shared_ptr<SocketConnection>
 UnixSocketClient::connect(boost::asio::io_service &io, std::string socketFile) {
@@ -8,12 +8,24 @@ UnixSocketClient::connect(boost::asio::io_service &io, std::string socketFile) {
     try {
         sockConnection->getSocket().connect(unix_endpoint);
         if (sockConnection->getSocket().is_open()) {
-            BOOST_LOG_TRIVIAL(debug) << "[UnixSocketClient] Connect successful to path: "
-                                     << unix_endpoint.path();
+            MATRIXLOG(debug) << "[UnixSocketClient] Connect successful to path: "
+                             << unix_endpoint.path();
             sockConnection->startReceiving();
         }
     } catch (boost::system::system_error e) {
-        BOOST_LOG_TRIVIAL(debug) << "[UnixSocketClient] " << e.what();
+        MATRIXLOG(debug) << "[UnixSocketClient] " << e.what();
+        sockConnection->setDead(true);
+    }
+    return sockConnection;
+}
+
+std::shared_ptr<SocketConnection> UnixSocketClient::adopt(boost::asio::io_service &io, int fd) {
+    auto sockConnection = std::make_shared<SocketConnection>(io);
+    try {
+        sockConnection->getSocket().assign(boost::asio::generic::stream_protocol(AF_UNIX, SOCK_STREAM), fd);
+        sockConnection->startReceiving();
+    } catch (boost::system::system_error e) {
+        MATRIXLOG(debug) << "[UnixSocketClient] " << e.what();
         sockConnection->setDead(true);
     }
     return sockConnection;
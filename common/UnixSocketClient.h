@@ -3,9 +3,14 @@
 
 #include <SocketConnection.h>
 
+#define LAUNCHERFDENVVARIABLE "MATRIXSERVER_FD" // connected socket inherited from the server's launcher
+
 class UnixSocketClient {
 public:
     static std::shared_ptr<SocketConnection> connect(boost::asio::io_service &io, std::string socketFile);
+
+    // takes over an already connected unix stream socket, e.g. one end of a socketpair()
+    static std::shared_ptr<SocketConnection> adopt(boost::asio::io_service &io, int fd);
 };
 
 
@@ -1,5 +1,5 @@
 #include "UnixSocketServer.h"
-#include <boost/log/trivial.hpp>
+#include <Log.h>
 
 UnixSocketServer::UnixSocketServer(boost::asio::io_service &setIo, boost::asio::local::stream_protocol::endpoint setEndpoint) :
         io(setIo),
@@ -15,7 +15,7 @@ UnixSocketServer::UnixSocketServer(boost::asio::io_service &setIo, boost::asio::
 }
 
 void UnixSocketServer::doAccept() {
-    BOOST_LOG_TRIVIAL(debug) << "[Server] Start accepting on path: " << this->endpoint.path();
+    MATRIXLOG(debug) << "[Server] Start accepting on path: " << this->endpoint.path();
     auto tempCon = std::make_shared<SocketConnection>(io);
     this->acceptor.async_accept(tempCon->getSocket(),
                                 [this, tempCon](boost::system::error_code error) {
@@ -25,14 +25,14 @@ void UnixSocketServer::doAccept() {
 
 void UnixSocketServer::handleAccept(const boost::system::error_code &error, std::shared_ptr<SocketConnection> connection) {
     if (!error) {
-        BOOST_LOG_TRIVIAL(debug) << "[Server] Accepted Connection";
+        MATRIXLOG(debug) << "[Server] Accepted Connection";
         connection->startReceiving();
         if (acceptCallback != NULL) {
             acceptCallback(connection);
         }
         doAccept();
     } else {
-        BOOST_LOG_TRIVIAL(debug) << "[Server] Server Accept Error: " << error.message();
+        MATRIXLOG(debug) << "[Server] Server Accept Error: " << error.message();
     }
 }
 
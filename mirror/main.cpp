@@ -0,0 +1,100 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+#include <FrameMirror.h>
+#include <FrameTimer.h>
+
+/*
+ * Looks at the frame a server publishes when ServerConfig.mirrorName is set, without disturbing it:
+ * - prints how many frames were published, the frame rate and the age of the last frame
+ * - --screenshot writes the last frame as a binary PPM, the screens side by side
+ * - --max-age makes it a health check: exits with 1 if the last frame is older (or there is no mirror)
+ */
+
+struct MirrorOptions {
+    std::string name = FRAMEMIRRORDEFAULTNAME;
+    std::string screenshot;
+    double maxAgeSeconds = 0;
+    bool watch = false;
+};
+
+static void usage() {
+    std::cout << "usage: matrixmirror [<name>] [--screenshot <file.ppm>] [--max-age <seconds>] [--watch]" << std::endl;
+}
+
+static bool writeScreenshot(const std::string &path, std::vector<std::shared_ptr<Screen>> &screens) {
+    int width = 0;
+    int height = 0;
+    for (auto &screen : screens) {
+        width += screen->getWidth();
+        height = std::max(height, screen->getHeight());
+    }
+    std::vector<uint8_t> pixels(width * height * 3, 0);
+    int left = 0;
+    for (auto &screen : screens) {
+        for (int y = 0; y < screen->getHeight(); y++) {
+            for (int x = 0; x < screen->getWidth(); x++) {
+                auto color = screen->getPixel(x, y);
+                auto *pixel = &pixels[(y * width + left + x) * 3];
+                pixel[0] = color.r();
+                pixel[1] = color.g();
+                pixel[2] = color.b();
+            }
+        }
+        left += screen->getWidth();
+    }
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write((const char *) pixels.data(), pixels.size());
+    return file.good();
+}
+
+int main(int argc, char **argv) {
+    MirrorOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--screenshot" && i + 1 < argc) {
+            options.screenshot = argv[++i];
+        } else if (arg == "--max-age" && i + 1 < argc) {
+            options.maxAgeSeconds = std::stod(argv[++i]);
+        } else if (arg == "--watch") {
+            options.watch = true;
+        } else if (arg[0] != '-') {
+            options.name = arg[0] == '/' ? arg : "/" + arg;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    FrameMirrorReader reader;
+    if (!reader.open(options.name)) {
+        std::cerr << "no frame mirror " << options.name << ", is mirrorName set in the server config?" << std::endl;
+        return 1;
+    }
+    auto screens = reader.createScreens();
+    FrameMirrorInfo info;
+    do {
+        auto before = reader.getFrames();
+        auto start = FrameTimer::nowNs();
+        sleep(1);
+        double fps = (reader.getFrames() - before) * 1e9 / (FrameTimer::nowNs() - start);
+        if (!reader.read(screens, info)) {
+            std::cerr << "the server kept writing, no consistent frame" << std::endl;
+            return 1;
+        }
+        double age = info.timestampNs > 0 ? (FrameTimer::nowNs() - info.timestampNs) / 1e9 : -1;
+        std::cout << options.name << ": " << screens.size() << " screens, " << info.frames << " frames, "
+                  << fps << " fps, last frame " << age << " s ago, brightness " << info.brightness << std::endl;
+        if (options.maxAgeSeconds > 0 && (age < 0 || age > options.maxAgeSeconds))
+            return 1;
+    } while (options.watch);
+
+    if (!options.screenshot.empty() && !writeScreenshot(options.screenshot, screens)) {
+        std::cerr << "can't write " << options.screenshot << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "CountingRenderer.h"
+
+#include <FrameTimer.h>
+
+#define FNVOFFSETBASIS 14695981039346656037ULL
+#define FNVPRIME 1099511628211ULL
+
+CountingRenderer::CountingRenderer() : historySize(COUNTINGRENDERERHISTORY), historyNext(0) {
+
+}
+
+CountingRenderer::CountingRenderer(std::vector<std::shared_ptr<Screen>> initScreens, size_t setHistorySize) :
+        historySize(setHistorySize > 0 ? setHistorySize : 1), historyNext(0) {
+    init(initScreens);
+}
+
+void CountingRenderer::init(std::vector<std::shared_ptr<Screen>> initScreens) {
+    screens = initScreens;
+    history.reserve(historySize);
+}
+
+void CountingRenderer::setScreenData(int screenId, Color *screenData) {
+    if (screenId >= 0 && screenId < (int) screens.size()) {
+        screens.at(screenId)->setScreenData(screenData);
+    }
+}
+
+void CountingRenderer::render() {
+    auto now = FrameTimer::nowNs();
+    RenderedFrame frame;
+    frame.timestamp = now;
+    frame.checksum = checksum(screens);
+    auto hashed = FrameTimer::nowNs();
+
+    if (stats.frames > 0) {
+        int64_t interval = now - stats.lastTimestamp;
+        if (stats.frames == 1 || interval < stats.minIntervalNs)
+            stats.minIntervalNs = interval;
+        if (interval > stats.maxIntervalNs)
+            stats.maxIntervalNs = interval;
+        stats.meanIntervalNs += (interval - stats.meanIntervalNs) / stats.frames;
+    }
+    stats.frames++;
+    stats.lastTimestamp = now;
+    stats.lastChecksum = frame.checksum;
+    stats.lastChecksumNs = hashed - now;
+    publishedStats.store(stats);
+
+    std::lock_guard<std::mutex> lock(historyLock);
+    if (history.size() < historySize) {
+        history.push_back(frame);
+    } else {
+        history[historyNext] = frame;
+    }
+    historyNext = (historyNext + 1) % historySize;
+}
+
+void CountingRenderer::setGlobalBrightness(int brightness) {
+    globalBrightness = brightness;
+}
+
+int CountingRenderer::getGlobalBrightness() {
+    return globalBrightness;
+}
+
+CountingRendererStats CountingRenderer::getStats() {
+    return publishedStats.load();
+}
+
+std::vector<RenderedFrame> CountingRenderer::getHistory() {
+    std::lock_guard<std::mutex> lock(historyLock);
+    if (history.size() < historySize)
+        return history;
+    std::vector<RenderedFrame> ordered(history.begin() + historyNext, history.end());
+    ordered.insert(ordered.end(), history.begin(), history.begin() + historyNext);
+    return ordered;
+}
+
+uint64_t CountingRenderer::checksum(const std::vector<std::shared_ptr<Screen>> &checkScreens) {
+    uint64_t hash = FNVOFFSETBASIS;
+    for (auto &screen : checkScreens) {
+        auto data = screen->getScreenDataRaw();
+        auto size = screen->getScreenDataSize();
+        for (int i = 0; i < size; i++) {
+            hash = (hash ^ data[i].r()) * FNVPRIME;
+            hash = (hash ^ data[i].g()) * FNVPRIME;
+            hash = (hash ^ data[i].b()) * FNVPRIME;
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,65 @@
+#ifndef MATRIXSERVER_COUNTINGRENDERER_H
+#define MATRIXSERVER_COUNTINGRENDERER_H
+
+#include <IRenderer.h>
+#include <SeqLock.h>
+#include <mutex>
+#include <stdint.h>
+
+#define COUNTINGRENDERERHISTORY 1024
+
+struct RenderedFrame {
+    uint64_t timestamp; // CLOCK_MONOTONIC ns of render()
+    uint64_t checksum;  // FNV-1a over the pixels of all screens
+};
+
+struct CountingRendererStats {
+    uint64_t frames = 0;
+    uint64_t lastTimestamp = 0;
+    uint64_t lastChecksum = 0;
+    int64_t minIntervalNs = 0; // between two render() calls
+    int64_t maxIntervalNs = 0;
+    double meanIntervalNs = 0;
+    int64_t lastChecksumNs = 0; // time spent hashing the last frame
+};
+
+/*
+ * Headless benchmark renderer. Takes the screen data like a hardware renderer does, and records
+ * for every frame when it was rendered and a checksum of its content, so tests and benchmarks can
+ * check the frame rate and what was shown without a cube. The last COUNTINGRENDERERHISTORY frames
+ * are kept.
+ */
+class CountingRenderer : public IRenderer {
+public:
+    CountingRenderer();
+
+    CountingRenderer(std::vector<std::shared_ptr<Screen>> screens, size_t historySize = COUNTINGRENDERERHISTORY);
+
+    void init(std::vector<std::shared_ptr<Screen>>);
+
+    void setScreenData(int, Color *);
+
+    void render();
+
+    void setGlobalBrightness(int);
+
+    int getGlobalBrightness();
+
+    CountingRendererStats getStats();
+
+    // oldest first
+    std::vector<RenderedFrame> getHistory();
+
+    static uint64_t checksum(const std::vector<std::shared_ptr<Screen>> &screens);
+
+private:
+    SeqLock<CountingRendererStats> publishedStats;
+    CountingRendererStats stats; // render thread only
+    std::mutex historyLock;
+    std::vector<RenderedFrame> history;
+    size_t historySize;
+    size_t historyNext;
+};
+
+
+#endif //MATRIXSERVER_COUNTINGRENDERER_H
@@ -2,6 +2,10 @@
 
 #include <cstring>
 
+#include <FrameTimer.h>
+#include <Metrics.h>
+#include <Trace.h>
+
 extern "C" {
     #include "mpsse/mpsse.h"
 }
@@ -49,9 +53,11 @@ void FPGARendererFTDI::setScreenData(int screenId, Color *screenData) {
 }
 
 void FPGARendererFTDI::render() {
+    static auto &vsyncLatency = Metrics::histogram("vsync_wait", "waiting for the vsync of the display");
+    static auto &convertLatency = Metrics::histogram("convert", "converting the screens into the display format");
+    static auto &transferLatency = Metrics::histogram("bus_transfer", "sending a frame to the display");
     if(!renderMutex.try_lock())
         return;
-//    auto usStart = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());
 
     const int screenWidth = screens[0]->getWidth();
     const int screenHeight = screens[0]->getHeight();
@@ -66,6 +72,7 @@ void FPGARendererFTDI::render() {
     uint8_t *cmd_buf = (uint8_t*)malloc(llen+128);
 
     /* Doing VSync first */
+    auto vsyncStart = FrameTimer::nowNs();
 #if 1
     do {
         cmd_buf[0] = 0x00;
@@ -77,8 +84,12 @@ void FPGARendererFTDI::render() {
     } while (((cmd_buf[0] | cmd_buf[1]) & 0x02) != 0x02);
 #endif
 
-//    auto usTotal2 = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()) - usStart;
-//    std::cout << "vsync:  " << usTotal2.count() << " us" << std::endl;
+    auto linesStart = FrameTimer::nowNs();
+    vsyncLatency.record(linesStart - vsyncStart);
+    Trace::record("vsync_wait", vsyncStart, linesStart);
+
+    // the lines are converted and sent in turns
+    int64_t convertNs = 0, transferNs = 0;
 
     /* Upload all the lines */
     for (int y=0; y<screenHeight; y++)
@@ -98,6 +109,7 @@ void FPGARendererFTDI::render() {
         /* SPI payload */
         cmd_buf[i++] = 0x80;
 
+        auto lineStart = FrameTimer::nowNs();
         Color tmpColor;
         for(const auto& screen : screens) {
             for(int x = 0; x < screen->getWidth(); x++) {
@@ -153,18 +165,22 @@ void FPGARendererFTDI::render() {
         cmd_buf[i++] = 0x28; /* gpio */
         cmd_buf[i++] = 0x2b; /* dir  */
 
+        auto sendStart = FrameTimer::nowNs();
+        convertNs += sendStart - lineStart;
         mpsse_send_raw(cmd_buf, i);
+        transferNs += FrameTimer::nowNs() - sendStart;
     }
 
+    Trace::record("lines", linesStart, FrameTimer::nowNs()); // converted and sent in turns, one span for all
+
     /* Swap Frame */
     cmd_buf[0] = 0x04;
     cmd_buf[1] = 0x00;
     set_cs(0);
     mpsse_send_spi(cmd_buf, 2);
     set_cs(1);
-
-//    auto usTotal = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()) - usStart;
-//    std::cout << "render: " << usTotal.count() << " us" << std::endl;
+    convertLatency.record(convertNs);
+    transferLatency.record(transferNs);
 
     renderMutex.unlock();
 }
@@ -8,6 +8,10 @@
 #include <thread>
 #include <unistd.h>
 
+#include <FrameTimer.h>
+#include <Metrics.h>
+#include <Trace.h>
+
 #define TWOBYSIX
 
 const char *spiDevice = "/dev/spidev0.0";
@@ -87,8 +91,13 @@ bool SpiWriteQueueAddCSTrigger(){
 }
 
 void SpiWriteQueueTrigger(){
-    std::thread([&](){
+    static auto &transferLatency = Metrics::histogram("bus_transfer", "sending a frame to the display");
+    auto frameId = Trace::getFrame();
+    std::thread([&, frameId](){
+        TraceSpan span("spi_ioctl", frameId);
+        auto transferStart = FrameTimer::nowNs();
         ioctl (spiDevFilehandle, SPI_IOC_MESSAGE(spiIocTransfersPos), spiIocTransfers);
+        transferLatency.record(FrameTimer::nowNs() - transferStart);
     }).detach();
 }
 
@@ -207,9 +216,11 @@ void FPGARendererRPISPI::setScreenData(int screenId, Color *screenData) {
 }
 
 void FPGARendererRPISPI::render() {
-
+    static auto &vsyncLatency = Metrics::histogram("vsync_wait", "waiting for the vsync of the display");
+    static auto &convertLatency = Metrics::histogram("convert", "converting the screens into the display format");
 
     /* Doing VSync */
+    auto vsyncStart = FrameTimer::nowNs();
     do {
         cmd_buf[0] = 0x00;
         cmd_buf[1] = 0x00;
@@ -217,12 +228,13 @@ void FPGARendererRPISPI::render() {
         usleep(100);
 //        printf("%d\n", cmd_buf[0] | cmd_buf[1]);
     } while (((cmd_buf[0] | cmd_buf[1]) & 0x02) != 0x02);
+    auto convertStart = FrameTimer::nowNs();
+    vsyncLatency.record(convertStart - vsyncStart);
+    Trace::record("vsync_wait", vsyncStart, convertStart);
 
         if(!screenDataMutex.try_lock())
         return;
 
-    auto usStart = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());
-
 #ifdef TWOBYSIX
     // 2 transfers per line (linedata + line flush) + 1 frame swap, 3 additional bytes (startbyte + line flush) per linelength + 2 bytes for frameswap
     SpiWriteQueueInit(lineCount * 2 + 1, (bytesPerLine+3) * lineCount + 2);
@@ -343,13 +355,11 @@ void FPGARendererRPISPI::render() {
 
 
 
-//    auto usTotal2 = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()) - usStart;
-//    std::cout << "vsync:  " << usTotal2.count() << " us" << std::endl;
+    auto convertEnd = FrameTimer::nowNs();
+    convertLatency.record(convertEnd - convertStart);
+    Trace::record("convert", convertStart, convertEnd);
 
     SpiWriteQueueTrigger();
-
-    auto usTotal = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()) - usStart;
-//    std::cout << "render: " << usTotal.count() << " us" << std::endl;
 }
 
 void FPGARendererRPISPI::setGlobalBrightness(int brightness) {
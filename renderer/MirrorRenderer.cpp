@@ -0,0 +1,42 @@
+#include "MirrorRenderer.h"
+
+#include <FrameTimer.h>
+
+MirrorRenderer::MirrorRenderer(std::vector<std::shared_ptr<Screen>> initScreens, const std::string &name) :
+        writing(false) {
+    screens = initScreens;
+    writer.open(name, screens);
+}
+
+void MirrorRenderer::setScreenData(int screenId, Color *screenData) {
+    for (size_t i = 0; i < screens.size(); i++) {
+        if (screens[i]->getScreenId() != screenId)
+            continue;
+        // the frame is marked as being written from its first screen until render()
+        if (!writing) {
+            writer.begin();
+            writing = true;
+        }
+        writer.setScreen(i, screenData);
+        return;
+    }
+}
+
+void MirrorRenderer::render() {
+    if (!writing)
+        writer.begin();
+    writer.end(FrameTimer::nowNs(), globalBrightness);
+    writing = false;
+}
+
+void MirrorRenderer::setGlobalBrightness(int brightness) {
+    globalBrightness = brightness;
+}
+
+int MirrorRenderer::getGlobalBrightness() {
+    return globalBrightness;
+}
+
+bool MirrorRenderer::isOpen() {
+    return writer.isOpen();
+}
@@ -0,0 +1,33 @@
+#ifndef MATRIXSERVER_MIRRORRENDERER_H
+#define MATRIXSERVER_MIRRORRENDERER_H
+
+#include <IRenderer.h>
+#include <FrameMirror.h>
+#include <string>
+
+/*
+ * Publishes every rendered frame in a FrameMirror shared memory segment (ServerConfig.mirrorName), so
+ * local viewers see exactly what the other renderers get, after post processing. The screens are copied
+ * into the segment as they arrive, screens the server skips because they didn't change aren't copied.
+ */
+class MirrorRenderer : public IRenderer {
+public:
+    MirrorRenderer(std::vector<std::shared_ptr<Screen>> screens, const std::string &name = FRAMEMIRRORDEFAULTNAME);
+
+    void setScreenData(int, Color *);
+
+    void render();
+
+    void setGlobalBrightness(int);
+
+    int getGlobalBrightness();
+
+    bool isOpen();
+
+private:
+    FrameMirrorWriter writer;
+    bool writing;
+};
+
+
+#endif //MATRIXSERVER_MIRRORRENDERER_H
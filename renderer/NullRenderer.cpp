@@ -0,0 +1,33 @@
+#include "NullRenderer.h"
+
+NullRenderer::NullRenderer() : frames(0) {
+
+}
+
+NullRenderer::NullRenderer(std::vector<std::shared_ptr<Screen>> initScreens) : frames(0) {
+    init(initScreens);
+}
+
+void NullRenderer::init(std::vector<std::shared_ptr<Screen>> initScreens) {
+    screens = initScreens;
+}
+
+void NullRenderer::setScreenData(int, Color *) {
+
+}
+
+void NullRenderer::render() {
+    frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+void NullRenderer::setGlobalBrightness(int brightness) {
+    globalBrightness = brightness;
+}
+
+int NullRenderer::getGlobalBrightness() {
+    return globalBrightness;
+}
+
+uint64_t NullRenderer::getFrameCount() {
+    return frames.load(std::memory_order_relaxed);
+}
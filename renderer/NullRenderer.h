@@ -0,0 +1,35 @@
+#ifndef MATRIXSERVER_NULLRENDERER_H
+#define MATRIXSERVER_NULLRENDERER_H
+
+#include <IRenderer.h>
+#include <atomic>
+#include <stdint.h>
+
+/*
+ * Discards every frame. Runs apps and the render pipeline without any hardware, so what is left
+ * is the cost of the app itself.
+ */
+class NullRenderer : public IRenderer {
+public:
+    NullRenderer();
+
+    NullRenderer(std::vector<std::shared_ptr<Screen>> screens);
+
+    void init(std::vector<std::shared_ptr<Screen>>);
+
+    void setScreenData(int, Color *);
+
+    void render();
+
+    void setGlobalBrightness(int);
+
+    int getGlobalBrightness();
+
+    uint64_t getFrameCount();
+
+private:
+    std::atomic<uint64_t> frames;
+};
+
+
+#endif //MATRIXSERVER_NULLRENDERER_H
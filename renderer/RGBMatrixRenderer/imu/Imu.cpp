@@ -1,66 +1,177 @@
 #include "Imu.h"
 #include <cmath>
+#include <cstdlib>
+#include <fcntl.h>
+#include <time.h>
 
-Imu::Imu(){
+static uint64_t monotonicNs(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+Imu::Imu() : serial(nullptr), thread_(nullptr), running(false), freefall(false), parseErrors(0), replay(false),
+             replayTimestamp(0), replayPeriod(0){
+  acceleration[0] = acceleration[1] = acceleration[2] = 0;
+}
 
+Imu::~Imu(){
+  stopThread();
+  delete serial;
 }
 
-bool Imu::init(std::string portname){
+bool Imu::init(std::string portname, bool startThread){
   serial = new SerialPort(portname.c_str(), 115200);
-  startRefreshThread();
+  if(startThread)
+    startRefreshThread();
+  return true;
+}
+
+bool Imu::initReplay(std::string capturePath, unsigned int sampleRateHz, bool startThread){
+  int fd = open(capturePath.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0 || sampleRateHz == 0)
+    return false;
+  serial = new SerialPort(fd);
+  replay = true;
+  replayTimestamp = monotonicNs();
+  replayPeriod = 1000000000ULL / sampleRateHz;
+  if(startThread)
+    startRefreshThread();
   return true;
 }
 
 std::vector<float> Imu::parseString(std::string input){
-    std::vector<float> result;
-    std::istringstream sstream(input);
-    for (std::string part; std::getline(sstream, part, ','); ) {
-        result.push_back(std::stof(part));
-    }
+    std::vector<float> result(3);
+    if(!parseLine(input.c_str(), result.data(), 3))
+      result.clear();
     return result;
 }
 
+// parses exactly count comma separated floats in place, rejects anything else
+bool Imu::parseLine(const char * line, float * values, int count){
+  const char * ptr = line;
+  for(int i = 0; i < count; i++){
+    char * end;
+    values[i] = strtof(ptr, &end);
+    if(end == ptr)
+      return false;
+    while(*end == ' ')
+      end++;
+    if(i < count - 1 && *end++ != ',')
+      return false;
+    ptr = end;
+  }
+  return *ptr == '\0';
+}
+
+// latest sample, the returned array belongs to the Imu and is overwritten by the next call
 float * Imu::getAcceleration(){
-    return acceleration;
+  ImuSample sample{};
+  if(samples.getLatest(sample)){
+    acceleration[0] = sample.acceleration[0];
+    acceleration[1] = sample.acceleration[1];
+    acceleration[2] = sample.acceleration[2];
+  }
+  return acceleration;
+}
+
+bool Imu::getLatest(ImuSample & sample){
+  return samples.getLatest(sample);
+}
+
+size_t Imu::getHistory(ImuSample * history, size_t maxCount){
+  return samples.getHistory(history, maxCount);
+}
+
+uint64_t Imu::getSampleCount(){
+  return samples.getCount();
+}
+
+uint64_t Imu::getParseErrors(){
+  return parseErrors;
+}
+
+// set it before init, it is called on the reader thread
+void Imu::setFreefallCallback(std::function<void(const ImuSample &)> callback){
+  freefallCallback = callback;
 }
 
 bool Imu::isInFreefall(){
   return freefall;
 }
 
-void Imu::refresh()
+bool Imu::isReplayFinished(){
+  return replay && !running;
+}
+
+void Imu::addSample(const float * values){
+  ImuSample sample{};
+  if(replay){
+    sample.timestamp = replayTimestamp;
+    replayTimestamp += replayPeriod;
+  }else{
+    sample.timestamp = monotonicNs();
+  }
+  sample.acceleration[0] = values[0];
+  sample.acceleration[1] = values[1];
+  sample.acceleration[2] = values[2];
+  sample.freefall = std::abs(values[0]) < threshold && std::abs(values[1]) < threshold && std::abs(values[2]) < threshold;
+  samples.push(sample);
+  if(sample.freefall && !freefall && freefallCallback)
+    freefallCallback(sample);
+  freefall = sample.freefall;
+}
+
+int Imu::getFd(){
+  return serial != nullptr ? serial->getFd() : -1;
+}
+
+// handles the lines which are already available without waiting, returns false once the input has ended
+bool Imu::handleInput(){
+  return readLines(0);
+}
+
+// handles all complete lines, returns false once the input has ended
+bool Imu::refresh()
+{
+  return readLines(IMUREADTIMEOUT);
+}
+
+bool Imu::readLines(int timeoutMs)
 {
-  std::vector<float> result = parseString(serial->readLine());
-  if(result.size() == 3){
-    acceleration[0] = result[0];
-    acceleration[1] = result[1];
-    acceleration[2] = result[2];
-    if(std::abs(acceleration[0]) < threshold && std::abs(acceleration[1]) < threshold && std::abs(acceleration[2]) < threshold)
-      freefall = true;
-    else
-      freefall = false;
+  size_t length;
+  float values[3];
+  while(const char * line = serial->readLine(length, timeoutMs)){
+    if(parseLine(line, values, 3))
+      addSample(values);
+    else if(length > 0)
+      parseErrors++;
   }
+  return !serial->isEof();
 }
 
 void Imu::startRefreshThread()
 {
+  running = true;
   thread_ = new boost::thread(&Imu::internalLoop, this);
 }
 
 void Imu::stopThread()
 {
+  boost::mutex::scoped_lock lock(threadLock_);
+  running = false;
   if(thread_ != NULL)
   {
-	thread_->interrupt();
     thread_->join();
+    delete thread_;
     thread_ = NULL;
   }
 }
 
 void Imu::internalLoop()
 {
-  while(1){
-    refresh();
-    usleep(1000);
+  while(running){
+    if(!refresh())
+      running = false;
   }
 }
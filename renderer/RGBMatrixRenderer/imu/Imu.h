@@ -1,27 +1,67 @@
 #ifndef __IMU__
+#define __IMU__
 #include "SerialPort.h"
+#include "SampleRing.h"
 #include <vector>
+#include <atomic>
+#include <functional>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 
+#define IMUSAMPLERINGSIZE 256
+#define IMUREADTIMEOUT 100 //ms, how often the reader thread checks for stopThread
+
+struct ImuSample {
+  uint64_t timestamp; // CLOCK_MONOTONIC ns, when the line was received
+  float acceleration[3];
+  bool freefall;
+};
+
+/*
+ * Reads "x,y,z" acceleration lines from the serial IMU on its own thread or a SensorHub's. Every
+ * sample goes into a lock-free ring, so readers get the latest value or a window of history without
+ * blocking the reader. Free-fall is evaluated per sample, the callback fires on the sample which starts a fall.
+ */
 class Imu{
 public:
   Imu();
-  bool init(std::string portname);
+  ~Imu();
+  // startThread = false: the owner polls getFd() and calls handleInput(), e.g. a SensorHub
+  bool init(std::string portname, bool startThread = true);
+  // reads a recorded serial capture instead of the device, samples are spaced by 1/sampleRateHz
+  bool initReplay(std::string capturePath, unsigned int sampleRateHz = 100, bool startThread = true);
+  int getFd();
+  bool handleInput();
   float * getAcceleration();
+  bool getLatest(ImuSample & sample);
+  size_t getHistory(ImuSample * samples, size_t maxCount);
+  uint64_t getSampleCount();
+  uint64_t getParseErrors();
+  void setFreefallCallback(std::function<void(const ImuSample &)> callback);
   void startRefreshThread();
   void stopThread();
-  void refresh();
+  bool refresh();
   bool isInFreefall();
+  bool isReplayFinished();
+  static bool parseLine(const char * line, float * values, int count);
 protected:
   std::vector<float> parseString(std::string input);
 private:
   void internalLoop();
+  bool readLines(int timeoutMs);
+  void addSample(const float * values);
   float acceleration[3];
   SerialPort *serial;
   boost::thread * thread_;
   boost::mutex threadLock_;
-  bool freefall;
+  std::atomic<bool> running;
+  std::atomic<bool> freefall;
+  std::atomic<uint64_t> parseErrors;
   float threshold = 0.1;
+  SampleRing<ImuSample, IMUSAMPLERINGSIZE> samples;
+  std::function<void(const ImuSample &)> freefallCallback;
+  bool replay;
+  uint64_t replayTimestamp;
+  uint64_t replayPeriod;
 };
 #endif
@@ -0,0 +1,76 @@
+#ifndef __SAMPLERING__
+#define __SAMPLERING__
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+/*
+ * Ring of the last N samples, one writer, any number of readers, no locks. Every slot carries its
+ * own sequence number (seqlock), readers retry a slot which is overwritten while they copy it.
+ */
+template<typename T, size_t N>
+class SampleRing {
+  static_assert(std::is_trivially_copyable<T>::value, "SampleRing needs a trivially copyable type");
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SampleRing size has to be a power of two");
+public:
+  SampleRing() : count(0) {
+    for(auto & slot : slots)
+      slot.sequence.store(0, std::memory_order_relaxed);
+  }
+
+  void push(const T & value) {
+    auto index = count.load(std::memory_order_relaxed);
+    auto & slot = slots[index & (N - 1)];
+    auto seq = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.data = value;
+    slot.sequence.store(seq + 2, std::memory_order_release);
+    count.store(index + 1, std::memory_order_release);
+  }
+
+  bool getLatest(T & value) const {
+    return getHistory(&value, 1) == 1;
+  }
+
+  // copies up to maxCount of the newest samples, oldest first, returns the number copied
+  size_t getHistory(T * values, size_t maxCount) const {
+    for(;;) {
+      auto newest = count.load(std::memory_order_acquire);
+      size_t available = newest < N ? newest : N - 1; // the oldest slot may be in the middle of a write
+      size_t copied = maxCount < available ? maxCount : available;
+      bool consistent = true;
+      for(size_t i = 0; i < copied && consistent; i++)
+        consistent = readSlot(newest - copied + i, values[i]);
+      if(consistent)
+        return copied;
+    }
+  }
+
+  // number of samples pushed since construction
+  uint64_t getCount() const {
+    return count.load(std::memory_order_acquire);
+  }
+
+private:
+  // false if the slot was overwritten with a newer sample while reading
+  bool readSlot(uint64_t index, T & value) const {
+    auto & slot = slots[index & (N - 1)];
+    auto before = slot.sequence.load(std::memory_order_acquire);
+    value = slot.data;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto after = slot.sequence.load(std::memory_order_relaxed);
+    // every write of a slot adds 2 to its sequence, so the index tells which write it has to be
+    return before == after && before == 2 * (index / N + 1);
+  }
+
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    T data;
+  };
+  Slot slots[N];
+  std::atomic<uint64_t> count;
+};
+
+#endif
@@ -1,9 +1,29 @@
 #include "SerialPort.h"
 
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
 SerialPort::SerialPort(std::string port, unsigned int baud_rate)
-        : io(), serial(io,port)
+        : io(), serial(io,port), ownsFd(false), eof(false), begin(0), end(0)
 {
     serial.set_option(boost::asio::serial_port_base::baud_rate(baud_rate));
+    fd = serial.native_handle();
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+SerialPort::SerialPort(int replayFd)
+        : io(), serial(io), fd(replayFd), ownsFd(true), eof(false), begin(0), end(0)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+SerialPort::~SerialPort()
+{
+    if(ownsFd)
+        close(fd);
 }
 
 void SerialPort::writeString(std::string s)
@@ -13,20 +33,70 @@ void SerialPort::writeString(std::string s)
 
 std::string SerialPort::readLine()
 {
-    using namespace boost;
-    char c;
-    std::string result;
+    size_t length;
+    const char * line;
+    while((line = readLine(length)) == nullptr && !eof);
+    return line != nullptr ? std::string(line, length) : std::string();
+}
+
+// returns the next line without "\r\n" (null terminated, valid until the next call), nullptr on timeout or eof
+const char * SerialPort::readLine(size_t & length, int timeoutMs)
+{
     for(;;)
     {
-        asio::read(serial,asio::buffer(&c,1));
-        switch(c)
+        auto newline = (char *) memchr(buffer + begin, '\n', end - begin);
+        if(newline != nullptr)
+        {
+            auto line = buffer + begin;
+            length = newline - line;
+            if(length > 0 && line[length - 1] == '\r')
+                length--;
+            line[length] = '\0';
+            begin = newline - buffer + 1;
+            return line;
+        }
+        if(begin > 0)
         {
-            case '\r':
-                break;
-            case '\n':
-                return result;
-            default:
-                result+=c;
+            memmove(buffer, buffer + begin, end - begin);
+            end -= begin;
+            begin = 0;
         }
+        if(end == SERIALBUFFERSIZE) // line too long, drop it
+            end = 0;
+        if(!fill(timeoutMs))
+            return nullptr;
     }
 }
+
+bool SerialPort::fill(int timeoutMs)
+{
+    if(eof)
+        return false;
+    auto bytes = read(fd, buffer + end, SERIALBUFFERSIZE - end);
+    if(bytes < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if(poll(&pfd, 1, timeoutMs) <= 0)
+            return false;
+        bytes = read(fd, buffer + end, SERIALBUFFERSIZE - end);
+        if(bytes < 0 && (errno == EAGAIN || errno == EINTR) && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+            bytes = 0;
+    }
+    // an error other than no data yet (EIO once a USB serial adapter is unplugged) ends the input as well
+    if(bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EINTR))
+        eof = true;
+    if(bytes <= 0)
+        return false;
+    end += bytes;
+    return true;
+}
+
+bool SerialPort::isEof()
+{
+    return eof;
+}
+
+int SerialPort::getFd()
+{
+    return fd;
+}
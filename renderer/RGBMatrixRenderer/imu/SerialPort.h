@@ -1,19 +1,38 @@
 #ifndef __SERIALPORT__
+#define __SERIALPORT__
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <boost/asio.hpp>
 
+#define SERIALBUFFERSIZE 1024
+
+/*
+ * Buffered line reader. Reads whatever is available in one syscall and hands out complete lines
+ * in place (no copies, no allocations). The replay constructor reads a recorded capture from a
+ * file or pipe instead of a serial device.
+ */
 class SerialPort
 {
 public:
   SerialPort(std::string port, unsigned int baud_rate);
+  SerialPort(int replayFd);
+  ~SerialPort();
   void writeString(std::string s);
   std::string readLine();
+  const char * readLine(size_t & length, int timeoutMs = -1);
+  bool isEof();
+  int getFd();
 private:
-  void internalLoop();
+  bool fill(int timeoutMs);
   boost::asio::io_service io;
   boost::asio::serial_port serial;
+  int fd;
+  bool ownsFd;
+  bool eof;
+  char buffer[SERIALBUFFERSIZE + 1];
+  size_t begin;
+  size_t end;
 };
 
 #endif
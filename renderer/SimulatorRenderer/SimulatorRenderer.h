@@ -3,18 +3,19 @@
 
 #include <IRenderer.h>
 #include <TcpClient.h>
+#include <FrameMessage.h>
 #include <boost/thread/thread.hpp>
 
-#define DEFAULTSERVERADRESS "127.0.0.1"
-#define DEFAULTSERVERPORT "1337"
+#define DEFAULTSIMULATORADDRESS "127.0.0.1"
+#define DEFAULTSIMULATORPORT "1337"
 
 
 class SimulatorRenderer : public IRenderer {
 public:
     SimulatorRenderer();
 
-    SimulatorRenderer(std::vector<std::shared_ptr<Screen>> screens, std::string setServerAddress = DEFAULTSERVERADRESS,
-                      std::string setServerPort = DEFAULTSERVERPORT);
+    SimulatorRenderer(std::vector<std::shared_ptr<Screen>> screens, std::string setServerAddress = DEFAULTSIMULATORADDRESS,
+                      std::string setServerPort = DEFAULTSIMULATORPORT);
 
     void init(std::vector<std::shared_ptr<Screen>>);
 
@@ -32,6 +33,7 @@ private:
     std::string serverAddress;
     std::string serverPort;
     std::shared_ptr<SocketConnection> connection;
+    FrameMessage frameMessage;
     boost::thread *mainThread;
     boost::thread *ioThread;
     boost::asio::io_service io_context;
@@ -0,0 +1,302 @@
+#include <iostream>
+#include <string>
+#include <map>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <Log.h>
+#include <boost/thread/thread.hpp>
+
+#include <FrameCapture.h>
+#include <FrameTimer.h>
+#include <CubeConfig.h>
+#include <NullRenderer.h>
+#include <CountingRenderer.h>
+#include <SimulatorRenderer.h>
+#include <Server.h>
+#include <UnixSocketClient.h>
+
+/*
+ * Plays a capture recorded by the server (ServerConfig.capturePath) back, at the original speed or
+ * as fast as possible:
+ * - into a renderer: the frames go straight to it, for renderer throughput
+ * - into a server (--server): a server with that renderer runs in this process, every recorded app
+ *   connects to it and sends its messages again, the whole frame path is measured. Frames wait
+ *   for their ack when played as fast as possible. Input pushed to the apps is only counted. The
+ *   server gets its own port, sockets and shared memory, a server running on the host isn't touched.
+ */
+
+struct ReplayOptions {
+    std::string path;
+    std::string renderer = "counting";
+    bool fast = false;
+    bool server = false;
+    double fromSeconds = 0;
+    int loops = 1;
+};
+
+struct ReplayResult {
+    uint64_t frames = 0;
+    uint64_t messages = 0;
+    uint64_t inputs = 0;
+    uint64_t dropped = 0; // frames the server didn't ack
+    int64_t renderNs = 0;
+    int64_t maxRenderNs = 0;
+};
+
+struct ReplayApp {
+    std::shared_ptr<SocketConnection> connection;
+    std::atomic<int> appId{0};
+    std::atomic<uint64_t> acks{0};
+    std::atomic<uint64_t> kills{0};
+};
+
+static void usage() {
+    std::cout << "usage: matrixreplay <capture> [--fast] [--from <seconds>] [--loop <count>] "
+                 "[--renderer null|counting|simulator] [--server]" << std::endl;
+}
+
+static void sleepUntil(int64_t deadlineNs) {
+    struct timespec ts;
+    ts.tv_sec = deadlineNs / 1000000000LL;
+    ts.tv_nsec = deadlineNs % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+}
+
+// waits until the value changes, false after timeoutNs
+template<typename T>
+static bool waitFor(const std::atomic<T> &value, T from, int64_t timeoutNs) {
+    auto deadline = FrameTimer::nowNs() + timeoutNs;
+    while (value.load() == from) {
+        if (FrameTimer::nowNs() > deadline)
+            return false;
+        usleep(50);
+    }
+    return true;
+}
+
+class ServerTarget {
+public:
+    ServerTarget(bool fast, std::string socketPath) : fast(fast), socketPath(socketPath), work(io) {
+        ioThread = boost::thread([this]() { io.run(); });
+    }
+
+    ~ServerTarget() {
+        io.stop();
+        ioThread.join();
+    }
+
+    void send(CaptureReader &reader, CaptureEvent &event, ReplayResult &result) {
+        auto &message = event.message;
+        switch (message.messagetype()) {
+            case matrixserver::registerApp:
+                connect(message);
+                break;
+            case matrixserver::setScreenFrame: {
+                auto *app = connect(message);
+                if (app == nullptr)
+                    break;
+                reader.fillFrame(message);
+                message.set_appid(app->appId);
+                uint64_t acks = app->acks, kills = app->kills;
+                app->connection->sendMessage(std::make_shared<matrixserver::MatrixServerMessage>(message));
+                if (fast && !waitFor(app->acks, acks, 1000000000LL))
+                    result.dropped++;
+                else if (app->kills != kills)
+                    result.dropped++;
+                break;
+            }
+            case matrixserver::requestScreenAccess:
+            case matrixserver::appKill: {
+                auto found = apps.find(message.appid());
+                if (found == apps.end())
+                    break;
+                message.set_appid(found->second->appId);
+                found->second->connection->sendMessage(std::make_shared<matrixserver::MatrixServerMessage>(message));
+                break;
+            }
+            default:
+                break; // launchApp would start the apps for real
+        }
+    }
+
+private:
+    // the recorded app, connected and registered on its first message
+    ReplayApp *connect(const matrixserver::MatrixServerMessage &message) {
+        auto found = apps.find(message.appid());
+        if (found != apps.end())
+            return found->second.get();
+        auto app = std::make_shared<ReplayApp>();
+        app->connection = UnixSocketClient::connect(io, socketPath);
+        if (app->connection->isDead())
+            return nullptr;
+        auto *replayApp = app.get();
+        app->connection->setReceiveCallback([replayApp](std::shared_ptr<UniversalConnection>,
+                                                        std::shared_ptr<matrixserver::MatrixServerMessage> received) {
+            if (received->messagetype() == matrixserver::registerApp)
+                replayApp->appId = received->appid();
+            else if (received->messagetype() == matrixserver::setScreenFrame)
+                replayApp->acks++;
+            else if (received->messagetype() == matrixserver::appKill)
+                replayApp->kills++;
+        });
+        auto request = std::make_shared<matrixserver::MatrixServerMessage>();
+        request->set_messagetype(matrixserver::registerApp);
+        if (message.messagetype() == matrixserver::registerApp) {
+            request->CopyFrom(message);
+            request->set_appid(0);
+        }
+        app->connection->sendMessage(request);
+        if (!waitFor(app->appId, 0, 1000000000LL)) {
+            std::cout << "app " << message.appid() << " wasn't registered" << std::endl;
+            return nullptr;
+        }
+        apps[message.appid()] = app;
+        return replayApp;
+    }
+
+    bool fast;
+    std::string socketPath;
+    boost::asio::io_service io;
+    boost::asio::io_service::work work;
+    boost::thread ioThread;
+    std::map<int, std::shared_ptr<ReplayApp>> apps; // by the recorded appId
+};
+
+static void replay(CaptureReader &reader, const ReplayOptions &options, IRenderer &renderer, ServerTarget *server,
+                   ReplayResult &result) {
+    auto fromNs = reader.getStartNs() + (int64_t) (options.fromSeconds * 1e9);
+    reader.seek(fromNs);
+    CaptureEvent event;
+    int64_t offset = 0; // capture time -> now
+    while (reader.next(event)) {
+        if (event.timestampNs < fromNs)
+            continue; // between the keyframe and the start
+        if (offset == 0)
+            offset = FrameTimer::nowNs() - event.timestampNs;
+        if (!options.fast)
+            sleepUntil(event.timestampNs + offset);
+        result.messages++;
+        auto &message = event.message;
+        if (message.messagetype() == matrixserver::joystickData || message.messagetype() == matrixserver::imuData) {
+            result.inputs++;
+            continue;
+        }
+        if (message.messagetype() == matrixserver::setScreenFrame)
+            result.frames++;
+        if (server != nullptr) {
+            server->send(reader, event, result);
+            continue;
+        }
+        if (message.messagetype() != matrixserver::setScreenFrame)
+            continue;
+        for (const auto &screenInfo : message.screendata()) {
+            auto *screen = reader.getScreen(screenInfo.screenid());
+            if (screen != nullptr)
+                renderer.setScreenData(screenInfo.screenid(), const_cast<Color *>(screen));
+        }
+        if (message.has_serverconfig())
+            renderer.setGlobalBrightness(message.serverconfig().globalscreenbrightness());
+        auto start = FrameTimer::nowNs();
+        renderer.render();
+        auto duration = FrameTimer::nowNs() - start;
+        result.renderNs += duration;
+        if (duration > result.maxRenderNs)
+            result.maxRenderNs = duration;
+    }
+}
+
+int main(int argc, char **argv) {
+    ReplayOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--fast") {
+            options.fast = true;
+        } else if (argument == "--server") {
+            options.server = true;
+        } else if (argument == "--from" && hasValue) {
+            options.fromSeconds = std::stod(argv[++i]);
+        } else if (argument == "--loop" && hasValue) {
+            options.loops = std::max(1, std::stoi(argv[++i]));
+        } else if (argument == "--renderer" && hasValue) {
+            options.renderer = argv[++i];
+        } else if (options.path.empty() && argument[0] != '-') {
+            options.path = argument;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (options.path.empty()) {
+        usage();
+        return 1;
+    }
+    Log::setLevel(LogLevel::info);
+
+    CaptureReader reader;
+    if (!reader.open(options.path))
+        return 1;
+    matrixserver::ServerConfig serverConfig(reader.getServerConfig());
+    serverConfig.clear_capturepath();
+    if (options.server) {
+        // the recorded server's port, sockets and mirror are those of the server running on this host
+        auto suffix = std::to_string(getpid());
+        serverConfig.mutable_serverconnection()->set_serverport("0");
+        serverConfig.set_unixsocketpath("/tmp/matrixreplay-" + suffix + ".sock");
+        serverConfig.set_ipcaddress("matrixreplay-" + suffix);
+        if (!serverConfig.mirrorname().empty())
+            serverConfig.set_mirrorname("/matrixreplay-frame-" + suffix);
+        serverConfig.set_metricsport(0);
+        serverConfig.clear_metricssocket();
+        serverConfig.clear_cluster(); // the replay runs on its own, the capture has all screens
+    }
+    std::cout << "capture with " << reader.getIndex().size() << " keyframes, " << serverConfig.screeninfo_size()
+              << " screens" << std::endl;
+
+    auto screens = createScreens(serverConfig);
+    std::shared_ptr<IRenderer> renderer;
+    if (options.renderer == "null")
+        renderer = std::make_shared<NullRenderer>(screens);
+    else if (options.renderer == "simulator")
+        renderer = std::make_shared<SimulatorRenderer>(screens);
+    else
+        renderer = std::make_shared<CountingRenderer>(screens);
+
+    std::unique_ptr<Server> server;
+    std::unique_ptr<ServerTarget> target;
+    if (options.server) {
+        server.reset(new Server(renderer, serverConfig)); // tick() isn't called, no default app is started
+        target.reset(new ServerTarget(options.fast, serverConfig.unixsocketpath()));
+    }
+
+    ReplayResult result;
+    auto start = FrameTimer::nowNs();
+    for (int loop = 0; loop < options.loops; loop++)
+        replay(reader, options, *renderer, target.get(), result);
+    double seconds = (FrameTimer::nowNs() - start) / 1e9;
+
+    std::cout << "replayed " << result.frames << " frames, " << result.messages << " messages (" << result.inputs
+              << " input) in " << seconds << " s: " << (seconds > 0 ? result.frames / seconds : 0) << " fps" << std::endl;
+    if (options.server)
+        std::cout << "dropped frames " << result.dropped << std::endl;
+    else if (result.frames > 0)
+        std::cout << "render mean " << result.renderNs / (int64_t) result.frames / 1000 << " us, max "
+                  << result.maxRenderNs / 1000 << " us" << std::endl;
+    if (auto counting = std::dynamic_pointer_cast<CountingRenderer>(renderer)) {
+        auto stats = counting->getStats();
+        std::cout << "renderer frames " << stats.frames << ", interval min " << stats.minIntervalNs / 1000 << " us, max "
+                  << stats.maxIntervalNs / 1000 << " us, last checksum " << std::hex << stats.lastChecksum << std::dec
+                  << std::endl;
+    }
+    if (options.server) {
+        unlink(serverConfig.unixsocketpath().c_str());
+        boost::interprocess::message_queue::remove(serverConfig.ipcaddress().c_str());
+        if (!serverConfig.mirrorname().empty())
+            shm_unlink(serverConfig.mirrorname().c_str());
+    }
+    _exit(0); // the server has no shutdown
+}
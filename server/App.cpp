@@ -1,17 +1,32 @@
 #include <iostream>
-#include <boost/log/trivial.hpp>
+#include <Log.h>
 #include "App.h"
 
 App::App(std::shared_ptr<UniversalConnection> setCon) {
     connection = setCon;
     appId = generateAppId();
+    inputSubscribed = false;
+    overlay = false;
+}
+
+App::App(std::shared_ptr<PluginApp> setPlugin) {
+    plugin = setPlugin;
+    appId = generateAppId();
+    inputSubscribed = true;
+    overlay = false;
 }
 
 int App::getAppId() {
     return appId;
 }
 
+// plugins only understand appKill, everything else reaches them through function calls
 void App::sendMsg(std::shared_ptr<matrixserver::MatrixServerMessage> message){
+    if (plugin) {
+        if (message->messagetype() == matrixserver::appKill)
+            plugin->kill();
+        return;
+    }
     connection->sendMessage(message);
 }
 
@@ -27,6 +42,32 @@ std::shared_ptr<UniversalConnection> App::getConnection() {
     return connection;
 }
 
+std::shared_ptr<PluginApp> App::getPlugin() {
+    return plugin;
+}
+
+bool App::isDead() {
+    if (plugin)
+        return plugin->hasEnded();
+    return connection->isDead();
+}
+
+void App::setInputSubscribed(bool subscribed) {
+    inputSubscribed = subscribed;
+}
+
+bool App::isInputSubscribed() {
+    return inputSubscribed;
+}
+
+void App::setOverlay(bool setOverlay) {
+    overlay = setOverlay;
+}
+
+bool App::isOverlay() {
+    return overlay;
+}
+
 int App::generateAppId() {
     //todo implement check for duplicates
     return rand();
@@ -3,6 +3,7 @@
 
 #include <matrixserver.pb.h>
 #include <SocketConnection.h>
+#include <PluginApp.h>
 
 enum class AppState : unsigned int {
     running,
@@ -15,6 +16,7 @@ enum class AppState : unsigned int {
 class App {
 public:
     App(std::shared_ptr<UniversalConnection>);
+    App(std::shared_ptr<PluginApp>);
     ~App() = default;
 
     int getAppId();
@@ -27,12 +29,29 @@ public:
 
     std::shared_ptr<UniversalConnection> getConnection();
 
+    // in-process app, nullptr for apps connected through a transport
+    std::shared_ptr<PluginApp> getPlugin();
+
+    bool isDead();
+
     int generateAppId();
 
+    void setInputSubscribed(bool);
+
+    bool isInputSubscribed();
+
+    // draws into its own compositor layer and never becomes the foreground app
+    void setOverlay(bool);
+
+    bool isOverlay();
+
 private:
     int appId;
     AppState appState;
+    bool inputSubscribed;
+    bool overlay;
     std::shared_ptr<UniversalConnection> connection;
+    std::shared_ptr<PluginApp> plugin;
 };
 
 
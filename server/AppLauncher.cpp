@@ -0,0 +1,381 @@
+#include "AppLauncher.h"
+
+#include <spawn.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include <cstring>
+#include <Log.h>
+
+#include <SocketConnection.h>
+#include <UnixSocketClient.h>
+#include <FrameTimer.h>
+
+extern char **environ;
+
+// posix_spawn() without a shell, fd becomes LAUNCHERFD in the child and is announced in fdVariable
+static bool spawnProcess(pid_t &pid, const std::string &path, const std::vector<std::string> &arguments, int fd,
+                         const char *fdVariable, bool quiet) {
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(path.c_str()));
+    for (const auto &argument : arguments)
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    argv.push_back(nullptr);
+    std::string fdEntry = std::string(fdVariable) + "=" + std::to_string(LAUNCHERFD);
+    std::vector<char *> envp;
+    for (char **entry = environ; *entry != nullptr; entry++) {
+        if (strncmp(*entry, fdEntry.c_str(), strlen(fdVariable) + 1) != 0)
+            envp.push_back(*entry);
+    }
+    envp.push_back(const_cast<char *>(fdEntry.c_str()));
+    envp.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd, LAUNCHERFD);
+    if (quiet) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    // own process group (what nohup ... & did), default signal handling and no blocked signals
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    sigfillset(&signals);
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+    posix_spawnattr_setpgroup(&attributes, 0);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+
+    int result = posix_spawn(&pid, path.c_str(), &actions, &attributes, argv.data(), envp.data());
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    if (result != 0) {
+        MATRIXLOG(warning) << "[AppLauncher] can't start " << path << ": " << strerror(result);
+        return false;
+    }
+    return true;
+}
+
+AppLauncher::AppLauncher(boost::asio::io_service &io_context, ConnectionCallback callback) :
+        io(io_context),
+        connectionCallback(callback),
+        awaitingFirstFrame(0),
+        zygotePid(0),
+        zygoteFd(-1),
+        totalFirstFrameNs(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+AppLauncher::~AppLauncher() {
+    stop();
+}
+
+bool AppLauncher::startZygote(const std::string &zygotePath, const std::vector<std::string> &preload) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (zygoteFd >= 0)
+        return true;
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0)
+        return false;
+    pid_t pid;
+    bool started = spawnProcess(pid, zygotePath, preload, fds[1], ZYGOTEFDENVVARIABLE, false);
+    close(fds[1]);
+    if (!started) {
+        close(fds[0]);
+        return false;
+    }
+    zygotePid = pid;
+    zygoteFd = fds[0];
+    MATRIXLOG(debug) << "[AppLauncher] zygote " << zygotePath << " started as " << pid;
+    return true;
+}
+
+bool AppLauncher::hasZygote() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return zygoteFd >= 0;
+}
+
+int AppLauncher::launch(const std::string &path, const std::vector<std::string> &arguments, bool restartOnFailure) {
+    Launch launch;
+    launch.info.pid = 0;
+    launch.info.path = path;
+    launch.info.arguments = arguments;
+    launch.info.zygote = isPlugin(path);
+    launch.info.restartOnFailure = restartOnFailure;
+    launch.info.restarts = 0;
+    launch.info.state = LaunchState::running;
+    launch.info.exitStatus = 0;
+    launch.info.launchTimestamp = 0;
+    launch.info.firstFrameNs = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!start(launch)) {
+        stats.failures++;
+        launch.info.state = LaunchState::failed;
+        history.push_back(launch.info);
+        if (history.size() > LAUNCHERHISTORY)
+            history.pop_front();
+        return 0;
+    }
+    launches.push_back(launch);
+    return launch.info.pid;
+}
+
+bool AppLauncher::start(Launch &launch) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        MATRIXLOG(warning) << "[AppLauncher] socketpair failed: " << strerror(errno);
+        return false;
+    }
+    auto connection = std::make_shared<SocketConnection>(io);
+    boost::system::error_code error;
+    connection->getSocket().assign(boost::asio::generic::stream_protocol(AF_UNIX, SOCK_STREAM), fds[0], error);
+    if (error) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    launch.info.launchTimestamp = FrameTimer::nowNs();
+    launch.info.firstFrameNs = 0;
+    bool started = launch.info.zygote ? forkFromZygote(launch, fds[1]) : spawn(launch, fds[1]);
+    close(fds[1]);
+    if (!started)
+        return false;
+    stats.launches++;
+    // the server knows the connection before anything is read from it
+    connectionCallback(connection);
+    connection->startReceiving();
+    launch.connection = connection;
+    awaitingFirstFrame++;
+    MATRIXLOG(debug) << "[AppLauncher] " << launch.info.path << " started as " << launch.info.pid
+                     << (launch.info.zygote ? " by the zygote" : "");
+    return true;
+}
+
+bool AppLauncher::spawn(Launch &launch, int appFd) {
+    pid_t pid;
+    if (!spawnProcess(pid, launch.info.path, launch.info.arguments, appFd, LAUNCHERFDENVVARIABLE, true))
+        return false;
+    launch.info.pid = pid;
+    return true;
+}
+
+bool AppLauncher::forkFromZygote(Launch &launch, int appFd) {
+    if (zygoteFd < 0) {
+        MATRIXLOG(warning) << "[AppLauncher] can't start " << launch.info.path << ", no zygote is running";
+        return false;
+    }
+    if (!sendWithFd(zygoteFd, launch.info.path.data(), launch.info.path.size(), appFd))
+        return false;
+    auto pid = readZygoteReports(true);
+    if (pid <= 0)
+        return false;
+    launch.info.pid = pid;
+    return true;
+}
+
+int AppLauncher::readZygoteReports(bool wait) {
+    ZygoteReport report;
+    while (zygoteFd >= 0) {
+        if (wait) {
+            struct pollfd pollFd = {zygoteFd, POLLIN, 0};
+            if (poll(&pollFd, 1, LAUNCHERSTOPTIMEOUT) == 0) {
+                MATRIXLOG(warning) << "[AppLauncher] the zygote doesn't answer";
+                return 0;
+            }
+        }
+        auto length = recv(zygoteFd, &report, sizeof(report), wait ? 0 : MSG_DONTWAIT);
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (length <= 0) {
+            MATRIXLOG(warning) << "[AppLauncher] lost the zygote";
+            close(zygoteFd);
+            zygoteFd = -1;
+            return 0;
+        }
+        if (length != sizeof(report))
+            continue;
+        if (!report.spawned)
+            zygoteExits.push_back(report);
+        else if (wait)
+            return report.pid;
+    }
+    return 0;
+}
+
+void AppLauncher::reap() {
+    std::lock_guard<std::mutex> lock(mutex);
+    readZygoteReports(false);
+    for (size_t i = 0; i < launches.size();) {
+        auto &info = launches[i].info;
+        int status = 0;
+        bool hasEnded = false;
+        if (!info.zygote) {
+            hasEnded = waitpid(info.pid, &status, WNOHANG) == info.pid;
+        } else {
+            for (auto report = zygoteExits.begin(); report != zygoteExits.end(); ++report) {
+                if (report->pid == info.pid) {
+                    status = report->status;
+                    zygoteExits.erase(report);
+                    hasEnded = true;
+                    break;
+                }
+            }
+            // without the zygote there are no reports, the app is reaped by init
+            if (!hasEnded && zygoteFd < 0 && kill(info.pid, 0) < 0 && errno == ESRCH)
+                hasEnded = true;
+        }
+        if (hasEnded)
+            ended(i, status);
+        else
+            i++;
+    }
+    zygoteExits.clear();
+    int status;
+    if (zygotePid > 0 && waitpid(zygotePid, &status, WNOHANG) == zygotePid) {
+        MATRIXLOG(warning) << "[AppLauncher] the zygote ended";
+        zygotePid = 0;
+        if (zygoteFd >= 0)
+            close(zygoteFd);
+        zygoteFd = -1;
+    }
+}
+
+void AppLauncher::ended(size_t index, int status) {
+    Launch launch = launches[index];
+    launches.erase(launches.begin() + index);
+    if (launch.connection) {
+        launch.connection.reset();
+        awaitingFirstFrame--;
+    }
+    auto &info = launch.info;
+    info.exitStatus = status;
+    if (info.state == LaunchState::running)
+        info.state = LaunchState::exited;
+    bool failed = WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+    MATRIXLOG(debug) << "[AppLauncher] " << info.path << " (" << info.pid << ") ended"
+                     << (failed ? " with a failure" : "");
+    history.push_back(info);
+    if (history.size() > LAUNCHERHISTORY)
+        history.pop_front();
+
+    if (info.state == LaunchState::exited && failed && info.restartOnFailure && info.restarts < LAUNCHERMAXRESTARTS) {
+        Launch restart;
+        restart.info = info;
+        restart.info.pid = 0;
+        restart.info.restarts++;
+        restart.info.state = LaunchState::running;
+        restart.info.exitStatus = 0;
+        if (start(restart)) {
+            stats.restarts++;
+            launches.push_back(restart);
+        } else {
+            stats.failures++;
+        }
+    }
+}
+
+void AppLauncher::frameReceived(UniversalConnection *connection) {
+    if (awaitingFirstFrame == 0)
+        return;
+    auto now = FrameTimer::nowNs();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &launch : launches) {
+        if (launch.connection.get() != connection)
+            continue;
+        auto &info = launch.info;
+        info.firstFrameNs = now - info.launchTimestamp;
+        launch.connection.reset();
+        awaitingFirstFrame--;
+        stats.firstFrames++;
+        stats.lastFirstFrameNs = info.firstFrameNs;
+        if (stats.firstFrames == 1 || info.firstFrameNs < stats.minFirstFrameNs)
+            stats.minFirstFrameNs = info.firstFrameNs;
+        if (info.firstFrameNs > stats.maxFirstFrameNs)
+            stats.maxFirstFrameNs = info.firstFrameNs;
+        totalFirstFrameNs += info.firstFrameNs;
+        stats.meanFirstFrameNs = totalFirstFrameNs / (int64_t) stats.firstFrames;
+        MATRIXLOG(debug) << "[AppLauncher] first frame of " << info.path << " "
+                         << info.firstFrameNs / 1000 << " us after the launch";
+        break;
+    }
+}
+
+bool AppLauncher::terminate(int pid) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &launch : launches) {
+        if (launch.info.pid == pid) {
+            launch.info.state = LaunchState::terminated;
+            return kill(-pid, SIGTERM) == 0 || kill(pid, SIGTERM) == 0;
+        }
+    }
+    return false;
+}
+
+void AppLauncher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &launch : launches) {
+            launch.info.state = LaunchState::terminated;
+            kill(-launch.info.pid, SIGTERM);
+        }
+    }
+    for (int i = 0; i < LAUNCHERSTOPTIMEOUT / 10; i++) {
+        reap();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (launches.empty())
+                break;
+        }
+        usleep(10000);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &launch : launches) {
+        MATRIXLOG(warning) << "[AppLauncher] killing " << launch.info.path << " (" << launch.info.pid << ")";
+        kill(-launch.info.pid, SIGKILL);
+        if (!launch.info.zygote)
+            waitpid(launch.info.pid, nullptr, 0);
+        launch.connection.reset();
+        history.push_back(launch.info);
+        if (history.size() > LAUNCHERHISTORY)
+            history.pop_front();
+    }
+    launches.clear();
+    awaitingFirstFrame = 0;
+    // the zygote ends once its control socket is closed
+    if (zygoteFd >= 0)
+        close(zygoteFd);
+    zygoteFd = -1;
+    if (zygotePid > 0)
+        waitpid(zygotePid, nullptr, 0);
+    zygotePid = 0;
+}
+
+std::vector<LaunchInfo> AppLauncher::getLaunches() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<LaunchInfo> result;
+    for (const auto &launch : launches)
+        result.push_back(launch.info);
+    return result;
+}
+
+std::vector<LaunchInfo> AppLauncher::getHistory() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::vector<LaunchInfo>(history.begin(), history.end());
+}
+
+LauncherStats AppLauncher::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+bool AppLauncher::isPlugin(const std::string &path) {
+    return path.size() > 3 && path.compare(path.size() - 3, 3, ".so") == 0;
+}
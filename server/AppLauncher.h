@@ -0,0 +1,132 @@
+#ifndef MATRIXSERVER_APPLAUNCHER_H
+#define MATRIXSERVER_APPLAUNCHER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+#include <boost/asio.hpp>
+
+#include <UniversalConnection.h>
+#include <Zygote.h>
+
+#define LAUNCHERFD 3 // fd number of the connection in a spawned app
+#define LAUNCHERMAXRESTARTS 3
+#define LAUNCHERSTOPTIMEOUT 1000 //ms between SIGTERM and SIGKILL when the launcher stops its apps
+#define LAUNCHERHISTORY 16 // ended launches kept for getHistory()
+#define DEFAULTZYGOTE "/usr/local/bin/matrixzygote"
+
+enum class LaunchState : unsigned int {
+    running,
+    exited,     // ended on its own, see exitStatus
+    terminated, // stopped by the launcher
+    failed      // could not be started
+};
+
+struct LaunchInfo {
+    int pid;
+    std::string path;
+    std::vector<std::string> arguments;
+    bool zygote; // forked from the zygote instead of spawned
+    bool restartOnFailure;
+    unsigned int restarts;
+    LaunchState state;
+    int exitStatus;          // waitpid() status once it has exited
+    int64_t launchTimestamp; // CLOCK_MONOTONIC ns
+    int64_t firstFrameNs;    // launch to the first frame the server received, 0 before
+};
+
+struct LauncherStats {
+    uint64_t launches;
+    uint64_t failures;
+    uint64_t restarts;
+    uint64_t firstFrames;
+    int64_t lastFirstFrameNs;
+    int64_t minFirstFrameNs;
+    int64_t maxFirstFrameNs;
+    int64_t meanFirstFrameNs;
+};
+
+/*
+ * Starts apps for the server without a shell. Every app gets one end of a socketpair() as
+ * LAUNCHERFD (announced in LAUNCHERFDENVVARIABLE), the other end is handed to the server as a new
+ * connection before the app runs, so the app doesn't have to find and connect to the server.
+ * Executables are started with posix_spawn(), app plugins (*.so) are forked from the zygote if one
+ * is running. The launcher keeps track of its apps: reap() (called periodically, e.g. by
+ * Server::tick) collects ended apps and restarts the ones which asked for it after a failure,
+ * stop() ends all of them. The time from launch to the first frame is measured per app, the server
+ * reports frames with frameReceived().
+ */
+class AppLauncher {
+public:
+    typedef std::function<void(std::shared_ptr<UniversalConnection>)> ConnectionCallback;
+
+    AppLauncher(boost::asio::io_service &io, ConnectionCallback callback);
+
+    ~AppLauncher();
+
+    AppLauncher(AppLauncher const &) = delete;
+
+    // starts the zygote executable, the libraries in preload are loaded into it as well
+    bool startZygote(const std::string &zygotePath, const std::vector<std::string> &preload = {});
+
+    bool hasZygote();
+
+    // returns the pid of the app or 0
+    int launch(const std::string &path, const std::vector<std::string> &arguments = {}, bool restartOnFailure = false);
+
+    void reap();
+
+    void frameReceived(UniversalConnection *connection);
+
+    // SIGTERM to the app's process group, it is not restarted
+    bool terminate(int pid);
+
+    // terminates all apps and the zygote, waits LAUNCHERSTOPTIMEOUT before it kills them
+    void stop();
+
+    std::vector<LaunchInfo> getLaunches();
+
+    // ended launches, oldest first
+    std::vector<LaunchInfo> getHistory();
+
+    LauncherStats getStats();
+
+private:
+    struct Launch {
+        LaunchInfo info;
+        std::shared_ptr<UniversalConnection> connection; // until the first frame
+    };
+
+    bool start(Launch &launch);
+
+    bool spawn(Launch &launch, int appFd);
+
+    bool forkFromZygote(Launch &launch, int appFd);
+
+    void ended(size_t index, int status);
+
+    // collects the exit reports, returns the pid of the answer to a launch request if wait is set
+    int readZygoteReports(bool wait);
+
+    static bool isPlugin(const std::string &path);
+
+    boost::asio::io_service &io;
+    ConnectionCallback connectionCallback;
+    std::mutex mutex;
+    std::vector<Launch> launches;
+    std::deque<LaunchInfo> history;
+    std::atomic<int> awaitingFirstFrame;
+    int zygotePid;
+    int zygoteFd;
+    std::vector<ZygoteReport> zygoteExits; // reports of ended apps, handled by reap()
+    LauncherStats stats;
+    int64_t totalFirstFrameNs;
+};
+
+
+#endif //MATRIXSERVER_APPLAUNCHER_H
@@ -0,0 +1,355 @@
+#include "Cluster.h"
+
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <Log.h>
+#include <FrameTimer.h>
+#include <FrameDelta.h>
+#include <TcpClient.h>
+#include <Metrics.h>
+
+// frames and clock exchanges are small and must not wait for an ack of the previous message
+static void setNoDelay(std::shared_ptr<SocketConnection> connection) {
+    int enable = 1;
+    setsockopt(connection->getSocket().native_handle(), IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+}
+
+static std::vector<size_t> screenPixels(const std::vector<std::shared_ptr<Screen>> &screens, size_t count) {
+    std::vector<size_t> pixels;
+    for (size_t i = 0; i < count && i < screens.size(); i++)
+        pixels.push_back(screens[i]->getScreenDataSize());
+    return pixels;
+}
+
+ClusterLeader::ClusterLeader(boost::asio::io_service &io, const matrixserver::ServerConfig &config,
+                             std::vector<std::shared_ptr<Screen>> initScreens, size_t setLocalScreens) :
+        tcpServer(io, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(),
+                                                     config.cluster().port() > 0 ? config.cluster().port() : CLUSTERDEFAULTPORT)),
+        delayNs((config.cluster().presentationdelayms() > 0 ? config.cluster().presentationdelayms() : CLUSTERDEFAULTDELAY) * 1000000LL),
+        localScreens(std::min(setLocalScreens, initScreens.size())),
+        sequence(0),
+        presenter(screenPixels(initScreens, std::min(setLocalScreens, initScreens.size())),
+                  std::bind(&ClusterLeader::presentLocal, this, std::placeholders::_1)) {
+    screens = initScreens;
+    for (auto &screen : screens)
+        shown.emplace_back(screen->getScreenDataSize(), Color::black());
+    encoded.resize(screens.size());
+    delta.resize(screens.size(), false);
+    changed.resize(screens.size(), false);
+    localChanged.resize(localScreens, nullptr);
+    memset(&stats, 0, sizeof(stats));
+    tcpServer.setAcceptCallback(std::bind(&ClusterLeader::newFollower, this, std::placeholders::_1));
+    MATRIXLOG(info) << "[Cluster] leader of " << screens.size() << " screens, " << localScreens << " of them local, "
+                    << delayNs / 1000000 << " ms presentation delay";
+}
+
+ClusterLeader::~ClusterLeader() {
+    presenter.stop();
+}
+
+void ClusterLeader::addLocalRenderer(std::shared_ptr<IRenderer> renderer) {
+    std::lock_guard<std::mutex> lock(localMutex);
+    localRenderers.push_back(renderer);
+}
+
+void ClusterLeader::newFollower(std::shared_ptr<SocketConnection> connection) {
+    setNoDelay(connection);
+    connection->setReceiveCallback(
+            std::bind(&ClusterLeader::handleMessage, this, std::placeholders::_1, std::placeholders::_2));
+    Follower follower;
+    follower.connection = connection;
+    std::lock_guard<std::mutex> lock(followersMutex);
+    followers.push_back(follower);
+}
+
+void ClusterLeader::handleMessage(std::shared_ptr<UniversalConnection> connection,
+                                  std::shared_ptr<matrixserver::MatrixServerMessage> message) {
+    auto received = FrameTimer::nowNs();
+    if (message->messagetype() == matrixserver::clusterSync) {
+        auto answer = std::make_shared<matrixserver::MatrixServerMessage>();
+        answer->set_messagetype(matrixserver::clusterSync);
+        auto *sync = answer->mutable_clustersync();
+        sync->set_originns(message->clustersync().originns());
+        sync->set_receivens(received);
+        sync->set_transmitns(FrameTimer::nowNs());
+        connection->sendMessage(answer);
+    } else if (message->messagetype() == matrixserver::clusterJoin) {
+        std::lock_guard<std::mutex> lock(followersMutex);
+        for (auto &follower : followers) {
+            if (follower.connection != connection)
+                continue;
+            follower.screenIndices.clear();
+            for (auto screenId : message->clusterscreenids()) {
+                for (size_t i = 0; i < screens.size(); i++) {
+                    if (screens[i]->getScreenId() == screenId)
+                        follower.screenIndices.push_back(i);
+                }
+            }
+            follower.joined = true;
+            follower.needsAllScreens = true;
+            MATRIXLOG(info) << "[Cluster] follower joined for " << follower.screenIndices.size() << " screens";
+        }
+    }
+}
+
+void ClusterLeader::setScreenData(int screenId, Color *screenData) {
+    for (size_t i = 0; i < screens.size(); i++) {
+        if (screens[i]->getScreenId() != screenId)
+            continue;
+        size_t length = shown[i].size() * sizeof(Color);
+        encoded[i].resize(FRAMEDELTAMAXSIZE(length));
+        encoded[i].resize(encodeFrameDelta(reinterpret_cast<const uint8_t *>(shown[i].data()),
+                                           reinterpret_cast<const uint8_t *>(screenData), length,
+                                           reinterpret_cast<uint8_t *>(&encoded[i][0])));
+        delta[i] = encoded[i].size() < length; // otherwise the whole screen is smaller
+        memcpy(shown[i].data(), screenData, length);
+        changed[i] = true;
+        if (i < localScreens)
+            localChanged[i] = shown[i].data();
+        return;
+    }
+}
+
+void ClusterLeader::render() {
+    static auto &replicateLatency = Metrics::histogram("cluster_replicate", "encoding and sending a frame to the followers");
+    auto start = FrameTimer::nowNs();
+    auto presentAt = start + delayNs;
+    presenter.schedule(presentAt, globalBrightness, localChanged);
+    sequence++;
+    uint64_t screensSent = 0;
+    uint64_t deltaScreens = 0;
+    uint64_t bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(followersMutex);
+        followers.erase(std::remove_if(followers.begin(), followers.end(), [](const Follower &follower) {
+            return follower.connection->isDead();
+        }), followers.end());
+        for (auto &follower : followers) {
+            if (!follower.joined)
+                continue;
+            auto message = std::make_shared<matrixserver::MatrixServerMessage>();
+            message->set_messagetype(matrixserver::clusterFrame);
+            auto *frame = message->mutable_clusterframe();
+            frame->set_sequence(sequence);
+            frame->set_presentatns(presentAt);
+            frame->set_brightness(globalBrightness);
+            for (auto index : follower.screenIndices) {
+                if (!follower.needsAllScreens && !changed[index])
+                    continue;
+                auto *screen = frame->add_screens();
+                screen->set_screenid(screens[index]->getScreenId());
+                if (!follower.needsAllScreens && delta[index]) {
+                    screen->set_delta(true);
+                    screen->set_data(encoded[index]);
+                    deltaScreens++;
+                } else {
+                    screen->set_data((const char *) shown[index].data(), shown[index].size() * sizeof(Color));
+                }
+                bytes += screen->data().size();
+                screensSent++;
+            }
+            follower.needsAllScreens = false;
+            if (frame->screens_size() > 0)
+                follower.connection->sendMessage(message);
+        }
+        std::lock_guard<std::mutex> statsLock(statsMutex);
+        stats.frames++;
+        stats.screens += screensSent;
+        stats.deltaScreens += deltaScreens;
+        stats.bytes += bytes;
+        stats.followers = followers.size();
+    }
+    std::fill(changed.begin(), changed.end(), false);
+    std::fill(localChanged.begin(), localChanged.end(), nullptr);
+    replicateLatency.record(FrameTimer::nowNs() - start);
+}
+
+// present thread
+void ClusterLeader::presentLocal(ScheduledFrame &frame) {
+    std::lock_guard<std::mutex> lock(localMutex);
+    for (auto &renderer : localRenderers) {
+        if (renderer->getGlobalBrightness() != frame.brightness)
+            renderer->setGlobalBrightness(frame.brightness);
+        for (size_t i = 0; i < frame.screens.size(); i++) {
+            if (frame.changed[i])
+                renderer->setScreenData(screens[i]->getScreenId(), frame.screens[i].data());
+        }
+        renderer->render();
+    }
+}
+
+void ClusterLeader::setGlobalBrightness(int brightness) {
+    globalBrightness = brightness;
+}
+
+int ClusterLeader::getGlobalBrightness() {
+    return globalBrightness;
+}
+
+ClusterStats ClusterLeader::getStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    auto result = stats;
+    result.presenter = presenter.getStats();
+    return result;
+}
+
+ClusterFollower::ClusterFollower(boost::asio::io_service &setIo, const matrixserver::ServerConfig &config,
+                                 std::function<void(ScheduledFrame &)> present) :
+        io(setIo),
+        leaderAddress(config.cluster().leaderaddress().empty() ? "127.0.0.1" : config.cluster().leaderaddress()),
+        leaderPort(std::to_string(config.cluster().port() > 0 ? config.cluster().port() : CLUSTERDEFAULTPORT)),
+        firstScreenId(config.cluster().firstscreenid()),
+        running(true),
+        presenter([&config]() {
+            std::vector<size_t> pixels;
+            for (const auto &screenInfo : config.screeninfo())
+                pixels.push_back(screenInfo.width() * screenInfo.height());
+            return pixels;
+        }(), present) {
+    for (const auto &screenInfo : config.screeninfo()) {
+        screenIds.push_back(firstScreenId + (int) screenIds.size());
+        received.emplace_back(screenInfo.width() * screenInfo.height(), Color::black());
+    }
+    changedScreens.resize(screenIds.size(), nullptr);
+    memset(&stats, 0, sizeof(stats));
+    thread = new boost::thread(&ClusterFollower::syncLoop, this);
+}
+
+ClusterFollower::~ClusterFollower() {
+    running = false;
+    thread->interrupt();
+    thread->join();
+    delete thread;
+    presenter.stop();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (connection)
+        connection->setReceiveCallback(nullptr);
+}
+
+bool ClusterFollower::connect() {
+    auto newConnection = TcpClient::connect(io, leaderAddress, leaderPort);
+    if (newConnection->isDead())
+        return false;
+    setNoDelay(newConnection);
+    newConnection->setReceiveCallback(
+            std::bind(&ClusterFollower::handleMessage, this, std::placeholders::_1, std::placeholders::_2));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        connection = newConnection;
+        clock.reset();
+        stats.followers = 1;
+    }
+    auto join = std::make_shared<matrixserver::MatrixServerMessage>();
+    join->set_messagetype(matrixserver::clusterJoin);
+    for (auto screenId : screenIds)
+        join->add_clusterscreenids(screenId);
+    newConnection->sendMessage(join);
+    MATRIXLOG(info) << "[Cluster] following " << leaderAddress << ":" << leaderPort << " for the screens from "
+                    << firstScreenId << " on";
+    return true;
+}
+
+void ClusterFollower::syncLoop() {
+    try {
+        while (running) {
+            std::shared_ptr<UniversalConnection> current;
+            uint64_t samples;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                current = connection;
+                samples = clock.getSampleCount();
+            }
+            if (!current || current->isDead()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stats.followers = 0;
+                }
+                if (!connect())
+                    boost::this_thread::sleep_for(boost::chrono::microseconds(CLUSTERRECONNECTINTERVAL));
+                continue;
+            }
+            auto sync = std::make_shared<matrixserver::MatrixServerMessage>();
+            sync->set_messagetype(matrixserver::clusterSync);
+            sync->mutable_clustersync()->set_originns(FrameTimer::nowNs());
+            current->sendMessage(sync);
+            boost::this_thread::sleep_for(boost::chrono::microseconds(
+                    samples < CLOCKSYNCSAMPLES ? CLUSTERFASTSYNCINTERVAL : CLUSTERSYNCINTERVAL));
+        }
+    } catch (boost::thread_interrupted &) {
+    }
+}
+
+void ClusterFollower::handleMessage(std::shared_ptr<UniversalConnection>,
+                                    std::shared_ptr<matrixserver::MatrixServerMessage> message) {
+    auto arrived = FrameTimer::nowNs();
+    if (message->messagetype() == matrixserver::clusterSync) {
+        const auto &sync = message->clustersync();
+        std::lock_guard<std::mutex> lock(mutex);
+        clock.addSample(sync.originns(), sync.receivens(), sync.transmitns(), arrived);
+        stats.clockOffsetNs = clock.getOffsetNs();
+        stats.clockDelayNs = clock.getDelayNs();
+    } else if (message->messagetype() == matrixserver::clusterFrame) {
+        handleFrame(message->clusterframe());
+    }
+}
+
+void ClusterFollower::handleFrame(const matrixserver::ClusterFrame &frame) {
+    uint64_t screens = 0;
+    uint64_t deltaScreens = 0;
+    uint64_t bytes = 0;
+    for (const auto &screen : frame.screens()) {
+        int index = screen.screenid() - firstScreenId;
+        if (index < 0 || index >= (int) received.size())
+            continue;
+        auto &data = received[index];
+        bool applied;
+        if (screen.delta()) {
+            applied = applyFrameDelta(reinterpret_cast<uint8_t *>(data.data()), data.size() * sizeof(Color),
+                                      reinterpret_cast<const uint8_t *>(screen.data().data()), screen.data().size());
+        } else {
+            applied = screen.data().size() == data.size() * sizeof(Color);
+            if (applied)
+                memcpy(data.data(), screen.data().data(), screen.data().size());
+        }
+        if (!applied) {
+            MATRIXLOG(warning) << "[Cluster] screen " << screen.screenid() << " of frame " << frame.sequence()
+                               << " doesn't fit";
+            continue;
+        }
+        changedScreens[index] = data.data();
+        screens++;
+        deltaScreens += screen.delta() ? 1 : 0;
+        bytes += screen.data().size();
+    }
+    int64_t presentAt;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.frames++;
+        stats.screens += screens;
+        stats.deltaScreens += deltaScreens;
+        stats.bytes += bytes;
+        if (!clock.isSynchronized()) {
+            // the screens are kept, they are presented with the first frame after the clock is known
+            stats.unsynchronized++;
+            return;
+        }
+        presentAt = clock.toLocal(frame.presentatns());
+    }
+    presenter.schedule(presentAt, frame.brightness(), changedScreens);
+    std::fill(changedScreens.begin(), changedScreens.end(), nullptr);
+}
+
+ClusterStats ClusterFollower::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto result = stats;
+    result.presenter = presenter.getStats();
+    return result;
+}
+
+bool ClusterFollower::isSynchronized() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return clock.isSynchronized();
+}
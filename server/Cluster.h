@@ -0,0 +1,145 @@
+#ifndef MATRIXSERVER_CLUSTER_H
+#define MATRIXSERVER_CLUSTER_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <boost/thread/thread.hpp>
+
+#include <IRenderer.h>
+#include <TcpServer.h>
+#include <SocketConnection.h>
+#include <ClockSync.h>
+#include <matrixserver.pb.h>
+#include "FramePresenter.h"
+
+#define CLUSTERDEFAULTPORT 2018
+#define CLUSTERDEFAULTDELAY 40 // ms from rendering a frame on the leader to showing it on all cubes
+#define CLUSTERSYNCINTERVAL 200000 // us between two clock exchanges of a follower
+#define CLUSTERFASTSYNCINTERVAL 10000 // us, the first CLOCKSYNCSAMPLES exchanges after connecting
+#define CLUSTERRECONNECTINTERVAL 1000000 // us a follower waits before connecting to the leader again
+
+struct ClusterStats {
+    uint64_t frames;         // leader: replicated, follower: received
+    uint64_t screens;        // leader: sent to a follower, follower: received
+    uint64_t deltaScreens;   // of those sent as a FrameDelta
+    uint64_t bytes;          // of the screen data sent or received
+    uint64_t followers;      // leader: connected followers, follower: 1 while connected to the leader
+    int64_t clockOffsetNs;   // follower: clock of the leader - own clock
+    int64_t clockDelayNs;    // follower: round trip of the exchange the offset is taken from
+    uint64_t unsynchronized; // follower: frames received before the clock offset was known, shown with the next one
+    FramePresenterStats presenter;
+};
+
+/*
+ * The leader's side of a cluster, the one renderer of a leader server, the server's other renderers
+ * are its local renderers. The apps run on the leader and see the whole display. It gets the
+ * presented frames of the whole display (the leader's screens and ServerConfig.cluster.remoteScreenInfo after them),
+ * stamps them with a presentation time presentationDelayMs ahead and sends every follower the screens
+ * it shows which changed, as a FrameDelta against the previous frame where that is smaller. A follower
+ * which just joined gets all of its screens once. The leader's own renderers get the frame at the same
+ * presentation time from a FramePresenter, the followers answer clock exchanges so they can convert
+ * it to their clocks.
+ */
+class ClusterLeader : public IRenderer {
+public:
+    // screens: the display, the first localScreens of it are the leader's own
+    ClusterLeader(boost::asio::io_service &io, const matrixserver::ServerConfig &config,
+                  std::vector<std::shared_ptr<Screen>> screens, size_t localScreens);
+
+    ~ClusterLeader();
+
+    // shows the leader's screens of every frame at its presentation time
+    void addLocalRenderer(std::shared_ptr<IRenderer> renderer);
+
+    void setScreenData(int, Color *);
+
+    void render();
+
+    void setGlobalBrightness(int);
+
+    int getGlobalBrightness();
+
+    ClusterStats getStats();
+
+private:
+    struct Follower {
+        std::shared_ptr<UniversalConnection> connection;
+        std::vector<int> screenIndices;
+        bool joined = false;
+        bool needsAllScreens = true;
+    };
+
+    void newFollower(std::shared_ptr<SocketConnection> connection);
+
+    // io thread
+    void handleMessage(std::shared_ptr<UniversalConnection> connection, std::shared_ptr<matrixserver::MatrixServerMessage> message);
+
+    void presentLocal(ScheduledFrame &frame);
+
+    TcpServer tcpServer;
+    int64_t delayNs;
+    size_t localScreens;
+    std::vector<std::vector<Color>> shown; // the last frame of every display screen, the base of the deltas
+    std::vector<std::string> encoded; // the changed screens of the frame being rendered
+    std::vector<bool> delta;
+    std::vector<bool> changed;
+    std::vector<const Color *> localChanged;
+    uint64_t sequence;
+    std::mutex followersMutex;
+    std::vector<Follower> followers;
+    std::mutex localMutex; // the present thread renders the local renderers
+    std::vector<std::shared_ptr<IRenderer>> localRenderers;
+    std::mutex statsMutex;
+    ClusterStats stats;
+    FramePresenter presenter;
+};
+
+/*
+ * The follower's side of a cluster: connects to the leader, asks for the screens of the display from
+ * ServerConfig.cluster.firstScreenID on (as many as it has itself), keeps the clock offset to the leader
+ * with clock exchanges and presents the frames it receives at their presentation time on its own clock
+ * through the present callback, with its own screen ids. Reconnects when the leader goes away. A
+ * follower server doesn't show the frames of its own apps.
+ */
+class ClusterFollower {
+public:
+    ClusterFollower(boost::asio::io_service &io, const matrixserver::ServerConfig &config,
+                    std::function<void(ScheduledFrame &)> present);
+
+    ~ClusterFollower();
+
+    ClusterStats getStats();
+
+    bool isSynchronized();
+
+private:
+    void syncLoop();
+
+    bool connect();
+
+    // io thread
+    void handleMessage(std::shared_ptr<UniversalConnection> connection, std::shared_ptr<matrixserver::MatrixServerMessage> message);
+
+    void handleFrame(const matrixserver::ClusterFrame &frame);
+
+    boost::asio::io_service &io;
+    std::string leaderAddress;
+    std::string leaderPort;
+    int firstScreenId;
+    std::vector<int> screenIds; // of the display
+    std::vector<std::vector<Color>> received; // the last frame of every screen, the base of the deltas
+    std::vector<const Color *> changedScreens;
+    std::shared_ptr<UniversalConnection> connection;
+    std::mutex mutex; // connection, clock and stats
+    ClockOffsetEstimator clock;
+    ClusterStats stats;
+    std::atomic<bool> running;
+    FramePresenter presenter;
+    boost::thread *thread;
+};
+
+
+#endif //MATRIXSERVER_CLUSTER_H
@@ -0,0 +1,226 @@
+#include "Compositor.h"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(Color) == 3, "the blend kernel works on packed rgb bytes");
+
+static inline uint8_t blendChannel(uint8_t source, uint8_t destination, uint8_t alpha) {
+    // (s * a + d * (255 - a)) / 255 rounded, without a division, fits in 16 bit
+    uint16_t value = source * alpha + destination * (255 - alpha) + 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+void Compositor::alphaOver(Color *dst, const Color *src, size_t pixels, uint8_t opacity, bool blackIsTransparent) {
+    auto *d = reinterpret_cast<uint8_t *>(dst);
+    auto *s = reinterpret_cast<const uint8_t *>(src);
+    if (!blackIsTransparent) {
+        if (opacity == 255) {
+            memcpy(d, s, pixels * 3);
+            return;
+        }
+        // one alpha for all channels: a plain byte loop, the compiler vectorizes it
+        for (size_t i = 0; i < pixels * 3; i++)
+            d[i] = blendChannel(s[i], d[i], opacity);
+        return;
+    }
+    for (size_t i = 0; i < pixels; i++) {
+        uint8_t alpha = (s[0] | s[1] | s[2]) ? opacity : 0;
+        d[0] = blendChannel(s[0], d[0], alpha);
+        d[1] = blendChannel(s[1], d[1], alpha);
+        d[2] = blendChannel(s[2], d[2], alpha);
+        d += 3;
+        s += 3;
+    }
+}
+
+Compositor::Compositor(const matrixserver::ServerConfig &serverConfig) : nextOrder(0) {
+    memset(&stats, 0, sizeof(stats));
+    for (const auto &screenInfo : serverConfig.screeninfo()) {
+        screenIds.push_back(screenInfo.screenid());
+        screenWidths.push_back(screenInfo.width());
+        screenHeights.push_back(screenInfo.height());
+        screenSizes.push_back(screenInfo.width() * screenInfo.height());
+    }
+    caches.resize(screenIds.size());
+    for (size_t i = 0; i < caches.size(); i++) {
+        caches[i].below.resize(screenSizes[i], Color::black());
+        caches[i].output.resize(screenSizes[i], Color::black());
+    }
+}
+
+LayerConfig Compositor::configFromRequest(const matrixserver::LayerRequest &request) {
+    LayerConfig config;
+    config.z = request.z();
+    config.opacity = request.opacity() == 0 || request.opacity() > 255 ? 255 : request.opacity();
+    config.blackIsTransparent = request.blackistransparent();
+    for (const auto &region : request.regions())
+        config.regions.push_back({region.screenid(), region.x(), region.y(), region.width(), region.height()});
+    return config;
+}
+
+int Compositor::screenIndex(int screenId) {
+    for (size_t i = 0; i < screenIds.size(); i++) {
+        if (screenIds[i] == screenId)
+            return i;
+    }
+    return -1;
+}
+
+Compositor::Layer *Compositor::findLayer(int id) {
+    for (auto &layer : layers) {
+        if (layer->id == id)
+            return layer.get();
+    }
+    return nullptr;
+}
+
+void Compositor::sortLayers() {
+    std::sort(layers.begin(), layers.end(), [](const std::unique_ptr<Layer> &a, const std::unique_ptr<Layer> &b) {
+        return a->config.z != b->config.z ? a->config.z < b->config.z : a->order < b->order;
+    });
+}
+
+void Compositor::setLayer(int id, const LayerConfig &config) {
+    auto layer = findLayer(id);
+    if (!layer) {
+        layers.emplace_back(new Layer());
+        layer = layers.back().get();
+        layer->id = id;
+        layer->order = nextOrder++;
+        layer->regions.resize(screenIds.size());
+        layer->frames.resize(screenIds.size());
+        layer->versions.resize(screenIds.size(), 0);
+    }
+    layer->config = config;
+    for (size_t i = 0; i < screenIds.size(); i++) {
+        layer->regions[i].clear();
+        if (config.regions.empty())
+            layer->regions[i].push_back({screenIds[i], 0, 0, screenWidths[i], screenHeights[i]});
+        // a changed configuration changes what the layer contributes everywhere
+        layer->versions[i]++;
+    }
+    for (auto region : config.regions) {
+        auto index = screenIndex(region.screenId);
+        if (index < 0)
+            continue;
+        if (region.width <= 0)
+            region.width = screenWidths[index] - region.x;
+        if (region.height <= 0)
+            region.height = screenHeights[index] - region.y;
+        auto x0 = std::max(region.x, 0);
+        auto y0 = std::max(region.y, 0);
+        auto x1 = std::min(region.x + region.width, screenWidths[index]);
+        auto y1 = std::min(region.y + region.height, screenHeights[index]);
+        if (x1 <= x0 || y1 <= y0)
+            continue;
+        layer->regions[index].push_back({region.screenId, x0, y0, x1 - x0, y1 - y0});
+    }
+    for (size_t i = 0; i < screenIds.size(); i++) {
+        if (layer->regions[i].empty())
+            layer->frames[i].clear();
+        else
+            layer->frames[i].resize(screenSizes[i], Color::black()); // Color() leaves the channels undefined
+    }
+    sortLayers();
+}
+
+void Compositor::removeLayer(int id) {
+    layers.erase(std::remove_if(layers.begin(), layers.end(), [id](const std::unique_ptr<Layer> &layer) {
+        return layer->id == id;
+    }), layers.end());
+}
+
+bool Compositor::hasLayer(int id) {
+    return findLayer(id) != nullptr;
+}
+
+size_t Compositor::getLayerCount() {
+    return layers.size();
+}
+
+std::vector<int> Compositor::getLayerIds() {
+    std::vector<int> ids;
+    for (auto &layer : layers)
+        ids.push_back(layer->id);
+    return ids;
+}
+
+size_t Compositor::getScreenPixels(int screenId) {
+    auto index = screenIndex(screenId);
+    return index < 0 ? 0 : screenSizes[index];
+}
+
+void Compositor::setLayerFrame(int id, int screenId, const Color *data, size_t pixels) {
+    auto layer = findLayer(id);
+    auto index = screenIndex(screenId);
+    if (!layer || index < 0 || layer->regions[index].empty() || pixels < (size_t) screenSizes[index])
+        return;
+    memcpy(layer->frames[index].data(), data, screenSizes[index] * sizeof(Color));
+    layer->versions[index]++;
+}
+
+void Compositor::blend(Layer &layer, size_t screen, std::vector<Color> &target) {
+    // column by column, the layout of Screen
+    auto height = screenHeights[screen];
+    for (const auto &region : layer.regions[screen]) {
+        for (int x = region.x; x < region.x + region.width; x++) {
+            auto offset = x * height + region.y;
+            alphaOver(&target[offset], &layer.frames[screen][offset], region.height,
+                      layer.config.opacity, layer.config.blackIsTransparent);
+        }
+    }
+}
+
+int Compositor::compose(std::function<void(int screenId, Color *data)> output) {
+    int composited = 0;
+    std::vector<std::pair<int, uint64_t>> signature;
+    std::vector<Layer *> stack;
+    for (size_t screen = 0; screen < screenIds.size(); screen++) {
+        auto &cache = caches[screen];
+        signature.clear();
+        stack.clear();
+        for (auto &layer : layers) {
+            if (layer->regions[screen].empty())
+                continue;
+            signature.emplace_back(layer->id, layer->versions[screen]);
+            stack.push_back(layer.get());
+        }
+        if (cache.valid && signature == cache.composed) {
+            stats.screensUnchanged++;
+            continue;
+        }
+
+        // the layers below the lowest change are the same as last time, they go into the cache
+        size_t unchanged = 0;
+        while (unchanged < signature.size() && unchanged < cache.composed.size() &&
+               signature[unchanged] == cache.composed[unchanged])
+            unchanged++;
+        size_t reused = cache.cached.size();
+        if (reused > unchanged || !std::equal(cache.cached.begin(), cache.cached.end(), signature.begin())) {
+            std::fill(cache.below.begin(), cache.below.end(), Color::black());
+            reused = 0;
+        }
+        for (size_t i = reused; i < unchanged; i++)
+            blend(*stack[i], screen, cache.below);
+        cache.cached.assign(signature.begin(), signature.begin() + unchanged);
+
+        cache.output = cache.below;
+        for (size_t i = unchanged; i < stack.size(); i++)
+            blend(*stack[i], screen, cache.output);
+        cache.composed = signature;
+        cache.valid = true;
+
+        stats.layersCached += reused;
+        stats.layersBlended += stack.size() - reused;
+        stats.screensComposited++;
+        output(screenIds[screen], cache.output.data());
+        composited++;
+    }
+    stats.compositions++;
+    return composited;
+}
+
+CompositorStats Compositor::getStats() {
+    return stats;
+}
@@ -0,0 +1,118 @@
+#ifndef MATRIXSERVER_COMPOSITOR_H
+#define MATRIXSERVER_COMPOSITOR_H
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <stdint.h>
+
+#include <Color.h>
+#include <matrixserver.pb.h>
+
+struct LayerRegion {
+    int screenId;
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+struct LayerConfig {
+    int z = 0;
+    uint8_t opacity = 255;
+    bool blackIsTransparent = false;
+    std::vector<LayerRegion> regions; // empty: all screens
+};
+
+struct CompositorStats {
+    uint64_t compositions;
+    uint64_t screensComposited;
+    uint64_t screensUnchanged; // nothing on the screen changed, the last result was kept
+    uint64_t layersBlended;
+    uint64_t layersCached;     // blended once into the cache below a changing layer and reused
+};
+
+/*
+ * Blends the layers of several apps into the screens the renderers get. Every layer has a z-order,
+ * an opacity and the screens or rectangles it owns, and keeps the last frame its app sent.
+ * For every screen the compositor keeps the result of the layers below the lowest layer which
+ * changed, so static content under an animated overlay is blended once, and screens without any
+ * change aren't composited at all. The server's foreground app is the base layer, apps which asked
+ * for a layer are overlays; as long as there are none the server bypasses the compositor. Not thread
+ * safe, the server calls it under its renderer lock.
+ *
+ *   compositor.setLayer(gameId, LayerConfig());                // opaque, all screens
+ *   compositor.setLayer(batteryId, overlay);                   // z 1, a corner of the top screen
+ *   compositor.setLayerFrame(gameId, screenId, pixels);        // whenever a frame arrives
+ *   compositor.compose([&](int screenId, Color *data) { renderer->setScreenData(screenId, data); });
+ */
+class Compositor {
+public:
+    Compositor(const matrixserver::ServerConfig &serverConfig);
+
+    // adds the layer or changes its configuration
+    void setLayer(int id, const LayerConfig &config);
+
+    void removeLayer(int id);
+
+    bool hasLayer(int id);
+
+    size_t getLayerCount();
+
+    // bottom to top
+    std::vector<int> getLayerIds();
+
+    // size of the composited screen, 0 for unknown screens
+    size_t getScreenPixels(int screenId);
+
+    // copies the screen of the layer, ignored if the layer doesn't own a part of the screen or pixels is too short
+    void setLayerFrame(int id, int screenId, const Color *data, size_t pixels);
+
+    // blends the screens which changed since the last call, returns how many were handed to output
+    int compose(std::function<void(int screenId, Color *data)> output);
+
+    CompositorStats getStats();
+
+    static LayerConfig configFromRequest(const matrixserver::LayerRequest &request);
+
+    // dst = src * opacity + dst * (1 - opacity) per channel, exact 8 bit rounding, vectorizes
+    static void alphaOver(Color *dst, const Color *src, size_t pixels, uint8_t opacity, bool blackIsTransparent);
+
+private:
+    struct Layer {
+        int id;
+        uint64_t order; // ties in z are stacked in the order the layers were added
+        LayerConfig config;
+        std::vector<std::vector<LayerRegion>> regions; // per screen index, clamped, empty if not owned
+        std::vector<std::vector<Color>> frames;        // per screen index, only for owned screens
+        std::vector<uint64_t> versions;                // per screen index, counts frames
+    };
+
+    struct ScreenCache {
+        std::vector<std::pair<int, uint64_t>> composed; // layer id and version of the last result
+        std::vector<std::pair<int, uint64_t>> cached;   // layers blended into below
+        std::vector<Color> below;
+        std::vector<Color> output;
+        bool valid = false; // output holds the result for composed
+    };
+
+    int screenIndex(int screenId);
+
+    Layer *findLayer(int id);
+
+    void sortLayers();
+
+    void blend(Layer &layer, size_t screen, std::vector<Color> &target);
+
+    std::vector<int> screenIds;
+    std::vector<int> screenSizes; // pixels
+    std::vector<int> screenWidths;
+    std::vector<int> screenHeights;
+    std::vector<std::unique_ptr<Layer>> layers; // sorted bottom to top
+    std::vector<ScreenCache> caches;
+    uint64_t nextOrder;
+    CompositorStats stats;
+};
+
+
+#endif //MATRIXSERVER_COMPOSITOR_H
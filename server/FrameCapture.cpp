@@ -0,0 +1,455 @@
+#include "FrameCapture.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <Log.h>
+
+#include <FrameTimer.h>
+#include <FrameDelta.h>
+
+static_assert(sizeof(CaptureRecord) == 16 && sizeof(CaptureIndexEntry) == 24, "the records are written as they are");
+
+static inline size_t padded(size_t length) {
+    return (length + 7) & ~(size_t) 7;
+}
+
+CaptureRecorder::CaptureRecorder() :
+        opened(false),
+        fd(-1),
+        map(nullptr),
+        capacity(0),
+        size(0),
+        record(nullptr) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+CaptureRecorder::~CaptureRecorder() {
+    close();
+}
+
+bool CaptureRecorder::open(const std::string &path, const matrixserver::ServerConfig &serverConfig) {
+    close();
+    std::lock_guard<std::mutex> lock(mutex);
+    // a reader maps what it finds at path, it must never see the file grow or shrink
+    auto temporary = path + CAPTURETEMPSUFFIX;
+    fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        MATRIXLOG(warning) << "[CaptureRecorder] can't open " << temporary << ": " << strerror(errno);
+        return false;
+    }
+    capturePath = path;
+    size = 0;
+    capacity = 0;
+    memset(&stats, 0, sizeof(stats));
+    if (!reserve(sizeof(CaptureFileHeader))) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    int64_t startNs = FrameTimer::nowNs();
+    CaptureFileHeader header;
+    memcpy(header.magic, CAPTUREMAGIC, sizeof(header.magic));
+    header.version = 1;
+    header.reserved = 0;
+    header.startNs = startNs;
+    memcpy(map, &header, sizeof(header));
+    size = sizeof(header);
+
+    screenIds.clear();
+    screens.clear();
+    for (const auto &screenInfo : serverConfig.screeninfo()) {
+        screenIds.push_back(screenInfo.screenid());
+        screens.emplace_back(screenInfo.width() * screenInfo.height(), Color::black());
+    }
+    writeMessage(serverConfig, startNs, CaptureRecord::config);
+    // the reader starts with black screens as well, the start needs no keys
+    index.clear();
+    index.push_back({startNs, size, 0});
+    stats.fileBytes = size;
+    opened = true;
+    MATRIXLOG(info) << "[CaptureRecorder] recording to " << path;
+    return true;
+}
+
+void CaptureRecorder::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd < 0)
+        return;
+    opened = false;
+    if (map != nullptr) {
+        uint64_t indexOffset = size;
+        auto *payload = beginRecord(CaptureRecord::index, index.size() * sizeof(CaptureIndexEntry), 0);
+        if (payload != nullptr) {
+            memcpy(payload, index.data(), index.size() * sizeof(CaptureIndexEntry));
+            endRecord(index.size() * sizeof(CaptureIndexEntry));
+            if (reserve(sizeof(CaptureTrailer))) {
+                CaptureTrailer trailer;
+                memcpy(trailer.magic, CAPTURETRAILERMAGIC, sizeof(trailer.magic));
+                trailer.indexOffset = indexOffset;
+                memcpy(map + size, &trailer, sizeof(trailer));
+                size += sizeof(trailer);
+            }
+        }
+        munmap(map, capacity);
+        map = nullptr;
+    }
+    if (ftruncate(fd, size) != 0)
+        MATRIXLOG(warning) << "[CaptureRecorder] can't truncate the capture: " << strerror(errno);
+    ::close(fd);
+    fd = -1;
+    if (rename((capturePath + CAPTURETEMPSUFFIX).c_str(), capturePath.c_str()) != 0)
+        MATRIXLOG(warning) << "[CaptureRecorder] can't move the capture to " << capturePath << ": " << strerror(errno);
+}
+
+bool CaptureRecorder::isOpen() {
+    return opened.load(std::memory_order_relaxed);
+}
+
+CaptureStats CaptureRecorder::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+bool CaptureRecorder::reserve(size_t bytes) {
+    if (size + bytes <= capacity)
+        return true;
+    size_t newCapacity = capacity + std::max((size_t) CAPTUREGROWSIZE, padded(bytes));
+    if (map != nullptr)
+        munmap(map, capacity);
+    map = nullptr;
+    if (ftruncate(fd, newCapacity) == 0) {
+        void *newMap = mmap(nullptr, newCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (newMap != MAP_FAILED) {
+            map = static_cast<uint8_t *>(newMap);
+            capacity = newCapacity;
+            return true;
+        }
+    }
+    MATRIXLOG(warning) << "[CaptureRecorder] can't extend the capture, recording stopped: " << strerror(errno);
+    opened = false;
+    return false;
+}
+
+uint8_t *CaptureRecorder::beginRecord(CaptureRecord::Type type, size_t maxLength, int64_t nowNs) {
+    if (map == nullptr || !reserve(sizeof(CaptureRecord) + padded(maxLength)))
+        return nullptr;
+    record = reinterpret_cast<CaptureRecord *>(map + size);
+    record->type = type;
+    record->length = 0;
+    record->timestampNs = nowNs;
+    return map + size + sizeof(CaptureRecord);
+}
+
+void CaptureRecorder::endRecord(size_t length) {
+    record->length = length;
+    memset(map + size + sizeof(CaptureRecord) + length, 0, padded(length) - length);
+    size += sizeof(CaptureRecord) + padded(length);
+    stats.fileBytes = size;
+}
+
+void CaptureRecorder::writeMessage(const google::protobuf::MessageLite &message, int64_t nowNs, CaptureRecord::Type type) {
+    size_t length = message.ByteSizeLong();
+    auto *payload = beginRecord(type, length, nowNs);
+    if (payload == nullptr)
+        return;
+    message.SerializeWithCachedSizesToArray(payload);
+    endRecord(length);
+}
+
+void CaptureRecorder::writeScreen(int screenId, const Color *data, size_t bytes, int64_t nowNs) {
+    auto found = std::find(screenIds.begin(), screenIds.end(), screenId);
+    if (found == screenIds.end())
+        return;
+    auto &screen = screens[found - screenIds.begin()];
+    size_t length = screen.size() * sizeof(Color);
+    if (bytes < length)
+        return;
+    stats.rawBytes += length;
+    auto *previous = reinterpret_cast<uint8_t *>(screen.data());
+    auto *current = reinterpret_cast<const uint8_t *>(data);
+    auto *payload = beginRecord(CaptureRecord::delta, 4 + FRAMEDELTAMAXSIZE(length), nowNs);
+    if (payload == nullptr)
+        return;
+    memcpy(payload, &screenId, 4);
+    size_t deltaLength = encodeFrameDelta(previous, current, length, payload + 4);
+    if (deltaLength == 0)
+        return; // unchanged, the record is dropped
+    if (deltaLength > length + 8) {
+        // more spans than content, one span over the whole screen
+        uint32_t span[2] = {0, (uint32_t) length};
+        memcpy(payload + 4, span, sizeof(span));
+        memcpy(payload + 4 + sizeof(span), current, length);
+        deltaLength = length + sizeof(span);
+    }
+    endRecord(4 + deltaLength);
+    memcpy(previous, current, length);
+    stats.deltas++;
+}
+
+void CaptureRecorder::writeKeyframe(int64_t nowNs) {
+    index.push_back({nowNs, size, stats.frames});
+    for (size_t i = 0; i < screens.size(); i++) {
+        size_t length = screens[i].size() * sizeof(Color);
+        auto *payload = beginRecord(CaptureRecord::key, 4 + length, nowNs);
+        if (payload == nullptr)
+            return;
+        memcpy(payload, &screenIds[i], 4);
+        memcpy(payload + 4, screens[i].data(), length);
+        endRecord(4 + length);
+    }
+    stats.keyframes++;
+}
+
+void CaptureRecorder::beginFrame(int64_t nowNs) {
+    if (stats.frames > 0 && stats.frames % CAPTUREKEYINTERVAL == 0)
+        writeKeyframe(nowNs);
+    stats.frames++;
+    stats.messages++;
+}
+
+void CaptureRecorder::recordMessage(const matrixserver::MatrixServerMessage &message, int64_t nowNs) {
+    if (!isOpen())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (message.messagetype() != matrixserver::setScreenFrame) {
+        stats.messages++;
+        writeMessage(message, nowNs, CaptureRecord::message);
+        return;
+    }
+    beginFrame(nowNs);
+    frameMessage.Clear();
+    frameMessage.set_messagetype(message.messagetype());
+    frameMessage.set_appid(message.appid());
+    if (message.has_serverconfig())
+        frameMessage.mutable_serverconfig()->set_globalscreenbrightness(message.serverconfig().globalscreenbrightness());
+    for (const auto &screenInfo : message.screendata()) {
+        writeScreen(screenInfo.screenid(), reinterpret_cast<const Color *>(screenInfo.framedata().data()),
+                    screenInfo.framedata().size(), nowNs);
+        frameMessage.add_screendata()->set_screenid(screenInfo.screenid());
+    }
+    writeMessage(frameMessage, nowNs, CaptureRecord::message);
+}
+
+void CaptureRecorder::recordFrame(int appId, const std::vector<std::shared_ptr<Screen>> &frameScreens, int64_t nowNs) {
+    if (!isOpen())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    beginFrame(nowNs);
+    frameMessage.Clear();
+    frameMessage.set_messagetype(matrixserver::setScreenFrame);
+    frameMessage.set_appid(appId);
+    for (const auto &screen : frameScreens) {
+        writeScreen(screen->getScreenId(), screen->getScreenDataRaw(), screen->getScreenDataSize() * sizeof(Color), nowNs);
+        frameMessage.add_screendata()->set_screenid(screen->getScreenId());
+    }
+    writeMessage(frameMessage, nowNs, CaptureRecord::message);
+}
+
+CaptureReader::CaptureReader() :
+        map(nullptr),
+        size(0),
+        position(0),
+        firstRecord(0),
+        end(0),
+        startNs(0) {
+}
+
+CaptureReader::~CaptureReader() {
+    close();
+}
+
+bool CaptureReader::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        MATRIXLOG(warning) << "[CaptureReader] can't open " << path << ": " << strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(CaptureFileHeader) + sizeof(CaptureRecord)) {
+        MATRIXLOG(warning) << "[CaptureReader] " << path << " is no capture";
+        ::close(fd);
+        return false;
+    }
+    void *fileMap = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping stays
+    if (fileMap == MAP_FAILED) {
+        MATRIXLOG(warning) << "[CaptureReader] can't map " << path << ": " << strerror(errno);
+        return false;
+    }
+    map = static_cast<const uint8_t *>(fileMap);
+    size = info.st_size;
+
+    CaptureFileHeader header;
+    memcpy(&header, map, sizeof(header));
+    CaptureRecord config;
+    memcpy(&config, map + sizeof(header), sizeof(config));
+    size_t configEnd = sizeof(header) + sizeof(config) + padded(config.length);
+    if (memcmp(header.magic, CAPTUREMAGIC, sizeof(header.magic)) != 0 || config.type != CaptureRecord::config ||
+        configEnd > size || !serverConfig.ParseFromArray(map + sizeof(header) + sizeof(config), config.length)) {
+        MATRIXLOG(warning) << "[CaptureReader] " << path << " is no capture";
+        close();
+        return false;
+    }
+    startNs = header.startNs;
+    firstRecord = configEnd;
+    for (const auto &screenInfo : serverConfig.screeninfo()) {
+        screenIds.push_back(screenInfo.screenid());
+        screens.emplace_back(screenInfo.width() * screenInfo.height(), Color::black());
+    }
+
+    end = size;
+    CaptureTrailer trailer;
+    memcpy(&trailer, map + size - sizeof(trailer), sizeof(trailer));
+    CaptureRecord indexRecord;
+    if (memcmp(trailer.magic, CAPTURETRAILERMAGIC, sizeof(trailer.magic)) == 0 && trailer.indexOffset >= firstRecord &&
+        trailer.indexOffset + sizeof(indexRecord) <= size - sizeof(trailer)) {
+        memcpy(&indexRecord, map + trailer.indexOffset, sizeof(indexRecord));
+        size_t count = indexRecord.length / sizeof(CaptureIndexEntry);
+        if (indexRecord.type == CaptureRecord::index &&
+            trailer.indexOffset + sizeof(indexRecord) + count * sizeof(CaptureIndexEntry) <= size - sizeof(trailer)) {
+            index.resize(count);
+            memcpy(index.data(), map + trailer.indexOffset + sizeof(indexRecord), count * sizeof(CaptureIndexEntry));
+            end = trailer.indexOffset;
+        }
+    }
+    if (end == size)
+        rebuildIndex(); // the recording wasn't closed
+    position = firstRecord;
+    return true;
+}
+
+void CaptureReader::close() {
+    if (map != nullptr)
+        munmap(const_cast<uint8_t *>(map), size);
+    map = nullptr;
+    size = 0;
+    end = 0;
+    position = 0;
+    screenIds.clear();
+    screens.clear();
+    index.clear();
+}
+
+// the keyframes are the runs of key records
+void CaptureReader::rebuildIndex() {
+    index.clear();
+    index.push_back({startNs, firstRecord, 0});
+    uint64_t frames = 0;
+    bool inKeyframe = false;
+    size_t offset = firstRecord;
+    while (offset + sizeof(CaptureRecord) <= end) {
+        CaptureRecord record;
+        memcpy(&record, map + offset, sizeof(record));
+        if (record.type < CaptureRecord::config || record.type > CaptureRecord::index ||
+            offset + sizeof(record) + record.length > end)
+            break;
+        if (record.type == CaptureRecord::key && !inKeyframe)
+            index.push_back({record.timestampNs, offset, frames});
+        inKeyframe = record.type == CaptureRecord::key;
+        if (record.type == CaptureRecord::message) {
+            matrixserver::MatrixServerMessage message;
+            if (message.ParseFromArray(map + offset + sizeof(record), record.length) &&
+                message.messagetype() == matrixserver::setScreenFrame)
+                frames++;
+        }
+        offset += sizeof(record) + padded(record.length);
+    }
+    end = offset;
+}
+
+const matrixserver::ServerConfig &CaptureReader::getServerConfig() {
+    return serverConfig;
+}
+
+const std::vector<CaptureIndexEntry> &CaptureReader::getIndex() {
+    return index;
+}
+
+int64_t CaptureReader::getStartNs() {
+    return startNs;
+}
+
+int CaptureReader::screenIndex(int screenId) {
+    auto found = std::find(screenIds.begin(), screenIds.end(), screenId);
+    return found == screenIds.end() ? -1 : (int) (found - screenIds.begin());
+}
+
+bool CaptureReader::next(CaptureEvent &event) {
+    while (position + sizeof(CaptureRecord) <= end) {
+        CaptureRecord record;
+        memcpy(&record, map + position, sizeof(record));
+        const uint8_t *payload = map + position + sizeof(record);
+        if (position + sizeof(record) + record.length > end)
+            break;
+        position += sizeof(record) + padded(record.length);
+        switch (record.type) {
+            case CaptureRecord::key:
+            case CaptureRecord::delta: {
+                int32_t screenId;
+                if (record.length < 4)
+                    break;
+                memcpy(&screenId, payload, 4);
+                int i = screenIndex(screenId);
+                if (i < 0)
+                    break;
+                auto *screen = reinterpret_cast<uint8_t *>(screens[i].data());
+                size_t length = screens[i].size() * sizeof(Color);
+                if (record.type == CaptureRecord::key)
+                    memcpy(screen, payload + 4, std::min(length, (size_t) record.length - 4));
+                else if (!applyFrameDelta(screen, length, payload + 4, record.length - 4))
+                    MATRIXLOG(warning) << "[CaptureReader] broken delta of screen " << screenId;
+                break;
+            }
+            case CaptureRecord::message:
+                event.timestampNs = record.timestampNs;
+                if (event.message.ParseFromArray(payload, record.length))
+                    return true;
+                MATRIXLOG(warning) << "[CaptureReader] broken message at " << position;
+                break;
+            case CaptureRecord::config:
+            case CaptureRecord::index:
+                break;
+            default:
+                position = end;
+                return false;
+        }
+    }
+    position = end;
+    return false;
+}
+
+void CaptureReader::seek(int64_t timestampNs) {
+    size_t offset = firstRecord;
+    for (const auto &entry : index) {
+        if (entry.timestampNs > timestampNs)
+            break;
+        offset = entry.offset;
+    }
+    for (auto &screen : screens)
+        std::fill(screen.begin(), screen.end(), Color::black());
+    position = offset;
+}
+
+const Color *CaptureReader::getScreen(int screenId) {
+    int i = screenIndex(screenId);
+    return i < 0 ? nullptr : screens[i].data();
+}
+
+size_t CaptureReader::getScreenPixels(int screenId) {
+    int i = screenIndex(screenId);
+    return i < 0 ? 0 : screens[i].size();
+}
+
+void CaptureReader::fillFrame(matrixserver::MatrixServerMessage &message) {
+    for (auto &screenInfo : *message.mutable_screendata()) {
+        int i = screenIndex(screenInfo.screenid());
+        if (i >= 0)
+            screenInfo.set_framedata(screens[i].data(), screens[i].size() * sizeof(Color));
+    }
+}
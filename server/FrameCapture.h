@@ -0,0 +1,190 @@
+#ifndef MATRIXSERVER_FRAMECAPTURE_H
+#define MATRIXSERVER_FRAMECAPTURE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+#include <Color.h>
+#include <Screen.h>
+#include <matrixserver.pb.h>
+
+#define CAPTUREMAGIC "MXCAP001"
+#define CAPTURETRAILERMAGIC "MXCAPEND"
+#define CAPTUREGROWSIZE (16 * 1024 * 1024) // the file is extended and mapped again in these steps
+#define CAPTUREKEYINTERVAL 250 // frames between two keyframes (index entries)
+#define CAPTURETEMPSUFFIX ".tmp" // what a capture is recorded as until it is closed
+
+/*
+ * Capture file, everything little endian and 8 byte aligned:
+ *   CaptureFileHeader
+ *   records: CaptureRecord, length bytes payload, padding to 8 bytes
+ *   index record and CaptureTrailer, written by close()
+ * The first record is the ServerConfig. A frame is written as the screen records (key: the whole
+ * screen, delta: spans of the changed bytes against the last content of the screen) followed by
+ * the message record, which has the screen ids but no frame data. All other messages are stored
+ * as they are. Every CAPTUREKEYINTERVAL frames all screens are written as keys and the position
+ * goes into the index. A file without trailer (the server died) is read by scanning the records.
+ */
+
+struct CaptureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    int64_t startNs; // FrameTimer::nowNs() when the recording started
+};
+
+struct CaptureRecord {
+    enum Type : uint32_t {
+        config = 1,  // serialized ServerConfig
+        message = 2, // serialized MatrixServerMessage
+        key = 3,     // uint32 screenId, the pixels, only in keyframes
+        delta = 4,   // uint32 screenId, a FrameDelta (spans: uint32 offset, uint32 length, the bytes)
+        index = 5    // CaptureIndexEntry[]
+    };
+    uint32_t type;
+    uint32_t length;
+    int64_t timestampNs;
+};
+
+struct CaptureIndexEntry {
+    int64_t timestampNs;
+    uint64_t offset; // of the first key record
+    uint64_t frame;
+};
+
+struct CaptureTrailer {
+    char magic[8];
+    uint64_t indexOffset; // of the index record
+};
+
+struct CaptureStats {
+    uint64_t frames;
+    uint64_t messages; // all messages, frames included
+    uint64_t keyframes;
+    uint64_t deltas; // screens which changed
+    uint64_t rawBytes; // of the screens handed in
+    uint64_t fileBytes;
+};
+
+/*
+ * Appends the messages a server receives and the input it pushes to the apps to a capture file
+ * mapped into memory, so recording a frame is a delta encoding into the page cache and no write()
+ * call. Thread safe, frames come from the io thread and the plugin threads.
+ */
+class CaptureRecorder {
+public:
+    CaptureRecorder();
+
+    ~CaptureRecorder();
+
+    // records into path + CAPTURETEMPSUFFIX, close() renames it to path
+    bool open(const std::string &path, const matrixserver::ServerConfig &serverConfig);
+
+    // writes the index, cuts the file to its size and moves it into place
+    void close();
+
+    bool isOpen();
+
+    void recordMessage(const matrixserver::MatrixServerMessage &message, int64_t nowNs);
+
+    // a frame of an in-process app
+    void recordFrame(int appId, const std::vector<std::shared_ptr<Screen>> &screens, int64_t nowNs);
+
+    CaptureStats getStats();
+
+private:
+    // mutex held, returns the payload of the new record, nullptr if the file can't grow
+    uint8_t *beginRecord(CaptureRecord::Type type, size_t maxLength, int64_t nowNs);
+
+    // mutex held, the record gets its final length
+    void endRecord(size_t length);
+
+    bool reserve(size_t bytes);
+
+    void writeScreen(int screenId, const Color *data, size_t bytes, int64_t nowNs);
+
+    void writeKeyframe(int64_t nowNs);
+
+    void writeMessage(const google::protobuf::MessageLite &message, int64_t nowNs, CaptureRecord::Type type);
+
+    // mutex held, the start of a frame
+    void beginFrame(int64_t nowNs);
+
+    std::mutex mutex;
+    std::atomic<bool> opened;
+    std::string capturePath;
+    int fd;
+    uint8_t *map;
+    size_t capacity;
+    size_t size;
+    CaptureRecord *record; // the one beginRecord() started
+    std::vector<int> screenIds;
+    std::vector<std::vector<Color>> screens; // the last content of every screen
+    std::vector<CaptureIndexEntry> index;
+    matrixserver::MatrixServerMessage frameMessage; // the frame without its data
+    CaptureStats stats;
+};
+
+struct CaptureEvent {
+    int64_t timestampNs;
+    matrixserver::MatrixServerMessage message; // the screens of frames are empty, see getScreen()
+};
+
+/*
+ * Reads a capture file mapped into memory. next() returns the messages in order and keeps the
+ * content of every screen up to date, the screens of a frame are at getScreen() until the next
+ * frame. seek() jumps to the keyframe before a point in time.
+ */
+class CaptureReader {
+public:
+    CaptureReader();
+
+    ~CaptureReader();
+
+    bool open(const std::string &path);
+
+    void close();
+
+    const matrixserver::ServerConfig &getServerConfig();
+
+    const std::vector<CaptureIndexEntry> &getIndex();
+
+    int64_t getStartNs();
+
+    // false at the end of the file or on a broken record
+    bool next(CaptureEvent &event);
+
+    // to the last keyframe at or before timestampNs, the start of the file if there is none
+    void seek(int64_t timestampNs);
+
+    // nullptr for unknown screens
+    const Color *getScreen(int screenId);
+
+    size_t getScreenPixels(int screenId);
+
+    // copies the screens into the frame data of the frame message next() returned
+    void fillFrame(matrixserver::MatrixServerMessage &message);
+
+private:
+    int screenIndex(int screenId);
+
+    void rebuildIndex();
+
+    const uint8_t *map;
+    size_t size;
+    size_t position;
+    size_t firstRecord; // the one after the config
+    size_t end; // of the records
+    int64_t startNs;
+    matrixserver::ServerConfig serverConfig;
+    std::vector<int> screenIds;
+    std::vector<std::vector<Color>> screens;
+    std::vector<CaptureIndexEntry> index;
+};
+
+
+#endif //MATRIXSERVER_FRAMECAPTURE_H
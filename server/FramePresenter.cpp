@@ -0,0 +1,138 @@
+#include "FramePresenter.h"
+
+#include <cstring>
+#include <FrameTimer.h>
+#include <Metrics.h>
+
+FramePresenter::FramePresenter(const std::vector<size_t> &setScreenPixels,
+                               std::function<void(ScheduledFrame &)> setPresent, size_t setDepth) :
+        screenPixels(setScreenPixels),
+        present(setPresent),
+        depth(setDepth > 0 ? setDepth : 1),
+        running(true),
+        presenting(false) {
+    memset(&stats, 0, sizeof(stats));
+    thread = new boost::thread(&FramePresenter::presentLoop, this);
+}
+
+FramePresenter::~FramePresenter() {
+    stop();
+}
+
+void FramePresenter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running)
+            return;
+        running = false;
+    }
+    condition.notify_all();
+    thread->join();
+    delete thread;
+    thread = nullptr;
+}
+
+std::unique_ptr<ScheduledFrame> FramePresenter::takeFrame() {
+    if (!pool.empty()) {
+        auto frame = std::move(pool.back());
+        pool.pop_back();
+        return frame;
+    }
+    std::unique_ptr<ScheduledFrame> frame(new ScheduledFrame());
+    for (auto pixels : screenPixels)
+        frame->screens.emplace_back(pixels, Color::black());
+    frame->changed.resize(screenPixels.size(), false);
+    return frame;
+}
+
+void FramePresenter::merge(ScheduledFrame &older, ScheduledFrame &newer) {
+    for (size_t i = 0; i < newer.screens.size(); i++) {
+        if (older.changed[i] && !newer.changed[i]) {
+            newer.screens[i].swap(older.screens[i]);
+            newer.changed[i] = true;
+        }
+    }
+}
+
+void FramePresenter::schedule(int64_t presentAtNs, int brightness, const std::vector<const Color *> &screens) {
+    static auto &framesMerged = Metrics::counter("scheduled_frames_merged", "scheduled frames replaced by a newer one before they were presented");
+    std::unique_lock<std::mutex> lock(mutex);
+    auto frame = takeFrame();
+    // copied under the lock which guards the pool, the present thread only waits for it while a frame is queued
+    for (size_t i = 0; i < screenPixels.size(); i++) {
+        frame->changed[i] = i < screens.size() && screens[i] != nullptr;
+        if (frame->changed[i])
+            memcpy(frame->screens[i].data(), screens[i], screenPixels[i] * sizeof(Color));
+    }
+    frame->brightness = brightness;
+    frame->presentAtNs = presentAtNs;
+    if (!queue.empty() && queue.back()->presentAtNs > presentAtNs)
+        frame->presentAtNs = queue.back()->presentAtNs;
+    if (queue.size() >= depth) {
+        auto oldest = std::move(queue.front());
+        queue.pop_front();
+        merge(*oldest, queue.empty() ? *frame : *queue.front());
+        pool.push_back(std::move(oldest));
+        stats.merged++;
+        framesMerged.fetch_add(1, std::memory_order_relaxed);
+    }
+    queue.push_back(std::move(frame));
+    lock.unlock();
+    condition.notify_all();
+}
+
+void FramePresenter::presentLoop() {
+    static auto &lateness = Metrics::histogram("scheduled_present", "from the presentation time of a scheduled frame to its presentation");
+    static auto &framesMerged = Metrics::counter("scheduled_frames_merged", "scheduled frames replaced by a newer one before they were presented");
+    static auto &framesLate = Metrics::counter("scheduled_frames_late", "scheduled frames presented more than 2 ms after their time");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        if (queue.empty()) {
+            condition.wait(lock);
+            continue;
+        }
+        auto now = FrameTimer::nowNs();
+        if (queue.front()->presentAtNs > now) {
+            condition.wait_for(lock, std::chrono::nanoseconds(queue.front()->presentAtNs - now));
+            continue;
+        }
+        auto frame = std::move(queue.front());
+        queue.pop_front();
+        while (!queue.empty() && queue.front()->presentAtNs <= now) {
+            merge(*frame, *queue.front());
+            pool.push_back(std::move(frame));
+            frame = std::move(queue.front());
+            queue.pop_front();
+            stats.merged++;
+            framesMerged.fetch_add(1, std::memory_order_relaxed);
+        }
+        presenting = true;
+        lock.unlock();
+        auto late = FrameTimer::nowNs() - frame->presentAtNs;
+        present(*frame);
+        lateness.record(late);
+        lock.lock();
+        presenting = false;
+        stats.frames++;
+        if (late > FRAMEPRESENTERLATE) {
+            stats.late++;
+            framesLate.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (late > stats.maxLateNs)
+            stats.maxLateNs = late;
+        pool.push_back(std::move(frame));
+        presentedCondition.notify_all();
+    }
+}
+
+FramePresenterStats FramePresenter::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void FramePresenter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    presentedCondition.wait(lock, [this]() {
+        return !running || (!presenting && (queue.empty() || queue.front()->presentAtNs > FrameTimer::nowNs()));
+    });
+}
@@ -0,0 +1,79 @@
+#ifndef MATRIXSERVER_FRAMEPRESENTER_H
+#define MATRIXSERVER_FRAMEPRESENTER_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <stdint.h>
+#include <boost/thread/thread.hpp>
+
+#include <Color.h>
+
+#define FRAMEPRESENTERDEPTH 8 // frames waiting for their presentation time, more are merged into the next one
+#define FRAMEPRESENTERLATE 2000000LL // ns, frames presented later than this count as late
+
+struct ScheduledFrame {
+    int64_t presentAtNs = 0; // CLOCK_MONOTONIC
+    int brightness = 100;
+    std::vector<std::vector<Color>> screens; // by index, only the changed ones hold the frame
+    std::vector<bool> changed;
+};
+
+struct FramePresenterStats {
+    uint64_t frames;   // presented
+    uint64_t late;     // presented more than FRAMEPRESENTERLATE after their time
+    uint64_t merged;   // not presented on their own, a newer frame was due as well or the queue was full
+    int64_t maxLateNs;
+};
+
+/*
+ * Presents frames at a given time on its own thread. A frame only holds the screens which changed,
+ * so when several frames are due at once only the newest is presented, with the changed screens of
+ * the older ones it replaces. The frames come from a pool, scheduling copies the screens but doesn't
+ * allocate once the pool is warm.
+ */
+class FramePresenter {
+public:
+    // the pixels of every screen, the frames use the same indices
+    FramePresenter(const std::vector<size_t> &screenPixels, std::function<void(ScheduledFrame &)> present,
+                   size_t depth = FRAMEPRESENTERDEPTH);
+
+    ~FramePresenter();
+
+    // copies the screens (nullptr: unchanged) into a frame presented at presentAtNs, never before the frames
+    // scheduled earlier
+    void schedule(int64_t presentAtNs, int brightness, const std::vector<const Color *> &screens);
+
+    FramePresenterStats getStats();
+
+    // waits until the frames which are due are presented
+    void flush();
+
+    void stop();
+
+private:
+    void presentLoop();
+
+    std::unique_ptr<ScheduledFrame> takeFrame();
+
+    static void merge(ScheduledFrame &older, ScheduledFrame &newer);
+
+    std::vector<size_t> screenPixels;
+    std::function<void(ScheduledFrame &)> present;
+    size_t depth;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable presentedCondition;
+    std::deque<std::unique_ptr<ScheduledFrame>> queue;
+    std::vector<std::unique_ptr<ScheduledFrame>> pool;
+    bool running;
+    bool presenting;
+    FramePresenterStats stats;
+    boost::thread *thread;
+};
+
+
+#endif //MATRIXSERVER_FRAMEPRESENTER_H
@@ -0,0 +1,175 @@
+#include "JitterBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <FrameTimer.h>
+#include <Metrics.h>
+
+JitterBuffer::JitterBuffer(std::function<void(int, const matrixserver::MatrixServerMessage &)> setPresent,
+                           size_t setDepth) :
+        present(setPresent),
+        depth(setDepth > 0 ? setDepth : 1),
+        running(true),
+        presenting(false) {
+    memset(&stats, 0, sizeof(stats));
+    thread = new boost::thread(&JitterBuffer::presentLoop, this);
+}
+
+JitterBuffer::~JitterBuffer() {
+    stop();
+}
+
+void JitterBuffer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running)
+            return;
+        running = false;
+        queues.clear();
+    }
+    condition.notify_all();
+    presentedCondition.notify_all();
+    thread->join();
+    delete thread;
+    thread = nullptr;
+}
+
+void JitterBuffer::releaseAck(AppQueue &queue, std::vector<std::function<void()>> &acks) {
+    if (!queue.pendingAck || queue.frames.size() >= depth)
+        return;
+    acks.push_back(std::move(queue.pendingAck));
+    queue.pendingAck = nullptr;
+}
+
+bool JitterBuffer::push(int appId, int64_t presentAtNs, std::shared_ptr<matrixserver::MatrixServerMessage> message,
+                        std::function<void()> ack) {
+    static auto &framesLate = Metrics::counter("jitter_frames_late", "scheduled app frames dropped because their presentation time had passed");
+    static auto &framesOverflow = Metrics::counter("jitter_frames_overflow", "scheduled app frames dropped because the app's jitter buffer was full");
+    static auto &framesTooEarly = Metrics::counter("jitter_frames_too_early", "scheduled app frames too far ahead to be buffered, shown on arrival");
+    auto now = FrameTimer::nowNs();
+    std::unique_lock<std::mutex> lock(mutex);
+    if (presentAtNs > now + JITTERBUFFERMAXAHEAD) {
+        stats.tooEarly++;
+        framesTooEarly.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (presentAtNs < now - JITTERBUFFERLATE) {
+        stats.late++;
+        framesLate.fetch_add(1, std::memory_order_relaxed);
+        lock.unlock();
+        ack();
+        return true;
+    }
+    std::vector<std::function<void()>> acks;
+    auto &queue = queues[appId];
+    // an app which didn't wait for the held back ack doesn't need it any more
+    if (queue.pendingAck) {
+        acks.push_back(std::move(queue.pendingAck));
+        queue.pendingAck = nullptr;
+    }
+    auto position = std::upper_bound(queue.frames.begin(), queue.frames.end(), presentAtNs,
+                                     [](int64_t time, const BufferedFrame &frame) {
+                                         return time < frame.presentAtNs;
+                                     });
+    queue.frames.insert(position, BufferedFrame{presentAtNs, std::move(message)});
+    stats.frames++;
+    if (queue.frames.size() > depth) {
+        queue.frames.pop_front();
+        stats.overflow++;
+        framesOverflow.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (queue.frames.size() < depth) {
+        acks.push_back(std::move(ack));
+    } else {
+        queue.pendingAck = std::move(ack);
+        stats.deferredAcks++;
+    }
+    lock.unlock();
+    condition.notify_all();
+    for (auto &release : acks)
+        release();
+    return true;
+}
+
+void JitterBuffer::presentLoop() {
+    static auto &lateness = Metrics::histogram("jitter_present", "from the presentation time of a scheduled app frame to its presentation");
+    static auto &framesLate = Metrics::counter("jitter_frames_late", "scheduled app frames dropped because their presentation time had passed");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        int appId = 0;
+        AppQueue *next = nullptr;
+        for (auto &entry : queues) {
+            if (entry.second.frames.empty())
+                continue;
+            if (next == nullptr || entry.second.frames.front().presentAtNs < next->frames.front().presentAtNs) {
+                appId = entry.first;
+                next = &entry.second;
+            }
+        }
+        if (next == nullptr) {
+            condition.wait(lock);
+            continue;
+        }
+        auto now = FrameTimer::nowNs();
+        if (next->frames.front().presentAtNs > now) {
+            condition.wait_for(lock, std::chrono::nanoseconds(next->frames.front().presentAtNs - now));
+            continue;
+        }
+        // a newer frame of the app is due as well, the older one would only flash up
+        while (next->frames.size() > 1 && next->frames[1].presentAtNs <= now) {
+            next->frames.pop_front();
+            stats.late++;
+            framesLate.fetch_add(1, std::memory_order_relaxed);
+        }
+        auto frame = std::move(next->frames.front());
+        next->frames.pop_front();
+        std::vector<std::function<void()>> acks;
+        releaseAck(*next, acks);
+        presenting = true;
+        lock.unlock();
+        for (auto &release : acks)
+            release();
+        auto late = FrameTimer::nowNs() - frame.presentAtNs;
+        present(appId, *frame.message);
+        lateness.record(late);
+        frame.message.reset();
+        lock.lock();
+        presenting = false;
+        stats.presented++;
+        if (late > stats.maxLateNs)
+            stats.maxLateNs = late;
+        presentedCondition.notify_all();
+    }
+}
+
+void JitterBuffer::removeApp(int appId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    queues.erase(appId);
+}
+
+size_t JitterBuffer::getBuffered(int appId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = queues.find(appId);
+    return found == queues.end() ? 0 : found->second.frames.size();
+}
+
+JitterBufferStats JitterBuffer::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void JitterBuffer::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    presentedCondition.wait(lock, [this]() {
+        if (!running)
+            return true;
+        if (presenting)
+            return false;
+        auto now = FrameTimer::nowNs();
+        for (auto &entry : queues) {
+            if (!entry.second.frames.empty() && entry.second.frames.front().presentAtNs <= now)
+                return false;
+        }
+        return true;
+    });
+}
@@ -0,0 +1,95 @@
+#ifndef MATRIXSERVER_JITTERBUFFER_H
+#define MATRIXSERVER_JITTERBUFFER_H
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <stdint.h>
+#include <boost/thread/thread.hpp>
+
+#include <matrixserver.pb.h>
+
+#define JITTERBUFFERDEPTH 8 // frames an app may have waiting for their presentation time
+#define JITTERBUFFERLATE 2000000LL // ns, frames arriving later than this after their presentation time are dropped
+#define JITTERBUFFERMAXAHEAD 2000000000LL // ns, frames further ahead are shown on arrival, the clocks don't match
+
+struct JitterBufferStats {
+    uint64_t frames;    // buffered
+    uint64_t presented;
+    uint64_t late;      // dropped, their time had passed on arrival or a newer frame of the app was due as well
+    uint64_t overflow;  // dropped, the app had more than the depth buffered without waiting for the acks
+    uint64_t tooEarly;  // further than JITTERBUFFERMAXAHEAD ahead, not buffered
+    uint64_t deferredAcks; // acks held back until the app had room in its buffer again
+    int64_t maxLateNs;  // of the presented frames
+};
+
+/*
+ * Holds the frames apps send ahead (MatrixServerMessage.presentAtNs) and presents each one at its time
+ * on its own thread, so a producer which renders in bursts (a file player, an app on the other end of
+ * Wi-Fi) is shown at an even pace. Every app has its own queue, ordered by presentation time. The
+ * received message itself is kept, a connection parses the next one into a new message while it is
+ * held. The app gets the ack of a frame right away while its queue has room and only once a frame
+ * left it otherwise, so an app which runs ahead is paced by the display. A frame which is late on
+ * arrival or which a newer frame of the app overtook is dropped, a frame which became due while it
+ * waited is always shown. The server routes a frame when it is due, the app may have lost the
+ * screen by then.
+ */
+class JitterBuffer {
+public:
+    // present: on the buffer's thread, renders a frame of the app
+    JitterBuffer(std::function<void(int appId, const matrixserver::MatrixServerMessage &)> present,
+                 size_t depth = JITTERBUFFERDEPTH);
+
+    ~JitterBuffer();
+
+    // any thread, ack is called once the app may send its next frame. false if the frame is too far
+    // ahead to be buffered, it is up to the caller then
+    bool push(int appId, int64_t presentAtNs, std::shared_ptr<matrixserver::MatrixServerMessage> message,
+              std::function<void()> ack);
+
+    // drops the frames of an app which is gone, its deferred ack isn't sent
+    void removeApp(int appId);
+
+    size_t getBuffered(int appId);
+
+    JitterBufferStats getStats();
+
+    // waits until the frames which are due are presented
+    void flush();
+
+    void stop();
+
+private:
+    struct BufferedFrame {
+        int64_t presentAtNs;
+        std::shared_ptr<matrixserver::MatrixServerMessage> message;
+    };
+
+    struct AppQueue {
+        std::deque<BufferedFrame> frames;
+        std::function<void()> pendingAck;
+    };
+
+    void presentLoop();
+
+    // mutex held, the ack is called by the caller once the lock is released
+    void releaseAck(AppQueue &queue, std::vector<std::function<void()>> &acks);
+
+    std::function<void(int, const matrixserver::MatrixServerMessage &)> present;
+    size_t depth;
+    std::map<int, AppQueue> queues;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable presentedCondition;
+    bool running;
+    bool presenting;
+    JitterBufferStats stats;
+    boost::thread *thread;
+};
+
+
+#endif //MATRIXSERVER_JITTERBUFFER_H
@@ -0,0 +1,83 @@
+#include "MetricsServer.h"
+
+#include <Log.h>
+
+struct MetricsServer::Request {
+    explicit Request(boost::asio::io_service &io) : socket(io), buffer(METRICSMAXREQUESTSIZE) {}
+
+    boost::asio::generic::stream_protocol::socket socket;
+    boost::asio::streambuf buffer;
+    std::string response;
+};
+
+MetricsServer::MetricsServer(boost::asio::io_service &setIo, std::function<void(std::string &)> setExposition) :
+        io(setIo),
+        exposition(setExposition),
+        tcpAcceptor(setIo),
+        unixAcceptor(setIo) {
+}
+
+bool MetricsServer::listenTcp(int port) {
+    boost::system::error_code error;
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+    tcpAcceptor.open(endpoint.protocol(), error);
+    if (!error)
+        tcpAcceptor.set_option(boost::asio::socket_base::reuse_address(true), error);
+    if (!error)
+        tcpAcceptor.bind(endpoint, error);
+    if (!error)
+        tcpAcceptor.listen(boost::asio::socket_base::max_connections, error);
+    if (error) {
+        MATRIXLOG(warning) << "[MetricsServer] can't listen on port " << port << ": " << error.message();
+        return false;
+    }
+    doAccept(tcpAcceptor);
+    return true;
+}
+
+bool MetricsServer::listenUnix(const std::string &path) {
+    boost::system::error_code error;
+    ::unlink(path.c_str());
+    boost::asio::local::stream_protocol::endpoint endpoint(path);
+    unixAcceptor.open(endpoint.protocol(), error);
+    if (!error)
+        unixAcceptor.bind(endpoint, error);
+    if (!error)
+        unixAcceptor.listen(boost::asio::socket_base::max_connections, error);
+    if (error) {
+        MATRIXLOG(warning) << "[MetricsServer] can't listen on " << path << ": " << error.message();
+        return false;
+    }
+    doAccept(unixAcceptor);
+    return true;
+}
+
+template<typename Acceptor>
+void MetricsServer::doAccept(Acceptor &acceptor) {
+    auto request = std::make_shared<Request>(io);
+    acceptor.async_accept(request->socket, [this, &acceptor, request](boost::system::error_code error) {
+        if (error) {
+            MATRIXLOG(debug) << "[MetricsServer] accept error: " << error.message();
+            return;
+        }
+        // the request itself doesn't matter, only its end
+        boost::asio::async_read_until(request->socket, request->buffer, "\r\n\r\n",
+                                      [this, request](boost::system::error_code, size_t) {
+                                          respond(request);
+                                      });
+        doAccept(acceptor);
+    });
+}
+
+void MetricsServer::respond(std::shared_ptr<Request> request) {
+    std::string body;
+    exposition(body);
+    request->response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                        std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    boost::asio::async_write(request->socket, boost::asio::buffer(request->response),
+                             [request](boost::system::error_code, size_t) {
+                                 boost::system::error_code ignored;
+                                 request->socket.shutdown(boost::asio::socket_base::shutdown_both, ignored);
+                                 request->socket.close(ignored);
+                             });
+}
@@ -0,0 +1,43 @@
+#ifndef MATRIXSERVER_METRICSSERVER_H
+#define MATRIXSERVER_METRICSSERVER_H
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <boost/asio.hpp>
+
+#define METRICSMAXREQUESTSIZE 8192
+
+/*
+ * Answers every http request on its sockets with the Prometheus text exposition the callback
+ * writes, one request per connection. Runs on the io thread of the server, so the callback must
+ * not block.
+ *
+ *   curl http://127.0.0.1:<metricsPort>/metrics
+ *   curl --unix-socket <metricsSocket> http://localhost/metrics
+ */
+class MetricsServer {
+public:
+    MetricsServer(boost::asio::io_service &io, std::function<void(std::string &)> exposition);
+
+    // on 127.0.0.1 only
+    bool listenTcp(int port);
+
+    bool listenUnix(const std::string &path);
+
+private:
+    struct Request;
+
+    template<typename Acceptor>
+    void doAccept(Acceptor &acceptor);
+
+    void respond(std::shared_ptr<Request> request);
+
+    boost::asio::io_service &io;
+    std::function<void(std::string &)> exposition;
+    boost::asio::ip::tcp::acceptor tcpAcceptor;
+    boost::asio::local::stream_protocol::acceptor unixAcceptor;
+};
+
+
+#endif //MATRIXSERVER_METRICSSERVER_H
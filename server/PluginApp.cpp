@@ -0,0 +1,264 @@
+#include "PluginApp.h"
+
+#include <dlfcn.h>
+#include <setjmp.h>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <mutex>
+#include <Log.h>
+
+#include <CubeConfig.h>
+#include <FrameTimer.h>
+#include <Trace.h>
+
+static const int crashSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL};
+static struct sigaction previousActions[NSIG];
+static std::once_flag crashHandlerInstalled;
+
+// plugins resolve the common library against the server executable (ENABLE_EXPORTS). Screen, Color
+// and the protobuf types are linked in anyway, this keeps what only plugins use.
+static void *const pluginSymbols[] __attribute__((used)) = {(void *) &inputEventsFromStates};
+
+// set while the plugin code runs on a plugin thread, the crash handler jumps back here
+static thread_local sigjmp_buf *crashJump = nullptr;
+
+PluginApp::PluginApp(std::string setPath) :
+        path(setPath),
+        handle(nullptr),
+        destroyFunction(nullptr),
+        thread_(nullptr),
+        shared(std::make_shared<PluginThread>()) {
+    shared->path = setPath;
+}
+
+PluginApp::~PluginApp() {
+    kill();
+    // give the thread time to finish its frame
+    for (int i = 0; i < PLUGINSTOPTIMEOUT / 10 && thread_ != nullptr && !shared->finished; i++)
+        usleep(10000);
+    if (!unload() && thread_ != nullptr) {
+        // the thread keeps its PluginThread, the plugin stays loaded
+        MATRIXLOG(error) << "[PluginApp] " << path << " is still running while it is destroyed";
+        thread_->detach();
+        delete thread_;
+    }
+}
+
+bool PluginApp::load() {
+    shared->loadTimestamp = FrameTimer::nowNs();
+    handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+        MATRIXLOG(warning) << "[PluginApp] can't load " << path << ": " << dlerror();
+        return false;
+    }
+    auto abiVersion = (AppPluginAbiFunction) dlsym(handle, APPPLUGINABISYMBOL);
+    auto createFunction = (AppPluginCreateFunction) dlsym(handle, APPPLUGINCREATESYMBOL);
+    destroyFunction = (AppPluginDestroyFunction) dlsym(handle, APPPLUGINDESTROYSYMBOL);
+    bool usable = false;
+    if (abiVersion == nullptr || createFunction == nullptr || destroyFunction == nullptr) {
+        MATRIXLOG(warning) << "[PluginApp] " << path << " is no matrixserver plugin";
+    } else if (abiVersion() != APPPLUGINABIVERSION) {
+        MATRIXLOG(warning) << "[PluginApp] " << path << " was built for plugin ABI " << abiVersion()
+                           << ", the server has " << APPPLUGINABIVERSION;
+    } else {
+        usable = true;
+    }
+    if (!usable) {
+        dlclose(handle);
+        handle = nullptr;
+        return false;
+    }
+    shared->createFunction = createFunction;
+    return true;
+}
+
+bool PluginApp::start(const matrixserver::ServerConfig &setServerConfig, FrameCallback callback) {
+    if (shared->createFunction == nullptr || thread_ != nullptr)
+        return false;
+    shared->serverConfig.CopyFrom(setServerConfig);
+    shared->screens = createScreens(shared->serverConfig);
+    shared->frameCallback = callback;
+    installCrashHandler();
+    shared->heartbeat = FrameTimer::nowNs();
+    shared->state = PluginState::running;
+    thread_ = new boost::thread(&PluginApp::internalLoop, shared);
+    return true;
+}
+
+void PluginApp::setLauncher(AppLaunchFunction launch) {
+    shared->launcher = launch;
+}
+
+void PluginApp::kill() {
+    shared->stopRequested = true;
+}
+
+bool PluginApp::unload() {
+    if (shared->state == PluginState::hung)
+        return false;
+    if (thread_ == nullptr) {
+        if (handle != nullptr) { // loaded but never started
+            dlclose(handle);
+            handle = nullptr;
+        }
+        return true;
+    }
+    if (!shared->finished)
+        return false;
+    thread_->join();
+    delete thread_;
+    thread_ = nullptr;
+    if (shared->state == PluginState::ended || shared->state == PluginState::failed) {
+        if (shared->app != nullptr)
+            destroyFunction(shared->app);
+        shared->app = nullptr;
+        dlclose(handle);
+        handle = nullptr;
+        MATRIXLOG(debug) << "[PluginApp] " << path << " unloaded";
+        return true;
+    }
+    // the plugin may have left its objects or locks in any state, it stays loaded
+    shared->app = nullptr;
+    handle = nullptr;
+    return true;
+}
+
+bool PluginApp::hasEnded() {
+    return shared->finished || shared->state == PluginState::hung;
+}
+
+bool PluginApp::checkWatchdog(int64_t nowNs, int64_t timeoutNs) {
+    auto &plugin = *shared;
+    if (plugin.state == PluginState::hung)
+        return true;
+    if (plugin.state != PluginState::running || plugin.finished || nowNs - plugin.heartbeat < timeoutNs)
+        return false;
+    MATRIXLOG(warning) << "[PluginApp] " << path << " didn't finish a frame for "
+                       << (nowNs - plugin.heartbeat) / 1000000 << " ms, stopping it";
+    plugin.stopRequested = true;
+    plugin.state = PluginState::hung;
+    return true;
+}
+
+void PluginApp::setInput(const InputState &input) {
+    if (shared->state == PluginState::running && shared->created && !shared->finished)
+        shared->app->setInput(input);
+}
+
+PluginState PluginApp::getState() {
+    return shared->state;
+}
+
+std::string PluginApp::getPath() {
+    return path;
+}
+
+uint64_t PluginApp::getFrameCount() {
+    return shared->frames;
+}
+
+int64_t PluginApp::getStartupNs() {
+    return shared->startupNs;
+}
+
+void PluginApp::internalLoop(std::shared_ptr<PluginThread> plugin) {
+    // own stack for the crash handler, a stack overflow must not fault again in the handler
+    std::vector<char> signalStack(PLUGINSIGNALSTACKSIZE);
+    stack_t stack;
+    stack.ss_sp = signalStack.data();
+    stack.ss_size = signalStack.size();
+    stack.ss_flags = 0;
+    sigaltstack(&stack, nullptr);
+
+    sigjmp_buf jump;
+    int signal = sigsetjmp(jump, 1);
+    if (signal == 0) {
+        crashJump = &jump;
+        runFrames(*plugin);
+    } else {
+        MATRIXLOG(error) << "[PluginApp] " << plugin->path << " crashed with signal " << signal;
+        plugin->state = PluginState::crashed;
+    }
+    crashJump = nullptr;
+
+    stack.ss_flags = SS_DISABLE;
+    sigaltstack(&stack, nullptr);
+    plugin->finished = true;
+}
+
+void PluginApp::runFrames(PluginThread &plugin) {
+    try {
+        // the constructor is plugin code as well, it may throw or crash
+        plugin.app = plugin.createFunction();
+        if (plugin.app == nullptr) {
+            MATRIXLOG(error) << "[PluginApp] " << plugin.path << " created no app";
+            plugin.state = PluginState::failed;
+            return;
+        }
+        plugin.created = true;
+        auto *app = plugin.app;
+        FrameTimer frameTimer(app->getFps());
+        app->setLauncher(plugin.launcher);
+        app->attach(plugin.screens, plugin.serverConfig);
+        frameTimer.start();
+        while (!plugin.stopRequested) {
+            bool running;
+            {
+                TraceSpan span("loop");
+                running = app->loop();
+            }
+            if (!running)
+                break;
+            // a fault while the server renders the frame is the server's own
+            auto jump = crashJump;
+            crashJump = nullptr;
+            plugin.frameCallback(plugin.screens);
+            crashJump = jump;
+            auto now = FrameTimer::nowNs();
+            plugin.heartbeat = now;
+            if (plugin.frames++ == 0)
+                plugin.startupNs = now - plugin.loadTimestamp;
+            if (app->getFps() != frameTimer.getFps())
+                frameTimer.setFps(app->getFps());
+            frameTimer.wait();
+        }
+        if (plugin.state == PluginState::running)
+            plugin.state = PluginState::ended;
+    } catch (std::exception &e) {
+        MATRIXLOG(error) << "[PluginApp] " << plugin.path << " failed: " << e.what();
+        plugin.state = PluginState::failed;
+    } catch (...) {
+        MATRIXLOG(error) << "[PluginApp] " << plugin.path << " failed";
+        plugin.state = PluginState::failed;
+    }
+}
+
+void PluginApp::installCrashHandler() {
+    std::call_once(crashHandlerInstalled, []() {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = &PluginApp::crashHandler;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        for (auto signal : crashSignals)
+            sigaction(signal, &action, &previousActions[signal]);
+    });
+}
+
+void PluginApp::crashHandler(int signal, siginfo_t *info, void *context) {
+    if (crashJump != nullptr)
+        siglongjmp(*crashJump, signal);
+    // not a plugin thread: the fault is the server's own, behave as before the handler was installed
+    auto &previous = previousActions[signal];
+    if (previous.sa_flags & SA_SIGINFO) {
+        if (previous.sa_sigaction != nullptr) {
+            previous.sa_sigaction(signal, info, context);
+            return;
+        }
+    } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+        previous.sa_handler(signal);
+        return;
+    }
+    sigaction(signal, &previous, nullptr); // the faulting instruction runs again and takes the default action
+}
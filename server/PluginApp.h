@@ -0,0 +1,114 @@
+#ifndef MATRIXSERVER_PLUGINAPP_H
+#define MATRIXSERVER_PLUGINAPP_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <signal.h>
+#include <boost/thread/thread.hpp>
+
+#include <AppPlugin.h>
+#include <SeqLock.h>
+#include <matrixserver.pb.h>
+
+#define PLUGINWATCHDOGTIMEOUT 2000000000LL //ns without a finished frame until a plugin counts as hung
+#define PLUGINSTOPTIMEOUT 1000 //ms a destroyed plugin gets to finish its frame
+#define PLUGINSIGNALSTACKSIZE 65536
+
+enum class PluginState : unsigned int {
+    loaded,
+    running,
+    ended,   // loop() returned false or the plugin was killed
+    failed,  // loop() threw
+    crashed, // fatal signal on the plugin thread
+    hung     // stopped by the watchdog
+};
+
+/*
+ * An app loaded from a shared object and run on a thread of the server. Every frame the plugin
+ * draws into its own screens, which are handed to frameCallback on the plugin thread.
+ * Fatal signals (SIGSEGV, SIGBUS, SIGFPE, SIGILL) on the plugin thread end only the plugin, the
+ * watchdog (checkWatchdog, called periodically by the server) stops plugins which stopped
+ * finishing frames. A crashed plugin is never dlclose()d, its objects may be broken. A hung plugin
+ * thread can't be stopped at all, it keeps what it works on (PluginThread) and the plugin's code
+ * for good, the PluginApp can still be destroyed. A cleanly ended plugin is destroyed and dlclose()d.
+ */
+class PluginApp {
+public:
+    typedef std::function<void(std::vector<std::shared_ptr<Screen>> &)> FrameCallback;
+
+    PluginApp(std::string path);
+
+    ~PluginApp();
+
+    PluginApp(PluginApp const &) = delete;
+
+    // only checks the plugin, the app is created on its thread by start()
+    bool load();
+
+    bool start(const matrixserver::ServerConfig &serverConfig, FrameCallback callback);
+
+    // how the plugin starts other apps, set before start()
+    void setLauncher(AppLaunchFunction launch);
+
+    // asks the plugin to end after the current frame, the thread is joined by unload()
+    void kill();
+
+    // joins and unloads a plugin which has ended, true once it is gone, never true for a hung one
+    bool unload();
+
+    bool hasEnded();
+
+    // marks the plugin hung if its last frame finished more than timeoutNs ago, true if it is hung
+    bool checkWatchdog(int64_t nowNs, int64_t timeoutNs = PLUGINWATCHDOGTIMEOUT);
+
+    void setInput(const InputState &input);
+
+    PluginState getState();
+
+    std::string getPath();
+
+    uint64_t getFrameCount();
+
+    // CLOCK_MONOTONIC ns from load() to the end of the first frame, 0 before
+    int64_t getStartupNs();
+
+private:
+    // owned by the PluginApp and its thread, a hung thread outlives the PluginApp
+    struct PluginThread {
+        std::string path;
+        IAppPlugin *app = nullptr; // created on the plugin thread
+        AppPluginCreateFunction createFunction = nullptr;
+        matrixserver::ServerConfig serverConfig;
+        std::vector<std::shared_ptr<Screen>> screens;
+        FrameCallback frameCallback;
+        AppLaunchFunction launcher;
+        std::atomic<PluginState> state{PluginState::loaded};
+        std::atomic<bool> stopRequested{false};
+        std::atomic<bool> created{false}; // app is set
+        std::atomic<bool> finished{false};
+        std::atomic<int64_t> heartbeat{0}; // end of the last frame
+        std::atomic<uint64_t> frames{0};
+        int64_t loadTimestamp = 0;
+        std::atomic<int64_t> startupNs{0};
+    };
+
+    static void internalLoop(std::shared_ptr<PluginThread> plugin);
+
+    static void runFrames(PluginThread &plugin);
+
+    static void installCrashHandler();
+
+    static void crashHandler(int signal, siginfo_t *info, void *context);
+
+    std::string path;
+    void *handle;
+    AppPluginDestroyFunction destroyFunction;
+    boost::thread *thread_;
+    std::shared_ptr<PluginThread> shared;
+};
+
+
+#endif //MATRIXSERVER_PLUGINAPP_H
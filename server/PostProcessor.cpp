@@ -0,0 +1,278 @@
+#include "PostProcessor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <FrameTimer.h>
+#include <Compositor.h>
+
+#define POSTMAXBLURRADIUS 127 // (2 * radius + 1) * 255 fits into the 16 bit sums
+
+static_assert(sizeof(Color) == 3, "the kernels work on packed rgb bytes");
+
+PostProcessor::PostProcessor(const matrixserver::ServerConfig &serverConfig) :
+        brightness(100),
+        gamma(1.0f),
+        crossfadeStartNs(0),
+        brightnessStage(false) {
+    size_t largest = 0;
+    int tallest = 0;
+    for (const auto &screenInfo : serverConfig.screeninfo()) {
+        size_t pixels = screenInfo.width() * screenInfo.height();
+        screenIds.push_back(screenInfo.screenid());
+        screenWidths.push_back(screenInfo.width());
+        screenHeights.push_back(screenInfo.height());
+        inputs.emplace_back(pixels, Color::black());
+        outputs.emplace_back(pixels, Color::black());
+        largest = std::max(largest, pixels);
+        tallest = std::max(tallest, screenInfo.height());
+    }
+    for (const auto &config : serverConfig.postprocessing()) {
+        if (config.type() == matrixserver::PostProcessingStage::noStage)
+            continue;
+        Stage stage;
+        stage.config.CopyFrom(config);
+        stage.stats.name = stageName(config.type());
+        stage.stats.runs = 0;
+        stage.stats.lastNs = 0;
+        stage.stats.maxNs = 0;
+        stage.stats.totalNs = 0;
+        stages.push_back(stage);
+        if (config.type() == matrixserver::PostProcessingStage::brightnessGamma) {
+            brightnessStage = true;
+            if (config.gamma() > 0)
+                gamma = config.gamma();
+        }
+        if (config.type() == matrixserver::PostProcessingStage::blur || config.type() == matrixserver::PostProcessingStage::bloom) {
+            scratch.resize(largest);
+            sums.resize(tallest * 3);
+        }
+        if (config.type() == matrixserver::PostProcessingStage::bloom)
+            glow.resize(largest);
+        if (config.type() == matrixserver::PostProcessingStage::crossfade)
+            fadeFrom = outputs;
+    }
+    if (serverConfig.globalscreenbrightness() > 0)
+        brightness = std::min(serverConfig.globalscreenbrightness(), 100);
+    buildLut();
+}
+
+std::string PostProcessor::stageName(matrixserver::PostProcessingStage::StageType type) {
+    switch (type) {
+        case matrixserver::PostProcessingStage::brightnessGamma:
+            return "brightnessGamma";
+        case matrixserver::PostProcessingStage::colorTemperature:
+            return "colorTemperature";
+        case matrixserver::PostProcessingStage::crossfade:
+            return "crossfade";
+        case matrixserver::PostProcessingStage::blur:
+            return "blur";
+        case matrixserver::PostProcessingStage::bloom:
+            return "bloom";
+        default:
+            return "none";
+    }
+}
+
+bool PostProcessor::isActive() {
+    return !stages.empty();
+}
+
+bool PostProcessor::handlesBrightness() {
+    return brightnessStage;
+}
+
+void PostProcessor::setBrightness(int setBrightness) {
+    setBrightness = std::max(0, std::min(setBrightness, 100));
+    if (setBrightness == brightness)
+        return;
+    brightness = setBrightness;
+    buildLut();
+}
+
+void PostProcessor::buildLut() {
+    for (int i = 0; i < 256; i++)
+        lut[i] = (uint8_t) std::lround(255.0 * std::pow(i / 255.0, gamma) * brightness / 100.0);
+}
+
+void PostProcessor::setScreen(int screenId, const Color *data, size_t pixels) {
+    for (size_t i = 0; i < screenIds.size(); i++) {
+        if (screenIds[i] == screenId && pixels >= inputs[i].size()) {
+            memcpy(inputs[i].data(), data, inputs[i].size() * sizeof(Color));
+            return;
+        }
+    }
+}
+
+void PostProcessor::startCrossfade() {
+    if (fadeFrom.empty())
+        return; // no crossfade stage
+    fadeFrom = inputs;
+    crossfadeStartNs = -1;
+}
+
+void PostProcessor::process(int64_t nowNs) {
+    if (crossfadeStartNs < 0)
+        crossfadeStartNs = nowNs; // the first frame of the new app
+    for (size_t i = 0; i < inputs.size(); i++)
+        memcpy(outputs[i].data(), inputs[i].data(), inputs[i].size() * sizeof(Color));
+    for (auto &stage : stages) {
+        auto start = FrameTimer::nowNs();
+        runStage(stage, nowNs);
+        auto duration = FrameTimer::nowNs() - start;
+        stage.stats.runs++;
+        stage.stats.lastNs = duration;
+        stage.stats.totalNs += duration;
+        if (duration > stage.stats.maxNs)
+            stage.stats.maxNs = duration;
+    }
+}
+
+// Tanner Helland's fit of the black body colors, relative to 6500K so that is neutral
+static void kelvinToRgb(int kelvin, double rgb[3]) {
+    double t = kelvin / 100.0;
+    rgb[0] = t <= 66 ? 255 : 329.698727446 * std::pow(t - 60, -0.1332047592);
+    rgb[1] = t <= 66 ? 99.4708025861 * std::log(t) - 161.1195681661 : 288.1221695283 * std::pow(t - 60, -0.0755148492);
+    rgb[2] = t >= 66 ? 255 : t <= 19 ? 0 : 138.5177312231 * std::log(t - 10) - 305.0447927307;
+    for (int c = 0; c < 3; c++)
+        rgb[c] = std::max(0.0, std::min(rgb[c], 255.0));
+}
+
+void PostProcessor::runStage(Stage &stage, int64_t nowNs) {
+    const auto &config = stage.config;
+    switch (config.type()) {
+        case matrixserver::PostProcessingStage::brightnessGamma:
+            for (auto &output : outputs)
+                applyLut(reinterpret_cast<uint8_t *>(output.data()), output.size() * 3, lut);
+            break;
+        case matrixserver::PostProcessingStage::colorTemperature: {
+            double target[3], neutral[3];
+            kelvinToRgb(config.kelvin() > 0 ? config.kelvin() : 6500, target);
+            kelvinToRgb(6500, neutral);
+            uint8_t scale[3];
+            for (int c = 0; c < 3; c++)
+                scale[c] = (uint8_t) std::lround(std::min(255.0, 255.0 * target[c] / neutral[c]));
+            for (auto &output : outputs)
+                scaleChannels(reinterpret_cast<uint8_t *>(output.data()), output.size(), scale[0], scale[1], scale[2]);
+            break;
+        }
+        case matrixserver::PostProcessingStage::crossfade: {
+            if (crossfadeStartNs == 0)
+                break;
+            int64_t durationNs = std::max(config.durationms(), 1) * 1000000LL;
+            int64_t elapsed = nowNs - crossfadeStartNs;
+            if (elapsed >= durationNs) {
+                crossfadeStartNs = 0;
+                break;
+            }
+            // the old frame fades out on top of the new one
+            auto opacity = (uint8_t) (255 - elapsed * 255 / durationNs);
+            for (size_t i = 0; i < outputs.size(); i++)
+                Compositor::alphaOver(outputs[i].data(), fadeFrom[i].data(), outputs[i].size(), opacity, false);
+            break;
+        }
+        case matrixserver::PostProcessingStage::blur: {
+            auto radius = config.radius() > 0 ? config.radius() : 1;
+            for (size_t i = 0; i < outputs.size(); i++)
+                boxBlur(reinterpret_cast<uint8_t *>(outputs[i].data()), reinterpret_cast<uint8_t *>(scratch.data()),
+                        sums.data(), screenWidths[i], screenHeights[i], radius);
+            break;
+        }
+        case matrixserver::PostProcessingStage::bloom: {
+            auto radius = config.radius() > 0 ? config.radius() : 2;
+            auto strength = (uint16_t) std::lround(std::min(config.strength() > 0 ? config.strength() : 1.0f, 4.0f) * 256);
+            auto threshold = config.threshold();
+            for (size_t i = 0; i < outputs.size(); i++) {
+                auto *data = reinterpret_cast<uint8_t *>(outputs[i].data());
+                auto *bright = reinterpret_cast<uint8_t *>(glow.data());
+                size_t length = outputs[i].size() * 3;
+                for (size_t n = 0; n < length; n++)
+                    bright[n] = data[n] > threshold ? data[n] : 0;
+                boxBlur(bright, reinterpret_cast<uint8_t *>(scratch.data()), sums.data(), screenWidths[i], screenHeights[i], radius);
+                addScaled(data, bright, length, strength);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void PostProcessor::output(std::function<void(int screenId, Color *data)> callback) {
+    for (size_t i = 0; i < outputs.size(); i++)
+        callback(screenIds[i], outputs[i].data());
+}
+
+std::vector<PostStageStats> PostProcessor::getStats() {
+    std::vector<PostStageStats> stats;
+    for (auto &stage : stages)
+        stats.push_back(stage.stats);
+    return stats;
+}
+
+void PostProcessor::applyLut(uint8_t *data, size_t length, const std::array<uint8_t, 256> &lut) {
+    for (size_t i = 0; i < length; i++)
+        data[i] = lut[data[i]];
+}
+
+static inline uint8_t scaleChannel(uint8_t value, uint8_t scale) {
+    uint16_t product = value * scale + 128;
+    return (product + (product >> 8)) >> 8;
+}
+
+void PostProcessor::scaleChannels(uint8_t *data, size_t pixels, uint8_t red, uint8_t green, uint8_t blue) {
+    for (size_t i = 0; i < pixels; i++) {
+        data[0] = scaleChannel(data[0], red);
+        data[1] = scaleChannel(data[1], green);
+        data[2] = scaleChannel(data[2], blue);
+        data += 3;
+    }
+}
+
+void PostProcessor::addScaled(uint8_t *data, const uint8_t *glow, size_t length, uint16_t strength) {
+    for (size_t i = 0; i < length; i++) {
+        uint32_t value = data[i] + ((glow[i] * (uint32_t) strength) >> 8);
+        data[i] = value > 255 ? 255 : value;
+    }
+}
+
+void PostProcessor::boxBlur(uint8_t *data, uint8_t *scratch, uint16_t *sums, int width, int height, int radius) {
+    radius = std::max(1, std::min(radius, POSTMAXBLURRADIUS));
+    uint32_t count = 2 * radius + 1;
+    uint32_t reciprocal = (65536 + count / 2) / count; // sum * reciprocal >> 16 instead of a division
+    size_t column = height * 3;
+
+    // along y, the pixels of a column are contiguous: a running sum per channel
+    for (int x = 0; x < width; x++) {
+        const uint8_t *in = data + x * column;
+        uint8_t *out = scratch + x * column;
+        for (int c = 0; c < 3; c++) {
+            uint32_t sum = 0;
+            for (int k = -radius; k <= radius; k++)
+                sum += in[std::max(0, std::min(k, height - 1)) * 3 + c];
+            for (int y = 0; y < height; y++) {
+                out[y * 3 + c] = (sum * reciprocal + 32768) >> 16;
+                sum += in[std::min(y + radius + 1, height - 1) * 3 + c];
+                sum -= in[std::max(y - radius, 0) * 3 + c];
+            }
+        }
+    }
+
+    // along x whole columns are added and removed, plain loops over the bytes of a column which vectorize
+    memset(sums, 0, column * sizeof(uint16_t));
+    for (int k = -radius; k <= radius; k++) {
+        const uint8_t *in = scratch + std::max(0, std::min(k, width - 1)) * column;
+        for (size_t n = 0; n < column; n++)
+            sums[n] += in[n];
+    }
+    for (int x = 0; x < width; x++) {
+        uint8_t *out = data + x * column;
+        for (size_t n = 0; n < column; n++)
+            out[n] = (sums[n] * reciprocal + 32768) >> 16;
+        const uint8_t *add = scratch + std::min(x + radius + 1, width - 1) * column;
+        const uint8_t *remove = scratch + std::max(x - radius, 0) * column;
+        for (size_t n = 0; n < column; n++)
+            sums[n] += add[n] - remove[n];
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef MATRIXSERVER_POSTPROCESSOR_H
+#define MATRIXSERVER_POSTPROCESSOR_H
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <array>
+#include <stdint.h>
+
+#include <Color.h>
+#include <matrixserver.pb.h>
+
+struct PostStageStats {
+    std::string name;
+    uint64_t runs;
+    int64_t lastNs;
+    int64_t maxNs;
+    int64_t totalNs;
+};
+
+/*
+ * The post-processing pipeline of the server: the stages configured in ServerConfig.postProcessing
+ * run in their order once per presented frame, over all screens, before the renderers get the
+ * result. So every renderer shows the same thing and the cost is paid once, not per renderer.
+ * The server hands in the screens of the frame with setScreen(), screens it doesn't hand in keep
+ * their last content. Without stages the server doesn't use it at all. Not thread safe, the
+ * server calls it under its renderer lock.
+ *
+ *   postProcessor.setScreen(screenId, pixels, pixelCount); // every screen of the frame
+ *   postProcessor.process(FrameTimer::nowNs());
+ *   postProcessor.output([&](int screenId, Color *data) { renderer->setScreenData(screenId, data); });
+ */
+class PostProcessor {
+public:
+    PostProcessor(const matrixserver::ServerConfig &serverConfig);
+
+    bool isActive();
+
+    // the brightnessGamma stage applies the brightness, the renderers have to stay at 100
+    bool handlesBrightness();
+
+    // 0..100
+    void setBrightness(int brightness);
+
+    // ignored if pixels is too short or the screen is unknown
+    void setScreen(int screenId, const Color *data, size_t pixels);
+
+    // the frames from the next process() on fade in from the last frame handed in, the stages
+    // before the crossfade stage only apply to the new frames
+    void startCrossfade();
+
+    void process(int64_t nowNs);
+
+    void output(std::function<void(int screenId, Color *data)> callback);
+
+    std::vector<PostStageStats> getStats();
+
+    static std::string stageName(matrixserver::PostProcessingStage::StageType type);
+
+    // out = lut[in] for every byte
+    static void applyLut(uint8_t *data, size_t length, const std::array<uint8_t, 256> &lut);
+
+    // per channel scale / 255, exact rounding
+    static void scaleChannels(uint8_t *data, size_t pixels, uint8_t red, uint8_t green, uint8_t blue);
+
+    // box blur of a screen stored column by column (Screen layout), radius in pixels (at most 127),
+    // edges clamped, scratch has the size of the screen, sums one entry per byte of a column
+    static void boxBlur(uint8_t *data, uint8_t *scratch, uint16_t *sums, int width, int height, int radius);
+
+    // data = min(data + glow * strength / 256, 255)
+    static void addScaled(uint8_t *data, const uint8_t *glow, size_t length, uint16_t strength);
+
+private:
+    struct Stage {
+        matrixserver::PostProcessingStage config;
+        PostStageStats stats;
+    };
+
+    void buildLut();
+
+    void runStage(Stage &stage, int64_t nowNs);
+
+    std::vector<Stage> stages;
+    std::vector<int> screenIds;
+    std::vector<int> screenWidths;
+    std::vector<int> screenHeights;
+    std::vector<std::vector<Color>> inputs;
+    std::vector<std::vector<Color>> outputs;
+    std::vector<std::vector<Color>> fadeFrom; // inputs when the crossfade started
+    std::vector<Color> scratch;
+    std::vector<Color> glow;
+    std::vector<uint16_t> sums;
+    std::array<uint8_t, 256> lut;
+    int brightness;
+    float gamma;
+    int64_t crossfadeStartNs; // 0: no crossfade running, -1: starts with the next process()
+    bool brightnessStage;
+};
+
+
+#endif //MATRIXSERVER_POSTPROCESSOR_H
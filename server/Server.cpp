@@ -1,66 +1,627 @@
 #include <vector>
 #include <iostream>
 #include <future>
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/expressions.hpp>
+#include <Log.h>
 #include <sys/time.h>
 #include <random>
 #include <chrono>
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+#include <unistd.h>
 
 #include "Server.h"
-
-std::string defaultApp("/usr/local/bin/MainMenu 1>/dev/null 2>/dev/null &");
-bool defaultAppStarted = false;
+#include <FrameTimer.h>
+#include <FrameHash.h>
+#include <CubeConfig.h>
+#include <MirrorRenderer.h>
 
 App *Server::getAppByID(int searchID) {
     for (unsigned int i = 0; i < apps.size(); i++) {
-        if (apps[i].getAppId() == searchID) {
-            return &apps[i];
+        if (apps[i]->getAppId() == searchID) {
+            return apps[i].get();
         }
     }
     return nullptr;
 }
 
 Server::Server(std::shared_ptr<IRenderer> setRenderer, matrixserver::ServerConfig &setServerConfig) :
+        foregroundAppId(0),
+        defaultAppStarted(false),
+        commands(SERVERCOMMANDQUEUESIZE),
+        coreCommands(0),
+        coreBatches(0),
+        coreMaxBatch(0),
+        queueFull(0),
         ioContext(),
-        serverConfig(setServerConfig),
         tcpServer(ioContext, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), std::stoi(setServerConfig.serverconnection().serverport()))),
-//        unixServer(ioContext, boost::asio::local::stream_protocol::endpoint("/tmp/matrixserver.sock")),
-        ipcServer("matrixserver"),
+        unixServer(ioContext, boost::asio::local::stream_protocol::endpoint(
+                setServerConfig.unixsocketpath().empty() ? DEFAULTUNIXSOCKETPATH : setServerConfig.unixsocketpath())),
+        ipcServer(setServerConfig.ipcaddress().empty() ? DEFAULTIPCADDRESS : setServerConfig.ipcaddress()),
+        launcher(ioContext, std::bind(&Server::newConnectionCallback, this, std::placeholders::_1)),
+        serverConfig(joinClusterDisplay(setServerConfig)),
+        compositor(setServerConfig),
+        postProcessor(setServerConfig),
+        baseLayerId(0),
+        metricsServer(ioContext, std::bind(&Server::writeMetrics, this, std::placeholders::_1)),
         joystickmngr(8) {
-    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::debug);
-    renderers.push_back(setRenderer);
+    Log::setLevel(LogLevel::debug);
+    Trace::init();
+    for (const auto &screenInfo : serverConfig.screeninfo())
+        presentScreenIds.push_back(screenInfo.screenid());
+    memset(&presentStats, 0, sizeof(presentStats));
+    // a leader's renderers show its own screens at the presentation time of the cluster
+    auto localScreens = createScreens(serverConfig);
+    if (serverConfig.cluster().role() == matrixserver::ClusterConfig::leader) {
+        localScreens.resize(localScreens.size() - serverConfig.cluster().remotescreeninfo_size());
+        clusterLeader = std::make_shared<ClusterLeader>(ioContext, serverConfig, createScreens(serverConfig),
+                                                        localScreens.size());
+        addRenderer(clusterLeader);
+    }
+    addRenderer(setRenderer);
+    if (!serverConfig.mirrorname().empty())
+        addRenderer(std::make_shared<MirrorRenderer>(localScreens, serverConfig.mirrorname()));
+    if (serverConfig.cluster().role() == matrixserver::ClusterConfig::follower) {
+        clusterFollower = std::make_shared<ClusterFollower>(ioContext, serverConfig, [this](ScheduledFrame &frame) {
+            presentClusterFrame(frame);
+        });
+    }
+    frameAck = std::make_shared<matrixserver::MatrixServerMessage>(); // immutable, shared by all connections
+    frameAck->set_messagetype(matrixserver::setScreenFrame);
+    frameAck->set_status(matrixserver::success);
+    jitterBuffer = std::make_shared<JitterBuffer>([this](int appId, const matrixserver::MatrixServerMessage &message) {
+        presentScheduledFrame(appId, message);
+    });
+    // before anything can post to it
+    coreThread = new boost::thread(&Server::coreLoop, this);
+    coreThreadId = coreThread->get_id();
     tcpServer.setAcceptCallback(std::bind(&Server::newConnectionCallback, this, std::placeholders::_1));
-//    unixServer.setAcceptCallback(std::bind(&Server::newConnectionCallback, this, std::placeholders::_1));
+    unixServer.setAcceptCallback(std::bind(&Server::newConnectionCallback, this, std::placeholders::_1));
     ipcServer.setAcceptCallback(std::bind(&Server::newConnectionCallback, this, std::placeholders::_1));
+    if (access(DEFAULTZYGOTE, X_OK) == 0)
+        launcher.startZygote(DEFAULTZYGOTE);
+    if (serverConfig.metricsport() > 0)
+        metricsServer.listenTcp(serverConfig.metricsport());
+    if (!serverConfig.metricssocket().empty())
+        metricsServer.listenUnix(serverConfig.metricssocket());
     ioThread = new boost::thread([this]() { this->ioContext.run(); });
     std::random_device rd;
     srand(rd());
+    memset(&inputBaseline, 0, sizeof(inputBaseline));
+    memset(&lastInput, 0, sizeof(lastInput));
+    inputAppId = 0;
+    inputMessage = std::make_shared<matrixserver::MatrixServerMessage>();
+    inputMessage->set_messagetype(matrixserver::joystickData);
+    inputChanged = false;
+    joystickmngr.setChangeCallback([this]() {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        inputChanged = true;
+        inputCondition.notify_one();
+    });
+    inputThread = new boost::thread(&Server::inputLoop, this);
+    if (!serverConfig.capturepath().empty())
+        startRecording(serverConfig.capturepath());
+}
+
+bool Server::startRecording(const std::string &path) {
+    return recorder.open(path, serverConfig);
+}
+
+void Server::stopRecording() {
+    recorder.close();
+}
+
+CaptureStats Server::getCaptureStats() {
+    return recorder.getStats();
+}
+
+static void addCounter(matrixserver::ServerStats &stats, const char *name, const char *help, uint64_t value) {
+    auto *counter = stats.add_counters();
+    counter->set_name(name);
+    counter->set_help(help);
+    counter->set_value(value);
+}
+
+void Server::getServerStats(matrixserver::ServerStats &stats) {
+    Metrics::fillStats(stats);
+    auto core = getCoreStats();
+    addCounter(stats, "commands", "commands handled by the core thread", core.commands);
+    addCounter(stats, "command_queue_full", "posts which waited for room in the command queue", core.queueFull);
+    std::lock_guard<std::mutex> lock(renderMutex);
+    addCounter(stats, "frames", "frames rendered", presentStats.frames);
+    addCounter(stats, "frames_skipped", "frames identical to what the renderers show", presentStats.framesSkipped);
+    addCounter(stats, "screens", "screens handed to a renderer", presentStats.screens);
+    addCounter(stats, "screens_skipped", "screens a renderer already showed", presentStats.screensSkipped);
+    if (clusterLeader || clusterFollower) {
+        auto cluster = getClusterStats();
+        addCounter(stats, "cluster_frames", "frames replicated to or received from the cluster", cluster.frames);
+        addCounter(stats, "cluster_screens", "screens replicated to or received from the cluster", cluster.screens);
+        addCounter(stats, "cluster_delta_screens", "of the cluster screens, those sent as a delta", cluster.deltaScreens);
+        addCounter(stats, "cluster_bytes", "screen data replicated to or received from the cluster", cluster.bytes);
+    }
+    for (const auto &rate : appFrameRates) {
+        auto *app = stats.add_apps();
+        app->set_appid(rate.first);
+        app->set_frames(rate.second.frames);
+        app->set_fps(rate.second.intervalNs > 0 ? 1e9 / rate.second.intervalNs : 0);
+    }
+}
+
+void Server::writeMetrics(std::string &out) {
+    matrixserver::ServerStats stats;
+    getServerStats(stats);
+    Metrics::exposition(stats, out);
+}
+
+void Server::countAppFrame(int appId, int64_t nowNs) {
+    auto &rate = appFrameRates[appId];
+    if (rate.frames > 0) {
+        double interval = nowNs - rate.lastNs;
+        rate.intervalNs = rate.frames == 1 ? interval : rate.intervalNs + (interval - rate.intervalNs) / 16;
+    }
+    rate.frames++;
+    rate.lastNs = nowNs;
+}
+
+void Server::setImuSource(std::function<bool(ImuState &)> source) {
+    imuSource = source;
+}
+
+std::vector<PostStageStats> Server::getPostProcessingStats() {
+    std::lock_guard<std::mutex> lock(renderMutex);
+    return postProcessor.getStats();
+}
+
+ServerCoreStats Server::getCoreStats() {
+    ServerCoreStats stats;
+    stats.commands = coreCommands;
+    stats.batches = coreBatches;
+    stats.maxBatch = coreMaxBatch;
+    stats.queueFull = queueFull;
+    return stats;
+}
+
+void Server::coreLoop() {
+    ServerCommand command;
+    while (true) {
+        commands.waitForData(SERVERCOREWAIT);
+        uint64_t batch = 0;
+        while (commands.pop(command)) {
+            process(command);
+            batch++;
+        }
+        command = ServerCommand(); // the last connection and message must not stay alive here
+        if (batch > 0) {
+            coreCommands.fetch_add(batch, std::memory_order_relaxed);
+            coreBatches.fetch_add(1, std::memory_order_relaxed);
+            if (batch > coreMaxBatch.load(std::memory_order_relaxed))
+                coreMaxBatch.store(batch, std::memory_order_relaxed);
+        }
+    }
+}
+
+void Server::post(ServerCommand command) {
+    if (boost::this_thread::get_id() == coreThreadId) {
+        process(command);
+        return;
+    }
+    if (commands.push(command))
+        return;
+    queueFull.fetch_add(1, std::memory_order_relaxed);
+    while (!commands.push(command))
+        usleep(100);
+}
+
+void Server::process(ServerCommand &command) {
+    switch (command.type) {
+        case ServerCommand::connectionAdded:
+            connections.push_back(command.connection);
+            break;
+        case ServerCommand::request:
+            handleCommand(command.connection, command.message);
+            break;
+        case ServerCommand::appAdded:
+            apps.push_back(command.app);
+            publishForeground();
+            break;
+        case ServerCommand::tick:
+            housekeeping();
+            break;
+        default:
+            break;
+    }
+}
+
+// core thread, after every change of apps
+void Server::publishForeground() {
+    std::shared_ptr<App> newForeground;
+    for (auto app = apps.rbegin(); app != apps.rend(); app++) {
+        if (!(*app)->isOverlay()) {
+            newForeground = *app;
+            break;
+        }
+    }
+    foregroundAppId.store(newForeground ? newForeground->getAppId() : 0, std::memory_order_release);
+    std::atomic_store(&foreground, newForeground);
+
+    std::lock_guard<std::mutex> lock(renderMutex);
+    int newBaseLayerId = newForeground ? newForeground->getAppId() : 0;
+    if (newBaseLayerId != baseLayerId) {
+        if (baseLayerId != 0)
+            compositor.removeLayer(baseLayerId);
+        if (newBaseLayerId != 0) {
+            compositor.setLayer(newBaseLayerId, LayerConfig());
+            postProcessor.startCrossfade();
+        }
+        baseLayerId = newBaseLayerId;
+    }
+    for (auto id : compositor.getLayerIds()) {
+        if (id != baseLayerId && getAppByID(id) == nullptr)
+            compositor.removeLayer(id);
+    }
+    for (auto rate = appFrameRates.begin(); rate != appFrameRates.end();) {
+        if (getAppByID(rate->first) == nullptr) {
+            jitterBuffer->removeApp(rate->first);
+            rate = appFrameRates.erase(rate);
+        } else
+            rate++;
+    }
+}
+
+void Server::setAppLayer(std::shared_ptr<App> app, const matrixserver::MatrixServerMessage &message) {
+    {
+        std::lock_guard<std::mutex> lock(renderMutex);
+        if (message.has_layerrequest()) {
+            if (app->getAppId() == baseLayerId)
+                baseLayerId = 0; // the layer is reconfigured instead of replaced
+            app->setOverlay(true);
+            compositor.setLayer(app->getAppId(), Compositor::configFromRequest(message.layerrequest()));
+        } else if (app->isOverlay()) {
+            app->setOverlay(false);
+            compositor.removeLayer(app->getAppId());
+        }
+    }
+    if (!app->isOverlay()) {
+        // on top of the other apps, the one which was in the foreground gets appKill with its next frame
+        apps.erase(std::remove(apps.begin(), apps.end(), app), apps.end());
+        apps.push_back(app);
+    }
+    publishForeground();
+}
+
+// joystick input is pushed as soon as the reactor reports it, the interval only paces the imu
+void Server::inputLoop() {
+    while (true) {
+        pushInput();
+        std::unique_lock<std::mutex> lock(inputMutex);
+        inputCondition.wait_for(lock, std::chrono::microseconds(INPUTPUSHINTERVAL), [this]() { return inputChanged; });
+        inputChanged = false;
+    }
+}
+
+// sends the input state to the foreground app if it changed since the last push
+void Server::pushInput() {
+    auto foreground = std::atomic_load(&this->foreground);
+    if (!foreground) {
+        inputAppId = 0;
+        return;
+    }
+
+    InputState input;
+    memset(&input, 0, sizeof(input));
+    joystickmngr.getStates(input.joysticks, MAXJOYSTICKS);
+    if (imuSource)
+        input.imu.valid = imuSource(input.imu);
+
+    bool foregroundChanged = foreground->getAppId() != inputAppId;
+    if (foregroundChanged) {
+        // press counts start at 0 for every app that comes to the foreground
+        memcpy(&inputBaseline, &input, sizeof(input));
+        inputAppId = foreground->getAppId();
+    }
+    for (int j = 0; j < MAXJOYSTICKS; j++) {
+        auto &joystick = input.joysticks[j];
+        for (int n = 0; n < MAXBUTTONAXISCOUNT; n++) {
+            joystick.buttonPressCount[n] -= inputBaseline.joysticks[j].buttonPressCount[n];
+            joystick.axisPressCount[n] -= inputBaseline.joysticks[j].axisPressCount[n];
+        }
+        if (joystick.timestamp > input.timestamp)
+            input.timestamp = joystick.timestamp;
+    }
+    if (input.imu.valid && input.imu.timestamp > input.timestamp)
+        input.timestamp = input.imu.timestamp;
+
+    if (!foregroundChanged && memcmp(&input, &lastInput, sizeof(input)) == 0)
+        return;
+    memcpy(&lastInput, &input, sizeof(input));
+
+    if (foreground->getPlugin()) {
+        foreground->getPlugin()->setInput(input);
+    } else if (foreground->isInputSubscribed()) {
+        inputStateToMessage(input, *inputMessage);
+        foreground->sendMsg(inputMessage);
+    }
+    if (recorder.isOpen()) {
+        if (foreground->getPlugin() || !foreground->isInputSubscribed())
+            inputStateToMessage(input, *inputMessage);
+        inputMessage->set_appid(inputAppId);
+        recorder.recordMessage(*inputMessage, FrameTimer::nowNs());
+    }
 }
 
 void Server::newConnectionCallback(std::shared_ptr<UniversalConnection> connection) {
-    BOOST_LOG_TRIVIAL(debug) << "[matrixserver] NEW SocketConnection CALLBACK!";
+    MATRIXLOG(debug) << "[matrixserver] NEW SocketConnection CALLBACK!";
     connection->setReceiveCallback(
             std::bind(&Server::handleRequest, this, std::placeholders::_1, std::placeholders::_2));
-    connections.push_back(connection);
+    ServerCommand command;
+    command.type = ServerCommand::connectionAdded;
+    command.connection = connection;
+    post(command);
 }
 
 void Server::handleRequest(std::shared_ptr<UniversalConnection> connection, std::shared_ptr<matrixserver::MatrixServerMessage> message) {
+    // new apps are recorded with the id they get
+    if (recorder.isOpen() && !(message->messagetype() == matrixserver::registerApp && message->appid() == 0))
+        recorder.recordMessage(*message, FrameTimer::nowNs());
+    if (message->messagetype() == matrixserver::setScreenFrame) {
+        TraceFrame traceFrame(message->frameid());
+        handleFrame(connection, message);
+        return;
+    }
+    if (message->messagetype() == matrixserver::clusterSync) {
+        // not through the core thread, its queue would only add to the round trip
+        auto received = FrameTimer::nowNs();
+        auto answer = std::make_shared<matrixserver::MatrixServerMessage>();
+        answer->set_messagetype(matrixserver::clusterSync);
+        auto *sync = answer->mutable_clustersync();
+        sync->set_originns(message->clustersync().originns());
+        sync->set_receivens(received);
+        sync->set_transmitns(FrameTimer::nowNs());
+        connection->sendMessage(answer);
+        return;
+    }
+    ServerCommand command;
+    command.type = ServerCommand::request;
+    command.connection = connection;
+    command.message = message;
+    post(command);
+}
+
+Server::FrameRoute Server::routeFrame(int appId) {
+    if (appId == 0 || !compositor.hasLayer(appId) || clusterFollower)
+        return FrameRoute::rejected;
+    if (appId == baseLayerId && compositor.getLayerCount() == 1)
+        return postProcessor.isActive() ? FrameRoute::processed : FrameRoute::direct;
+    return FrameRoute::composite;
+}
+
+void Server::renderComposited() {
+    static auto &compositeLatency = Metrics::histogram("composite", "blending the layers of a frame");
+    TraceSpan span("composite");
+    bool processed = postProcessor.isActive();
+    auto start = FrameTimer::nowNs();
+    compositor.compose([this, processed](int screenId, Color *data) {
+        if (processed) {
+            postProcessor.setScreen(screenId, data, compositor.getScreenPixels(screenId));
+            return;
+        }
+        presentScreen(screenId, data, compositor.getScreenPixels(screenId));
+    });
+    compositeLatency.record(FrameTimer::nowNs() - start);
+    if (processed) {
+        renderProcessed();
+        return;
+    }
+    presentFrame();
+}
+
+void Server::renderProcessed() {
+    TraceSpan span("postprocess");
+    postProcessor.process(FrameTimer::nowNs());
+    postProcessor.output([this](int screenId, Color *data) {
+        presentScreen(screenId, data, compositor.getScreenPixels(screenId));
+    });
+    presentFrame();
+}
+
+void Server::setBrightness(int brightness) {
+    if (postProcessor.handlesBrightness()) {
+        postProcessor.setBrightness(brightness);
+        return;
+    }
+    for (size_t i = 0; i < renderers.size(); i++) {
+        if (renderers[i]->getGlobalBrightness() == brightness)
+            continue;
+        renderers[i]->setGlobalBrightness(brightness);
+        // the same frame looks different now, it has to be rendered again
+        std::fill(presentedHashes[i].begin(), presentedHashes[i].end(), 0);
+    }
+}
+
+void Server::presentScreen(int screenId, Color *data, size_t pixels) {
+    auto hash = frameHash(data, pixels * sizeof(Color));
+    if (hash == 0)
+        hash = 1; // 0 marks a screen the renderer has to get in any case
+    int index = -1;
+    for (size_t i = 0; i < presentScreenIds.size(); i++) {
+        if (presentScreenIds[i] == screenId)
+            index = i;
+    }
+    for (size_t i = 0; i < renderers.size(); i++) {
+        if (index >= 0 && presentedHashes[i][index] == hash) {
+            presentStats.screensSkipped++;
+            continue;
+        }
+        renderers[i]->setScreenData(screenId, data);
+        if (index >= 0)
+            presentedHashes[i][index] = hash;
+        rendererChanged[i] = true;
+        presentStats.screens++;
+    }
+}
+
+void Server::presentFrame() {
+    static auto &renderLatency = Metrics::histogram("render", "render() of a renderer");
+    bool rendered = false;
+    for (size_t i = 0; i < renderers.size(); i++) {
+        if (!rendererChanged[i])
+            continue;
+        auto start = FrameTimer::nowNs();
+        renderers[i]->render();
+        auto end = FrameTimer::nowNs();
+        renderLatency.record(end - start);
+        Trace::record("render", start, end);
+        rendererChanged[i] = false;
+        rendered = true;
+    }
+    if (rendered)
+        presentStats.frames++;
+    else
+        presentStats.framesSkipped++;
+}
+
+PresentStats Server::getPresentStats() {
+    std::lock_guard<std::mutex> lock(renderMutex);
+    return presentStats;
+}
+
+// present thread of the cluster follower, the screens of the frame are in the order of the config
+void Server::presentClusterFrame(ScheduledFrame &frame) {
+    std::lock_guard<std::mutex> lock(renderMutex);
+    setBrightness(frame.brightness);
+    for (size_t i = 0; i < frame.screens.size() && i < presentScreenIds.size(); i++) {
+        if (frame.changed[i])
+            presentScreen(presentScreenIds[i], frame.screens[i].data(), frame.screens[i].size());
+    }
+    presentFrame();
+}
+
+ClusterStats Server::getClusterStats() {
+    if (clusterLeader)
+        return clusterLeader->getStats();
+    if (clusterFollower)
+        return clusterFollower->getStats();
+    ClusterStats stats;
+    memset(&stats, 0, sizeof(stats));
+    return stats;
+}
+
+matrixserver::ServerConfig &Server::joinClusterDisplay(matrixserver::ServerConfig &config) {
+    if (config.cluster().role() == matrixserver::ClusterConfig::leader) {
+        for (const auto &screenInfo : config.cluster().remotescreeninfo())
+            *config.add_screeninfo() = screenInfo;
+    }
+    return config;
+}
+
+// on the thread which received the frame, the renderers and the compositor are the only shared state it touches
+void Server::handleFrame(std::shared_ptr<UniversalConnection> connection, std::shared_ptr<matrixserver::MatrixServerMessage> message) {
+    static auto &ackLatency = Metrics::histogram("ack", "from a received frame to its ack");
+    static auto &framesDropped = Metrics::counter("frames_dropped", "frames of apps which aren't shown, answered with appKill");
+    TraceSpan span("handleFrame", 0, TraceFlow::in);
+    auto received = FrameTimer::nowNs();
+    launcher.frameReceived(connection.get());
+    std::unique_lock<std::mutex> lock(renderMutex);
+    auto route = routeFrame(message->appid());
+    if (route != FrameRoute::rejected)
+        countAppFrame(message->appid(), received);
+    if (route != FrameRoute::rejected && message->presentatns() != 0) {
+        lock.unlock();
+        // the route is taken again at the presentation time, the app may be in the background by then
+        if (jitterBuffer->push(message->appid(), message->presentatns(), message,
+                               [this, connection]() { connection->sendMessage(frameAck); }))
+            return;
+        lock.lock();
+        route = routeFrame(message->appid());
+    }
+    if (route != FrameRoute::rejected) {
+        presentMessage(route, *message);
+        lock.unlock();
+        connection->sendMessage(frameAck);
+        ackLatency.record(FrameTimer::nowNs() - received);
+    } else {
+        lock.unlock();
+        framesDropped.fetch_add(1, std::memory_order_relaxed);
+        //send app to pause
+        MATRIXLOG(debug) << "[Server] send app " << message->appid() << " to pause";
+        auto msg = std::make_shared<matrixserver::MatrixServerMessage>();
+        msg->set_messagetype(matrixserver::appKill);
+        connection->sendMessage(msg);
+    }
+}
+
+void Server::presentMessage(FrameRoute route, const matrixserver::MatrixServerMessage &message) {
+    if (route == FrameRoute::direct) {
+        for (const auto &screenInfo : message.screendata()) {
+            presentScreen(screenInfo.screenid(), (Color *) screenInfo.framedata().data(), //TODO: remove C style cast
+                          screenInfo.framedata().size() / sizeof(Color));
+        }
+        presentFrame();
+        if (message.has_serverconfig())
+            setBrightness(message.serverconfig().globalscreenbrightness());
+    } else if (route == FrameRoute::processed || route == FrameRoute::composite) {
+        if (message.has_serverconfig() && message.appid() == baseLayerId)
+            setBrightness(message.serverconfig().globalscreenbrightness());
+        for (const auto &screenInfo : message.screendata()) {
+            auto data = (const Color *) screenInfo.framedata().data();
+            auto pixels = screenInfo.framedata().size() / sizeof(Color);
+            if (route == FrameRoute::processed)
+                postProcessor.setScreen(screenInfo.screenid(), data, pixels);
+            else
+                compositor.setLayerFrame(message.appid(), screenInfo.screenid(), data, pixels);
+        }
+        if (route == FrameRoute::processed)
+            renderProcessed();
+        else
+            renderComposited();
+    }
+}
+
+// jitter buffer thread, an app which lost the screen meanwhile was sent appKill with its next frame
+void Server::presentScheduledFrame(int appId, const matrixserver::MatrixServerMessage &message) {
+    static auto &framesRejected = Metrics::counter("jitter_frames_rejected", "scheduled app frames of apps which weren't shown any more at their time");
+    TraceFrame traceFrame(message.frameid());
+    TraceSpan span("presentScheduled");
+    std::lock_guard<std::mutex> lock(renderMutex);
+    auto route = routeFrame(appId);
+    if (route == FrameRoute::rejected) {
+        framesRejected.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    presentMessage(route, message);
+}
+
+JitterBufferStats Server::getJitterBufferStats() {
+    return jitterBuffer->getStats();
+}
+
+// core thread
+void Server::handleCommand(std::shared_ptr<UniversalConnection> connection, std::shared_ptr<matrixserver::MatrixServerMessage> message) {
     switch (message->messagetype()) {
         case matrixserver::registerApp:
             if (message->appid() == 0) {
-                BOOST_LOG_TRIVIAL(debug) << "[matrixserver] register new App request received";
-                apps.push_back(App(connection));
+                MATRIXLOG(debug) << "[matrixserver] register new App request received";
+                auto app = std::make_shared<App>(connection);
+                app->setInputSubscribed(message->subscribeinput());
+                if (recorder.isOpen()) {
+                    matrixserver::MatrixServerMessage registered(*message);
+                    registered.set_appid(app->getAppId());
+                    recorder.recordMessage(registered, FrameTimer::nowNs());
+                }
+                apps.push_back(app);
+                if (message->has_layerrequest())
+                    setAppLayer(app, *message);
+                else
+                    publishForeground();
                 auto response = std::make_shared<matrixserver::MatrixServerMessage>();
-                response->set_appid(apps.back().getAppId());
+                response->set_appid(app->getAppId());
                 response->set_messagetype(matrixserver::registerApp);
                 response->set_status(matrixserver::success);
                 connection->sendMessage(response);
             }
             break;
         case matrixserver::getServerInfo: {
-            BOOST_LOG_TRIVIAL(debug) << "[matrixserver] get ServerInfo request received";
+            MATRIXLOG(debug) << "[matrixserver] get ServerInfo request received";
             auto response = std::make_shared<matrixserver::MatrixServerMessage>();
             response->set_messagetype(matrixserver::getServerInfo);
             auto *tempServerConfig = new matrixserver::ServerConfig();
@@ -69,90 +630,209 @@ void Server::handleRequest(std::shared_ptr<UniversalConnection> connection, std:
             connection->sendMessage(response);
             break;
         }
-        case matrixserver::requestScreenAccess:
-            //TODO App level logic, set App on top, pause all other Apps, which aren't on top any more
+        case matrixserver::requestScreenAccess: {
+            std::shared_ptr<App> app;
+            for (auto &candidate : apps) {
+                if (candidate->getAppId() == message->appid())
+                    app = candidate;
+            }
+            if (app)
+                setAppLayer(app, *message);
+            auto response = std::make_shared<matrixserver::MatrixServerMessage>();
+            response->set_messagetype(matrixserver::requestScreenAccess);
+            response->set_appid(message->appid());
+            response->set_status(app ? matrixserver::success : matrixserver::error);
+            connection->sendMessage(response);
+            break;
+        }
+        case matrixserver::getServerStats: {
+            auto response = std::make_shared<matrixserver::MatrixServerMessage>();
+            response->set_messagetype(matrixserver::getServerStats);
+            getServerStats(*response->mutable_serverstats());
+            connection->sendMessage(response);
             break;
-        case matrixserver::setScreenFrame:
-            if (message->appid() == apps.back().getAppId()) {
-                for (auto renderer : renderers) {
-                    for (auto screenInfo : message->screendata()) {
-                        renderer->setScreenData(screenInfo.screenid(), (Color *) screenInfo.framedata().data()); //TODO: remove C style cast
-                    }
-                    auto usStart = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());
-//                  std::thread([renderer](){renderer->render();}).detach();
-                    renderer->render();
-                    auto response = std::make_shared<matrixserver::MatrixServerMessage>();
-                    response->set_messagetype(matrixserver::setScreenFrame);
-                    response->set_status(matrixserver::success);
-                    connection->sendMessage(response);
-                    auto usTotal = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()) - usStart;
-                    if (message->has_serverconfig())
-                        renderer->setGlobalBrightness(message->serverconfig().globalscreenbrightness());
-                    //BOOST_LOG_TRIVIAL(debug) << "[Server] rendertime: " << usTotal.count() << " us"; // ~ 15ms
-                }
-            } else {
-                //send app to pause
-                BOOST_LOG_TRIVIAL(debug) << "[Server] send app " << message->appid() << " to pause";
-                auto msg = std::make_shared<matrixserver::MatrixServerMessage>();
-                msg->set_messagetype(matrixserver::appKill);
-                connection->sendMessage(msg);
+        }
+        case matrixserver::trace: {
+            // the apps write to the same file, their spans end up on the server's timeline
+            for (auto &app : apps) {
+                if (app->getConnection() && app->getConnection() != connection)
+                    app->sendMsg(message);
             }
+            auto response = std::make_shared<matrixserver::MatrixServerMessage>();
+            response->set_messagetype(matrixserver::trace);
+            response->set_status(Trace::apply(message->tracerequest()) ? matrixserver::success : matrixserver::error);
+            connection->sendMessage(response);
+            break;
+        }
+        case matrixserver::launchApp: {
+            const auto &request = message->launchrequest();
+            MATRIXLOG(debug) << "[Server] App " << message->appid() << " launches " << request.path();
+            std::vector<std::string> arguments(request.arguments().begin(), request.arguments().end());
+            auto response = std::make_shared<matrixserver::MatrixServerMessage>();
+            response->set_messagetype(matrixserver::launchApp);
+            response->set_appid(message->appid());
+            // the server runs as root, nothing from the network gets to start a process
+            bool allowed = connection->getTransport() != TransportType::tcp && isLaunchable(request.path());
+            if (!allowed)
+                MATRIXLOG(warning) << "[Server] refused to launch " << request.path();
+            response->set_status(allowed && launcher.launch(request.path(), arguments, request.restartonfailure()) != 0
+                                 ? matrixserver::success : matrixserver::error);
+            connection->sendMessage(response);
             break;
+        }
         case matrixserver::appAlive:
         case matrixserver::appPause:
         case matrixserver::appResume:
         case matrixserver::appKill:
-            BOOST_LOG_TRIVIAL(debug) << "[Server] appkill " << message->appid() << " successfull";
-            apps.erase(std::remove_if(apps.begin(), apps.end(), [message](App a) {
-                if (a.getAppId() == message->appid()) {
-                    BOOST_LOG_TRIVIAL(debug) << "[Server] App " << message->appid() << " deleted";
+            MATRIXLOG(debug) << "[Server] appkill " << message->appid() << " successfull";
+            apps.erase(std::remove_if(apps.begin(), apps.end(), [message](const std::shared_ptr<App> &a) {
+                if (a->getAppId() == message->appid()) {
+                    MATRIXLOG(debug) << "[Server] App " << message->appid() << " deleted";
                     return true;
                 } else {
                     return false;
                 }
             }), apps.end());
+            publishForeground();
         default:
             break;
     }
 }
 
 bool Server::tick() {
+    ServerCommand command;
+    command.type = ServerCommand::tick;
+    post(command);
+    return true;
+}
+
+void Server::housekeeping() {
+    Trace::poll();
     if (joystickmngr.getButtonPress(11)) {
-        if (apps.size() > 0) {
-            BOOST_LOG_TRIVIAL(debug) << "kill current app" << std::endl;
+        if (foreground) {
+            MATRIXLOG(debug) << "kill current app" << std::endl;
             auto msg = std::make_shared<matrixserver::MatrixServerMessage>();
             msg->set_messagetype(matrixserver::appKill);
-            apps.back().sendMsg(msg);
+            foreground->sendMsg(msg);
         }
     }
     joystickmngr.clearAllButtonPresses();
 
-    if (apps.size() == 0 && !defaultAppStarted) {
-        BOOST_LOG_TRIVIAL(debug) << "starting default app" << std::endl;
-        system(defaultApp.data());
+    if (!foreground && !defaultAppStarted && !clusterFollower) {
+        MATRIXLOG(debug) << "starting default app" << std::endl;
+        if (access(DEFAULTPLUGIN, R_OK) != 0 || startPlugin(DEFAULTPLUGIN) == 0)
+            launcher.launch(DEFAULTAPP);
         defaultAppStarted = true;
     }
-    if (apps.size() > 0) {
+    if (foreground) {
         defaultAppStarted = false;
     }
 
-    apps.erase(std::remove_if(apps.begin(), apps.end(), [](App a) {
-        bool returnVal = a.getConnection()->isDead();
-        if (returnVal)
-            BOOST_LOG_TRIVIAL(debug) << "[matrixserver] App " << a.getAppId() << " deleted";
+    checkPlugins();
+    launcher.reap();
+
+    apps.erase(std::remove_if(apps.begin(), apps.end(), [](const std::shared_ptr<App> &a) {
+        bool returnVal = a->isDead();
+        if (returnVal) {
+            MATRIXLOG(debug) << "[matrixserver] App " << a->getAppId() << " deleted";
+        }
         return returnVal;
     }), apps.end());
+    publishForeground();
 
     connections.erase(std::remove_if(connections.begin(), connections.end(), [](std::shared_ptr<UniversalConnection> con) {
         bool returnVal = con->isDead();
         if (returnVal) {
-            BOOST_LOG_TRIVIAL(debug) << "[matrixserver] Connection deleted";
+            MATRIXLOG(debug) << "[matrixserver] Connection deleted";
         }
         return returnVal;
     }), connections.end());
-    return true;
+}
+
+bool Server::isLaunchable(const std::string &path) {
+    auto directory = serverConfig.appsdirectory().empty() ? std::string(DEFAULTAPPSDIRECTORY)
+                                                          : serverConfig.appsdirectory();
+    char resolvedDirectory[PATH_MAX];
+    char resolvedPath[PATH_MAX];
+    if (realpath(directory.c_str(), resolvedDirectory) == nullptr || realpath(path.c_str(), resolvedPath) == nullptr)
+        return false;
+    auto prefix = std::string(resolvedDirectory) + "/";
+    return strncmp(resolvedPath, prefix.c_str(), prefix.size()) == 0;
+}
+
+AppLauncher &Server::getLauncher() {
+    return launcher;
 }
 
 void Server::addRenderer(std::shared_ptr<IRenderer> newRenderer) {
+    if (clusterLeader && newRenderer != clusterLeader) {
+        clusterLeader->addLocalRenderer(newRenderer);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(renderMutex);
+    if (postProcessor.handlesBrightness())
+        newRenderer->setGlobalBrightness(100);
     renderers.push_back(newRenderer);
+    presentedHashes.emplace_back(presentScreenIds.size(), 0);
+    rendererChanged.push_back(false);
+}
+
+int Server::startPlugin(const std::string &path) {
+    auto plugin = std::make_shared<PluginApp>(path);
+    if (!plugin->load())
+        return 0;
+    ServerCommand command;
+    command.type = ServerCommand::appAdded;
+    command.app = std::make_shared<App>(plugin);
+    int appId = command.app->getAppId();
+    post(command);
+    plugin->setLauncher([this](const std::string &launchPath) {
+        return isLaunchable(launchPath) && launcher.launch(launchPath) != 0;
+    });
+    // the frame callback runs on the plugin thread, it only renders while the plugin has a layer
+    plugin->start(serverConfig, [this, appId](std::vector<std::shared_ptr<Screen>> &screens) {
+        renderScreens(appId, screens);
+    });
+    MATRIXLOG(debug) << "[matrixserver] Plugin " << path << " started as App " << appId;
+    return appId;
+}
+
+void Server::renderScreens(int appId, std::vector<std::shared_ptr<Screen>> &screens) {
+    TraceSpan span("renderScreens");
+    auto received = FrameTimer::nowNs();
+    recorder.recordFrame(appId, screens, received);
+    std::lock_guard<std::mutex> lock(renderMutex);
+    auto route = routeFrame(appId);
+    if (route != FrameRoute::rejected)
+        countAppFrame(appId, received);
+    if (route == FrameRoute::direct) {
+        for (auto &screen : screens)
+            presentScreen(screen->getScreenId(), screen->getScreenDataRaw(), screen->getWidth() * screen->getHeight());
+        presentFrame();
+    } else if (route == FrameRoute::processed) {
+        for (auto &screen : screens) {
+            postProcessor.setScreen(screen->getScreenId(), screen->getScreenDataRaw(),
+                                    screen->getWidth() * screen->getHeight());
+        }
+        renderProcessed();
+    } else if (route == FrameRoute::composite) {
+        for (auto &screen : screens) {
+            compositor.setLayerFrame(appId, screen->getScreenId(), screen->getScreenDataRaw(),
+                                     screen->getWidth() * screen->getHeight());
+        }
+        renderComposited();
+    }
+}
+
+// watchdog for the in-process apps, a plugin which ended is unloaded once its thread is done
+void Server::checkPlugins() {
+    auto now = FrameTimer::nowNs();
+    for (auto &app : apps) {
+        auto plugin = app->getPlugin();
+        if (!plugin)
+            continue;
+        plugin->checkWatchdog(now);
+        if (plugin->hasEnded())
+            plugin->unload();
+    }
 }
@@ -3,6 +3,9 @@
 
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <boost/thread/thread.hpp>
 
 #include <Screen.h>
@@ -13,36 +16,239 @@
 #include <UnixSocketServer.h>
 #include <IpcServer.h>
 #include <Joystick.h>
+#include <InputState.h>
+#include <PluginApp.h>
+#include <AppLauncher.h>
+#include <MpscQueue.h>
+#include <Compositor.h>
+#include <PostProcessor.h>
+#include <FrameCapture.h>
+#include <MetricsServer.h>
+#include <Metrics.h>
+#include <Trace.h>
+#include <Cluster.h>
+#include <JitterBuffer.h>
+#include <map>
 
+#define INPUTPUSHINTERVAL 10000 //us
+#define SERVERCOMMANDQUEUESIZE 1024
+#define SERVERCOREWAIT 100000000LL //ns the core thread sleeps at most without commands
+#define DEFAULTAPP "/usr/local/bin/MainMenu"
+#define DEFAULTPLUGIN "/usr/local/lib/matrixapplication/plugins/MainMenu.so" // used instead of the MainMenu binary if installed
+#define DEFAULTAPPSDIRECTORY "/home/pi/APPS" // where MainMenu finds the apps
+
+// posted to the core thread, the message is not modified any more once it is posted
+struct ServerCommand {
+    enum Type : unsigned int {
+        none,
+        connectionAdded,
+        request, // every message except frames
+        appAdded,
+        tick
+    };
+    Type type = none;
+    std::shared_ptr<UniversalConnection> connection;
+    std::shared_ptr<matrixserver::MatrixServerMessage> message;
+    std::shared_ptr<App> app;
+};
+
+struct ServerCoreStats {
+    uint64_t commands;
+    uint64_t batches;
+    uint64_t maxBatch;
+    uint64_t queueFull; // posts which had to wait for the core thread
+};
+
+struct PresentStats {
+    uint64_t frames;         // rendered by at least one renderer
+    uint64_t framesSkipped;  // identical to what all renderers show, render() wasn't called
+    uint64_t screens;        // handed to a renderer
+    uint64_t screensSkipped; // a renderer already had it
+};
+
+struct AppFrameRate {
+    uint64_t frames;
+    int64_t lastNs;
+    double intervalNs; // moving average
+};
+
+/*
+ * The apps and connections belong to the core thread. The transports (io thread, ipc reader
+ * threads), the launcher and tick() only post commands into a lock-free queue, the core thread
+ * handles them in batches. Frames don't take that detour: they are rendered on the thread which
+ * received them (scheduled ones on the JitterBuffer's thread), straight from the message, against
+ * the foreground app the core thread publishes (foregroundAppId, foreground), so the frame path
+ * only takes the renderer lock.
+ */
 class Server {
 public:
     Server() = default;
 
     ~Server() = default;
 
+    // a cluster leader adds the screens of its followers to the config, the apps see the whole display
     Server(std::shared_ptr<IRenderer>, matrixserver::ServerConfig &);
 
+    // posts the periodic housekeeping (default app, kill button, dead apps) to the core thread
     bool tick();
 
+    // receive callback of all connections, any thread
     void handleRequest(std::shared_ptr<UniversalConnection> connection, std::shared_ptr<matrixserver::MatrixServerMessage> message);
 
     void newConnectionCallback(std::shared_ptr<UniversalConnection>);
 
+    // on a cluster leader the renderer shows the leader's screens at their presentation time
     void addRenderer(std::shared_ptr<IRenderer>);
 
+    // loads an app plugin and runs it in-process as the new foreground app, returns its appId or 0
+    int startPlugin(const std::string &path);
+
+    // core thread only
     App * getAppByID(int searchID);
 
+    AppLauncher &getLauncher();
+
+    // called by the input thread, fills the sample and returns true if one is available
+    void setImuSource(std::function<bool(ImuState &)> source);
+
+    ServerCoreStats getCoreStats();
+
+    std::vector<PostStageStats> getPostProcessingStats();
+
+    PresentStats getPresentStats();
+
+    // records into a capture file for matrixreplay, ServerConfig.capturePath starts it right away
+    bool startRecording(const std::string &path);
+
+    void stopRecording();
+
+    CaptureStats getCaptureStats();
+
+    // the histograms and counters of the process and the server's own counters and app frame rates
+    void getServerStats(matrixserver::ServerStats &stats);
+
+    // Prometheus text exposition of getServerStats()
+    void writeMetrics(std::string &out);
+
+    ClusterStats getClusterStats();
+
+    JitterBufferStats getJitterBufferStats();
+
 private:
-    std::vector<App> apps;
+    void coreLoop();
+
+    // runs the command right away on the core thread, waits for room in the queue elsewhere
+    void post(ServerCommand command);
+
+    void process(ServerCommand &command);
+
+    void handleCommand(std::shared_ptr<UniversalConnection> connection, std::shared_ptr<matrixserver::MatrixServerMessage> message);
+
+    void handleFrame(std::shared_ptr<UniversalConnection> connection, std::shared_ptr<matrixserver::MatrixServerMessage> message);
+
+    void housekeeping();
+
+    // launchApp starts nothing outside the apps directory, symlinks are resolved first
+    bool isLaunchable(const std::string &path);
+
+    void publishForeground();
+
+    // core thread, turns the app into an overlay with its own layer or back into a foreground app
+    void setAppLayer(std::shared_ptr<App> app, const matrixserver::MatrixServerMessage &message);
+
+    enum class FrameRoute : unsigned int {
+        direct,    // the foreground app without overlays and post-processing
+        processed, // the foreground app without overlays
+        composite,
+        rejected
+    };
+
+    // renderMutex held
+    FrameRoute routeFrame(int appId);
+
+    // renderMutex held, renders a frame of the app the route allows
+    void presentMessage(FrameRoute route, const matrixserver::MatrixServerMessage &message);
+
+    // takes renderMutex, a frame of the jitter buffer is due
+    void presentScheduledFrame(int appId, const matrixserver::MatrixServerMessage &message);
+
+    // renderMutex held, after the layer frames were set
+    void renderComposited();
+
+    // renderMutex held, after the screens were handed to the post processor
+    void renderProcessed();
+
+    // renderMutex held, brightness of a frame
+    void setBrightness(int brightness);
+
+    // renderMutex held, hands the screen to the renderers which don't show it yet (by its hash), a
+    // frame which changes nothing isn't rendered at all, the app still gets its ack
+    void presentScreen(int screenId, Color *data, size_t pixels);
+
+    // renderMutex held, renders the renderers which got a screen since the last call
+    void presentFrame();
+
+    // takes renderMutex, a frame of the cluster leader is due
+    void presentClusterFrame(ScheduledFrame &frame);
+
+    static matrixserver::ServerConfig &joinClusterDisplay(matrixserver::ServerConfig &config);
+
+    void inputLoop();
+
+    void pushInput();
+
+    void renderScreens(int appId, std::vector<std::shared_ptr<Screen>> &screens);
+
+    // renderMutex held, a frame of the app arrived
+    void countAppFrame(int appId, int64_t nowNs);
+
+    void checkPlugins();
+
+    std::vector<std::shared_ptr<App>> apps; // core thread only, the last one without overlay is in the foreground
+    std::shared_ptr<App> foreground; // std::atomic_load/atomic_store, for the input thread
+    std::atomic<int> foregroundAppId; // 0 without apps, for the frame path
+    bool defaultAppStarted;
+    MpscQueue<ServerCommand> commands;
+    boost::thread *coreThread;
+    boost::thread::id coreThreadId;
+    std::atomic<uint64_t> coreCommands;
+    std::atomic<uint64_t> coreBatches;
+    std::atomic<uint64_t> coreMaxBatch;
+    std::atomic<uint64_t> queueFull;
     std::vector<std::shared_ptr<IRenderer>> renderers;
+    std::vector<int> presentScreenIds;
+    std::vector<std::vector<uint64_t>> presentedHashes; // renderMutex, per renderer and screen, 0: unknown
+    std::vector<bool> rendererChanged; // renderMutex
+    PresentStats presentStats; // renderMutex
+    std::mutex renderMutex; // remote frames arrive on the io thread, plugin frames on their own threads
     boost::asio::io_service ioContext;
     boost::thread *ioThread;
     TcpServer tcpServer;
-//    UnixSocketServer unixServer;
+    UnixSocketServer unixServer;
     IpcServer ipcServer;
+    AppLauncher launcher;
     matrixserver::ServerConfig & serverConfig;
-    std::vector<std::shared_ptr<UniversalConnection>> connections;
+    Compositor compositor; // renderMutex
+    PostProcessor postProcessor; // renderMutex
+    int baseLayerId; // renderMutex, the foreground app's layer
+    CaptureRecorder recorder;
+    std::map<int, AppFrameRate> appFrameRates; // renderMutex
+    MetricsServer metricsServer;
+    std::shared_ptr<ClusterLeader> clusterLeader;
+    std::shared_ptr<ClusterFollower> clusterFollower;
+    std::shared_ptr<JitterBuffer> jitterBuffer;
+    std::vector<std::shared_ptr<UniversalConnection>> connections; // core thread only
     JoystickManager joystickmngr;
+    std::shared_ptr<matrixserver::MatrixServerMessage> frameAck;
+    boost::thread *inputThread;
+    std::mutex inputMutex;
+    std::condition_variable inputCondition;
+    bool inputChanged;
+    std::function<bool(ImuState &)> imuSource;
+    InputState inputBaseline;
+    InputState lastInput;
+    int inputAppId;
+    std::shared_ptr<matrixserver::MatrixServerMessage> inputMessage;
 };
 
 
@@ -0,0 +1,234 @@
+#include "Zygote.h"
+
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <Log.h>
+
+#include <SocketConnection.h>
+#include <FrameMessage.h>
+#include <FrameTimer.h>
+#include <InputState.h>
+#include <PluginApp.h>
+
+bool sendWithFd(int socket, const void *data, size_t length, int fd) {
+    struct iovec iov;
+    iov.iov_base = const_cast<void *>(data);
+    iov.iov_len = length;
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd >= 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    return sendmsg(socket, &msg, MSG_NOSIGNAL) == (ssize_t) length;
+}
+
+ssize_t receiveWithFd(int socket, void *data, size_t length, int &fd) {
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = length;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    fd = -1;
+    auto length_ = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); length_ >= 0 && cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    return length_;
+}
+
+static void reportEndedApps(int controlFd) {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        ZygoteReport report = {pid, status, 0};
+        send(controlFd, &report, sizeof(report), MSG_NOSIGNAL);
+    }
+}
+
+int runZygote(int controlFd) {
+    // SIGCHLD is only read through the signalfd, the children get the original mask back
+    sigset_t childSignal, previousMask;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, &previousMask);
+    int signalFd = signalfd(-1, &childSignal, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    struct pollfd fds[2];
+    fds[0].fd = controlFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = signalFd;
+    fds[1].events = POLLIN;
+    char path[PATH_MAX + 1];
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(signalFd, &info, sizeof(info)) == sizeof(info));
+            reportEndedApps(controlFd);
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            int connectionFd;
+            auto length = receiveWithFd(controlFd, path, PATH_MAX, connectionFd);
+            if (length <= 0)
+                break; // the launcher is gone
+            path[length] = '\0';
+            pid_t pid = connectionFd >= 0 ? fork() : -1;
+            if (pid == 0) {
+                close(controlFd);
+                close(signalFd);
+                sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+                setpgid(0, 0);
+                _exit(runPluginHost(path, connectionFd));
+            }
+            if (connectionFd >= 0)
+                close(connectionFd);
+            ZygoteReport report = {pid > 0 ? pid : 0, 0, 1};
+            send(controlFd, &report, sizeof(report), MSG_NOSIGNAL);
+        }
+    }
+    close(signalFd);
+    return 0;
+}
+
+int runPluginHost(const std::string &path, int connectionFd) {
+    boost::asio::io_service io;
+    auto connection = std::make_shared<SocketConnection>(io);
+    try {
+        connection->getSocket().assign(boost::asio::generic::stream_protocol(AF_UNIX, SOCK_STREAM), connectionFd);
+    } catch (boost::system::system_error &e) {
+        MATRIXLOG(error) << "[Zygote] " << e.what();
+        return 1;
+    }
+    PluginApp plugin(path);
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    int appId = 0;
+    bool configured = false;
+    bool frameInFlight = false;
+    matrixserver::ServerConfig serverConfig;
+    InputState input;
+    memset(&input, 0, sizeof(input));
+
+    // same handshake as MatrixApplication: registerApp, then getServerInfo
+    connection->setReceiveCallback([&](std::shared_ptr<UniversalConnection> con,
+                                       std::shared_ptr<matrixserver::MatrixServerMessage> message) {
+        switch (message->messagetype()) {
+            case matrixserver::registerApp:
+                if (message->status() == matrixserver::success) {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        appId = message->appid();
+                    }
+                    auto request = std::make_shared<matrixserver::MatrixServerMessage>();
+                    request->set_messagetype(matrixserver::getServerInfo);
+                    request->set_appid(message->appid());
+                    con->sendMessage(request);
+                }
+                break;
+            case matrixserver::getServerInfo: {
+                std::lock_guard<std::mutex> lock(mutex);
+                serverConfig.CopyFrom(message->serverconfig());
+                configured = true;
+            }
+                condition.notify_all();
+                break;
+            case matrixserver::setScreenFrame: {
+                std::lock_guard<std::mutex> lock(mutex);
+                frameInFlight = false;
+            }
+                condition.notify_all();
+                break;
+            case matrixserver::joystickData:
+            case matrixserver::imuData:
+                inputStateFromMessage(*message, input);
+                plugin.setInput(input);
+                break;
+            case matrixserver::appKill: {
+                auto response = std::make_shared<matrixserver::MatrixServerMessage>();
+                response->set_messagetype(matrixserver::appKill);
+                response->set_appid(appId);
+                response->set_status(matrixserver::success);
+                con->sendMessage(response);
+                plugin.kill();
+            }
+                break;
+            default:
+                break;
+        }
+    });
+    connection->startReceiving();
+    boost::thread ioThread([&io]() { io.run(); });
+
+    auto message = std::make_shared<matrixserver::MatrixServerMessage>();
+    message->set_messagetype(matrixserver::registerApp);
+    message->set_subscribeinput(true);
+    connection->sendMessage(message);
+
+    int exitCode = 1;
+    bool ready;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready = condition.wait_for(lock, std::chrono::milliseconds(ZYGOTESETUPTIMEOUT), [&]() { return configured; });
+    }
+    FrameMessage frameMessage;
+    plugin.setLauncher([&](const std::string &launchPath) {
+        auto request = std::make_shared<matrixserver::MatrixServerMessage>();
+        request->set_messagetype(matrixserver::launchApp);
+        request->set_appid(appId);
+        request->mutable_launchrequest()->set_path(launchPath);
+        connection->sendMessage(request);
+        return !connection->isDead();
+    });
+    if (ready && plugin.load() && plugin.start(serverConfig, [&](std::vector<std::shared_ptr<Screen>> &screens) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!condition.wait_for(lock, std::chrono::milliseconds(ZYGOTEFRAMEACKTIMEOUT),
+                                [&]() { return !frameInFlight; }))
+            return; // no ack for the last frame, drop this one
+        frameInFlight = true;
+        connection->sendMessage(frameMessage.encode(screens, appId));
+    })) {
+        while (!plugin.hasEnded()) {
+            if (connection->isDead())
+                plugin.kill();
+            if (plugin.checkWatchdog(FrameTimer::nowNs()))
+                _exit(1); // the plugin thread can't be stopped
+            usleep(10000);
+        }
+        exitCode = plugin.getState() == PluginState::ended ? 0 : 1;
+        plugin.unload();
+    } else {
+        MATRIXLOG(error) << "[Zygote] can't start " << path;
+    }
+    io.stop();
+    ioThread.join();
+    return exitCode;
+}
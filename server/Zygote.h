@@ -0,0 +1,42 @@
+#ifndef MATRIXSERVER_ZYGOTE_H
+#define MATRIXSERVER_ZYGOTE_H
+
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ZYGOTEFDENVVARIABLE "MATRIXZYGOTE_FD" // control socket of the zygote, set by the launcher
+#define ZYGOTESETUPTIMEOUT 2000 //ms a forked app waits for its registration at the server
+#define ZYGOTEFRAMEACKTIMEOUT 1000 //ms a forked app waits for the ack of its last frame
+
+/*
+ * The zygote is a process which has the server's common library, protobuf and boost (and whatever
+ * it was told to preload) loaded and initialised, but no threads. For every launch request of the
+ * AppLauncher it forks, the child loads the app plugin and runs it as an ordinary remote app on the
+ * connection which came with the request. Nothing has to be loaded or relocated at launch time
+ * and the pages stay shared with the zygote.
+ *
+ * Control protocol, SOCK_SEQPACKET, one datagram per message:
+ *   launcher -> zygote: plugin path, the app's end of the connection as SCM_RIGHTS
+ *   zygote -> launcher: ZygoteReport
+ */
+
+struct ZygoteReport {
+    int32_t pid;     // 0 if the fork failed
+    int32_t status;  // waitpid() status of an ended app
+    int32_t spawned; // 1: answer to a launch request, 0: an app ended
+};
+
+// main loop of the zygote process, returns once the launcher closed the control socket
+int runZygote(int controlFd);
+
+// runs the plugin at path as a remote app on an already connected socket, returns the exit code
+int runPluginHost(const std::string &path, int connectionFd);
+
+bool sendWithFd(int socket, const void *data, size_t length, int fd);
+
+// fd is -1 if the message carried none
+ssize_t receiveWithFd(int socket, void *data, size_t length, int &fd);
+
+
+#endif //MATRIXSERVER_ZYGOTE_H
@@ -0,0 +1,29 @@
+#include <iostream>
+#include <vector>
+#include <Log.h>
+
+#include <Server.h>
+#include <NullRenderer.h>
+
+#include <CubeConfig.h>
+#include <matrixserver.pb.h>
+
+// a server without a display, for benchmarks and for running several servers of a cluster on one host
+int main(int argc, char **argv) {
+    matrixserver::ServerConfig serverConfig;
+    if (!loadServerConfig(argc, argv, serverConfig))
+        return 1;
+
+    MATRIXLOG(info) << "ServerConfig: " << std::endl << serverConfig.DebugString() << std::endl;
+
+    auto screens = createScreens(serverConfig);
+
+    auto renderer = std::make_shared<NullRenderer>(screens);
+
+    Server server(renderer, serverConfig);
+
+    while (server.tick())
+        usleep(100000);
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <AppPlugin.h>
+#include <stdexcept>
+#include <cstdlib>
+#include <unistd.h>
+
+// app plugin for tests-plugin.cpp, the server name of the config selects what it does
+class TestPlugin : public IAppPlugin {
+public:
+    TestPlugin() {
+        if (getenv("TESTPLUGIN_CONSTRUCTOR_THROWS") != nullptr)
+            throw std::runtime_error("test");
+    }
+
+    void attach(std::vector<std::shared_ptr<Screen>> setScreens, const matrixserver::ServerConfig &serverConfig) {
+        screens = setScreens;
+        mode = serverConfig.servername();
+    }
+
+    bool loop() {
+        frame++;
+        for (auto &screen : screens)
+            screen->fill(Color(frame, lastButton, 0));
+        if (frame == 5) {
+            if (mode == "crash")
+                *(volatile int *) nullptr = 1;
+            if (mode == "throw")
+                throw std::runtime_error("test");
+            if (mode == "hang")
+                while (true)
+                    sleep(1);
+        }
+        return mode != "end" || frame < 10;
+    }
+
+    int getFps() {
+        return 200;
+    }
+
+    void setInput(const InputState &input) {
+        lastButton = input.joysticks[0].buttonPressCount[0];
+    }
+
+    void setLauncher(AppLaunchFunction) {}
+
+private:
+    std::vector<std::shared_ptr<Screen>> screens;
+    std::string mode;
+    uint8_t frame = 0;
+    uint8_t lastButton = 0;
+};
+
+MATRIXAPPLICATION_PLUGIN_EXPORT(TestPlugin)
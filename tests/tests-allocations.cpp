@@ -0,0 +1,51 @@
+#include "catch.hpp"
+#include <Cobs.h>
+#include <Screen.h>
+#include <FrameMessage.h>
+#include <matrixserver.pb.h>
+#include <Log.h>
+#include <Metrics.h>
+
+TEST_CASE("frame hot path allocations benchmark", "[allocations]") {
+    auto logLevel = Log::getLevel();
+    Log::setLevel(LogLevel::debug); // like app and server, trace logs are compiled in outside of Release builds
+    std::vector<std::shared_ptr<Screen>> screens;
+    for (int i = 0; i < 6; i++) {
+        screens.push_back(std::make_shared<Screen>(64, 64, i));
+        screens.back()->fill(Color::random());
+    }
+    FrameMessage frameMessage;
+    Cobs cobsDecoder(100000);
+    std::string serializeBuffer, sendBuffer;
+    auto receiveMessage = std::make_shared<matrixserver::MatrixServerMessage>();
+    int receivedScreens = 0;
+    auto parsePacket = [&](const std::string &packet) {
+        if (receiveMessage->ParseFromArray(packet.data(), packet.size()))
+            receivedScreens += receiveMessage->screendata_size();
+    };
+
+    // encode -> serialize -> COBS -> stream decode -> parse, like a frame from app to server over a socket
+    auto frame = [&]() {
+        frameMessage.encode(screens, 42)->SerializeToString(&serializeBuffer);
+        Cobs::encode(serializeBuffer, sendBuffer);
+        // a single pointer capture fits into std::function without allocating, like [this] in SocketConnection
+        cobsDecoder.insertBytes((const uint8_t *) sendBuffer.data(), sendBuffer.size(),
+                                [&parsePacket](const std::string &packet) { parsePacket(packet); });
+    };
+
+    for (int i = 0; i < 3; i++)
+        frame(); // warm up, buffers grow to frame size
+
+    const int frames = 100;
+    receivedScreens = 0;
+    uint64_t startCount = Metrics::getAllocations();
+    for (int i = 0; i < frames; i++)
+        frame();
+    uint64_t allocations = Metrics::getAllocations() - startCount;
+
+    WARN("Heap allocations per frame in the steady state: " << (float) allocations / frames);
+    CHECK(receivedScreens == frames * 6);
+    CHECK(receiveMessage->screendata(5).framedata().size() == 64 * 64 * sizeof(Color));
+    Log::setLevel(logLevel);
+    CHECK(allocations == 0);
+}
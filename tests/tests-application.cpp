@@ -0,0 +1,66 @@
+#include "catch.hpp"
+#include "../application/MatrixApplication.h"
+#include <CubeConfig.h>
+#include <UnixSocketClient.h>
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class FillApp : public MatrixApplication {
+public:
+    FillApp() : MatrixApplication(MAXFPS) {}
+
+    bool loop() {
+        for (auto &screen : screens)
+            screen->fill(Color::red());
+        return true;
+    }
+};
+
+TEST_CASE("MatrixApplication keeps sending frames after an ack got lost", "[application]") {
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    // the app runs until the process exits (MatrixApplication::stop() exits), so the server side
+    // has to stay as well: the io thread never ends and keeps io and the connection
+    auto io = new boost::asio::io_service();
+    auto server = UnixSocketClient::adopt(*io, fds[0]);
+    std::atomic<int> frames(0);
+    server->setReceiveCallback([&frames](std::shared_ptr<UniversalConnection> connection,
+                                         std::shared_ptr<matrixserver::MatrixServerMessage> message) {
+        auto response = std::make_shared<matrixserver::MatrixServerMessage>();
+        response->set_messagetype(message->messagetype());
+        response->set_appid(1);
+        response->set_status(matrixserver::success);
+        switch (message->messagetype()) {
+            case matrixserver::registerApp:
+                break;
+            case matrixserver::getServerInfo:
+                createDefaultCubeConfig(*response->mutable_serverconfig());
+                break;
+            case matrixserver::setScreenFrame:
+                if (++frames == 3)
+                    return; // lost
+                break;
+            default:
+                return;
+        }
+        connection->sendMessage(response);
+    });
+    new boost::thread([io, server]() { io->run(); });
+
+    setenv(LAUNCHERFDENVVARIABLE, std::to_string(fds[1]).c_str(), 1);
+    auto app = new FillApp();
+    CHECK(app->getTransport() == TransportType::unixSocket);
+    app->start();
+
+    // about FRAMEACKTIMEOUT without frames, then the app goes on at its frame rate
+    for (int i = 0; i < 3000 && frames < 10; i++)
+        usleep(1000);
+    CHECK(frames >= 10);
+
+    auto pause = std::make_shared<matrixserver::MatrixServerMessage>();
+    pause->set_messagetype(matrixserver::appPause);
+    server->sendMessage(pause);
+}
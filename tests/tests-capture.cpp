@@ -0,0 +1,84 @@
+#include "catch.hpp"
+#include <FrameCapture.h>
+#include <CubeConfig.h>
+#include <FrameMessage.h>
+#include <FrameTimer.h>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+// its own file for every run, test runs on the same host don't share it
+static std::string makeCapturePath() {
+    char path[] = "/tmp/matrixserver-test-capture-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0)
+        close(fd);
+    return path;
+}
+
+TEST_CASE("Capture replays frames, messages and keyframes", "[capture]") {
+    auto capturePath = makeCapturePath();
+    matrixserver::ServerConfig serverConfig;
+    createDefaultCubeConfig(serverConfig);
+    auto screens = createScreens(serverConfig);
+    FrameMessage frameMessage;
+    int frames = CAPTUREKEYINTERVAL * 2 + 10;
+    int64_t start = FrameTimer::nowNs();
+    {
+        CaptureRecorder recorder;
+        REQUIRE(recorder.open(capturePath, serverConfig));
+        matrixserver::MatrixServerMessage registerApp;
+        registerApp.set_messagetype(matrixserver::registerApp);
+        registerApp.set_appid(42);
+        recorder.recordMessage(registerApp, start);
+        for (int frame = 0; frame < frames; frame++) {
+            for (auto &screen : screens)
+                screen->fill(Color::black());
+            screens[frame % 6]->setPixel(frame % 64, 3, Color(frame, 1, 2));
+            if (frame % 2 == 0) {
+                recorder.recordMessage(*frameMessage.encode(screens, 42), start + (frame + 1) * 1000000LL);
+            } else {
+                recorder.recordFrame(7, screens, start + (frame + 1) * 1000000LL);
+            }
+        }
+        auto stats = recorder.getStats();
+        CHECK(stats.frames == (uint64_t) frames);
+        CHECK(stats.keyframes == 2);
+        CHECK(stats.fileBytes < stats.rawBytes / 50);
+        CHECK(access((capturePath + CAPTURETEMPSUFFIX).c_str(), F_OK) == 0); // not in place before it is complete
+        recorder.close();
+        CHECK(access((capturePath + CAPTURETEMPSUFFIX).c_str(), F_OK) != 0);
+    }
+
+    CaptureReader reader;
+    REQUIRE(reader.open(capturePath));
+    CHECK(reader.getServerConfig().screeninfo_size() == 6);
+    REQUIRE(reader.getIndex().size() == 3);
+    CHECK(reader.getIndex()[1].frame == CAPTUREKEYINTERVAL);
+
+    CaptureEvent event;
+    REQUIRE(reader.next(event));
+    CHECK(event.message.messagetype() == matrixserver::registerApp);
+    CHECK(event.message.appid() == 42);
+    for (int frame = 0; frame < frames; frame++) {
+        REQUIRE(reader.next(event));
+        REQUIRE(event.timestampNs == start + (frame + 1) * 1000000LL);
+        REQUIRE(event.message.appid() == (frame % 2 == 0 ? 42 : 7));
+        REQUIRE(event.message.screendata_size() == 6);
+        const Color *screen = reader.getScreen(frame % 6);
+        REQUIRE(screen[(frame % 64) * 64 + 3] == Color(frame, 1, 2));
+        REQUIRE(reader.getScreen((frame + 1) % 6)[((frame + 63) % 64) * 64 + 3] == Color::black());
+    }
+    CHECK_FALSE(reader.next(event));
+
+    // into the second keyframe, the screens are complete right away
+    reader.seek(start + (CAPTUREKEYINTERVAL * 2 + 5) * 1000000LL);
+    REQUIRE(reader.next(event));
+    CHECK(event.timestampNs == start + (CAPTUREKEYINTERVAL * 2 + 1) * 1000000LL);
+    int frame = CAPTUREKEYINTERVAL * 2;
+    CHECK(reader.getScreen(frame % 6)[(frame % 64) * 64 + 3] == Color(frame, 1, 2));
+    reader.fillFrame(event.message);
+    CHECK(event.message.screendata(0).framedata().size() == 64 * 64 * 3);
+    reader.close();
+    unlink(capturePath.c_str());
+}
@@ -0,0 +1,340 @@
+#include "catch.hpp"
+#include <ClockSync.h>
+#include <FrameDelta.h>
+#include <FramePresenter.h>
+#include <FrameMirror.h>
+#include <FrameMessage.h>
+#include <FrameTimer.h>
+#include <TcpClient.h>
+#include <google/protobuf/util/json_util.h>
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <fstream>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+TEST_CASE("ClockOffsetEstimator takes the exchange with the shortest round trip", "[cluster]") {
+    ClockOffsetEstimator clock;
+    CHECK_FALSE(clock.isSynchronized());
+    const int64_t offset = 5000000000LL; // the remote clock is 5 s ahead
+    int64_t local = 1000000;
+    // 100 us each way, 20 us to answer, the return path is congested for all but one exchange
+    for (int i = 0; i < CLOCKSYNCSAMPLES; i++) {
+        int64_t back = i == 7 ? 100000 : 100000 + 3000000;
+        int64_t t0 = local;
+        int64_t t1 = t0 + 100000 + offset;
+        int64_t t2 = t1 + 20000;
+        int64_t t3 = t2 - offset + back;
+        clock.addSample(t0, t1, t2, t3);
+        local += 10000000;
+    }
+    REQUIRE(clock.isSynchronized());
+    CHECK(clock.getOffsetNs() == offset);
+    CHECK(clock.getDelayNs() == 200000);
+    CHECK(clock.toLocal(offset + 42) == 42);
+    CHECK(clock.toRemote(42) == offset + 42);
+
+    // the good exchange ages out, the estimate is off by half the asymmetry then
+    for (int i = 0; i < CLOCKSYNCSAMPLES; i++)
+        clock.addSample(local, local + 100000 + offset, local + 120000 + offset, local + 3220000);
+    CHECK(clock.getOffsetNs() == offset - 1500000);
+    clock.reset();
+    CHECK_FALSE(clock.isSynchronized());
+}
+
+TEST_CASE("FrameDelta only holds the changed spans of a screen", "[cluster]") {
+    std::vector<uint8_t> previous(1000, 7), current(1000, 7), out(FRAMEDELTAMAXSIZE(1000));
+    CHECK(encodeFrameDelta(previous.data(), current.data(), 1000, out.data()) == 0);
+
+    current[3] = 1;
+    current[10] = 2; // close enough to be in the same span
+    current[500] = 3;
+    current[999] = 4;
+    auto length = encodeFrameDelta(previous.data(), current.data(), 1000, out.data());
+    CHECK(length == 3 * 8 + 8 + 1 + 1);
+    CHECK(applyFrameDelta(previous.data(), 1000, out.data(), length));
+    CHECK(previous == current);
+    CHECK_FALSE(applyFrameDelta(previous.data(), 999, out.data(), length));
+    CHECK_FALSE(applyFrameDelta(previous.data(), 1000, out.data(), length - 1));
+
+    // every other byte changed, the delta is longer than the screen but within FRAMEDELTAMAXSIZE
+    for (size_t i = 0; i < current.size(); i += 2)
+        current[i]++;
+    length = encodeFrameDelta(previous.data(), current.data(), 1000, out.data());
+    CHECK(length > 1000);
+    CHECK(length <= out.size());
+    CHECK(applyFrameDelta(previous.data(), 1000, out.data(), length));
+    CHECK(previous == current);
+}
+
+TEST_CASE("FramePresenter presents frames at their time", "[cluster]") {
+    std::vector<int64_t> presentedAt;
+    std::vector<std::vector<bool>> presentedScreens;
+    std::vector<uint8_t> presentedRed;
+    FramePresenter presenter({4, 4}, [&](ScheduledFrame &frame) {
+        presentedAt.push_back(FrameTimer::nowNs() - frame.presentAtNs);
+        presentedScreens.push_back(frame.changed);
+        presentedRed.push_back(frame.changed[1] ? frame.screens[1][0].r() : 0);
+    });
+    std::vector<Color> screen(4, Color(7, 0, 0));
+    auto start = FrameTimer::nowNs();
+    presenter.schedule(start + 20000000, 100, {screen.data(), nullptr});
+    presenter.schedule(start + 40000000, 100, {nullptr, screen.data()});
+    usleep(60000);
+    presenter.flush();
+    REQUIRE(presentedAt.size() == 2);
+    CHECK(presentedAt[0] >= 0);
+    CHECK(presentedAt[0] < 10000000);
+    CHECK(presentedScreens[0] == std::vector<bool>({true, false}));
+    CHECK(presentedScreens[1] == std::vector<bool>({false, true}));
+
+    // due at once: only the newest is presented, with the screens of the older one
+    start = FrameTimer::nowNs();
+    presenter.schedule(start - 2000000, 100, {screen.data(), nullptr});
+    screen[0] = Color(9, 0, 0);
+    presenter.schedule(start - 1000000, 100, {nullptr, screen.data()});
+    usleep(20000);
+    presenter.flush();
+    auto stats = presenter.getStats();
+    CHECK(stats.frames + stats.merged == 4);
+    CHECK(presentedScreens.back() == std::vector<bool>({true, true}));
+    CHECK(presentedRed.back() == 9);
+}
+
+// different ports nothing listens on right now, taken from the kernel
+static std::vector<std::string> freePorts(size_t count) {
+    boost::asio::io_service io;
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::acceptor>> acceptors;
+    std::vector<std::string> ports;
+    for (size_t i = 0; i < count; i++) {
+        acceptors.emplace_back(new boost::asio::ip::tcp::acceptor(
+                io, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 0)));
+        ports.push_back(std::to_string(acceptors.back()->local_endpoint().port()));
+    }
+    return ports;
+}
+
+// server processes on this host, each with its own ports, sockets and frame mirror, also across test runs
+class ClusterNode {
+public:
+    ClusterNode(const std::string &setName, matrixserver::ServerConfig config) : pid(0) {
+        auto name = setName + "-" + std::to_string(getpid());
+        mirrorName = "/matrixserver-test-" + name;
+        configPath = "/tmp/matrixserver-test-" + name + ".json";
+        config.set_unixsocketpath("/tmp/matrixserver-test-" + name + ".sock");
+        config.set_ipcaddress("matrixserver-test-" + name);
+        config.set_mirrorname(mirrorName);
+        std::string json;
+        google::protobuf::util::MessageToJsonString(config, &json);
+        std::ofstream(configPath) << json;
+        pid = fork();
+        if (pid == 0) {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            execl(SERVERNULLPATH, SERVERNULLPATH, configPath.c_str(), (char *) nullptr);
+            _exit(127);
+        }
+    }
+
+    ~ClusterNode() {
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+        shm_unlink(mirrorName.c_str());
+        unlink(configPath.c_str());
+    }
+
+    bool openMirror(FrameMirrorReader &reader) {
+        for (int i = 0; i < 500; i++) {
+            if (reader.open(mirrorName))
+                return true;
+            usleep(10000);
+        }
+        return false;
+    }
+
+    std::string mirrorName;
+    std::string configPath;
+    pid_t pid;
+};
+
+static matrixserver::ServerConfig clusterNodeConfig(const std::string &port, int firstScreenId,
+                                                    const std::string &clusterPort) {
+    matrixserver::ServerConfig config;
+    config.mutable_serverconnection()->set_serveraddress("127.0.0.1");
+    config.mutable_serverconnection()->set_serverport(port);
+    for (int i = 0; i < 2; i++) {
+        auto *screenInfo = config.add_screeninfo();
+        screenInfo->set_screenid(i);
+        screenInfo->set_width(16);
+        screenInfo->set_height(16);
+        auto *remote = config.mutable_cluster()->add_remotescreeninfo();
+        *remote = *screenInfo;
+        remote->set_screenid(firstScreenId + i);
+    }
+    config.mutable_cluster()->set_port(std::stoi(clusterPort));
+    config.mutable_cluster()->set_presentationdelayms(30);
+    return config;
+}
+
+TEST_CASE("A cluster of server processes presents the display in sync", "[cluster]") {
+    auto ports = freePorts(3);
+    auto leaderConfig = clusterNodeConfig(ports[0], 2, ports[1]);
+    leaderConfig.mutable_cluster()->set_role(matrixserver::ClusterConfig::leader);
+    ClusterNode leader("leader", leaderConfig);
+    FrameMirrorReader leaderMirror;
+    REQUIRE(leader.openMirror(leaderMirror));
+
+    auto followerConfig = clusterNodeConfig(ports[2], 0, ports[1]);
+    followerConfig.mutable_cluster()->clear_remotescreeninfo();
+    followerConfig.mutable_cluster()->set_role(matrixserver::ClusterConfig::follower);
+    followerConfig.mutable_cluster()->set_firstscreenid(2);
+    ClusterNode follower("follower", followerConfig);
+    FrameMirrorReader followerMirror;
+    REQUIRE(follower.openMirror(followerMirror));
+    usleep(300000); // joined and the clock exchanges done
+
+    // an app on the leader draws on the display of both
+    boost::asio::io_service io;
+    auto connection = TcpClient::connect(io, "127.0.0.1", ports[0]);
+    REQUIRE_FALSE(connection->isDead());
+    std::atomic<int> appId(0);
+    std::atomic<int> acks(0);
+    connection->setReceiveCallback([&](std::shared_ptr<UniversalConnection>, std::shared_ptr<matrixserver::MatrixServerMessage> message) {
+        if (message->messagetype() == matrixserver::registerApp)
+            appId = message->appid();
+        if (message->messagetype() == matrixserver::setScreenFrame)
+            acks++;
+    });
+    boost::thread ioThread([&io]() { io.run(); });
+    auto registerApp = std::make_shared<matrixserver::MatrixServerMessage>();
+    registerApp->set_messagetype(matrixserver::registerApp);
+    connection->sendMessage(registerApp);
+    for (int i = 0; i < 200 && appId == 0; i++)
+        usleep(10000);
+    REQUIRE(appId != 0);
+
+    std::vector<std::shared_ptr<Screen>> display;
+    for (int i = 0; i < 4; i++)
+        display.push_back(std::make_shared<Screen>(16, 16, i));
+    FrameMessage frameMessage;
+    const int frames = 20;
+    for (int frame = 1; frame <= frames; frame++) {
+        for (int i = 0; i < 4; i++)
+            display[i]->fill(frame, i, 0);
+        display[3]->setPixel(frame % 16, 0, Color::white()); // a small change, sent as a delta
+        int before = acks;
+        connection->sendMessage(frameMessage.encode(display, appId));
+        for (int wait = 0; wait < 200 && acks == before; wait++)
+            usleep(1000);
+        usleep(25000);
+    }
+    usleep(100000); // the last frame is presented
+
+    auto leaderScreens = leaderMirror.createScreens();
+    auto followerScreens = followerMirror.createScreens();
+    REQUIRE(leaderScreens.size() == 2);
+    REQUIRE(followerScreens.size() == 2);
+    FrameMirrorInfo leaderInfo, followerInfo;
+    REQUIRE(leaderMirror.read(leaderScreens, leaderInfo));
+    REQUIRE(followerMirror.read(followerScreens, followerInfo));
+    CHECK(leaderScreens[1]->getPixel(5, 5) == Color(frames, 1, 0));
+    CHECK(followerScreens[0]->getPixel(5, 5) == Color(frames, 2, 0));
+    CHECK(followerScreens[1]->getPixel(5, 5) == Color(frames, 3, 0));
+    CHECK(followerScreens[1]->getPixel(frames % 16, 0) == Color::white());
+    CHECK(followerScreens[1]->getPixel((frames - 1) % 16, 0) == Color(frames, 3, 0));
+    // both showed the last frame at its presentation time, the same host has one clock
+    INFO("leader " << leaderInfo.timestampNs << " ns, follower " << followerInfo.timestampNs << " ns");
+    CHECK(std::abs(leaderInfo.timestampNs - followerInfo.timestampNs) < 5000000);
+
+    io.stop();
+    ioThread.join();
+}
+
+TEST_CASE("A server presents the frames an app sends ahead at their time", "[jitter]") {
+    auto ports = freePorts(2);
+    auto config = clusterNodeConfig(ports[0], 2, ports[1]);
+    config.clear_cluster();
+    ClusterNode server("scheduled", config);
+    FrameMirrorReader mirror;
+    REQUIRE(server.openMirror(mirror));
+
+    boost::asio::io_service io;
+    auto connection = TcpClient::connect(io, "127.0.0.1", ports[0]);
+    REQUIRE_FALSE(connection->isDead());
+    std::atomic<int> appId(0);
+    std::atomic<int> acks(0);
+    std::atomic<int64_t> serverReceived(0);
+    connection->setReceiveCallback([&](std::shared_ptr<UniversalConnection>, std::shared_ptr<matrixserver::MatrixServerMessage> message) {
+        if (message->messagetype() == matrixserver::registerApp)
+            appId = message->appid();
+        if (message->messagetype() == matrixserver::setScreenFrame)
+            acks++;
+        if (message->messagetype() == matrixserver::clusterSync)
+            serverReceived = message->clustersync().receivens();
+    });
+    boost::thread ioThread([&io]() { io.run(); });
+    auto registerApp = std::make_shared<matrixserver::MatrixServerMessage>();
+    registerApp->set_messagetype(matrixserver::registerApp);
+    connection->sendMessage(registerApp);
+    for (int i = 0; i < 200 && appId == 0; i++)
+        usleep(10000);
+    REQUIRE(appId != 0);
+
+    // the clock exchange an app on another host needs, the same host has one clock
+    auto sync = std::make_shared<matrixserver::MatrixServerMessage>();
+    sync->set_messagetype(matrixserver::clusterSync);
+    auto syncSent = FrameTimer::nowNs();
+    sync->mutable_clustersync()->set_originns(syncSent);
+    connection->sendMessage(sync);
+    for (int i = 0; i < 200 && serverReceived == 0; i++)
+        usleep(1000);
+    CHECK(serverReceived >= syncSent);
+    CHECK(serverReceived <= FrameTimer::nowNs());
+
+    // a burst of frames, shown 20 ms apart from 150 ms on
+    std::vector<std::shared_ptr<Screen>> screens;
+    for (int i = 0; i < 2; i++)
+        screens.push_back(std::make_shared<Screen>(16, 16, i));
+    FrameMessage frameMessage;
+    const int frames = 5;
+    auto start = FrameTimer::nowNs() + 150000000;
+    for (int frame = 1; frame <= frames; frame++) {
+        for (auto &screen : screens)
+            screen->fill(frame, 0, 0);
+        auto message = frameMessage.encode(screens, appId);
+        message->set_presentatns(start + (frame - 1) * 20000000LL);
+        int before = acks;
+        connection->sendMessage(message);
+        for (int wait = 0; wait < 200 && acks == before; wait++)
+            usleep(1000);
+    }
+    // all acked right away, nothing shown yet
+    CHECK(acks == frames);
+    CHECK(FrameTimer::nowNs() < start);
+    auto screensRead = mirror.createScreens();
+    FrameMirrorInfo info;
+    REQUIRE(mirror.read(screensRead, info));
+    CHECK(screensRead[0]->getPixel(5, 5) != Color(1, 0, 0));
+
+    usleep((start - FrameTimer::nowNs()) / 1000 + 5000);
+    REQUIRE(mirror.read(screensRead, info));
+    CHECK(screensRead[0]->getPixel(5, 5) == Color(1, 0, 0));
+    CHECK(info.timestampNs >= start);
+    CHECK(info.timestampNs < start + 5000000);
+
+    usleep(frames * 20000);
+    REQUIRE(mirror.read(screensRead, info));
+    CHECK(screensRead[1]->getPixel(5, 5) == Color(frames, 0, 0));
+    CHECK(info.timestampNs >= start + (frames - 1) * 20000000LL);
+    CHECK(info.timestampNs < start + (frames - 1) * 20000000LL + 5000000);
+
+    io.stop();
+    ioThread.join();
+}
@@ -165,7 +165,7 @@ const std::string test7((const char *) test_string_7, sizeof(test_string_7));
 const std::string test7_result((const char *) test_string_7_result, sizeof(test_string_7_result));
 
 
-std::string getHexArrayString(const uint8_t *data, size_t length) {
+static std::string getHexArrayString(const uint8_t *data, size_t length) {
     std::stringstream result;
     for (int i = 0; i < length; i++) {
         result << "0x" << std::hex << (int) data[i] << ", ";
@@ -173,7 +173,7 @@ std::string getHexArrayString(const uint8_t *data, size_t length) {
     return result.str();
 }
 
-std::string getHexArrayString(std::string input) {
+static std::string getHexArrayString(std::string input) {
     return getHexArrayString((const uint8_t *) input.data(), input.size());
 }
 
@@ -0,0 +1,127 @@
+#include "catch.hpp"
+#include <Compositor.h>
+#include <CubeConfig.h>
+#include <Screen.h>
+#include <map>
+#include <cmath>
+
+struct ComposedScreens {
+    std::map<int, std::vector<Color>> screens;
+    int calls = 0;
+
+    std::function<void(int, Color *)> output() {
+        return [this](int screenId, Color *data) {
+            screens[screenId].assign(data, data + 64 * 64);
+            calls++;
+        };
+    }
+
+    Color pixel(int screenId, int x, int y) {
+        return screens[screenId][x * 64 + y]; // column by column like Screen
+    }
+};
+
+TEST_CASE("alphaOver rounds like the exact blend", "[compositor]") {
+    std::vector<Color> source(256), destination(256), result(256);
+    for (int i = 0; i < 256; i++) {
+        source[i] = Color(i, 255 - i, i / 2);
+        destination[i] = Color(255 - i, i, 200);
+    }
+    for (int alpha : {0, 1, 64, 127, 128, 200, 254, 255}) {
+        result = destination;
+        Compositor::alphaOver(result.data(), source.data(), result.size(), alpha, false);
+        for (int i = 0; i < 256; i++) {
+            auto expected = [&](int s, int d) { return (int) std::lround((s * alpha + d * (255 - alpha)) / 255.0); };
+            REQUIRE(result[i].r() == expected(source[i].r(), destination[i].r()));
+            REQUIRE(result[i].g() == expected(source[i].g(), destination[i].g()));
+            REQUIRE(result[i].b() == expected(source[i].b(), destination[i].b()));
+        }
+    }
+
+    // unlit source pixels keep the destination
+    std::vector<Color> overlay = {Color::black(), Color::red()};
+    std::vector<Color> below = {Color::blue(), Color::blue()};
+    Compositor::alphaOver(below.data(), overlay.data(), 2, 255, true);
+    CHECK(below[0] == Color::blue());
+    CHECK(below[1] == Color::red());
+}
+
+TEST_CASE("Compositor stacks layers by z and regions", "[compositor]") {
+    matrixserver::ServerConfig serverConfig;
+    createDefaultCubeConfig(serverConfig);
+    Compositor compositor(serverConfig);
+    ComposedScreens composed;
+
+    Screen base(64, 64, 0), overlay(64, 64, 0);
+    base.fill(Color::blue());
+    overlay.fill(Color::red());
+
+    LayerConfig corner;
+    corner.z = 1;
+    corner.regions.push_back({0, 0, 0, 8, 8});
+    compositor.setLayer(2, corner); // added first, still on top
+    compositor.setLayer(1, LayerConfig());
+    compositor.setLayerFrame(1, 0, base.getScreenDataRaw(), 64 * 64);
+    compositor.setLayerFrame(2, 0, overlay.getScreenDataRaw(), 64 * 64);
+    compositor.setLayerFrame(2, 1, overlay.getScreenDataRaw(), 64 * 64); // not its screen, ignored
+
+    CHECK(compositor.compose(composed.output()) == 6);
+    CHECK(composed.pixel(0, 0, 0) == Color::red());
+    CHECK(composed.pixel(0, 7, 7) == Color::red());
+    CHECK(composed.pixel(0, 8, 7) == Color::blue());
+    CHECK(composed.pixel(1, 0, 0) == Color::black()); // no frame for it yet
+    CHECK(compositor.getLayerIds() == std::vector<int>({1, 2}));
+
+    // half transparent over the whole screen
+    corner.opacity = 128;
+    corner.regions.clear();
+    compositor.setLayer(2, corner);
+    compositor.setLayerFrame(2, 0, overlay.getScreenDataRaw(), 64 * 64);
+    compositor.compose(composed.output());
+    CHECK(composed.pixel(0, 32, 32) == Color(128, 0, 127));
+
+    compositor.removeLayer(2);
+    compositor.compose(composed.output());
+    CHECK(composed.pixel(0, 0, 0) == Color::blue());
+    CHECK(compositor.getLayerCount() == 1);
+}
+
+TEST_CASE("Compositor skips unchanged screens and caches the layers below a change", "[compositor]") {
+    matrixserver::ServerConfig serverConfig;
+    createDefaultCubeConfig(serverConfig);
+    Compositor compositor(serverConfig);
+    ComposedScreens composed;
+
+    Screen base(64, 64, 0), overlay(64, 64, 0);
+    base.fill(Color::green());
+    LayerConfig top;
+    top.z = 1;
+    top.blackIsTransparent = true;
+    top.regions.push_back({5, 0, 0, 0, 0}); // all of screen 5
+    compositor.setLayer(1, LayerConfig());
+    compositor.setLayer(2, top);
+    for (int screen = 0; screen < 6; screen++)
+        compositor.setLayerFrame(1, screen, base.getScreenDataRaw(), 64 * 64);
+    compositor.compose(composed.output());
+    REQUIRE(composed.calls == 6);
+
+    // only the overlay on screen 5 animates
+    for (int frame = 0; frame < 10; frame++) {
+        overlay.clear();
+        overlay.setPixel(frame, 0, Color::white());
+        compositor.setLayerFrame(2, 5, overlay.getScreenDataRaw(), 64 * 64);
+        CHECK(compositor.compose(composed.output()) == 1);
+        CHECK(composed.pixel(5, frame, 0) == Color::white());
+        CHECK(composed.pixel(5, frame + 1, 0) == Color::green());
+    }
+    auto stats = compositor.getStats();
+    CHECK(stats.screensUnchanged == 50);
+    CHECK(stats.layersCached == 9); // the base layer was blended into the cache once
+    CHECK(stats.compositions == 11);
+
+    CHECK(compositor.compose(composed.output()) == 0);
+
+    // too short frames are ignored
+    compositor.setLayerFrame(1, 0, base.getScreenDataRaw(), 100);
+    CHECK(compositor.compose(composed.output()) == 0);
+}
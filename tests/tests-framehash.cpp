@@ -0,0 +1,30 @@
+#include "catch.hpp"
+#include <FrameHash.h>
+#include <Screen.h>
+#include <string>
+#include <vector>
+
+TEST_CASE("frameHash is XXH64", "[framehash]") {
+    auto hash = [](const std::string &text) { return frameHash(text.data(), text.size()); };
+    CHECK(hash("") == 0xEF46DB3751D8E999ULL);
+    CHECK(hash("a") == 0xD24EC4F1A98C6E5BULL);
+    CHECK(hash("abc") == 0x44BC2CF5AD770999ULL);
+    CHECK(hash("Nobody inspects the spammish repetition") == 0xFBCEA83C8A378BF1ULL);
+}
+
+TEST_CASE("frameHash sees every pixel of a screen", "[framehash]") {
+    Screen screen(64, 64, 0);
+    screen.fill(Color::blue());
+    size_t length = 64 * 64 * sizeof(Color);
+    auto blue = frameHash(screen.getScreenDataRaw(), length);
+    CHECK(frameHash(screen.getScreenDataRaw(), length) == blue);
+    CHECK(frameHash(screen.getScreenDataRaw(), length, 1) != blue);
+
+    // the first and last byte, and one in the tail of the 32 byte rounds
+    std::vector<uint64_t> hashes = {blue};
+    for (auto position : {std::make_pair(0, 0), std::make_pair(63, 63), std::make_pair(63, 62)}) {
+        screen.setPixel(position.first, position.second, Color::red());
+        hashes.push_back(frameHash(screen.getScreenDataRaw(), length));
+        REQUIRE(hashes.back() != hashes[hashes.size() - 2]);
+    }
+}
@@ -0,0 +1,51 @@
+#include "catch.hpp"
+#include <FrameTimer.h>
+#include <unistd.h>
+
+TEST_CASE("FrameTimer keeps the frame rate without drift", "[frametimer]") {
+    const int frames = 50;
+    FrameTimer timer(200); // 5ms period
+    auto start = FrameTimer::nowNs();
+    timer.start();
+    for (int i = 0; i < frames; i++) {
+        usleep(500 + (i % 3) * 500); // uneven loop body, below budget
+        timer.wait();
+    }
+    auto totalMs = (FrameTimer::nowNs() - start) / 1000000;
+    auto stats = timer.getStats();
+    WARN("50 frames @200fps: " << totalMs << " ms, mean jitter " << stats.meanJitterNs / 1000 << " us, max jitter "
+                               << stats.maxJitterNs / 1000 << " us");
+    CHECK(stats.frames == frames);
+    // every frame ends on a period boundary, scheduler hiccups only cost the skipped periods
+    CHECK(totalMs >= 250);
+    CHECK(totalMs < (frames + (long) stats.skippedFrames) * 5 + 5);
+    CHECK(stats.load < 1.0f);
+}
+
+TEST_CASE("FrameTimer overrun policies", "[frametimer]") {
+    SECTION("skip drops the missed deadlines") {
+        FrameTimer timer(100, FrameTimerPolicy::skip);
+        timer.start();
+        usleep(25000); // 2.5 frames
+        CHECK_FALSE(timer.wait());
+        auto stats = timer.getStats();
+        CHECK(stats.overruns == 1);
+        CHECK(stats.skippedFrames == 2);
+        CHECK(stats.load > 2.0f);
+    }
+
+    SECTION("catchUp makes up the lost time") {
+        FrameTimer timer(100, FrameTimerPolicy::catchUp);
+        auto start = FrameTimer::nowNs();
+        timer.start();
+        usleep(25000);
+        timer.wait();
+        for (int i = 0; i < 4; i++)
+            timer.wait();
+        // 5 frames @ 100fps are due after 50ms, regardless of the overrun in frame 1
+        auto totalMs = (FrameTimer::nowNs() - start) / 1000000;
+        CHECK(totalMs >= 50);
+        CHECK(totalMs < 60);
+        CHECK(timer.getStats().skippedFrames == 0);
+    }
+}
@@ -0,0 +1,113 @@
+#include "catch.hpp"
+#include "../renderer/RGBMatrixRenderer/imu/Imu.h"
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+static std::string writeCapture(const std::string &content) {
+    char path[] = "/tmp/imuCaptureXXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, content.data(), content.size()) == (ssize_t) content.size());
+    close(fd);
+    return path;
+}
+
+TEST_CASE("Imu parses exactly three comma separated values", "[imu]") {
+    float values[3];
+    REQUIRE(Imu::parseLine("0.5,-1,2.25", values, 3));
+    CHECK(values[0] == 0.5f);
+    CHECK(values[1] == -1.0f);
+    CHECK(values[2] == 2.25f);
+    CHECK(Imu::parseLine(" 1 , 2 ,3", values, 3));
+    CHECK_FALSE(Imu::parseLine("1,2", values, 3));
+    CHECK_FALSE(Imu::parseLine("1,2,3,4", values, 3));
+    CHECK_FALSE(Imu::parseLine("1;2;3", values, 3));
+    CHECK_FALSE(Imu::parseLine("1,2,3x", values, 3));
+    CHECK_FALSE(Imu::parseLine("x,y,z", values, 3));
+    CHECK_FALSE(Imu::parseLine("", values, 3));
+}
+
+TEST_CASE("Imu replays a capture at its sample rate", "[imu]") {
+    std::string capture = "0,0,1\r\n"
+                          "garbage\n"
+                          "\n"
+                          "0.5,0.5\n"
+                          + std::string(SERIALBUFFERSIZE + 100, '7') + "\n" // too long, the rest is malformed
+                          "0.01,0.02,0.03\n"
+                          "1,0,0\n";
+    auto path = writeCapture(capture);
+    Imu imu;
+    REQUIRE(imu.initReplay(path, 100, false));
+    while (imu.refresh()) {
+    }
+    unlink(path.c_str());
+
+    CHECK(imu.getSampleCount() == 3);
+    CHECK(imu.getParseErrors() == 3);
+    ImuSample samples[4];
+    REQUIRE(imu.getHistory(samples, 4) == 3);
+    CHECK(samples[0].acceleration[2] == 1.0f);
+    CHECK(samples[1].acceleration[0] == 0.01f);
+    CHECK(samples[1].freefall);
+    CHECK(samples[2].acceleration[0] == 1.0f);
+    CHECK_FALSE(samples[2].freefall);
+    CHECK(samples[1].timestamp - samples[0].timestamp == 10000000);
+    CHECK(samples[2].timestamp - samples[1].timestamp == 10000000);
+    CHECK_FALSE(imu.isInFreefall());
+}
+
+TEST_CASE("Imu's reader thread ends with the replay and reports free-fall", "[imu]") {
+    auto path = writeCapture("0,0,1\n0,0,0\n0,0,0\n0,0,1\n0,0,0.05\n");
+    Imu imu;
+    int falls = 0;
+    imu.setFreefallCallback([&falls](const ImuSample &) { falls++; });
+    REQUIRE(imu.initReplay(path, 1000));
+    for (int i = 0; i < 2000 && !imu.isReplayFinished(); i++)
+        usleep(1000);
+    unlink(path.c_str());
+    REQUIRE(imu.isReplayFinished());
+    CHECK(imu.getSampleCount() == 5);
+    CHECK(falls == 2);
+    CHECK(imu.isInFreefall());
+}
+
+TEST_CASE("SerialPort ends the input on a read error", "[imu]") {
+    // reads fail like they do with EIO once a USB serial adapter is unplugged, here with EISDIR
+    int device = open("/tmp", O_RDONLY | O_DIRECTORY);
+    REQUIRE(device >= 0);
+    SerialPort port(device);
+    size_t length;
+    CHECK(port.readLine(length, 10) == nullptr);
+    CHECK(port.isEof());
+
+    // the reader thread stops instead of spinning on the error
+    Imu imu;
+    REQUIRE(imu.initReplay("/tmp", 100, false));
+    CHECK_FALSE(imu.refresh());
+}
+
+TEST_CASE("SampleRing keeps the newest samples when it wraps around", "[imu]") {
+    SampleRing<int, 8> ring;
+    int latest;
+    int history[16];
+    CHECK_FALSE(ring.getLatest(latest));
+    for (int i = 0; i < 3; i++)
+        ring.push(i);
+    REQUIRE(ring.getHistory(history, 16) == 3);
+    CHECK(history[0] == 0);
+    CHECK(history[2] == 2);
+
+    for (int i = 3; i < 20; i++)
+        ring.push(i);
+    CHECK(ring.getCount() == 20);
+    REQUIRE(ring.getLatest(latest));
+    CHECK(latest == 19);
+    // the oldest slot is left out, it may be in the middle of a write
+    REQUIRE(ring.getHistory(history, 16) == 7);
+    for (int i = 0; i < 7; i++)
+        CHECK(history[i] == 13 + i);
+    REQUIRE(ring.getHistory(history, 2) == 2);
+    CHECK(history[0] == 18);
+    CHECK(history[1] == 19);
+}
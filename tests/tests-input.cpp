@@ -0,0 +1,116 @@
+#include "catch.hpp"
+#include <InputState.h>
+#include <SeqLock.h>
+#include <SampleChannel.h>
+#include <cstring>
+
+TEST_CASE("InputState survives the message round trip", "[input]") {
+    InputState state;
+    memset(&state, 0, sizeof(state));
+    state.joysticks[1].connected = true;
+    state.joysticks[1].timestamp = 1200;
+    state.joysticks[1].button[3] = true;
+    state.joysticks[1].axis[0] = -1.0f;
+    state.joysticks[1].buttonPressCount[3] = 7;
+    state.joysticks[1].axisPressCount[0] = 2;
+    state.joysticks[1].axisPress[0] = -1.0f;
+    state.imu.valid = true;
+    state.imu.timestamp = 1100;
+    state.imu.acceleration[2] = 9.81f;
+
+    matrixserver::MatrixServerMessage message;
+    inputStateToMessage(state, message);
+    InputState received;
+    memset(&received, 0, sizeof(received));
+    received.joysticks[0].connected = true; // not in the message, so disconnected
+    inputStateFromMessage(message, received);
+
+    CHECK(received.timestamp == 1200); // newest sample
+    CHECK_FALSE(received.joysticks[0].connected);
+    CHECK(received.joysticks[1].connected);
+    CHECK(received.joysticks[1].timestamp == 1200);
+    CHECK(received.joysticks[1].button[3]);
+    CHECK_FALSE(received.joysticks[1].button[2]);
+    CHECK(received.joysticks[1].axis[0] == -1.0f);
+    CHECK(received.joysticks[1].buttonPressCount[3] == 7);
+    CHECK(received.joysticks[1].axisPressCount[0] == 2);
+    CHECK(received.joysticks[1].axisPress[0] == -1.0f);
+    CHECK(received.imu.valid);
+    CHECK(received.imu.timestamp == 1100);
+    CHECK(received.imu.acceleration[2] == 9.81f);
+}
+
+TEST_CASE("SeqLock returns the last stored value", "[input]") {
+    SeqLock<InputState> lock;
+    CHECK(lock.getVersion() == 0);
+    InputState state;
+    memset(&state, 0, sizeof(state));
+    state.timestamp = 42;
+    lock.store(state);
+    CHECK(lock.getVersion() == 1);
+    CHECK(lock.load().timestamp == 42);
+}
+
+TEST_CASE("SpscQueue keeps order and counts drops", "[input]") {
+    SpscQueue<int> queue(3);
+    CHECK(queue.capacity() == 4);
+    for (int i = 0; i < 5; i++)
+        queue.push(i);
+    CHECK(queue.size() == 4);
+    CHECK(queue.getDropped() == 1);
+    int value;
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(queue.pop(value));
+        CHECK(value == i);
+    }
+    CHECK_FALSE(queue.pop(value));
+}
+
+TEST_CASE("Coalesced input states are turned back into edges", "[input]") {
+    InputState previous, current;
+    memset(&previous, 0, sizeof(previous));
+    previous.joysticks[0].connected = true;
+    current = previous;
+    current.joysticks[0].timestamp = 500;
+    current.joysticks[0].buttonPressCount[2] = 2; // pressed twice, released in between and at the end
+    current.joysticks[0].axis[1] = 1.0f;
+    current.joysticks[0].axisPress[1] = 1.0f;
+    current.joysticks[0].axisPressCount[1] = 1;
+
+    InputEventQueue queue;
+    inputEventsFromStates(previous, current, queue);
+    // edges of a coalesced update are ordered by input number
+    InputEventType expected[] = {InputEventType::axisPress,
+                                 InputEventType::buttonPress, InputEventType::buttonRelease,
+                                 InputEventType::buttonPress, InputEventType::buttonRelease};
+    InputEvent event;
+    for (auto type : expected) {
+        REQUIRE(queue.pop(event));
+        CHECK(event.type == type);
+        CHECK(event.timestamp == 500);
+        if (type == InputEventType::axisPress) {
+            CHECK(event.number == 1);
+            CHECK(event.value == 1.0f);
+        }
+    }
+    CHECK_FALSE(queue.pop(event));
+
+    // a counter reset (app registered again) produces no presses
+    inputEventsFromStates(current, previous, queue);
+    REQUIRE(queue.pop(event));
+    CHECK(event.type == InputEventType::axisRelease);
+    CHECK_FALSE(queue.pop(event));
+}
+
+TEST_CASE("SampleChannel publishes the latest sample with its timestamp", "[input]") {
+    SampleChannel<float> channel;
+    float value = 0;
+    uint64_t timestamp = 0;
+    CHECK_FALSE(channel.get(value, &timestamp));
+    channel.publish(1.5f, 100);
+    channel.publish(2.5f, 200);
+    REQUIRE(channel.get(value, &timestamp));
+    CHECK(value == 2.5f);
+    CHECK(timestamp == 200);
+    CHECK(channel.getCount() == 2);
+}
@@ -0,0 +1,113 @@
+#include "catch.hpp"
+#include <JitterBuffer.h>
+#include <FrameTimer.h>
+#include <atomic>
+#include <unistd.h>
+
+struct PresentedFrame {
+    int appId;
+    uint64_t frameId;
+    int64_t lateNs;
+};
+
+static std::shared_ptr<matrixserver::MatrixServerMessage> scheduledFrame(uint64_t frameId, int64_t presentAtNs) {
+    auto message = std::make_shared<matrixserver::MatrixServerMessage>();
+    message->set_messagetype(matrixserver::setScreenFrame);
+    message->set_frameid(frameId);
+    message->set_presentatns(presentAtNs);
+    return message;
+}
+
+TEST_CASE("JitterBuffer presents the frames at their time and paces an app which runs ahead", "[jitter]") {
+    std::mutex mutex;
+    std::vector<PresentedFrame> presented;
+    JitterBuffer buffer([&](int appId, const matrixserver::MatrixServerMessage &message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        presented.push_back({appId, message.frameid(), FrameTimer::nowNs() - message.presentatns()});
+    }, 3);
+    std::atomic<int> acks(0);
+    auto ack = [&acks]() { acks++; };
+
+    auto start = FrameTimer::nowNs();
+    // sent out of order, shown in order
+    REQUIRE(buffer.push(1, start + 40000000, scheduledFrame(2, start + 40000000), ack));
+    REQUIRE(buffer.push(1, start + 20000000, scheduledFrame(1, start + 20000000), ack));
+    CHECK(acks == 2);
+    // the buffer is full now, the app has to wait for a frame to leave it
+    REQUIRE(buffer.push(1, start + 60000000, scheduledFrame(3, start + 60000000), ack));
+    CHECK(acks == 2);
+    CHECK(buffer.getBuffered(1) == 3);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(presented.empty());
+    }
+
+    usleep(30000);
+    CHECK(acks == 3);
+    usleep(50000);
+    buffer.flush();
+    CHECK(buffer.getBuffered(1) == 0);
+    std::lock_guard<std::mutex> lock(mutex);
+    REQUIRE(presented.size() == 3);
+    for (size_t i = 0; i < presented.size(); i++) {
+        CHECK(presented[i].appId == 1);
+        CHECK(presented[i].frameId == i + 1);
+        CHECK(presented[i].lateNs >= 0);
+        CHECK(presented[i].lateNs < 10000000);
+    }
+    auto stats = buffer.getStats();
+    CHECK(stats.frames == 3);
+    CHECK(stats.presented == 3);
+    CHECK(stats.late == 0);
+    CHECK(stats.deferredAcks == 1);
+}
+
+TEST_CASE("JitterBuffer drops late frames and the frames of removed apps", "[jitter]") {
+    std::mutex mutex;
+    std::vector<PresentedFrame> presented;
+    JitterBuffer buffer([&](int appId, const matrixserver::MatrixServerMessage &message) {
+        if (appId == 1)
+            usleep(20000); // keeps the buffer's thread busy while the frames of app 2 become due
+        std::lock_guard<std::mutex> lock(mutex);
+        presented.push_back({appId, message.frameid(), 0});
+    }, 3);
+    std::atomic<int> acks(0);
+    auto ack = [&acks]() { acks++; };
+
+    auto start = FrameTimer::nowNs();
+    // its time has passed on arrival: acked but never shown
+    REQUIRE(buffer.push(1, start - 10000000, scheduledFrame(1, 0), ack));
+    CHECK(acks == 1);
+    CHECK(buffer.getStats().late == 1);
+    // too far ahead, the clocks don't match
+    CHECK_FALSE(buffer.push(1, start + 3 * JITTERBUFFERMAXAHEAD, scheduledFrame(2, 0), ack));
+    CHECK(acks == 1);
+    CHECK(buffer.getStats().tooEarly == 1);
+
+    // both frames of app 2 are due once app 1 is presented, the older one is overtaken
+    REQUIRE(buffer.push(1, start, scheduledFrame(3, 0), ack));
+    REQUIRE(buffer.push(2, start + 2000000, scheduledFrame(4, 0), ack));
+    REQUIRE(buffer.push(2, start + 4000000, scheduledFrame(5, 0), ack));
+    // gone before its time
+    REQUIRE(buffer.push(3, start + 30000000, scheduledFrame(6, 0), ack));
+    buffer.removeApp(3);
+    CHECK(buffer.getBuffered(3) == 0);
+
+    // an app which doesn't wait for the acks overflows its buffer
+    for (int i = 0; i < 4; i++)
+        REQUIRE(buffer.push(4, start + 1000000000 + i, scheduledFrame(7 + i, 0), ack));
+    CHECK(buffer.getBuffered(4) == 3);
+
+    usleep(50000);
+    buffer.flush();
+    auto stats = buffer.getStats();
+    CHECK(stats.late == 2);
+    CHECK(stats.overflow == 1);
+    CHECK(stats.presented == 2);
+    std::lock_guard<std::mutex> lock(mutex);
+    REQUIRE(presented.size() == 2);
+    CHECK(presented[0].frameId == 3);
+    CHECK(presented[1].appId == 2);
+    CHECK(presented[1].frameId == 5);
+    buffer.stop();
+}
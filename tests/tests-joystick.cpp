@@ -0,0 +1,96 @@
+#include "catch.hpp"
+#include <Joystick.h>
+#include <FrameTimer.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static bool waitFor(std::function<bool()> condition) {
+    for (int i = 0; i < 200; i++) {
+        if (condition())
+            return true;
+        usleep(5000);
+    }
+    return false;
+}
+
+static Joystick::Event makeEvent(unsigned char type, unsigned char number, short value, unsigned int time) {
+    Joystick::Event event;
+    event.time = time;
+    event.value = value;
+    event.type = type;
+    event.number = number;
+    return event;
+}
+
+TEST_CASE("JoystickManager picks up hotplugged devices and their events", "[joystick]") {
+    char inputDir[] = "/tmp/matrixserver-input-XXXXXX";
+    REQUIRE(mkdtemp(inputDir) != nullptr);
+    std::string staging = std::string(inputDir) + ".js1";
+    std::string device = std::string(inputDir) + "/js1";
+    REQUIRE(mkfifo(staging.c_str(), 0600) == 0);
+
+    auto start = FrameTimer::nowNs();
+    JoystickManager manager(4, inputDir);
+    // construction must not wait for devices
+    CHECK(FrameTimer::nowNs() - start < 100000000);
+    CHECK_FALSE(manager.getJoysticks()[1]->isConnected());
+    auto edges = manager.subscribe();
+
+    // a fifo stands in for the device, hold the write end before it shows up in the watched directory
+    int fd = open(staging.c_str(), O_RDWR | O_NONBLOCK);
+    REQUIRE(fd >= 0);
+    REQUIRE(rename(staging.c_str(), device.c_str()) == 0);
+    REQUIRE(waitFor([&]() { return manager.getJoysticks()[1]->isConnected(); }));
+
+    // one write: the made up kernel times run ahead of the clock, events of a later read would be taken as now
+    Joystick::Event sent[] = {makeEvent(0x01, 3, 1, 1000), makeEvent(0x01, 3, 0, 1010),
+                              makeEvent(0x01, 3, 1, 1020), makeEvent(0x02, 0, -INT16_MAX, 1030)};
+    REQUIRE(write(fd, sent, sizeof(sent)) == sizeof(sent));
+    REQUIRE(waitFor([&]() { return manager.getAxis(0) < 0; }));
+
+    JoystickState states[4];
+    manager.getStates(states, 4);
+    CHECK(states[1].connected);
+    CHECK(states[1].button[3]);
+    CHECK(states[1].buttonPressCount[3] == 2);
+    CHECK(states[1].axisPressCount[0] == 1);
+    CHECK(states[1].axisPress[0] == -1.0f);
+    CHECK_FALSE(states[0].connected);
+
+    // every edge reaches the subscriber with the spacing of the kernel timestamps
+    InputEventType expected[] = {InputEventType::buttonPress, InputEventType::buttonRelease,
+                                 InputEventType::buttonPress, InputEventType::axisPress};
+    InputEvent events[4];
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(edges->pop(events[i]));
+        CHECK(events[i].type == expected[i]);
+        CHECK(events[i].joystick == 1);
+    }
+    CHECK(events[3].timestamp - events[0].timestamp == 30000000);
+    CHECK(events[3].timestamp <= (uint64_t) FrameTimer::nowNs());
+
+    // presses are latched until consumed, one per call
+    CHECK(manager.getButtonPress(3));
+    CHECK(manager.getButtonPress(3));
+    CHECK_FALSE(manager.getButtonPress(3));
+    CHECK(manager.getAxisPress(0) == -1.0f);
+    CHECK(manager.getAxisPress(0) == 0.0f);
+
+    // closing the write end looks like an unplugged device
+    close(fd);
+    REQUIRE(waitFor([&]() { return !manager.getJoysticks()[1]->isConnected(); }));
+    CHECK(manager.getAxis(0) == 0.0f);
+    InputEvent event;
+    REQUIRE(waitFor([&]() { return edges->pop(event); }));
+    CHECK(event.type == InputEventType::axisRelease);
+    REQUIRE(edges->pop(event));
+    CHECK(event.type == InputEventType::buttonRelease);
+    manager.unsubscribe(edges);
+
+    unlink(device.c_str());
+    rmdir(inputDir);
+}
@@ -0,0 +1,144 @@
+#include "catch.hpp"
+#include <AppLauncher.h>
+#include <CubeConfig.h>
+#include <UnixSocketClient.h>
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static bool waitFor(std::function<bool()> condition, int timeoutMs = 3000) {
+    for (int i = 0; i < timeoutMs && !condition(); i++)
+        usleep(1000);
+    return condition();
+}
+
+// runs the io_service like the server's io thread
+struct LauncherFixture {
+    LauncherFixture() : work(io), thread([this]() { io.run(); }) {}
+
+    ~LauncherFixture() {
+        io.stop();
+        thread.join();
+    }
+
+    boost::asio::io_service io;
+    boost::asio::io_service::work work;
+    boost::thread thread;
+    std::vector<std::shared_ptr<UniversalConnection>> connections;
+};
+
+static bool reapUntilEnded(AppLauncher &launcher, size_t count) {
+    return waitFor([&]() {
+        launcher.reap();
+        return launcher.getLaunches().empty() && launcher.getHistory().size() >= count;
+    });
+}
+
+TEST_CASE("AppLauncher spawns apps with a connected socket", "[launcher]") {
+    LauncherFixture fixture;
+    AppLauncher launcher(fixture.io, [&](std::shared_ptr<UniversalConnection> connection) {
+        fixture.connections.push_back(connection);
+    });
+    auto pid = launcher.launch("/bin/sh", {"-c", "[ \"$" LAUNCHERFDENVVARIABLE "\" = 3 ] && [ -S /proc/self/fd/3 ]"});
+    REQUIRE(pid > 0);
+    CHECK(fixture.connections.size() == 1);
+    REQUIRE(reapUntilEnded(launcher, 1));
+    auto ended = launcher.getHistory().back();
+    CHECK(ended.pid == pid);
+    CHECK(ended.state == LaunchState::exited);
+    CHECK(WIFEXITED(ended.exitStatus));
+    CHECK(WEXITSTATUS(ended.exitStatus) == 0);
+    CHECK(waitFor([&]() { return fixture.connections[0]->isDead(); })); // the app's end is closed
+
+    CHECK(launcher.launch("/nonexistent/app") == 0);
+    CHECK(launcher.getStats().failures == 1);
+    CHECK(launcher.getStats().launches == 1);
+}
+
+TEST_CASE("AppLauncher restarts failing apps and terminates its apps", "[launcher]") {
+    LauncherFixture fixture;
+    AppLauncher launcher(fixture.io, [](std::shared_ptr<UniversalConnection>) {});
+    REQUIRE(launcher.launch("/bin/sh", {"-c", "exit 3"}, true) > 0);
+    REQUIRE(reapUntilEnded(launcher, LAUNCHERMAXRESTARTS + 1));
+    auto ended = launcher.getHistory().back();
+    CHECK(ended.restarts == LAUNCHERMAXRESTARTS);
+    CHECK(WEXITSTATUS(ended.exitStatus) == 3);
+    CHECK(launcher.getStats().restarts == LAUNCHERMAXRESTARTS);
+
+    auto pid = launcher.launch("/bin/sleep", {"10"}, true);
+    REQUIRE(pid > 0);
+    CHECK(launcher.terminate(pid));
+    REQUIRE(waitFor([&]() {
+        launcher.reap();
+        return launcher.getLaunches().empty();
+    }));
+    CHECK(launcher.getHistory().back().state == LaunchState::terminated);
+    CHECK(WIFSIGNALED(launcher.getHistory().back().exitStatus));
+
+    REQUIRE(launcher.launch("/bin/sleep", {"10"}) > 0);
+    launcher.stop();
+    CHECK(launcher.getLaunches().empty());
+}
+
+TEST_CASE("AppLauncher forks plugins from the zygote", "[launcher]") {
+    LauncherFixture fixture;
+    AppLauncher *launcherPointer = nullptr;
+    std::atomic<int> frames(0);
+    matrixserver::ServerConfig serverConfig;
+    createDefaultCubeConfig(serverConfig);
+    serverConfig.set_servername("end"); // the test plugin ends after 9 frames
+    auto frameAck = std::make_shared<matrixserver::MatrixServerMessage>();
+    frameAck->set_messagetype(matrixserver::setScreenFrame);
+    frameAck->set_status(matrixserver::success);
+
+    // the part of the server the app talks to
+    AppLauncher launcher(fixture.io, [&](std::shared_ptr<UniversalConnection> connection) {
+        fixture.connections.push_back(connection);
+        connection->setReceiveCallback([&](std::shared_ptr<UniversalConnection> con,
+                                           std::shared_ptr<matrixserver::MatrixServerMessage> message) {
+            auto response = std::make_shared<matrixserver::MatrixServerMessage>();
+            switch (message->messagetype()) {
+                case matrixserver::registerApp:
+                    response->set_messagetype(matrixserver::registerApp);
+                    response->set_appid(42);
+                    response->set_status(matrixserver::success);
+                    con->sendMessage(response);
+                    break;
+                case matrixserver::getServerInfo:
+                    response->set_messagetype(matrixserver::getServerInfo);
+                    response->mutable_serverconfig()->CopyFrom(serverConfig);
+                    con->sendMessage(response);
+                    break;
+                case matrixserver::setScreenFrame:
+                    CHECK(message->appid() == 42);
+                    CHECK(message->screendata_size() == 6);
+                    launcherPointer->frameReceived(con.get());
+                    frames++;
+                    con->sendMessage(frameAck);
+                    break;
+                default:
+                    break;
+            }
+        });
+    });
+    launcherPointer = &launcher;
+
+    CHECK(launcher.launch(TESTPLUGINPATH) == 0); // plugins need the zygote
+    REQUIRE(launcher.startZygote(MATRIXZYGOTEPATH));
+    CHECK(launcher.hasZygote());
+    REQUIRE(launcher.launch(TESTPLUGINPATH) > 0);
+    REQUIRE(reapUntilEnded(launcher, 2));
+    auto ended = launcher.getHistory().back();
+    CHECK(ended.zygote);
+    CHECK(ended.state == LaunchState::exited);
+    CHECK(WEXITSTATUS(ended.exitStatus) == 0);
+    CHECK(ended.firstFrameNs > 0);
+    CHECK(frames == 9);
+    auto stats = launcher.getStats();
+    CHECK(stats.firstFrames == 1);
+    CHECK(stats.lastFirstFrameNs == ended.firstFrameNs);
+
+    launcher.stop();
+    CHECK_FALSE(launcher.hasZygote());
+}
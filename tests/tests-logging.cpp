@@ -0,0 +1,132 @@
+#include "catch.hpp"
+#include <Log.h>
+#include <UnixSocketClient.h>
+#include <FrameMessage.h>
+#include <FrameTimer.h>
+#include <boost/thread/thread.hpp>
+#include <sys/socket.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+TEST_CASE("MATRIXLOG filters before evaluating its arguments", "[logging]") {
+    std::vector<LogEntry> entries;
+    std::mutex entriesMutex;
+    Log::setSink([&](const LogEntry &entry) {
+        std::lock_guard<std::mutex> lock(entriesMutex);
+        entries.push_back(entry);
+    });
+    int evaluated = 0;
+    auto argument = [&evaluated]() { return ++evaluated; };
+
+    Log::setLevel(LogLevel::info);
+    MATRIXLOG(debug) << "not shown " << argument();
+    CHECK(evaluated == 0);
+    MATRIXLOG(warning) << "shown " << argument();
+    CHECK(evaluated == 1);
+    Log::setLevel(LogLevel::trace);
+    MATRIXLOG(trace) << "trace " << argument();
+    CHECK(evaluated == ((int) LogLevel::trace < MATRIXSERVER_LOG_MINLEVEL ? 1 : 2)); // compiled out in Release
+    // the else belongs to the outer if
+    bool skipped = false;
+    if (evaluated < 0)
+        MATRIXLOG(warning) << "never " << argument();
+    else
+        skipped = true;
+    CHECK(skipped);
+    Log::flush();
+
+    Log::setSink(nullptr);
+    Log::setLevel(LogLevel::debug);
+    REQUIRE(entries.size() >= 1);
+    CHECK(entries[0].level == LogLevel::warning);
+    CHECK(std::string(entries[0].text, entries[0].length) == "shown 1");
+    std::string line;
+    Log::format(entries[0], line);
+    CHECK(line.find("] [warning] shown 1") != std::string::npos);
+    CHECK(line[0] == '[');
+}
+
+TEST_CASE("MATRIXLOG queues messages of many threads without losing them", "[logging]") {
+    std::vector<std::string> messages;
+    std::mutex messagesMutex;
+    Log::setSink([&](const LogEntry &entry) {
+        std::lock_guard<std::mutex> lock(messagesMutex);
+        messages.emplace_back(entry.text, entry.length);
+    });
+    Log::setLevel(LogLevel::info);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < 200; i++) {
+                MATRIXLOG(info) << "thread " << t << " message " << i;
+                if (i % 50 == 49)
+                    Log::flush(); // stay below the queue size
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    MATRIXLOG(info) << std::string(1000, 'x');
+    Log::flush();
+    Log::setSink(nullptr);
+    Log::setLevel(LogLevel::debug);
+
+    REQUIRE(messages.size() == 4 * 200 + 1);
+    CHECK(messages.back() == std::string(LOGMESSAGESIZE, 'x'));
+    int next[4] = {0, 0, 0, 0}; // in order per thread
+    for (size_t i = 0; i + 1 < messages.size(); i++) {
+        int thread, message;
+        REQUIRE(sscanf(messages[i].c_str(), "thread %d message %d", &thread, &message) == 2);
+        REQUIRE(message == next[thread]++);
+    }
+    CHECK(Log::getDropped() == 0);
+}
+
+// handleWrite and handleRead of a socket pair, the log calls on them run for every message
+static double socketThroughput(std::shared_ptr<matrixserver::MatrixServerMessage> message, int messages) {
+    boost::asio::io_service io;
+    boost::asio::io_service::work work(io);
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    auto sender = UnixSocketClient::adopt(io, fds[0]);
+    auto receiver = UnixSocketClient::adopt(io, fds[1]);
+    std::atomic<int> received(0);
+    receiver->setReceiveCallback([&received](std::shared_ptr<UniversalConnection>,
+                                             std::shared_ptr<matrixserver::MatrixServerMessage>) { received++; });
+    sender->setReceiveCallback([](std::shared_ptr<UniversalConnection>, std::shared_ptr<matrixserver::MatrixServerMessage>) {});
+    boost::thread ioThread([&io]() { io.run(); });
+    auto start = FrameTimer::nowNs();
+    for (int i = 0; i < messages; i++) {
+        sender->sendMessage(message);
+        while (received < i + 1 - 16)
+            ; // up to 16 messages in flight
+    }
+    while (received < messages)
+        ;
+    double seconds = (FrameTimer::nowNs() - start) / 1e9;
+    io.stop();
+    ioThread.join();
+    return messages / seconds;
+}
+
+TEST_CASE("socket read and write throughput benchmark", "[logging]") {
+    Log::setLevel(LogLevel::debug); // like app and server
+    auto small = std::make_shared<matrixserver::MatrixServerMessage>();
+    small->set_messagetype(matrixserver::appAlive);
+    small->set_appid(42);
+    std::vector<std::shared_ptr<Screen>> screens;
+    for (int i = 0; i < 6; i++) {
+        screens.push_back(std::make_shared<Screen>(64, 64, i));
+        screens.back()->fill(Color::random());
+    }
+    FrameMessage frameMessage;
+    auto frame = frameMessage.encode(screens, 42);
+
+    socketThroughput(small, 1000); // warm up
+    double smallRate = socketThroughput(small, 100000);
+    double frameRate = socketThroughput(frame, 2000);
+    WARN("small messages: " << (int) smallRate << " /s, frames: " << (int) frameRate << " /s ("
+                            << (int) (frameRate * frame->ByteSizeLong() / 1e6) << " MB/s)");
+    CHECK(smallRate > 0);
+}
@@ -0,0 +1,46 @@
+#include "catch.hpp"
+#include <Metrics.h>
+
+TEST_CASE("LatencyHistogram buckets and percentiles", "[metrics]") {
+    for (uint64_t ns : {0ULL, 7ULL, 8ULL, 15ULL, 16ULL, 1000ULL, 123456789ULL, 1ULL << 40}) {
+        int index = LatencyHistogram::bucketIndex(ns);
+        REQUIRE(LatencyHistogram::bucketStart(index) <= ns);
+        REQUIRE(ns < LatencyHistogram::bucketStart(index + 1));
+        REQUIRE(ns - LatencyHistogram::bucketStart(index) <= ns / 8);
+    }
+    CHECK(LatencyHistogram::bucketIndex(~0ULL) == METRICSBUCKETS - 1);
+
+    LatencyHistogram histogram;
+    CHECK(histogram.percentile(0.5) == 0);
+    for (int i = 1; i <= 1000; i++)
+        histogram.record(i * 1000);
+    histogram.record(-5);
+    CHECK(histogram.getCount() == 1001);
+    CHECK(histogram.getMaxNs() == 1000000);
+    CHECK(histogram.getSumNs() == 500500000ULL);
+    CHECK(std::abs(histogram.percentile(0.5) - 500000) < 500000 / 8);
+    CHECK(std::abs(histogram.percentile(0.99) - 990000) < 990000 / 8);
+    CHECK(histogram.percentile(0) == 0);
+}
+
+TEST_CASE("Metrics registry and Prometheus exposition", "[metrics]") {
+    auto &counter = Metrics::counter("test_things", "things counted by the test");
+    CHECK(&counter == &Metrics::counter("test_things", "ignored"));
+    counter += 3;
+    auto &histogram = Metrics::histogram("test_stage", "a stage of the test");
+    histogram.record(2000000);
+
+    matrixserver::ServerStats stats;
+    Metrics::fillStats(stats);
+    auto *app = stats.add_apps();
+    app->set_appid(7);
+    app->set_frames(100);
+    app->set_fps(40);
+    std::string text;
+    Metrics::exposition(stats, text);
+    CHECK(text.find("# TYPE matrixserver_test_things_total counter\nmatrixserver_test_things_total 3\n") != std::string::npos);
+    CHECK(text.find("# HELP matrixserver_test_stage_seconds a stage of the test\n# TYPE matrixserver_test_stage_seconds summary\n") != std::string::npos);
+    CHECK(text.find("matrixserver_test_stage_seconds_count 1\n") != std::string::npos);
+    CHECK(text.find("matrixserver_test_stage_seconds_max 0.002000000\n") != std::string::npos);
+    CHECK(text.find("matrixserver_app_fps{app=\"7\"} 40.00\n") != std::string::npos);
+}
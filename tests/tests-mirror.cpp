@@ -0,0 +1,114 @@
+#include "catch.hpp"
+#include <FrameMirror.h>
+#include <MirrorRenderer.h>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <unistd.h>
+
+// test runs on the same host each get their own segment
+static std::string testMirrorName() {
+    return "/matrixserver-test-mirror-" + std::to_string(getpid());
+}
+
+static std::vector<std::shared_ptr<Screen>> mirrorScreens() {
+    std::vector<std::shared_ptr<Screen>> screens;
+    screens.push_back(std::make_shared<Screen>(8, 4, 0));
+    screens.push_back(std::make_shared<Screen>(5, 5, 3));
+    return screens;
+}
+
+TEST_CASE("FrameMirror publishes the rendered screens", "[mirror]") {
+    auto screens = mirrorScreens();
+    FrameMirrorReader reader;
+    CHECK_FALSE(reader.open(testMirrorName()));
+    {
+        MirrorRenderer renderer(screens, testMirrorName());
+        REQUIRE(renderer.isOpen());
+        REQUIRE(reader.open(testMirrorName()));
+        auto copies = reader.createScreens();
+        REQUIRE(copies.size() == 2);
+        CHECK(copies[1]->getWidth() == 5);
+        CHECK(copies[1]->getScreenId() == 3);
+
+        FrameMirrorInfo info;
+        REQUIRE(reader.read(copies, info));
+        CHECK(info.frames == 0);
+        CHECK(copies[0]->getPixel(7, 3).r() == 0);
+
+        screens[0]->fill(10, 20, 30);
+        screens[1]->fill(Color::red());
+        renderer.setScreenData(0, screens[0]->getScreenDataRaw());
+        renderer.setScreenData(3, screens[1]->getScreenDataRaw());
+        renderer.setScreenData(9, screens[1]->getScreenDataRaw()); // not mirrored
+        renderer.setGlobalBrightness(40);
+        renderer.render();
+        CHECK(reader.getFrames() == 1);
+        REQUIRE(reader.read(copies, info));
+        CHECK(info.frames == 1);
+        CHECK(info.brightness == 40);
+        CHECK(info.timestampNs > 0);
+        CHECK(copies[0]->getPixel(7, 3).g() == 20);
+        CHECK(copies[1]->getPixel(4, 4).r() == 255);
+
+        // a frame which only changes one screen keeps the other
+        screens[1]->fill(Color::blue());
+        renderer.setScreenData(3, screens[1]->getScreenDataRaw());
+        renderer.render();
+        REQUIRE(reader.read(copies, info));
+        CHECK(info.frames == 2);
+        CHECK(copies[0]->getPixel(0, 0).b() == 30);
+        CHECK(copies[1]->getPixel(2, 2).b() == 255);
+
+        std::vector<std::shared_ptr<Screen>> wrongLayout{std::make_shared<Screen>(8, 4, 0)};
+        CHECK_FALSE(reader.read(wrongLayout, info));
+    }
+    // gone with the server, the reader keeps its mapping
+    FrameMirrorReader late;
+    CHECK_FALSE(late.open(testMirrorName()));
+    CHECK(reader.getFrames() == 2);
+}
+
+TEST_CASE("FrameMirror readers never see a torn frame", "[mirror]") {
+    auto screens = mirrorScreens();
+    FrameMirrorWriter writer;
+    REQUIRE(writer.open(testMirrorName(), screens));
+    std::atomic<bool> done(false);
+    std::thread server([&]() {
+        for (int frame = 1; frame <= 20000; frame++) {
+            writer.begin();
+            for (size_t i = 0; i < screens.size(); i++) {
+                screens[i]->fill(frame & 0xff, (frame >> 8) & 0xff, i);
+                writer.setScreen(i, screens[i]->getScreenDataRaw());
+            }
+            writer.end(frame, 100);
+        }
+        done = true;
+    });
+
+    FrameMirrorReader reader;
+    REQUIRE(reader.open(testMirrorName()));
+    auto copies = reader.createScreens();
+    FrameMirrorInfo info;
+    int reads = 0;
+    int torn = 0;
+    while (!done || reads == 0) {
+        if (!reader.read(copies, info) || info.frames == 0) // still the black frame open() made
+            continue;
+        reads++;
+        for (size_t i = 0; i < copies.size(); i++) {
+            auto *data = copies[i]->getScreenDataRaw();
+            for (int p = 0; p < copies[i]->getScreenDataSize(); p++) {
+                if (data[p].r() != (info.frames & 0xff) || data[p].g() != ((info.frames >> 8) & 0xff) ||
+                    data[p].b() != i)
+                    torn++;
+            }
+        }
+        CHECK(info.timestampNs == (int64_t) info.frames);
+    }
+    server.join();
+    CHECK(reads > 0);
+    CHECK(torn == 0);
+    REQUIRE(reader.read(copies, info));
+    CHECK(info.frames == 20000);
+}
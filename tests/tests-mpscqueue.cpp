@@ -0,0 +1,72 @@
+#include "catch.hpp"
+#include <MpscQueue.h>
+#include <FrameTimer.h>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <unistd.h>
+
+TEST_CASE("MpscQueue keeps order and counts drops", "[mpscqueue]") {
+    MpscQueue<int> queue(3);
+    CHECK(queue.capacity() == 4);
+    int value;
+    CHECK_FALSE(queue.pop(value));
+    for (int i = 0; i < 4; i++)
+        CHECK(queue.push(i));
+    CHECK_FALSE(queue.push(4));
+    CHECK(queue.getDropped() == 1);
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(queue.pop(value));
+        CHECK(value == i);
+    }
+    CHECK_FALSE(queue.pop(value));
+    CHECK(queue.push(5)); // the slots are reused
+    REQUIRE(queue.pop(value));
+    CHECK(value == 5);
+
+    // popped values are released
+    MpscQueue<std::shared_ptr<int>> pointers(4);
+    auto pointer = std::make_shared<int>(1);
+    pointers.push(pointer);
+    std::shared_ptr<int> popped;
+    REQUIRE(pointers.pop(popped));
+    popped.reset();
+    CHECK(pointer.use_count() == 1);
+}
+
+TEST_CASE("MpscQueue takes values from several producers", "[mpscqueue]") {
+    MpscQueue<int64_t> queue(64);
+    CHECK_FALSE(queue.waitForData(1000000)); // times out while empty
+
+    const int producers = 4;
+    const int64_t count = 20000;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p, count]() {
+            for (int64_t i = 0; i < count; i++) {
+                while (!queue.push(p * count + i))
+                    usleep(10);
+            }
+        });
+    }
+    // every producer's values arrive in the order they were pushed, none is lost
+    std::vector<int64_t> next(producers, 0);
+    int64_t received = 0;
+    bool ordered = true;
+    auto timeout = FrameTimer::nowNs() + 10000000000LL;
+    while (received < producers * count && FrameTimer::nowNs() < timeout) {
+        int64_t value;
+        if (!queue.pop(value)) {
+            queue.waitForData(1000000);
+            continue;
+        }
+        auto producer = value / count;
+        ordered = ordered && value % count == next[producer];
+        next[producer] = value % count + 1;
+        received++;
+    }
+    for (auto &thread : threads)
+        thread.join();
+    CHECK(ordered);
+    CHECK(received == producers * count);
+}
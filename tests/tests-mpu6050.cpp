@@ -0,0 +1,114 @@
+#include "catch.hpp"
+#include "../application/Mpu6050.h"
+#include "../application/I2cDevice.h"
+#include <FrameTimer.h>
+#include <cmath>
+
+#define ACCELXOUTH 0x3B
+#define USERCTRL 0x6A
+#define FIFOCOUNTH 0x72
+#define FIFORW 0x74
+
+static void putWords(std::vector<uint8_t> &data, int16_t x, int16_t y, int16_t z) {
+    for (auto value : {x, y, z}) {
+        data.push_back((uint8_t) ((uint16_t) value >> 8));
+        data.push_back((uint8_t) value);
+    }
+}
+
+// the 14 data registers: accel, temperature, gyro
+static std::vector<uint8_t> burstFrame(int16_t ax, int16_t ay, int16_t az, int16_t gx, int16_t gy, int16_t gz) {
+    std::vector<uint8_t> frame;
+    putWords(frame, ax, ay, az);
+    frame.push_back(0);
+    frame.push_back(0);
+    putWords(frame, gx, gy, gz);
+    return frame;
+}
+
+TEST_CASE("Mpu6050 reads a sample in one burst and rotates it into the cube", "[mpu6050]") {
+    auto device = std::make_shared<RecordedI2cDevice>();
+    // 1 g along the sensor's x axis, 1 deg/s around each axis
+    device->addFrames(ACCELXOUTH, {burstFrame(16384, 0, 0, 131, 131, 131)}, true);
+    Mpu6050 mpu(device, 100, Mpu6050Mode::burst);
+    mpu.init(false);
+    CHECK(device->getRegister(USERCTRL) == 0);
+
+    auto transfers = device->getTransferCount();
+    for (int i = 0; i < 5; i++)
+        REQUIRE(mpu.poll());
+    CHECK(device->getTransferCount() == transfers + 5);
+    CHECK(mpu.getSampleCount() == 5);
+    CHECK(mpu.getPollRate() == 100);
+
+    // MPU6050MOUNTINGANGLE around the cube's y axis
+    auto acceleration = mpu.getAcceleration();
+    CHECK(acceleration[0] == Approx(std::sqrt(0.5f)).epsilon(0.001));
+    CHECK(acceleration[1] == Approx(std::sqrt(0.5f)).epsilon(0.001));
+    CHECK(acceleration[2] == Approx(0).margin(0.001));
+    auto gyro = mpu.getGyro();
+    CHECK(gyro[0] == Approx(0).margin(0.001));
+    CHECK(gyro[1] == Approx(std::sqrt(2.0f)).epsilon(0.001));
+    CHECK(gyro[2] == Approx(1).epsilon(0.001));
+}
+
+TEST_CASE("Mpu6050 calibration takes the gyro offset out", "[mpu6050]") {
+    auto device = std::make_shared<RecordedI2cDevice>();
+    device->addFrames(ACCELXOUTH, {burstFrame(0, 0, 16384, 131, 262, -131)}, true);
+    Mpu6050 mpu(device, 100, Mpu6050Mode::burst);
+    mpu.init(false);
+    mpu.calibrate(4);
+    for (int i = 0; i < 3; i++)
+        REQUIRE(mpu.poll());
+    CHECK(mpu.getGyro().norm() > 1); // still calibrating
+    REQUIRE(mpu.poll());
+    REQUIRE(mpu.poll());
+    auto gyro = mpu.getGyro();
+    for (int i = 0; i < 3; i++)
+        CHECK(gyro[i] == Approx(0).margin(0.001));
+}
+
+TEST_CASE("Mpu6050 drains its fifo with back-dated samples and resets it on overflow", "[mpu6050]") {
+    auto device = std::make_shared<RecordedI2cDevice>();
+    Mpu6050 mpu(device, 100, Mpu6050Mode::fifo);
+    mpu.init(false);
+    CHECK(mpu.getPollRate() == MPU6050FIFOPOLLRATE);
+    CHECK(device->getRegister(USERCTRL) == 0x40); // fifo enabled
+
+    // empty
+    CHECK_FALSE(mpu.poll());
+
+    // 3 records at rest, turning at 100 deg/s around the sensor's x and z axes
+    std::vector<uint8_t> records;
+    for (int i = 0; i < 3; i++) {
+        putWords(records, 0, 0, 16384);
+        putWords(records, 13100, 0, 13100);
+    }
+    device->addStream(FIFORW, records, FIFOCOUNTH);
+    mpu.setFilter(1, 1); // the pitch is the integrated gyro only
+    auto transfers = device->getTransferCount();
+    auto before = FrameTimer::nowNs();
+    REQUIRE(mpu.poll());
+    auto after = FrameTimer::nowNs();
+    CHECK(device->getTransferCount() == transfers + 2); // the count and one read of all records
+    CHECK(device->getStreamSize(FIFORW) == 0);
+    CHECK(mpu.getSampleCount() == 3);
+    auto sample = mpu.getSample();
+    CHECK(sample.timestamp >= (uint64_t) before);
+    CHECK(sample.timestamp <= (uint64_t) after);
+    // the first record is the start, the others were 10 ms apart: 141 deg/s for 20 ms
+    auto startPitch = std::atan2(std::sqrt(0.5f), std::sqrt(0.5f)) * 180 / 3.14159265f;
+    CHECK(sample.pitch == Approx(startPitch + 1.4142f * 100 * 0.02f).epsilon(0.001));
+
+    // a partial record stays in the fifo
+    std::vector<uint8_t> partial(6, 0);
+    device->addStream(FIFORW, partial);
+    CHECK_FALSE(mpu.poll());
+    CHECK(device->getStreamSize(FIFORW) == 6);
+
+    // overflowed, the record boundaries are lost
+    device->addStream(FIFORW, std::vector<uint8_t>(1024 - 6, 0));
+    CHECK_FALSE(mpu.poll());
+    CHECK(device->getRegister(USERCTRL) == (0x40 | 0x04));
+    CHECK(mpu.getSampleCount() == 3);
+}
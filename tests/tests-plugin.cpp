@@ -0,0 +1,107 @@
+#include "catch.hpp"
+#include <PluginApp.h>
+#include <CubeConfig.h>
+#include <FrameTimer.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+static bool waitFor(std::function<bool()> condition, int timeoutMs = 2000) {
+    for (int i = 0; i < timeoutMs && !condition(); i++)
+        usleep(1000);
+    return condition();
+}
+
+static matrixserver::ServerConfig testConfig(std::string mode) {
+    matrixserver::ServerConfig serverConfig;
+    createDefaultCubeConfig(serverConfig);
+    serverConfig.set_servername(mode);
+    return serverConfig;
+}
+
+TEST_CASE("PluginApp runs a plugin in-process", "[plugin]") {
+    PluginApp plugin(TESTPLUGINPATH);
+    REQUIRE(plugin.load());
+    std::atomic<int> frames(0);
+    std::atomic<int> lastRed(0);
+    std::atomic<int> lastGreen(0);
+    REQUIRE(plugin.start(testConfig("end"), [&](std::vector<std::shared_ptr<Screen>> &screens) {
+        CHECK(screens.size() == 6);
+        lastRed = screens[5]->getPixel(0, 0).r();
+        lastGreen = screens[5]->getPixel(0, 0).g();
+        frames++;
+    }));
+    InputState input;
+    memset(&input, 0, sizeof(input));
+    input.joysticks[0].buttonPressCount[0] = 7;
+    plugin.setInput(input);
+
+    REQUIRE(waitFor([&]() { return plugin.hasEnded(); }));
+    CHECK(plugin.getState() == PluginState::ended);
+    CHECK(frames == 9); // the 10th loop() ended the app
+    CHECK(lastRed == 9);
+    CHECK(plugin.getFrameCount() == 9);
+    CHECK(plugin.getStartupNs() > 0);
+    CHECK(plugin.unload());
+}
+
+TEST_CASE("PluginApp is killed cleanly", "[plugin]") {
+    PluginApp plugin(TESTPLUGINPATH);
+    REQUIRE(plugin.load());
+    REQUIRE(plugin.start(testConfig("run"), [](std::vector<std::shared_ptr<Screen>> &) {}));
+    REQUIRE(waitFor([&]() { return plugin.getFrameCount() >= 2; }));
+    CHECK_FALSE(plugin.unload()); // still running
+    plugin.kill();
+    REQUIRE(waitFor([&]() { return plugin.hasEnded(); }));
+    CHECK(plugin.getState() == PluginState::ended);
+    CHECK(plugin.unload());
+}
+
+TEST_CASE("PluginApp isolates crashing and failing plugins", "[plugin]") {
+    PluginApp crashing(TESTPLUGINPATH);
+    REQUIRE(crashing.load());
+    REQUIRE(crashing.start(testConfig("crash"), [](std::vector<std::shared_ptr<Screen>> &) {}));
+    REQUIRE(waitFor([&]() { return crashing.hasEnded(); }));
+    CHECK(crashing.getState() == PluginState::crashed);
+    CHECK(crashing.getFrameCount() == 4);
+    CHECK(crashing.unload());
+
+    PluginApp failing(TESTPLUGINPATH);
+    REQUIRE(failing.load());
+    REQUIRE(failing.start(testConfig("throw"), [](std::vector<std::shared_ptr<Screen>> &) {}));
+    REQUIRE(waitFor([&]() { return failing.hasEnded(); }));
+    CHECK(failing.getState() == PluginState::failed);
+    CHECK(failing.unload());
+
+    // the app is constructed on the plugin thread, a throwing constructor fails only the plugin
+    setenv("TESTPLUGIN_CONSTRUCTOR_THROWS", "1", 1);
+    PluginApp throwing(TESTPLUGINPATH);
+    REQUIRE(throwing.load());
+    REQUIRE(throwing.start(testConfig("end"), [](std::vector<std::shared_ptr<Screen>> &) {}));
+    REQUIRE(waitFor([&]() { return throwing.hasEnded(); }));
+    unsetenv("TESTPLUGIN_CONSTRUCTOR_THROWS");
+    CHECK(throwing.getState() == PluginState::failed);
+    CHECK(throwing.getFrameCount() == 0);
+    CHECK(throwing.unload());
+}
+
+TEST_CASE("PluginApp watchdog stops a hung plugin", "[plugin]") {
+    // the hung thread never returns, it keeps what it works on after the PluginApp is destroyed
+    PluginApp hanging(TESTPLUGINPATH);
+    REQUIRE(hanging.load());
+    REQUIRE(hanging.start(testConfig("hang"), [](std::vector<std::shared_ptr<Screen>> &) {}));
+    REQUIRE(waitFor([&]() { return hanging.getFrameCount() == 4; }));
+    CHECK_FALSE(hanging.checkWatchdog(FrameTimer::nowNs(), 1000000000LL));
+    usleep(100000);
+    CHECK(hanging.checkWatchdog(FrameTimer::nowNs(), 50000000LL));
+    CHECK(hanging.getState() == PluginState::hung);
+    CHECK(hanging.hasEnded());
+    CHECK_FALSE(hanging.unload());
+}
+
+TEST_CASE("PluginApp rejects what is no plugin", "[plugin]") {
+    PluginApp missing("/nonexistent/plugin.so");
+    CHECK_FALSE(missing.load());
+    CHECK(missing.unload());
+}
@@ -0,0 +1,104 @@
+#include "catch.hpp"
+#include <PostProcessor.h>
+#include <CubeConfig.h>
+#include <Screen.h>
+#include <map>
+
+static matrixserver::ServerConfig postProcessingConfig(std::vector<matrixserver::PostProcessingStage::StageType> types) {
+    matrixserver::ServerConfig serverConfig;
+    createDefaultCubeConfig(serverConfig);
+    for (auto type : types)
+        serverConfig.add_postprocessing()->set_type(type);
+    return serverConfig;
+}
+
+static std::map<int, std::vector<Color>> collect(PostProcessor &postProcessor) {
+    std::map<int, std::vector<Color>> screens;
+    postProcessor.output([&](int screenId, Color *data) {
+        screens[screenId].assign(data, data + 64 * 64);
+    });
+    return screens;
+}
+
+TEST_CASE("PostProcessor applies brightness, gamma and color temperature", "[postprocessor]") {
+    auto serverConfig = postProcessingConfig({matrixserver::PostProcessingStage::brightnessGamma,
+                                              matrixserver::PostProcessingStage::colorTemperature});
+    serverConfig.mutable_postprocessing(0)->set_gamma(2.0f);
+    serverConfig.mutable_postprocessing(1)->set_kelvin(6500);
+    PostProcessor postProcessor(serverConfig);
+    REQUIRE(postProcessor.isActive());
+    CHECK(postProcessor.handlesBrightness());
+
+    Screen frame(64, 64, 0);
+    frame.fill(Color(255, 128, 0));
+    postProcessor.setScreen(0, frame.getScreenDataRaw(), 64 * 64);
+    postProcessor.process(1);
+    auto screens = collect(postProcessor);
+    CHECK(screens[0][0] == Color(255, 64, 0)); // 6500K is neutral
+    CHECK(screens[1][0] == Color::black());
+
+    postProcessor.setBrightness(50);
+    postProcessor.process(2);
+    screens = collect(postProcessor);
+    CHECK(screens[0][0] == Color(128, 32, 0));
+
+    auto stats = postProcessor.getStats();
+    REQUIRE(stats.size() == 2);
+    CHECK(stats[0].name == "brightnessGamma");
+    CHECK(stats[1].runs == 2);
+    CHECK(stats[1].maxNs >= stats[1].lastNs);
+
+    // warm white loses blue, not red
+    std::vector<uint8_t> pixel = {255, 255, 255};
+    PostProcessor::scaleChannels(pixel.data(), 1, 255, 200, 100);
+    CHECK(pixel == std::vector<uint8_t>({255, 200, 100}));
+    auto warm = postProcessingConfig({matrixserver::PostProcessingStage::colorTemperature});
+    warm.mutable_postprocessing(0)->set_kelvin(3000);
+    PostProcessor warmProcessor(warm);
+    frame.fill(Color::white());
+    warmProcessor.setScreen(0, frame.getScreenDataRaw(), 64 * 64);
+    warmProcessor.process(1);
+    auto warmScreens = collect(warmProcessor);
+    CHECK(warmScreens[0][0].r() == 255);
+    CHECK(warmScreens[0][0].b() < 200);
+    CHECK_FALSE(warmProcessor.handlesBrightness());
+}
+
+TEST_CASE("PostProcessor blur keeps flat areas and spreads points", "[postprocessor]") {
+    std::vector<Color> screen(64 * 64, Color(90, 90, 90));
+    std::vector<Color> scratch(64 * 64);
+    std::vector<uint16_t> sums(64 * 3);
+    PostProcessor::boxBlur(reinterpret_cast<uint8_t *>(screen.data()), reinterpret_cast<uint8_t *>(scratch.data()),
+                           sums.data(), 64, 64, 2);
+    for (auto &pixel : screen)
+        REQUIRE(pixel == Color(90, 90, 90));
+
+    Screen point(64, 64, 0);
+    point.setPixel(10, 20, Color(250, 0, 0));
+    PostProcessor::boxBlur(reinterpret_cast<uint8_t *>(point.getScreenDataRaw()), reinterpret_cast<uint8_t *>(scratch.data()),
+                           sums.data(), 64, 64, 1);
+    CHECK(point.getPixel(10, 20).r() == 28); // 250 / 9
+    CHECK(point.getPixel(11, 21).r() == 28);
+    CHECK(point.getPixel(12, 20).r() == 0);
+    CHECK(point.getPixel(10, 20).g() == 0);
+}
+
+TEST_CASE("PostProcessor crossfades to the new app", "[postprocessor]") {
+    auto serverConfig = postProcessingConfig({matrixserver::PostProcessingStage::crossfade});
+    serverConfig.mutable_postprocessing(0)->set_durationms(100);
+    PostProcessor postProcessor(serverConfig);
+
+    Screen oldApp(64, 64, 0), newApp(64, 64, 0);
+    oldApp.fill(Color::white());
+    postProcessor.setScreen(0, oldApp.getScreenDataRaw(), 64 * 64);
+    postProcessor.process(1000000);
+
+    postProcessor.startCrossfade();
+    postProcessor.setScreen(0, newApp.getScreenDataRaw(), 64 * 64);
+    postProcessor.process(10000000);
+    CHECK(collect(postProcessor)[0][0] == Color::white());
+    postProcessor.process(60000000);
+    CHECK(collect(postProcessor)[0][0] == Color(128, 128, 128));
+    postProcessor.process(110000000);
+    CHECK(collect(postProcessor)[0][0] == Color::black());
+}
@@ -0,0 +1,89 @@
+#include "catch.hpp"
+#include <CubeConfig.h>
+#include <NullRenderer.h>
+#include <CountingRenderer.h>
+#include <unistd.h>
+
+TEST_CASE("createScreens places the cube sides", "[renderer]") {
+    matrixserver::ServerConfig serverConfig;
+    createDefaultCubeConfig(serverConfig);
+    REQUIRE(serverConfig.screeninfo_size() == 6);
+
+    auto plain = createScreens(serverConfig);
+    REQUIRE(plain.size() == 6);
+    CHECK(plain[0]->getWidth() == 64);
+    CHECK(plain[4]->getOffsetX() == 0);
+
+    CubeLayout layout = {{
+            {1, 1, Rotation::rot0},
+            {2, 1, Rotation::rot0},
+            {1, 0, Rotation::rot90},
+            {0, 1, Rotation::rot0},
+            {0, 0, Rotation::rot270},
+            {2, 0, Rotation::rot270}
+    }};
+    auto placed = createScreens(serverConfig, &layout);
+    REQUIRE(placed.size() == 6);
+    CHECK(placed[1]->getOffsetX() == 2); // right
+    CHECK(placed[1]->getOffsetY() == 1);
+    CHECK(placed[2]->getRotation() == Rotation::rot90); // back
+    CHECK(placed[5]->getRotation() == Rotation::rot270); // bottom
+}
+
+TEST_CASE("NullRenderer counts frames", "[renderer]") {
+    matrixserver::ServerConfig serverConfig;
+    createDefaultCubeConfig(serverConfig);
+    auto screens = createScreens(serverConfig);
+    NullRenderer renderer(screens);
+
+    Screen frame(64, 64, 0);
+    frame.fill(Color::red());
+    renderer.setScreenData(0, frame.getScreenDataRaw());
+    renderer.render();
+    renderer.render();
+    CHECK(renderer.getFrameCount() == 2);
+    CHECK(screens[0]->getPixel(0, 0) == Color::black()); // the frame went nowhere
+}
+
+TEST_CASE("CountingRenderer records frame times and checksums", "[renderer]") {
+    matrixserver::ServerConfig serverConfig;
+    createDefaultCubeConfig(serverConfig);
+    CountingRenderer renderer(createScreens(serverConfig), 4);
+
+    Screen frame(64, 64, 2);
+    renderer.render();
+    auto black = renderer.getStats().lastChecksum;
+    frame.setPixel(10, 10, Color::white());
+    renderer.setScreenData(2, frame.getScreenDataRaw());
+    usleep(1000);
+    renderer.render();
+    auto white = renderer.getStats().lastChecksum;
+    CHECK(white != black);
+    renderer.render();
+    CHECK(renderer.getStats().lastChecksum == white); // same content, same checksum
+
+    // the same pixel on another screen is another frame
+    Screen other(64, 64, 3);
+    other.setPixel(10, 10, Color::white());
+    frame.clear();
+    renderer.setScreenData(2, frame.getScreenDataRaw());
+    renderer.setScreenData(3, other.getScreenDataRaw());
+    renderer.render();
+    CHECK(renderer.getStats().lastChecksum != white);
+    renderer.render();
+
+    auto stats = renderer.getStats();
+    CHECK(stats.frames == 5);
+    CHECK(stats.maxIntervalNs >= 1000000);
+    CHECK(stats.minIntervalNs <= stats.maxIntervalNs);
+    CHECK(stats.meanIntervalNs > 0);
+
+    // the history keeps the newest frames, oldest first
+    auto history = renderer.getHistory();
+    REQUIRE(history.size() == 4);
+    CHECK(history[0].checksum == white);
+    CHECK(history[1].checksum == white);
+    CHECK(history[3].checksum == stats.lastChecksum);
+    for (size_t i = 1; i < history.size(); i++)
+        CHECK(history[i].timestamp >= history[i - 1].timestamp);
+}
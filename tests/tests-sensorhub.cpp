@@ -0,0 +1,92 @@
+#include "catch.hpp"
+#include "../application/SensorHub.h"
+#include "../application/ADS1000.h"
+#include "../application/I2cDevice.h"
+#include <atomic>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+
+TEST_CASE("SensorHub drives the polls and fds of a process from one thread", "[sensorhub]") {
+    auto device = std::make_shared<RecordedI2cDevice>();
+    device->addFrames(0x00, {{0x03, 0xb0}}, true); // 944, about 10 V
+    ADS1000 adc(device, 100);
+    REQUIRE(adc.init(false));
+    CHECK(device->getTransferCount() == 1); // the dummy read, no thread of its own
+
+    std::atomic<int> slowPolls(0);
+    std::atomic<int> fdEvents(0);
+    int pipeFds[2];
+    REQUIRE(pipe2(pipeFds, O_NONBLOCK) == 0);
+
+    SensorHub hub;
+    int adcId = hub.addDevice("adc", adc);
+    int slowId = hub.addPoll("slow", 10, [&slowPolls]() {
+        slowPolls++;
+        return true;
+    });
+    int fdId = hub.addFd("fake", pipeFds[0], [&fdEvents, &pipeFds]() {
+        char buffer[16];
+        while (read(pipeFds[0], buffer, sizeof(buffer)) > 0) {
+        }
+        fdEvents++;
+        return true;
+    });
+    REQUIRE(adcId >= 0);
+    REQUIRE(slowId >= 0);
+    REQUIRE(fdId >= 0);
+    CHECK(hub.getName(fdId) == "fake");
+
+    hub.start();
+    for (int i = 0; i < 3; i++) {
+        usleep(150000);
+        REQUIRE(write(pipeFds[1], "x", 1) == 1);
+    }
+    usleep(45000);
+    hub.stop();
+
+    // 500 ms at 100 Hz and 10 Hz
+    auto adcStats = hub.getStats(adcId);
+    auto slowStats = hub.getStats(slowId);
+    auto fdStats = hub.getStats(fdId);
+    CHECK(adcStats.polls >= 45);
+    CHECK(adcStats.polls <= 52);
+    CHECK(adcStats.failures == 0);
+    CHECK(slowStats.polls >= 4);
+    CHECK(slowStats.polls <= 6);
+    CHECK(slowStats.polls == (uint64_t) slowPolls);
+    CHECK(fdEvents == 4); // once at start and once per write
+    CHECK(fdStats.polls == 4);
+    CHECK(device->getTransferCount() == adcStats.polls + 1);
+    CHECK(std::fabs(adc.getVoltage() - (0.0106f * 944 - 0.0055f)) < 0.001f);
+    CHECK(adc.getChannel().getCount() == adcStats.polls);
+    // the 10 Hz poll always ran in a wakeup of the 100 Hz one
+    INFO("wakeups " << hub.getWakeups());
+    CHECK(hub.getWakeups() <= adcStats.polls + 3 + 1);
+
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+}
+
+TEST_CASE("SensorHub can be started again after stop", "[sensorhub]") {
+    std::atomic<int> polls(0);
+    SensorHub hub;
+    int id = hub.addPoll("fast", 100, [&polls]() {
+        polls++;
+        return true;
+    });
+    REQUIRE(id >= 0);
+
+    hub.start();
+    usleep(50000);
+    hub.stop();
+    int firstRun = polls;
+    CHECK(firstRun >= 3);
+
+    // the stop of the first run must not end the second one at once
+    hub.start();
+    usleep(100000);
+    hub.stop();
+    CHECK(polls - firstRun >= 8);
+    CHECK(hub.getStats(id).polls == (uint64_t) polls);
+}
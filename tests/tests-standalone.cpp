@@ -0,0 +1,46 @@
+#include "catch.hpp"
+#include "../application/MatrixApplicationStandalone.h"
+#include <CountingRenderer.h>
+#include <Log.h>
+#include <unistd.h>
+
+class FillStandaloneApp : public MatrixApplicationStandalone {
+public:
+    FillStandaloneApp() : MatrixApplicationStandalone(MAXFPS) {}
+
+    bool loop() {
+        for (auto &screen : screens)
+            screen->fill(Color::blue());
+        return true;
+    }
+
+    uint64_t checksum() {
+        return CountingRenderer::checksum(screens);
+    }
+};
+
+TEST_CASE("MatrixApplicationStandalone renders through the renderer factory and stops", "[standalone]") {
+    auto logLevel = Log::getLevel(); // the standalone app sets debug
+    std::shared_ptr<CountingRenderer> counting;
+    FillStandaloneApp app;
+    app.setRendererFactory([&counting](std::vector<std::shared_ptr<Screen>> screens) {
+        counting = std::make_shared<CountingRenderer>(screens);
+        return counting;
+    });
+    app.start();
+    REQUIRE(counting != nullptr);
+    CHECK(app.getRenderer() == counting);
+
+    for (int i = 0; i < 2000 && counting->getStats().frames < 10; i++)
+        usleep(1000);
+    app.stop();
+    Log::setLevel(logLevel);
+
+    auto stats = counting->getStats();
+    CHECK(stats.frames >= 10);
+    CHECK(stats.lastChecksum == app.checksum());
+    CHECK(app.getAppState() == AppState::killed);
+    // both threads are joined, nothing renders after stop()
+    usleep(50000);
+    CHECK(counting->getStats().frames == stats.frames);
+}
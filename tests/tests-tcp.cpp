@@ -5,6 +5,11 @@
 #include <SocketConnection.h>
 #include <Screen.h>
 #include <SimulatorRenderer.h>
+#include <UnixSocketClient.h>
+#include <FrameMessage.h>
+#include <boost/thread/thread.hpp>
+#include <sys/socket.h>
+#include <unistd.h>
 
 //TEST_CASE("simulator"){
 //    std::vector<std::shared_ptr<Screen>> screens;
@@ -20,4 +25,40 @@
 //        renderer->render();
 //        sleep(1);
 //    }
-//}
\ No newline at end of file
+//}
+TEST_CASE("A connection whose peer stops reading is closed instead of queueing without end", "[socket]") {
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    boost::asio::io_service io;
+    boost::asio::io_service::work work(io);
+    auto connection = UnixSocketClient::adopt(io, fds[0]);
+    boost::thread ioThread([&io]() { io.run(); });
+
+    // 6 screens of 64x64, about 74 kB per frame; the peer (fds[1]) never reads
+    std::vector<std::shared_ptr<Screen>> screens;
+    for (int i = 0; i < 6; i++)
+        screens.push_back(std::make_shared<Screen>(64, 64, i));
+    FrameMessage frameMessage;
+    int sent = 0;
+    for (; sent < 1000 && !connection->isDead(); sent++) {
+        screens[0]->fill(sent, 0, 0);
+        connection->sendMessage(frameMessage.encode(screens, 1));
+    }
+    CHECK(connection->isDead());
+    // the socket buffers and SEND_BUFFER_LIMIT, not all 1000 frames
+    CHECK(sent * 74000 < SEND_BUFFER_LIMIT + 4000000);
+    connection->sendMessage(frameMessage.encode(screens, 1)); // ignored
+
+    // the peer sees the connection closed once it reads what made it through
+    char buffer[65536];
+    ssize_t received;
+    size_t total = 0;
+    while ((received = read(fds[1], buffer, sizeof(buffer))) > 0)
+        total += received;
+    CHECK(received == 0);
+    CHECK(total > 0);
+
+    io.stop();
+    ioThread.join();
+    close(fds[1]);
+}
@@ -0,0 +1,118 @@
+#include "catch.hpp"
+#include <Trace.h>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <unistd.h>
+
+#define TESTTRACEPATH "/tmp/matrixserver-test-trace.json"
+
+static size_t count(const std::string &text, const std::string &pattern) {
+    size_t found = 0;
+    for (auto pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+        found++;
+    return found;
+}
+
+TEST_CASE("Trace spans carry their frame and are dumped once", "[trace]") {
+    std::string out;
+    Trace::setEnabled(false);
+    { TraceSpan span("off"); }
+    Trace::dump(out);
+    CHECK(out.find("\"off\"") == std::string::npos);
+
+    Trace::setEnabled(true);
+    auto frameId = Trace::makeFrameId(5);
+    {
+        TraceFrame frame(frameId);
+        TraceSpan span("test_send", 0, TraceFlow::out);
+        CHECK(Trace::getFrame() == frameId);
+    }
+    CHECK(Trace::getFrame() == 0);
+    std::thread([frameId]() {
+        TraceSpan span("test_receive", frameId, TraceFlow::in);
+    }).join();
+    Trace::record("test_plain", 1000, 3500);
+    out.clear();
+    Trace::dump(out);
+    Trace::setEnabled(false);
+
+    auto frame = "\"args\":{\"frame\":\"" + std::to_string(getpid()) + ":5\"}";
+    CHECK(count(out, "\"name\":\"test_send\",\"ph\":\"X\"") == 1);
+    CHECK(count(out, "\"name\":\"test_receive\",\"ph\":\"X\"") == 1);
+    CHECK(count(out, frame) == 2);
+    CHECK(count(out, "\"ph\":\"s\"") == 1);
+    CHECK(count(out, "\"ph\":\"f\",\"bp\":\"e\"") == 1);
+    CHECK(out.find("{\"name\":\"test_plain\",\"ph\":\"X\",\"ts\":1.000,\"dur\":2.500,") != std::string::npos);
+
+    out.clear();
+    Trace::dump(out);
+    CHECK(out.find("test_") == std::string::npos);
+}
+
+TEST_CASE("Trace keeps the newest spans and appends to the trace file", "[trace]") {
+    unlink(TESTTRACEPATH);
+    Trace::setEnabled(true);
+    for (int i = 0; i < TRACERINGSIZE + 10; i++)
+        Trace::record(i < 10 ? "test_old" : "test_new", i, i + 1);
+    REQUIRE(Trace::dumpToFile(TESTTRACEPATH));
+    Trace::record("test_later", 0, 1);
+    REQUIRE(Trace::dumpToFile(TESTTRACEPATH));
+    Trace::setEnabled(false);
+
+    std::ifstream file(TESTTRACEPATH);
+    std::stringstream content;
+    content << file.rdbuf();
+    auto text = content.str();
+    CHECK(text.compare(0, 2, "[\n") == 0);
+    CHECK(count(text, "[") == 1);
+    CHECK(count(text, "test_old") == 0);
+    CHECK(count(text, "test_new") == TRACERINGSIZE - 1); // the slot the writer may be in is skipped
+    CHECK(count(text, "test_later") == 1);
+    unlink(TESTTRACEPATH);
+}
+
+TEST_CASE("Trace doesn't follow a symlink at the trace path", "[trace]") {
+    auto target = std::string(TESTTRACEPATH) + ".target";
+    unlink(TESTTRACEPATH);
+    {
+        std::ofstream file(target);
+        file << "data";
+    }
+    REQUIRE(symlink(target.c_str(), TESTTRACEPATH) == 0);
+    Trace::setEnabled(true);
+    Trace::record("test_symlink", 0, 1);
+    CHECK_FALSE(Trace::dumpToFile(TESTTRACEPATH));
+    Trace::setEnabled(false);
+
+    std::ifstream file(target);
+    std::stringstream content;
+    content << file.rdbuf();
+    CHECK(content.str() == "data");
+    unlink(TESTTRACEPATH);
+    unlink(target.c_str());
+}
+
+TEST_CASE("Trace requests only use the configured trace files", "[trace]") {
+    unsetenv(TRACEENVVARIABLE);
+    Trace::setPath(TESTTRACEPATH);
+    matrixserver::TraceRequest request;
+    request.set_action(matrixserver::TraceRequest::start);
+    request.set_path("/etc/passwd");
+    CHECK_FALSE(Trace::apply(request));
+    CHECK_FALSE(Trace::isEnabled());
+    CHECK(Trace::getPath() == TESTTRACEPATH);
+
+    request.set_path(TRACEDEFAULTPATH);
+    CHECK(Trace::apply(request));
+    CHECK(Trace::isEnabled());
+    CHECK(Trace::getPath() == TRACEDEFAULTPATH);
+
+    setenv(TRACEENVVARIABLE, TESTTRACEPATH, 1);
+    request.set_path(TESTTRACEPATH);
+    CHECK(Trace::apply(request));
+    CHECK(Trace::getPath() == TESTTRACEPATH);
+    unsetenv(TRACEENVVARIABLE);
+    Trace::setEnabled(false);
+}
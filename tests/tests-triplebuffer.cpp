@@ -0,0 +1,56 @@
+#include "catch.hpp"
+#include <TripleBuffer.h>
+#include <FrameTimer.h>
+#include <thread>
+#include <unistd.h>
+
+TEST_CASE("TripleBuffer hands over the newest frame", "[triplebuffer]") {
+    TripleBuffer<int> buffer;
+    CHECK_FALSE(buffer.update());
+
+    buffer.getWriteBuffer() = 1;
+    buffer.publish();
+    buffer.getWriteBuffer() = 2;
+    buffer.publish(); // frame 1 was never read
+    REQUIRE(buffer.update());
+    CHECK(buffer.getReadBuffer() == 2);
+    CHECK_FALSE(buffer.update()); // nothing new, the reader shows frame 2 again
+
+    // the writer never gets the buffer the reader is holding
+    buffer.getWriteBuffer() = 3;
+    CHECK(buffer.getReadBuffer() == 2);
+
+    auto stats = buffer.getStats();
+    CHECK(stats.published == 2);
+    CHECK(stats.presented == 1);
+    CHECK(stats.dropped == 1);
+    CHECK(stats.repeated == 2);
+}
+
+TEST_CASE("TripleBuffer wakes the waiting reader", "[triplebuffer]") {
+    TripleBuffer<int64_t> buffer;
+    CHECK_FALSE(buffer.waitForUpdate(1000000)); // times out without a frame
+
+    const int frames = 200;
+    std::thread writer([&]() {
+        for (int i = 1; i <= frames; i++) {
+            buffer.getWriteBuffer() = i;
+            buffer.publish();
+            usleep(200);
+        }
+    });
+    int64_t last = 0;
+    bool ordered = true;
+    while (last < frames) {
+        if (!buffer.waitForUpdate(1000000000))
+            break;
+        ordered = ordered && buffer.getReadBuffer() > last;
+        last = buffer.getReadBuffer();
+    }
+    writer.join();
+    CHECK(ordered);
+    CHECK(last == frames);
+    auto stats = buffer.getStats();
+    CHECK(stats.published == frames);
+    CHECK(stats.presented + stats.dropped == frames);
+}
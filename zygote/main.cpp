@@ -0,0 +1,26 @@
+#include <iostream>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <Log.h>
+
+#include <Zygote.h>
+
+// started by the server's AppLauncher, the arguments are libraries to preload for the apps
+int main(int argc, char **argv) {
+    auto controlFdEnv = getenv(ZYGOTEFDENVVARIABLE);
+    if (controlFdEnv == nullptr) {
+        std::cerr << "matrixzygote is started by the matrixserver" << std::endl;
+        return 1;
+    }
+    int controlFd = atoi(controlFdEnv);
+    unsetenv(ZYGOTEFDENVVARIABLE);
+    fcntl(controlFd, F_SETFD, FD_CLOEXEC);
+    Log::setLevel(LogLevel::info);
+
+    for (int i = 1; i < argc; i++) {
+        if (dlopen(argv[i], RTLD_NOW | RTLD_GLOBAL) == nullptr)
+            MATRIXLOG(warning) << "[Zygote] can't preload " << argv[i] << ": " << dlerror();
+    }
+    return runZygote(controlFd);
+}